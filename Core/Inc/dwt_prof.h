@@ -0,0 +1,77 @@
+#ifndef __DWT_PROF_H__
+#define __DWT_PROF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Cycle-count profiling of the USB host hot paths with the Cortex-M4 DWT cycle counter.
+// Every probe collects count, min/max/total cycles and a log2 histogram. A probe measures
+// wall cycles between DWT_PROF_BEGIN and DWT_PROF_END, interrupts taken meanwhile are included.
+// Compiled in with DWT_PROF_ENABLE=1 (CMake option "DWT_PROF"), otherwise the markers compile to nothing.
+
+#ifndef DWT_PROF_ENABLE
+#define DWT_PROF_ENABLE 0
+#endif
+
+// Histogram: bucket 0 - less than 2^(DWT_PROF_HIST_SHIFT + 1) cycles, bucket i - [2^(i + SHIFT), 2^(i + SHIFT + 1)),
+// last bucket - everything above
+#define DWT_PROF_HIST_BUCKETS 12
+#define DWT_PROF_HIST_SHIFT   6
+
+typedef enum {
+  DWT_PROF_HCD_IRQ = 0,     // HAL_HCD_IRQHandler, OTG_HS
+  DWT_PROF_READ_PACKET,     // USB_ReadPacket, RX FIFO copy (not used by OTG_HS with DMA)
+  DWT_PROF_USBH_PROCESS,    // USBH_Process, every host thread wake-up
+  DWT_PROF_VIDEO_INPUT,     // USBH_VIDEO_InputStream
+  DWT_PROF_PARSE_PACKET,    // video_stream_process_packet
+  DWT_PROF_FRAME_CALLBACK,  // frame callback of the application
+  DWT_PROF_PROBES,
+} DWT_ProfProbeTypeDef;
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t hist[DWT_PROF_HIST_BUCKETS];
+} DWT_ProfDataTypeDef;
+
+#if DWT_PROF_ENABLE
+
+#include "stm32f4xx.h"
+
+// Markers must be in the same scope, a probe can not be nested into itself in the same scope
+#define DWT_PROF_BEGIN(probe) uint32_t dwt_prof_start_##probe = DWT->CYCCNT
+#define DWT_PROF_END(probe)   dwt_prof_record((probe), DWT->CYCCNT - dwt_prof_start_##probe)
+
+#else
+
+#define DWT_PROF_BEGIN(probe) \
+  do {                        \
+  } while (0)
+#define DWT_PROF_END(probe) \
+  do {                      \
+  } while (0)
+
+#endif
+
+// Enables the cycle counter and clears all probes
+void dwt_prof_init(void);
+void dwt_prof_reset(void);
+
+// Can be called from any task or interrupt
+void dwt_prof_record(DWT_ProfProbeTypeDef probe, uint32_t cycles);
+
+void dwt_prof_get(DWT_ProfProbeTypeDef probe, DWT_ProfDataTypeDef *data);
+
+// Print all probes to the log output
+void dwt_prof_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DWT_PROF_H__ */
@@ -0,0 +1,36 @@
+#ifndef __UART_LOG_H__
+#define __UART_LOG_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Asynchronous log output: "printf" copies text into a ring buffer, USART2 TX DMA sends it in background.
+// Writers never wait for the UART. If the buffer is full, the whole write is dropped and counted.
+
+// Ring buffer size in bytes, must be a power of 2
+#ifndef UART_LOG_BUFFER_SIZE
+#define UART_LOG_BUFFER_SIZE 2048
+#endif
+
+typedef struct {
+  uint32_t written_bytes;  // bytes put into the buffer
+  uint32_t dropped_bytes;  // bytes lost because the buffer was full
+  uint32_t dropped_writes;
+} UART_LogStatsTypeDef;
+
+// Must be called after "MX_USART2_UART_Init". Before that writes go to the UART directly (blocking).
+void uart_log_init(void);
+
+// Can be called from any task or interrupt, returns "len"
+int uart_log_write(const char *ptr, int len);
+
+void uart_log_get_stats(UART_LogStatsTypeDef *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UART_LOG_H__ */
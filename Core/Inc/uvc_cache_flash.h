@@ -0,0 +1,28 @@
+#ifndef __UVC_CACHE_FLASH_H__
+#define __UVC_CACHE_FLASH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usbh_video_cache.h"
+
+// Storage of the camera cache (see Core/lib/VIDEO/Inc/usbh_video_cache.h) in the last flash sector.
+// Sector 11 (128 KB at 0x080E0000) is left out of the FLASH region in STM32F407ZGTX_FLASH.ld.
+// Attached with UVC_CACHE_FLASH=1 (CMake option "UVC_CACHE_FLASH").
+
+#ifndef UVC_CACHE_FLASH
+#define UVC_CACHE_FLASH 0
+#endif
+
+#define UVC_CACHE_FLASH_BASE   0x080E0000UL
+#define UVC_CACHE_FLASH_SIZE   (128U * 1024U)
+#define UVC_CACHE_FLASH_SECTOR FLASH_SECTOR_11
+
+extern const VIDEO_CacheStorageTypeDef uvc_cache_flash;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
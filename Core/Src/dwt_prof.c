@@ -0,0 +1,99 @@
+/**
+  ******************************************************************************
+  * @file    dwt_prof.c
+  * @brief   DWT cycle-counter profiling probes
+  ******************************************************************************
+  * Probes are updated with interrupts disabled for a few cycles, so the same
+  * probe can be used by several tasks and interrupts. Dump copies every probe
+  * with interrupts disabled too (dwt_prof_get): every probe is consistent,
+  * but probes are copied one after another, not as one snapshot.
+  ******************************************************************************
+  */
+
+#include "dwt_prof.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f4xx.h"
+
+static DWT_ProfDataTypeDef dwt_prof_data[DWT_PROF_PROBES];
+
+static const char *const dwt_prof_names[DWT_PROF_PROBES] = {
+    "HCD IRQ", "read packet", "USBH process", "video input", "parse packet", "frame callback",
+};
+
+void dwt_prof_reset(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memset(dwt_prof_data, 0, sizeof(dwt_prof_data));
+  for (uint32_t i = 0; i < DWT_PROF_PROBES; i++) {
+    dwt_prof_data[i].min = UINT32_MAX;
+  }
+  __set_PRIMASK(primask);
+}
+
+void dwt_prof_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  dwt_prof_reset();
+}
+
+void dwt_prof_record(DWT_ProfProbeTypeDef probe, uint32_t cycles) {
+  if ((uint32_t) probe >= DWT_PROF_PROBES)
+    return;
+
+  int bucket = (cycles != 0) ? (31 - __builtin_clz(cycles) - DWT_PROF_HIST_SHIFT) : 0;
+  if (bucket < 0)
+    bucket = 0;
+  else if (bucket >= DWT_PROF_HIST_BUCKETS)
+    bucket = DWT_PROF_HIST_BUCKETS - 1;
+
+  DWT_ProfDataTypeDef *data = &dwt_prof_data[probe];
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  data->count++;
+  data->total += cycles;
+  if (cycles < data->min)
+    data->min = cycles;
+  if (cycles > data->max)
+    data->max = cycles;
+  data->hist[bucket]++;
+  __set_PRIMASK(primask);
+}
+
+void dwt_prof_get(DWT_ProfProbeTypeDef probe, DWT_ProfDataTypeDef *data) {
+  if ((uint32_t) probe >= DWT_PROF_PROBES)
+    return;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *data = dwt_prof_data[probe];
+  __set_PRIMASK(primask);
+}
+
+void dwt_prof_dump(void) {
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+
+  printf("profile, cycles (us at %lu MHz):\r\n", (unsigned long) cycles_per_us);
+  for (uint32_t i = 0; i < DWT_PROF_PROBES; i++) {
+    DWT_ProfDataTypeDef data;
+    dwt_prof_get((DWT_ProfProbeTypeDef) i, &data);
+    if (data.count == 0) {
+      printf("  %-14s -\r\n", dwt_prof_names[i]);
+      continue;
+    }
+
+    uint32_t mean = (uint32_t) (data.total / data.count);
+    printf("  %-14s n %lu, min %lu, mean %lu (%lu us), max %lu (%lu us)\r\n", dwt_prof_names[i], (unsigned long) data.count,
+           (unsigned long) data.min, (unsigned long) mean, (unsigned long) (mean / cycles_per_us), (unsigned long) data.max,
+           (unsigned long) (data.max / cycles_per_us));
+    printf("  %-14s", "");
+    for (uint32_t b = 0; b < (DWT_PROF_HIST_BUCKETS - 1); b++) {
+      printf(" <%lu:%lu", (unsigned long) (1UL << (b + DWT_PROF_HIST_SHIFT + 1)), (unsigned long) data.hist[b]);
+    }
+    printf(" >=%lu:%lu", (unsigned long) (1UL << (DWT_PROF_HIST_BUCKETS - 1 + DWT_PROF_HIST_SHIFT)),
+           (unsigned long) data.hist[DWT_PROF_HIST_BUCKETS - 1]);
+    printf("\r\n");
+  }
+}
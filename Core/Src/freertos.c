@@ -25,6 +25,13 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include <stdio.h>
+#include "dwt_prof.h"
+#include "usbh_video_controls.h"
+#include "usbh_video_stream_parsing.h"
+#if UVC_CACHE_FLASH
+#include "uvc_cache_flash.h"
+#endif
 
 /* USER CODE END Includes */
 
@@ -35,6 +42,18 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+// Streaming statistics are printed every STATS_PERIOD_MS
+#define STATS_PERIOD_MS 1000
+// DWT_PROF_ENABLE: profiling probes are printed and cleared every PROFILE_PERIOD_MS
+#define PROFILE_PERIOD_MS 10000
+// Exposure time set when the camera controls are queried, 100 us units (auto exposure is switched off):
+// frame rate and MJPEG frame size do not follow the light. 0 - auto exposure of the camera
+#define PIN_EXPOSURE 0
+// 1 - every frame taken from the frame ring is printed, debug only: 30+ lines per second push the
+// statistics out of the log ring
+#ifndef FRAME_LOG
+#define FRAME_LOG 0
+#endif
 
 /* USER CODE END PD */
 
@@ -45,6 +64,7 @@
 
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN Variables */
+extern USBH_HandleTypeDef hUsbHostHS;
 
 /* USER CODE END Variables */
 /* Definitions for defaultTask */
@@ -57,6 +77,7 @@ const osThreadAttr_t defaultTask_attributes = {
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN FunctionPrototypes */
+static void ControlDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, const VIDEO_ControlTypeDef *control, int32_t value, void *context);
 
 /* USER CODE END FunctionPrototypes */
 
@@ -117,16 +138,79 @@ void StartDefaultTask(void *argument)
   /* init code for USB_HOST */
   MX_USB_HOST_Init();
   /* USER CODE BEGIN StartDefaultTask */
+#if UVC_CACHE_FLASH
+  // Before the attach wait of the host core is over, the camera is not initialized yet
+  video_cache_attach_storage(&uvc_cache_flash);
+#endif
+  uint32_t stats_tick = osKernelGetTickCount();
+#if DWT_PROF_ENABLE
+  uint32_t profile_tick = stats_tick;
+  dwt_prof_init();
+#endif
+  uint8_t controls_pinned = 0;
   /* Infinite loop */
   for(;;)
   {
-    osDelay(1000);
+    // Frame stays untouched by the capture until it is released
+    VIDEO_FrameTypeDef *frame = video_stream_get_frame();
+    if (frame != NULL) {
+#if FRAME_LOG
+      printf("frame #%lu: %lu bytes, flags 0x%02lX, dropped %lu/%lu/%lu\r\n", frame->seq, frame->len, frame->flags, uvc_frame_ring.dropped_oldest,
+             uvc_frame_ring.dropped_newest, uvc_frame_ring.overruns);
+      if (frame->flags & VIDEO_FRAME_FLAG_CAPTURE) {
+        printf("  capture to delivery %ld us\r\n", (long) (frame->delivery_time - frame->capture_time));
+      }
+#endif
+      video_stream_release_frame(frame);
+    }
+
+    // Controls are pinned again for every connected camera, the table is queried again then
+    if (!video_controls_ready()) {
+      controls_pinned = 0;
+    } else if ((PIN_EXPOSURE != 0) && !controls_pinned) {
+      controls_pinned = 1;
+      // Requests run in order, the exposure time is refused while auto exposure is on
+      USBH_VIDEO_SetControl(&hUsbHostHS, VIDEO_CONTROL_AE_MODE, 1, ControlDone, NULL);  // manual
+      USBH_VIDEO_SetControl(&hUsbHostHS, VIDEO_CONTROL_EXPOSURE_TIME_ABSOLUTE, PIN_EXPOSURE, ControlDone, NULL);
+    }
+
+    if ((osKernelGetTickCount() - stats_tick) >= STATS_PERIOD_MS) {
+      VIDEO_StatsTypeDef stats;
+      stats_tick = osKernelGetTickCount();
+      if (USBH_VIDEO_GetStats(&hUsbHostHS, &stats) == USBH_OK) {
+        printf("stats: %lu.%02lu fps, %lu B/s, packets %lu (empty %lu, header only %lu, bad %lu, err %lu, lost %lu), missed %lu\r\n",
+               stats.fps_x100 / 100, stats.fps_x100 % 100, stats.bytes_per_sec, stats.packets, stats.empty_packets, stats.header_only_packets,
+               stats.bad_packets, stats.error_packets, stats.lost_packets, stats.missed_uframes);
+        printf("stats: frames %lu (truncated %lu, bad %lu, dropped %lu, skipped %lu), FID without EOF %lu\r\n", stats.frames_delivered,
+               stats.frames_truncated, stats.frames_bad, stats.frames_dropped, stats.frames_skipped, stats.fid_without_eof);
+      }
+#if UVC_CACHE_FLASH
+      // Code fetches and the OTG interrupt stall while the flash is programmed or erased (1-2 s when the sector is
+      // full), so the cache is written only while the camera is stopped: after it is suspended or unplugged, never
+      // between COMMIT (which marks the cache dirty) and the start of the stream
+      if ((video_cache_dirty() != 0) && USBH_VIDEO_IsStopped(&hUsbHostHS)) {
+        video_cache_flush();
+      }
+#endif
+    }
+#if DWT_PROF_ENABLE
+    if ((osKernelGetTickCount() - profile_tick) >= PROFILE_PERIOD_MS) {
+      profile_tick = osKernelGetTickCount();
+      dwt_prof_dump();
+      dwt_prof_reset();
+    }
+#endif
+    osDelay(10);
   }
   /* USER CODE END StartDefaultTask */
 }
 
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
+static void ControlDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, const VIDEO_ControlTypeDef *control, int32_t value, void *context)
+{
+  printf("control %s = %ld: status %d\r\n", video_controls_name((VIDEO_ControlIdTypeDef) control->id), (long) value, status);
+}
 
 /* USER CODE END Application */
 
@@ -34,8 +34,10 @@
 #include <strings.h>
 
 #include "cmsis_gcc.h"
+#include "uart_log.h"
 #include "usb_host.h"
 #include "usbh_video.h"
+#include "usbh_video_bench.h"
 #include "usbh_video_stream_parsing.h"
 
 /* USER CODE END Includes */
@@ -85,7 +87,22 @@ PUTCHAR_PROTOTYPE {
   return ch;
 }
 
-volatile uint8_t uvc_framebuffer3[UVC_MAX_FRAME_SIZE];
+volatile uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+#if UVC_BENCH
+static uint32_t bench_ticks(void) {
+  return DWT->CYCCNT;
+}
+
+// Parser benchmark on the frame pool, before the camera is started
+static void run_bench(void) {
+  const VIDEO_BenchClockTypeDef clock = {bench_ticks, SystemCoreClock};
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  video_bench_run_all(VIDEO_BENCH_PACKETS, &clock, (uint8_t *) uvc_frame_pool);
+}
+#endif
 /* USER CODE END 0 */
 
 /**
@@ -119,8 +136,12 @@ int main(void)
   MX_USART2_UART_Init();
   /* USER CODE BEGIN 2 */
   // InitExtraSections();
+  uart_log_init();
   printf("this is a version. %s\r\n", version_);
-  video_stream_init_buffers((uint8_t *) uvc_framebuffer3, (uint8_t *) uvc_framebuffer3);
+#if UVC_BENCH
+  run_bench();
+#endif
+  video_stream_init_buffers((uint8_t *) uvc_frame_pool);
   // videoPacketArrivedCallback(videoCallback);
 
   /* USER CODE END 2 */
@@ -30,6 +30,8 @@
 #include <sys/times.h>
 #include <time.h>
 
+#include "uart_log.h"
+
 /* Variables */
 extern int __io_putchar(int ch) __attribute__((weak));
 extern int __io_getchar(void) __attribute__((weak));
@@ -70,12 +72,8 @@ __attribute__((weak)) int _read(int file, char *ptr, int len) {
 
 __attribute__((weak)) int _write(int file, char *ptr, int len) {
   (void) file;
-  int DataIdx;
-
-  for (DataIdx = 0; DataIdx < len; DataIdx++) {
-    __io_putchar(*ptr++);
-  }
-  return len;
+  // Text is queued, USART2 TX DMA sends it in background
+  return uart_log_write(ptr, len);
 }
 
 int _close(int file) {
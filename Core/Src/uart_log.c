@@ -0,0 +1,136 @@
+/**
+  ******************************************************************************
+  * @file    uart_log.c
+  * @brief   Asynchronous log output over USART2 TX DMA
+  ******************************************************************************
+  * Writers reserve space in the ring buffer with a compare-and-swap on
+  * "uart_log_reserved", copy their text and add its length to
+  * "uart_log_committed". When both counters are equal no writer is in the
+  * middle of a copy, so everything up to "uart_log_committed" can be sent.
+  * Only one DMA transfer is in flight, it is started by the last writer or
+  * by the transfer complete interrupt of the previous one.
+  ******************************************************************************
+  */
+
+#include "uart_log.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "usart.h"
+
+#define UART_LOG_BUFFER_MASK (UART_LOG_BUFFER_SIZE - 1)
+
+#if (UART_LOG_BUFFER_SIZE & UART_LOG_BUFFER_MASK) != 0
+#error "UART_LOG_BUFFER_SIZE must be a power of 2"
+#endif
+
+extern int __io_putchar(int ch);
+
+static uint8_t uart_log_buffer[UART_LOG_BUFFER_SIZE];
+
+// Free running byte counters, buffer position is (counter & UART_LOG_BUFFER_MASK)
+static volatile uint32_t uart_log_reserved = 0;
+static volatile uint32_t uart_log_committed = 0;
+static volatile uint32_t uart_log_sent = 0;
+
+// Length of the DMA transfer in flight
+static volatile uint32_t uart_log_tx_len = 0;
+static volatile uint32_t uart_log_tx_busy = 0;
+
+static volatile uint8_t uart_log_ready = 0;
+
+static volatile UART_LogStatsTypeDef uart_log_stats;
+
+static void uart_log_kick(void) {
+  for (;;) {
+    uint32_t idle = 0;
+    if (!__atomic_compare_exchange_n(&uart_log_tx_busy, &idle, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      return;  // transfer in flight, it will call us when done
+
+    uint32_t committed = __atomic_load_n(&uart_log_committed, __ATOMIC_SEQ_CST);
+    uint32_t reserved = __atomic_load_n(&uart_log_reserved, __ATOMIC_SEQ_CST);
+    uint32_t sent = uart_log_sent;
+
+    if ((committed == reserved) && (committed != sent)) {
+      uint32_t pos = sent & UART_LOG_BUFFER_MASK;
+      uint32_t len = committed - sent;
+      if (len > (UART_LOG_BUFFER_SIZE - pos))
+        len = UART_LOG_BUFFER_SIZE - pos;  // the rest goes with the next transfer
+
+      uart_log_tx_len = len;
+      if (HAL_UART_Transmit_DMA(&huart2, &uart_log_buffer[pos], (uint16_t) len) == HAL_OK)
+        return;
+    }
+
+    __atomic_store_n(&uart_log_tx_busy, 0, __ATOMIC_SEQ_CST);
+    // A writer that committed meanwhile saw the busy flag and did not start the transfer
+    if (__atomic_load_n(&uart_log_committed, __ATOMIC_SEQ_CST) == committed)
+      return;
+  }
+}
+
+void uart_log_init(void) {
+  uart_log_ready = 1;
+}
+
+int uart_log_write(const char *ptr, int len) {
+  if (len <= 0)
+    return 0;
+
+  if (!uart_log_ready) {
+    for (int i = 0; i < len; i++) {
+      __io_putchar(ptr[i]);
+    }
+    return len;
+  }
+
+  uint32_t size = (uint32_t) len;
+  uint32_t start = __atomic_load_n(&uart_log_reserved, __ATOMIC_ACQUIRE);
+  do {
+    uint32_t used = start - __atomic_load_n(&uart_log_sent, __ATOMIC_ACQUIRE);
+    if (size > (UART_LOG_BUFFER_SIZE - used)) {
+      __atomic_fetch_add(&uart_log_stats.dropped_bytes, size, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&uart_log_stats.dropped_writes, 1, __ATOMIC_RELAXED);
+      return len;
+    }
+  } while (!__atomic_compare_exchange_n(&uart_log_reserved, &start, start + size, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  uint32_t pos = start & UART_LOG_BUFFER_MASK;
+  uint32_t first = UART_LOG_BUFFER_SIZE - pos;
+  if (first > size)
+    first = size;
+  memcpy(&uart_log_buffer[pos], ptr, first);
+  memcpy(&uart_log_buffer[0], ptr + first, size - first);
+
+  __atomic_fetch_add(&uart_log_committed, size, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&uart_log_stats.written_bytes, size, __ATOMIC_RELAXED);
+
+  uart_log_kick();
+  return len;
+}
+
+void uart_log_get_stats(UART_LogStatsTypeDef *stats) {
+  stats->written_bytes = uart_log_stats.written_bytes;
+  stats->dropped_bytes = uart_log_stats.dropped_bytes;
+  stats->dropped_writes = uart_log_stats.dropped_writes;
+}
+
+static void uart_log_tx_done(void) {
+  __atomic_store_n(&uart_log_sent, uart_log_sent + uart_log_tx_len, __ATOMIC_RELEASE);
+  __atomic_store_n(&uart_log_tx_busy, 0, __ATOMIC_SEQ_CST);
+  uart_log_kick();
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  if (huart->Instance == USART2) {
+    uart_log_tx_done();
+  }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+  // Text of a failed transfer is dropped, logging continues with the next one
+  if ((huart->Instance == USART2) && uart_log_tx_busy && (huart->gState == HAL_UART_STATE_READY)) {
+    uart_log_tx_done();
+  }
+}
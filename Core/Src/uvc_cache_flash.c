@@ -0,0 +1,50 @@
+/**
+  ******************************************************************************
+  * @file    uvc_cache_flash.c
+  * @brief   Camera cache storage in flash sector 11
+  ******************************************************************************
+  * Code runs from the same flash bank, so the CPU stalls while a word is
+  * programmed and while the sector is erased (up to 2 s). Interrupts are not
+  * disabled: handlers fetching from flash stall as well, DMA keeps running.
+  ******************************************************************************
+  */
+
+#include "uvc_cache_flash.h"
+
+#include "stm32f4xx_hal.h"
+
+static USBH_StatusTypeDef uvc_cache_flash_erase(void) {
+  FLASH_EraseInitTypeDef erase = {
+      .TypeErase = FLASH_TYPEERASE_SECTORS,
+      .Sector = UVC_CACHE_FLASH_SECTOR,
+      .NbSectors = 1,
+      .VoltageRange = FLASH_VOLTAGE_RANGE_3,
+  };
+  uint32_t bad_sector = 0;
+
+  HAL_FLASH_Unlock();
+  HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase, &bad_sector);
+  HAL_FLASH_Lock();
+  return (status == HAL_OK) ? USBH_OK : USBH_FAIL;
+}
+
+static USBH_StatusTypeDef uvc_cache_flash_program(uint32_t offset, const uint32_t *words, uint32_t count) {
+  HAL_StatusTypeDef status = HAL_OK;
+
+  if ((offset & 3U) || (offset > UVC_CACHE_FLASH_SIZE) || (count > (UVC_CACHE_FLASH_SIZE - offset) / 4U))
+    return USBH_FAIL;
+
+  HAL_FLASH_Unlock();
+  for (uint32_t i = 0; (i < count) && (status == HAL_OK); i++) {
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, UVC_CACHE_FLASH_BASE + offset + i * 4U, words[i]);
+  }
+  HAL_FLASH_Lock();
+  return (status == HAL_OK) ? USBH_OK : USBH_FAIL;
+}
+
+const VIDEO_CacheStorageTypeDef uvc_cache_flash = {
+    .base = (const uint8_t *) UVC_CACHE_FLASH_BASE,
+    .size = UVC_CACHE_FLASH_SIZE,
+    .erase = uvc_cache_flash_erase,
+    .program = uvc_cache_flash_program,
+};
@@ -9,9 +9,88 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include "usbh_core.h"
+#include "usbh_video_ctrl.h"
+#include "usbh_video_startup.h"
+#include "usbh_video_stats.h"
+
+// Maximum isochronous transactions per microframe (high-bandwidth HS endpoints, wMaxPacketSize bits 12:11).
+// 1 - only endpoints with one transaction per microframe are used
+#ifndef UVC_ISOC_MAX_MULT
+#define UVC_ISOC_MAX_MULT 3
+#endif
+
+// Maximum isochronous payload per (micro)frame in bytes (endpoint size * transactions), size of "tmp_packet_framebuffer"
+#define UVC_RX_FIFO_SIZE_LIMIT (1024 * UVC_ISOC_MAX_MULT)
+
+// wMaxPacketSize fields: transaction size and number of transactions per microframe
+#define UVC_EP_PACKET_SIZE(w) ((uint16_t) ((w) & 0x07FFU))
+#define UVC_EP_MULT(w)        ((uint8_t) ((((w) >> 11) & 0x03U) + 1U))
+
+// 1 - isochronous packets are received directly into the framebuffer (payload is never copied by CPU)
+// 0 - packets are received into "tmp_packet_framebuffer" and copied to the framebuffer
+#define UVC_ZERO_COPY_RX 1
+
+// 1 - isochronous packets are parsed and the next URB is submitted in the OTG interrupt,
+//     only "frame complete" and "packet lost" events are passed to the host thread
+// 0 - packets are handled by the host thread
+#ifndef UVC_ISR_FAST_PATH
+#define UVC_ISR_FAST_PATH 0
+#endif
+
+// 1 - two host channels of the isochronous endpoint are armed for even and odd (micro)frames, so the next
+//     transfer is always queued while the last packet is parsed. Used with a 1 (micro)frame interval only.
+//     Packets are received into two staging buffers and copied (UVC_ZERO_COPY_RX is not used).
+// 0 - one channel, the next transfer is submitted when the last packet is handled
+#ifndef UVC_ISOC_PINGPONG
+#define UVC_ISOC_PINGPONG 0
+#endif
+
+// Isochronous transfers in flight, number of "tmp_packet_framebuffer" staging buffers
+#if UVC_ISOC_PINGPONG
+#define UVC_ISOC_URBS 2
+#else
+#define UVC_ISOC_URBS 1
+#endif
 
-// Maximum endpoint size in bytes
-#define UVC_RX_FIFO_SIZE_LIMIT 2048
+// Trace levels of the VIDEO class subsystems, see "usbh_video_trace.h"
+// 0 - off, 1 - errors, 2 - events, 3 - debug (every packet)
+// Damaged packets and frames (ERR bit, bad header, lost packet, missed (micro)frames) are counted in the
+// streaming statistics (USBH_VIDEO_GetStats) and traced at the debug level only: a camera that reports
+// errors all the time does not flood the log from the receive path.
+// UVC_FAST_START (usbh_conf.h) lowers the defaults of the startup dumps (descriptors, PROBE state) to errors only
+#if (UVC_FAST_START == 1U)
+#ifndef UVC_TRACE_CTRL
+#define UVC_TRACE_CTRL 1
+#endif
+#ifndef UVC_TRACE_DESC
+#define UVC_TRACE_DESC 1
+#endif
+#endif
+#ifndef UVC_TRACE_PARSER
+#define UVC_TRACE_PARSER 1
+#endif
+#ifndef UVC_TRACE_ISOC
+#define UVC_TRACE_ISOC 1
+#endif
+#ifndef UVC_TRACE_CTRL
+#define UVC_TRACE_CTRL 2
+#endif
+#ifndef UVC_TRACE_DESC
+#define UVC_TRACE_DESC 2
+#endif
+#ifndef UVC_TRACE_CLOCK
+#define UVC_TRACE_CLOCK 2
+#endif
+
+// PROBE/COMMIT attempts after a failed one, the stream stays stopped when all of them fail
+#ifndef UVC_NEGOTIATION_RETRIES
+#define UVC_NEGOTIATION_RETRIES 2
+#endif
+
+// 1 - every payload copied into the framebuffer is verified with CRC32 (slow, for debugging DMA/cache issues)
+#ifndef UVC_INTEGRITY_CHECK
+#define UVC_INTEGRITY_CHECK 0
+#endif
 
 // Image width
 #define UVC_TARGET_WIDTH  320
@@ -27,7 +106,20 @@ extern "C" {
 // #define UVC_MAX_FRAME_SIZE    UVC_UNCOMP_FRAME_SIZE
 #define UVC_MAX_FRAME_SIZE (UVC_UNCOMP_FRAME_SIZE)
 // TODO - UVC_MAX_FRAME_SIZE for MJPEG mode can be smaller.
-// Needed value is send by camera - see "USBH_VS_GetCur" - dwMaxVideoFrameSize
+// Needed value is send by camera - see "USBH_VIDEO_ProbeDone" - dwMaxVideoFrameSize
+
+// Number of framebuffers (UVC_MAX_FRAME_SIZE bytes each) in the frame ring.
+// 2 - capture continues while the application holds a frame, 3+ - completed frames can also wait for the application.
+// The frame the application holds is never reused until it is released. With 2 slots every frame completed
+// meanwhile is reclaimed by the next one, the application gets the first frame after the release.
+// After COMMIT the same memory is carved into more framebuffers if the committed frame size is smaller
+// (up to VIDEO_FRAME_RING_MAX_SLOTS), see "video_stream_resize_buffers".
+#define UVC_FRAME_RING_SLOTS 2
+
+// Which completed frame is reused when the application is slow:
+// VIDEO_FRAME_DROP_OLDEST - application gets the latest frames
+// VIDEO_FRAME_DROP_NEWEST - application gets frames in capture order
+#define UVC_FRAME_DROP_POLICY VIDEO_FRAME_DROP_OLDEST
 
 typedef enum {
   USBH_VIDEO_MJPEG = 0,
@@ -60,10 +152,10 @@ typedef enum {
 typedef enum {
   VIDEO_REQ_INIT = 1,
   VIDEO_REQ_IDLE,
-  VIDEO_REQ_SET_DEFAULT_IN_INTERFACE,
-  VIDEO_REQ_SET_IN_INTERFACE,
   VIDEO_REQ_CS_REQUESTS,
   VIDEO_REQ_RESUME,
+  VIDEO_REQ_PROBE,
+  VIDEO_REQ_PROBE_WAIT,
 } VIDEO_ReqStateTypeDef;
 
 typedef enum {
@@ -83,7 +175,7 @@ typedef enum {
 
 typedef struct {
   uint8_t Ep;           // bEndpointAddress
-  uint16_t EpSize;      // wMaxPacketSize
+  uint16_t EpSize;      // wMaxPacketSize, bits 12:11 - additional transactions per microframe
   uint8_t AltSettings;  // bAlternateSetting
   uint8_t interface;    // bInterfaceNumber
   uint8_t valid;
@@ -92,14 +184,26 @@ typedef struct {
 
 typedef struct {
   uint8_t Ep;
-  uint16_t EpSize;
+  uint16_t EpSize;    // wMaxPacketSize, as in the endpoint descriptor
+  uint16_t XferSize;  // bytes per (micro)frame: transaction size * transactions
   uint8_t interface;
   uint8_t AltSettings;
   uint8_t supported;
 
   uint8_t Pipe;
+  uint8_t PongPipe;  // UVC_ISOC_PINGPONG: second channel of the endpoint, "Pipe" takes even and "PongPipe" odd (micro)frames
+  uint8_t pingpong;  // both channels are in use
   uint8_t Poll;
-  uint32_t timer;
+  uint16_t interval;  // service interval in "phost->Timer" ticks (microframes at HS, frames at FS)
+  uint32_t timer;     // "phost->Timer" of the last handled URB
+  volatile uint32_t urb_events[UVC_ISOC_URBS];  // URB state changes of the channel signaled from the OTG interrupt
+  volatile uint32_t urb_timer[UVC_ISOC_URBS];   // "phost->Timer" when the URB state of the channel changed
+  volatile uint32_t urb_frame[UVC_ISOC_URBS];   // bus (micro)frame number (HFNUM) when the URB state of the channel changed
+  uint8_t *urb_buf[UVC_ISOC_URBS];              // buffer of the URB in flight on the channel
+  volatile uint32_t frame_events;  // UVC_ISR_FAST_PATH: frames completed in the interrupt
+  volatile uint32_t lost_events;   // UVC_ISR_FAST_PATH: packets lost in the interrupt
+  volatile uint32_t urb_errors;    // URBs that were not completed, they are resubmitted
+  volatile uint32_t packets;       // URBs handled (received or lost)
 
   uint8_t asociated_as;
 
@@ -119,6 +223,8 @@ typedef struct {
 #define VIDEO_MAX_NUM_OUT_TERMINAL  4
 #define VIDEO_MAX_NUM_FEATURE_UNIT  2
 #define VIDEO_MAX_NUM_SELECTOR_UNIT 2
+#define VIDEO_MAX_NUM_PROCESSING_UNIT 2
+#define VIDEO_MAX_NUM_EXTENSION_UNIT  4
 
 // Video Steream Descriptor
 #define VIDEO_MAX_NUM_IN_HEADER 3
@@ -199,6 +305,30 @@ typedef struct {
   uint8_t iSelector;
 } VIDEO_SelectorDescTypeDef;
 
+/* VC Processing Unit Descriptor */
+typedef struct {
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubtype;  // must be UVC_VC_PROCESSING_UNIT
+  uint8_t bUnitID;
+  uint8_t bSourceID;
+  uint8_t wMaxMultiplier[2];
+  uint8_t bControlSize;
+  uint8_t bmControls[3];  // in fact, size of this array if defined by "bControlSize" value
+} VIDEO_PUDescTypeDef;
+
+/* VC Extension Unit Descriptor */
+typedef struct {
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubtype;  // must be UVC_VC_EXTENSION_UNIT
+  uint8_t bUnitID;
+  uint8_t guidExtensionCode[16];
+  uint8_t bNumControls;
+  uint8_t bNrInPins;
+  // baSourceID[bNrInPins], bControlSize, bmControls[bControlSize], iExtension are here
+} VIDEO_XUDescTypeDef;
+
 //**********************************************************************
 // Video Stream Descriptors
 
@@ -295,6 +425,8 @@ typedef struct {
   VIDEO_OTDescTypeDef *OutputTerminalDesc[VIDEO_MAX_NUM_OUT_TERMINAL];
   VIDEO_FeatureDescTypeDef *FeatureUnitDesc[VIDEO_MAX_NUM_FEATURE_UNIT];
   VIDEO_SelectorDescTypeDef *SelectorUnitDesc[VIDEO_MAX_NUM_SELECTOR_UNIT];
+  VIDEO_PUDescTypeDef *ProcessingUnitDesc[VIDEO_MAX_NUM_PROCESSING_UNIT];
+  VIDEO_XUDescTypeDef *ExtensionUnitDesc[VIDEO_MAX_NUM_EXTENSION_UNIT];
 } VIDEO_VCDescTypeDef;
 
 /* Class-Specific VC (Video Control) Interface Descriptor*/
@@ -305,7 +437,7 @@ typedef struct {
   VIDEO_MJPEGFrameDescTypeDef *MJPEGFrame[VIDEO_MAX_MJPEG_FRAME_D];
 
   VIDEO_UncompFormatDescTypeDef *UncompFormat[VIDEO_MAX_UNCOMP_FORMAT];
-  VIDEO_UncompFrameDescTypeDef *UncompFrame[VIDEO_MAX_MJPEG_FRAME_D];
+  VIDEO_UncompFrameDescTypeDef *UncompFrame[VIDEO_MAX_UNCOMP_FRAME_D];
 
 } VIDEO_VSDescTypeDef;
 
@@ -317,6 +449,8 @@ typedef struct {
   uint16_t InputTerminalNum;
   uint16_t OutputTerminalNum;
   uint16_t SelectorUnitNum;
+  uint16_t ProcessingUnitNum;
+  uint16_t ExtensionUnitNum;
 
   uint8_t InputHeaderNum;
 
@@ -325,6 +459,8 @@ typedef struct {
 
   uint8_t UncompFormatNum;
   uint8_t UncompFrameNum;
+
+  uint8_t FormatSkipped;  // format descriptor before the frames being parsed was not stored, the frames are skipped
 } VIDEO_ClassSpecificDescTypedef;
 
 //****************************************************************************
@@ -360,8 +496,13 @@ typedef struct _VIDEO_Process {
   VIDEO_ClassSpecificDescTypedef class_desc;
 
   VIDEO_InterfaceStreamPropTypeDef camera;
+  VIDEO_CtrlQueueTypeDef ctrl;  // class specific control requests, see usbh_video_ctrl.h
+  VIDEO_ProbeTypedef probe_rx;  // PROBE state returned by the camera (GET_CUR)
+  uint8_t negotiation_retries;  // PROBE/COMMIT attempts left, see UVC_NEGOTIATION_RETRIES
+  uint8_t negotiated;           // COMMIT is done, the stream can be started
+  const struct _VIDEO_Mode *volatile switch_mode;  // mode requested by USBH_VIDEO_SwitchMode, NULL if no switch runs
+  uint8_t control_interface;                       // bInterfaceNumber of the VideoControl interface, see usbh_video_controls.h
   uint16_t mem[8];
-  uint8_t temp_feature;
 } VIDEO_HandleTypeDef;
 
 /**
@@ -435,6 +576,8 @@ typedef struct _VIDEO_Process {
 #define UVC__MAX     0x3
 #define UVC__RES     0x4
 #define UVC__MEM     0x5
+#define UVC__INFO    0x6
+#define UVC__DEF     0x7
 
 #define UVC_SET_CUR  (UVC_SET_ | UVC__CUR)
 #define UVC_GET_CUR  (UVC_GET_ | UVC__CUR)
@@ -446,6 +589,9 @@ typedef struct _VIDEO_Process {
 #define UVC_GET_RES  (UVC_GET_ | UVC__RES)
 #define UVC_SET_MEM  (UVC_SET_ | UVC__MEM)
 #define UVC_GET_MEM  (UVC_GET_ | UVC__MEM)
+#define UVC_GET_LEN  (UVC_GET_ | UVC__MEM)  // UVC name of the code, size of a control
+#define UVC_GET_INFO (UVC_GET_ | UVC__INFO)
+#define UVC_GET_DEF  (UVC_GET_ | UVC__DEF)
 
 #define UVC_GET_STAT 0xff
 
@@ -479,11 +625,20 @@ extern USBH_ClassTypeDef VIDEO_Class;
  */
 USBH_StatusTypeDef USBH_VIDEO_SetFrequency(USBH_HandleTypeDef *phost, uint16_t sample_rate, uint8_t channel_num, uint8_t data_width);
 
-USBH_StatusTypeDef USBH_VS_SetCur(USBH_HandleTypeDef *phost, uint16_t request_type);
-USBH_StatusTypeDef USBH_VS_GetCur(USBH_HandleTypeDef *phost, uint16_t request_type);
+USBH_StatusTypeDef USBH_VS_SetCur(USBH_HandleTypeDef *phost, uint16_t request_type, VIDEO_CtrlDoneTypeDef done, void *context);
+USBH_StatusTypeDef USBH_VS_GetCur(USBH_HandleTypeDef *phost, uint16_t request_type, VIDEO_ProbeTypedef *probe, VIDEO_CtrlDoneTypeDef done,
+                                  void *context);
+USBH_StatusTypeDef USBH_VIDEO_CSRequest(USBH_HandleTypeDef *phost, uint8_t request, uint8_t unit, uint8_t selector, uint8_t *data, uint16_t length,
+                                        VIDEO_CtrlDoneTypeDef done, void *context);
+USBH_StatusTypeDef USBH_VIDEO_CheckProbe(const VIDEO_ProbeTypedef *request, const VIDEO_ProbeTypedef *response);
+uint8_t USBH_VIDEO_SelectAltSetting(USBH_HandleTypeDef *phost, uint32_t payload_size);
 USBH_StatusTypeDef USBH_VIDEO_Process(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef USBH_UVC_VIDEO_SUSPEND(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef USBH_UVC_VIDEO_RESUME(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef USBH_VIDEO_GetStats(USBH_HandleTypeDef *phost, VIDEO_StatsTypeDef *stats);
+USBH_StatusTypeDef USBH_VIDEO_GetStartup(USBH_HandleTypeDef *phost, VIDEO_StartupTypeDef *timeline);
+uint8_t USBH_VIDEO_IsStopped(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef USBH_VIDEO_SwitchMode(USBH_HandleTypeDef *phost, uint8_t bFormatIndex, uint8_t bFrameIndex, uint32_t interval);
 typedef void (*PacketArrived)(uint8_t *packet, uint16_t packetLen, void *arg);
 typedef struct {
   PacketArrived deliver_packet;
@@ -0,0 +1,70 @@
+#ifndef _USBH_VIDEO_BENCH_H
+#define _USBH_VIDEO_BENCH_H
+
+#include <stdint.h>
+
+#include "usbh_video.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Throughput benchmark of the stream parser (UVC_BENCH).
+// A synthetic payload stream is fed into "video_stream_process_packet" the way the isochronous URBs feed it:
+// every packet is placed by "video_stream_rx_buffer", only its payload header is written (the payload is left
+// as the DMA would leave it), completed frames are taken and released at once. Lossy streams also carry lost URBs,
+// packets with the ERR bit and short packets from a fixed pattern, so results are comparable across commits.
+// Timing uses a free-running counter given by the caller: DWT->CYCCNT on the target, a nanosecond clock natively.
+// The parser and the frame ring are taken over: the benchmark must run while no camera is streaming, buffers have
+// to be initialized again afterwards.
+
+#ifndef UVC_BENCH
+#define UVC_BENCH 0
+#endif
+
+// Packets per case
+#ifndef VIDEO_BENCH_PACKETS
+#define VIDEO_BENCH_PACKETS 200000
+#endif
+
+typedef struct {
+  uint32_t (*ticks)(void);  // free-running counter, wraps at 32 bits
+  uint32_t hz;              // counter frequency
+} VIDEO_BenchClockTypeDef;
+
+typedef struct {
+  uint16_t packet_size;               // bytes per (micro)frame, payload header included
+  USBH_VIDEO_TargetFormat_t format;
+  uint32_t frame_size;                // bytes per video frame
+  uint8_t lossy;                      // 1% lost, 1% short, 0.1% ERR packets
+} VIDEO_BenchCaseTypeDef;
+
+typedef struct {
+  uint32_t packets;  // packets handled, lost ones included
+  uint32_t lost;
+  uint32_t frames;   // frames delivered
+  uint64_t bytes;    // bytes received, payload headers included
+  uint64_t ticks;
+
+  // Derived
+  uint32_t ns_per_packet_x10;
+  uint32_t mb_per_sec_x100;  // 10^6 bytes per second
+  uint32_t frames_per_sec;
+} VIDEO_BenchResultTypeDef;
+
+// MJPEG and YUY2, 192/512/1024/2x1024/3x1024 bytes per (micro)frame, clean and lossy
+extern const VIDEO_BenchCaseTypeDef video_bench_cases[];
+extern const uint32_t video_bench_cases_num;
+
+// One case, "pool" - UVC_FRAME_RING_SLOTS framebuffers of UVC_MAX_FRAME_SIZE bytes
+void video_bench_run(const VIDEO_BenchCaseTypeDef *bench, uint32_t packets, const VIDEO_BenchClockTypeDef *clock, uint8_t *pool,
+                     VIDEO_BenchResultTypeDef *result);
+
+// All cases, one result line per case is printed
+void video_bench_run_all(uint32_t packets, const VIDEO_BenchClockTypeDef *clock, uint8_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _USBH_VIDEO_CACHE_H
+#define _USBH_VIDEO_CACHE_H
+
+#include "usbh_video.h"
+#include "usbh_video_modes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cache of the negotiated streaming state of known cameras.
+// When a camera has streamed once, its selected mode and the state it committed (PROBE/COMMIT) are kept.
+// On the next connect of the same camera the VIDEO class commits the cached state at once, without the
+// SET_CUR(PROBE)/GET_CUR(PROBE) round trip. If the camera refuses it, the entry is dropped and the state is
+// negotiated again.
+//
+// Entries are keyed by the device (VID/PID/bcdDevice, bus speed), a hash of its configuration descriptor and
+// a hash of the mode constraints, so a new firmware of the camera or new constraints never get a stale state.
+// The least recently used entry is replaced.
+//
+// Entries live in RAM and can be persisted in a storage block (a reserved flash sector) attached by the
+// application: records are appended, the block is erased only when it is full.
+
+// Number of cameras kept (about 80 bytes each)
+#ifndef UVC_CACHE_ENTRIES
+#define UVC_CACHE_ENTRIES 4
+#endif
+
+typedef struct {
+  uint16_t idVendor;
+  uint16_t idProduct;
+  uint16_t bcdDevice;
+  uint16_t speed;        // USBH_SPEED_*, alt settings differ between full and high speed
+  uint32_t cfg_hash;     // configuration descriptor
+  uint32_t select_hash;  // mode constraints and target settings
+} VIDEO_CacheKeyTypeDef;
+
+typedef struct {
+  VIDEO_CacheKeyTypeDef key;
+  VIDEO_ModeTypeDef mode;     // selected mode
+  VIDEO_ProbeTypedef commit;  // state committed by the camera
+} VIDEO_CacheEntryTypeDef;
+
+// Persistent storage: one erasable block, read through memory, programmed in 32-bit words that were erased before.
+// Implemented by the application, see Core/Inc/uvc_cache_flash.h.
+typedef struct {
+  const uint8_t *base;  // memory mapped block, 4-byte aligned
+  uint32_t size;        // bytes
+  USBH_StatusTypeDef (*erase)(void);
+  USBH_StatusTypeDef (*program)(uint32_t offset, const uint32_t *words, uint32_t count);
+} VIDEO_CacheStorageTypeDef;
+
+// Key of the attached camera for the mode constraints "constraints"
+void video_cache_key(USBH_HandleTypeDef *phost, const VIDEO_ModeConstraintsTypeDef *constraints, VIDEO_CacheKeyTypeDef *key);
+
+// Cached state of "key", USBH_FAIL if the camera is not known. Host task.
+USBH_StatusTypeDef video_cache_lookup(const VIDEO_CacheKeyTypeDef *key, VIDEO_CacheEntryTypeDef *entry);
+
+// Keep the committed state of "key". Host task. Not kept if all entries are dropped and not flushed yet.
+void video_cache_store(const VIDEO_CacheKeyTypeDef *key, const VIDEO_ModeTypeDef *mode, const VIDEO_ProbeTypedef *commit);
+
+// Drop the entry of "key", it is dropped from the storage by the next flush. Host task.
+void video_cache_forget(const VIDEO_CacheKeyTypeDef *key);
+
+// Drop all entries in RAM, the storage is not changed
+void video_cache_clear(void);
+
+// Attach the storage and load the entries it holds, the newest record of a key wins.
+// Called before the camera is attached.
+void video_cache_attach_storage(const VIDEO_CacheStorageTypeDef *storage);
+
+// Write the entries changed since the last flush to the storage. Any task but the host task.
+// Blocks while the flash is programmed, and while it is erased when the block is full: the whole flash bank
+// is stalled meanwhile (1-2 s for a 128 KB sector of the STM32F4), the OTG interrupt included. Called only
+// while USBH_VIDEO_IsStopped is 1.
+USBH_StatusTypeDef video_cache_flush(void);
+
+// Entries changed since the last flush
+uint32_t video_cache_dirty(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
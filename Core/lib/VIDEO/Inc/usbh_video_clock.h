@@ -0,0 +1,67 @@
+#ifndef _USBH_VIDEO_CLOCK_H
+#define _USBH_VIDEO_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Camera clock recovery.
+// Camera stamps payloads with its own clock (STC, dwClockFrequency): PTS - when the frame was captured,
+// SCR - STC value sampled at the start of a USB frame, together with the 11-bit USB frame number (SOF).
+// Bus frame numbers are shared by host and camera, so every SCR gives one pair
+// (camera STC, host time of that USB frame). A least-squares line through the last pairs maps
+// camera time to host time, its slope gives the camera clock drift.
+//
+// Host time is microseconds from the DWT cycle counter. The clock is used only by the context that handles
+// URBs: the USB host task, or the OTG interrupt with UVC_ISR_FAST_PATH. It uses single precision float only.
+
+// Number of SCR samples used for the mapping
+#ifndef VIDEO_CLOCK_SAMPLES
+#define VIDEO_CLOCK_SAMPLES 32
+#endif
+
+// Minimum distance between samples in USB frames (ms), window is about VIDEO_CLOCK_SAMPLES * this
+#ifndef VIDEO_CLOCK_SAMPLE_PERIOD
+#define VIDEO_CLOCK_SAMPLE_PERIOD 32
+#endif
+
+// Host cycle counter, "SystemCoreClock" ticks
+#ifndef VIDEO_CLOCK_HOST_CYCLES
+#define VIDEO_CLOCK_HOST_CYCLES() (DWT->CYCCNT)
+#endif
+
+typedef struct {
+  bool valid;              // enough samples to map camera time
+  uint32_t samples;        // samples in the window
+  uint32_t clock_hz;       // nominal camera clock, 0 if unknown
+  uint32_t measured_hz;    // camera clock measured against the host clock
+  int32_t drift_ppm;       // (measured - nominal) / nominal, 0 if nominal is unknown
+} VIDEO_ClockStateTypeDef;
+
+// clock_hz - camera clock frequency (dwClockFrequency), 0 if unknown
+void video_clock_init(uint32_t clock_hz);
+
+// Host time in microseconds, wraps around every ~71 minutes
+uint32_t video_clock_host_time_us(void);
+
+// Must be called when a packet is received, before it is parsed.
+// frame_number - bus (micro)frame number when the packet was received (USBH_LL_GetCurrentFrame, not "phost->Timer"
+// that loses coalesced SOFs), high_speed - it counts microframes
+void video_clock_packet_received(uint32_t frame_number, bool high_speed);
+
+// SCR of the last received packet
+void video_clock_add_scr(uint32_t stc, uint16_t sof);
+
+// Convert camera time (PTS or STC) to host time in microseconds, returns false if mapping is not ready yet
+bool video_clock_device_to_host(uint32_t device_time, uint32_t *host_time_us);
+
+void video_clock_get_state(VIDEO_ClockStateTypeDef *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef _USBH_VIDEO_CONTROLS_H
+#define _USBH_VIDEO_CONTROLS_H
+
+#include "usbh_video.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Control table of the camera: Camera Terminal, Processing Unit and Extension Unit controls.
+// Controls are listed from the bmControls bitmaps of the VideoControl descriptors when the VIDEO class is
+// initialized. GET_INFO, GET_MIN, GET_MAX, GET_RES and GET_DEF of every control (GET_LEN first for the
+// Extension Unit ones) are queried once by the class request state machine before PROBE, with UVC_FAST_START
+// they are queried in the background after the stream is started. The answers are kept in the table.
+//
+// Controls are read and written asynchronously through the control request queue (usbh_video_ctrl.h), e.g.
+// auto exposure off and a fixed exposure time keep the frame rate and the MJPEG frame size constant when
+// the light changes. Asynchronous controls (VIDEO_CONTROL_INFO_ASYNC) may still be changing when SET_CUR
+// is done, their status interrupts are not handled.
+//
+// Values of up to 4 bytes are kept as int32_t: sign extended for the signed controls, composite controls
+// (several fields in one control) are the little-endian bytes of the control. Extension Unit controls share
+// VIDEO_CONTROL_XU and may be longer, they are read and written by unit and selector as bytes with
+// USBH_VIDEO_GetUnitControl/SetUnitControl.
+
+// Maximum number of controls, the rest of the descriptors is ignored (28 bytes each)
+#ifndef UVC_MAX_CONTROLS
+#define UVC_MAX_CONTROLS 32
+#endif
+
+// Standard controls, Camera Terminal and Processing Unit (USB_Video_Class_1.1.pdf, A.9.4 and A.9.5)
+typedef enum {
+  // Camera Terminal
+  VIDEO_CONTROL_SCANNING_MODE = 0,
+  VIDEO_CONTROL_AE_MODE,  // bitmap: 1 - manual, 2 - auto, 4 - shutter priority, 8 - aperture priority
+  VIDEO_CONTROL_AE_PRIORITY,
+  VIDEO_CONTROL_EXPOSURE_TIME_ABSOLUTE,  // 100 us units
+  VIDEO_CONTROL_EXPOSURE_TIME_RELATIVE,
+  VIDEO_CONTROL_FOCUS_ABSOLUTE,
+  VIDEO_CONTROL_FOCUS_RELATIVE,
+  VIDEO_CONTROL_FOCUS_AUTO,
+  VIDEO_CONTROL_IRIS_ABSOLUTE,
+  VIDEO_CONTROL_IRIS_RELATIVE,
+  VIDEO_CONTROL_ZOOM_ABSOLUTE,
+  VIDEO_CONTROL_ZOOM_RELATIVE,
+  VIDEO_CONTROL_PANTILT_RELATIVE,
+  VIDEO_CONTROL_ROLL_ABSOLUTE,
+  VIDEO_CONTROL_ROLL_RELATIVE,
+  VIDEO_CONTROL_PRIVACY,
+  // Processing Unit
+  VIDEO_CONTROL_BACKLIGHT_COMPENSATION,
+  VIDEO_CONTROL_BRIGHTNESS,
+  VIDEO_CONTROL_CONTRAST,
+  VIDEO_CONTROL_GAIN,
+  VIDEO_CONTROL_POWER_LINE_FREQUENCY,  // 0 - disabled, 1 - 50 Hz, 2 - 60 Hz
+  VIDEO_CONTROL_HUE,
+  VIDEO_CONTROL_SATURATION,
+  VIDEO_CONTROL_SHARPNESS,
+  VIDEO_CONTROL_GAMMA,
+  VIDEO_CONTROL_WHITE_BALANCE_TEMPERATURE,  // kelvin
+  VIDEO_CONTROL_WHITE_BALANCE_TEMPERATURE_AUTO,
+  VIDEO_CONTROL_WHITE_BALANCE_COMPONENT,
+  VIDEO_CONTROL_WHITE_BALANCE_COMPONENT_AUTO,
+  VIDEO_CONTROL_DIGITAL_MULTIPLIER,
+  VIDEO_CONTROL_DIGITAL_MULTIPLIER_LIMIT,
+  VIDEO_CONTROL_HUE_AUTO,
+  VIDEO_CONTROL_ANALOG_VIDEO_STANDARD,
+  VIDEO_CONTROL_ANALOG_LOCK_STATUS,
+  VIDEO_CONTROL_XU,  // Extension Unit control, found by unit and selector
+  VIDEO_CONTROLS
+} VIDEO_ControlIdTypeDef;
+
+// Control kinds, from the UVC definition of the control
+#define VIDEO_CONTROL_SIGNED    0x01  // value is signed
+#define VIDEO_CONTROL_BITMAP    0x02  // one bit of GET_RES is set, GET_MIN/GET_MAX are not defined
+#define VIDEO_CONTROL_COMPOSITE 0x04  // several fields, not range checked
+
+// GET_INFO bits
+#define VIDEO_CONTROL_INFO_GET      0x01
+#define VIDEO_CONTROL_INFO_SET      0x02
+#define VIDEO_CONTROL_INFO_AUTO     0x04  // disabled by an automatic mode (when GET_INFO was queried)
+#define VIDEO_CONTROL_INFO_AUTOUPD  0x08  // changed by the camera itself
+#define VIDEO_CONTROL_INFO_ASYNC    0x10  // SET_CUR completes after the request
+
+// Values answered by the camera
+#define VIDEO_CONTROL_HAS_MIN 0x01
+#define VIDEO_CONTROL_HAS_MAX 0x02
+#define VIDEO_CONTROL_HAS_RES 0x04
+#define VIDEO_CONTROL_HAS_DEF 0x08
+#define VIDEO_CONTROL_HAS_CUR 0x10
+
+typedef struct {
+  uint8_t id;        // VIDEO_ControlIdTypeDef
+  uint8_t unit;      // bTerminalID or bUnitID, high byte of wIndex
+  uint8_t selector;  // control selector, high byte of wValue
+  uint8_t flags;     // VIDEO_CONTROL_SIGNED, _BITMAP, _COMPOSITE
+  uint16_t size;     // wLength: from the UVC definition, GET_LEN of the Extension Unit controls
+  uint8_t info;      // GET_INFO, VIDEO_CONTROL_INFO_*; 0 - not answered, the control is not used
+  uint8_t valid;     // VIDEO_CONTROL_HAS_*
+  int32_t min;
+  int32_t max;
+  int32_t res;
+  int32_t def;
+  volatile int32_t cur;  // last value read or written
+} VIDEO_ControlTypeDef;
+
+// Completion of USBH_VIDEO_GetControl/SetControl: USBH_OK, USBH_NOT_SUPPORTED (request stalled) or USBH_FAIL.
+// "value" is the value read or written. Called by the host task.
+typedef void (*VIDEO_ControlDoneTypeDef)(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, const VIDEO_ControlTypeDef *control,
+                                         int32_t value, void *context);
+
+// Completion of USBH_VIDEO_GetUnitControl/SetUnitControl, status as above. "data" is the buffer of the request
+// with the "length" bytes read or written. Called by the host task.
+typedef void (*VIDEO_ControlDataDoneTypeDef)(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, const VIDEO_ControlTypeDef *control,
+                                             uint8_t *data, uint16_t length, void *context);
+
+// Build the table from the parsed VideoControl descriptors, nothing is queried yet. Returns the number of controls.
+uint8_t video_controls_build(USBH_HandleTypeDef *phost);
+
+// Queue the next query of the table, host task only. Requests are chained from their completions, a request
+// that did not fit into the queue is queued by the next call. USBH_OK when all controls are queried.
+USBH_StatusTypeDef video_controls_query(USBH_HandleTypeDef *phost);
+
+// All controls are queried, the table does not change any more until the next camera
+uint8_t video_controls_ready(void);
+
+// Table built by "video_controls_build", valid while the camera is attached
+const VIDEO_ControlTypeDef *video_controls_table(uint8_t *num);
+
+// First control "id" of the table, NULL if the camera does not have it or it is not queried yet
+const VIDEO_ControlTypeDef *video_controls_find(VIDEO_ControlIdTypeDef id);
+
+// Control "selector" of the unit "unit", NULL if none
+const VIDEO_ControlTypeDef *video_controls_find_unit(uint8_t unit, uint8_t selector);
+
+// Printable control name
+const char *video_controls_name(VIDEO_ControlIdTypeDef id);
+
+USBH_StatusTypeDef USBH_VIDEO_GetControl(USBH_HandleTypeDef *phost, VIDEO_ControlIdTypeDef id, VIDEO_ControlDoneTypeDef done, void *context);
+USBH_StatusTypeDef USBH_VIDEO_SetControl(USBH_HandleTypeDef *phost, VIDEO_ControlIdTypeDef id, int32_t value, VIDEO_ControlDoneTypeDef done,
+                                         void *context);
+USBH_StatusTypeDef USBH_VIDEO_GetUnitControl(USBH_HandleTypeDef *phost, uint8_t unit, uint8_t selector, uint8_t *data, uint16_t length,
+                                             VIDEO_ControlDataDoneTypeDef done, void *context);
+USBH_StatusTypeDef USBH_VIDEO_SetUnitControl(USBH_HandleTypeDef *phost, uint8_t unit, uint8_t selector, uint8_t *data, uint16_t length,
+                                             VIDEO_ControlDataDoneTypeDef done, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
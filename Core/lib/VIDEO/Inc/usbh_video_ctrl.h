@@ -0,0 +1,81 @@
+#ifndef _USBH_VIDEO_CTRL_H
+#define _USBH_VIDEO_CTRL_H
+
+#include "usbh_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Queue of the class specific control requests of the VIDEO class.
+// Requests are submitted by any task and run one after another by the USB host task: "video_ctrl_process"
+// is called by the class request state machine and by the background process, it never waits, the host
+// task is woken up by the control transfer events. The completion callback runs in the host task.
+//
+// Slots are claimed by the producers with an atomic ticket (many producers), the host task is the only consumer:
+//
+//   FREE --(producer)--> WRITING --(producer)--> READY --(host task)--> FREE
+//
+// Data buffer of a request is used when the request starts, so a buffer written by the completion
+// callback of an earlier request is sent with its new content.
+
+// Number of requests that can wait in the queue
+#ifndef UVC_CTRL_QUEUE_LEN
+#define UVC_CTRL_QUEUE_LEN 8
+#endif
+
+// Completion: USBH_OK, USBH_NOT_SUPPORTED (request stalled) or USBH_FAIL
+typedef void (*VIDEO_CtrlDoneTypeDef)(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context);
+
+typedef enum {
+  VIDEO_CTRL_FREE = 0,
+  VIDEO_CTRL_WRITING,
+  VIDEO_CTRL_READY,
+} VIDEO_CtrlStateTypeDef;
+
+// Request of "video_ctrl_submit_batch"
+typedef struct {
+  USB_Setup_TypeDef setup;
+  uint8_t *data;
+  VIDEO_CtrlDoneTypeDef done;
+  void *context;
+} VIDEO_CtrlRequestTypeDef;
+
+typedef struct {
+  volatile uint32_t state;  // VIDEO_CtrlStateTypeDef
+  USB_Setup_TypeDef setup;
+  uint8_t *data;
+  VIDEO_CtrlDoneTypeDef done;
+  void *context;
+} VIDEO_CtrlSlotTypeDef;
+
+typedef struct {
+  VIDEO_CtrlSlotTypeDef slot[UVC_CTRL_QUEUE_LEN];
+  volatile uint32_t tail;  // next ticket of the producers
+  uint32_t head;           // ticket of the request at the head, host task only
+  uint8_t active;          // request at the head is started
+  uint32_t done;           // requests completed
+  uint32_t failed;         // requests completed with an error
+} VIDEO_CtrlQueueTypeDef;
+
+void video_ctrl_init(VIDEO_CtrlQueueTypeDef *queue);
+
+// Queue a request, USBH_FAIL if the queue is full. Any task.
+USBH_StatusTypeDef video_ctrl_submit(VIDEO_CtrlQueueTypeDef *queue, const USB_Setup_TypeDef *setup, uint8_t *data, VIDEO_CtrlDoneTypeDef done,
+                                     void *context);
+
+// Queue "count" requests back to back, all of them or none: USBH_FAIL if there are not enough free slots. Any task.
+USBH_StatusTypeDef video_ctrl_submit_batch(VIDEO_CtrlQueueTypeDef *queue, const VIDEO_CtrlRequestTypeDef *requests, uint32_t count);
+
+// Run the queue, host task only. USBH_OK when the queue is empty, USBH_BUSY while a request is running.
+// Requests are started only when no other control transfer of the host is in progress.
+USBH_StatusTypeDef video_ctrl_process(USBH_HandleTypeDef *phost, VIDEO_CtrlQueueTypeDef *queue);
+
+// Requests waiting or running
+uint32_t video_ctrl_pending(const VIDEO_CtrlQueueTypeDef *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _USBH_VIDEO_FRAME_RING_H
+#define _USBH_VIDEO_FRAME_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Single producer (USB host task) / single consumer (application task) ring of framebuffers.
+// Every slot is owned by exactly one side, ownership is passed by changing the slot state:
+//
+//   FREE --(producer)--> FILLING --(producer)--> READY --(consumer)--> HELD --(consumer)--> FREE
+//                           ^                      |
+//                           +----(producer drop)---+
+//
+// State changes are done with atomic compare-and-swap, so a READY frame is either taken by
+// the consumer or reclaimed by the producer, never both. The producer reclaims READY slots only:
+// a HELD slot is pinned until the consumer releases it, whatever the drop policy and the slot count.
+// Frame data is published with release semantics and taken with acquire semantics.
+
+// Maximum number of slots, the real number is set by "video_frame_ring_init"
+#ifndef VIDEO_FRAME_RING_MAX_SLOTS
+#define VIDEO_FRAME_RING_MAX_SLOTS 8
+#endif
+
+// Frame flags
+#define VIDEO_FRAME_FLAG_ERROR     (1 << 0)  // UVC error bit was set in one of the packets
+#define VIDEO_FRAME_FLAG_TRUNCATED (1 << 1)  // frame did not fit into the framebuffer
+#define VIDEO_FRAME_FLAG_PTS       (1 << 2)  // "pts" is valid
+#define VIDEO_FRAME_FLAG_SCR       (1 << 3)  // "scr_stc" and "scr_sof" are valid
+#define VIDEO_FRAME_FLAG_CAPTURE   (1 << 4)  // "capture_time" is valid
+
+typedef enum {
+  VIDEO_FRAME_FREE = 0,
+  VIDEO_FRAME_FILLING,
+  VIDEO_FRAME_READY,
+  VIDEO_FRAME_HELD,
+} VIDEO_FrameStateTypeDef;
+
+// What the producer does when a new frame starts and there is no FREE slot
+typedef enum {
+  VIDEO_FRAME_DROP_OLDEST = 0,  // reuse the oldest READY frame, consumer gets the latest frames
+  VIDEO_FRAME_DROP_NEWEST,      // reuse the newest READY frame, consumer gets frames in capture order
+} VIDEO_FrameDropPolicyTypeDef;
+
+typedef struct {
+  uint8_t *data;       // first byte of the frame
+  uint32_t len;        // frame length in bytes
+  uint32_t seq;        // frame sequence number, incremented for every completed frame
+  uint32_t timestamp;  // HAL tick at the end of the frame
+  uint32_t flags;      // VIDEO_FRAME_FLAG_xxx
+  uint32_t pts;        // presentation time stamp from the payload header, device clock (dwClockFrequency)
+  uint32_t scr_stc;    // source clock reference of the last packet with SCR, device clock
+  uint16_t scr_sof;    // USB SOF counter sampled together with "scr_stc", 11 bits
+  uint32_t capture_time;   // sensor capture time ("pts" mapped to the host clock), microseconds
+  uint32_t delivery_time;  // host time when the frame was completed, microseconds
+} VIDEO_FrameTypeDef;
+
+typedef struct {
+  VIDEO_FrameTypeDef frame;
+  uint8_t *buffer;  // start of the framebuffer
+  volatile uint32_t state;
+} VIDEO_FrameSlotTypeDef;
+
+typedef struct {
+  VIDEO_FrameSlotTypeDef slot[VIDEO_FRAME_RING_MAX_SLOTS];
+  uint32_t count;
+  uint32_t buffer_size;
+  VIDEO_FrameDropPolicyTypeDef policy;
+  uint32_t next_seq;
+
+  // Statistics, written by the producer only
+  volatile uint32_t completed;       // frames passed to the consumer side
+  volatile uint32_t dropped_oldest;  // READY frames reclaimed with VIDEO_FRAME_DROP_OLDEST
+  volatile uint32_t dropped_newest;  // READY frames reclaimed with VIDEO_FRAME_DROP_NEWEST
+  volatile uint32_t overruns;        // no slot at all for a new frame (consumer holds every other slot)
+} VIDEO_FrameRingTypeDef;
+
+// pool - "count" framebuffers of "buffer_size" bytes each, placed one after another
+// headroom - bytes reserved in front of every frame ("VIDEO_FrameTypeDef.data" = buffer + headroom)
+bool video_frame_ring_init(VIDEO_FrameRingTypeDef *ring, uint8_t *pool, uint32_t count, uint32_t buffer_size, uint32_t headroom,
+                           VIDEO_FrameDropPolicyTypeDef policy);
+
+// Producer, while no frame is captured: place "count" framebuffers of "buffer_size" bytes in the pool again.
+// Completed frames are dropped, counters and sequence numbers go on. Returns false and keeps the layout
+// if the consumer holds a frame.
+bool video_frame_ring_resize(VIDEO_FrameRingTypeDef *ring, uint8_t *pool, uint32_t count, uint32_t buffer_size, uint32_t headroom);
+
+// Producer side
+VIDEO_FrameSlotTypeDef *video_frame_ring_begin(VIDEO_FrameRingTypeDef *ring);
+void video_frame_ring_commit(VIDEO_FrameRingTypeDef *ring, VIDEO_FrameSlotTypeDef *slot);
+
+// Consumer side
+VIDEO_FrameTypeDef *video_frame_ring_acquire(VIDEO_FrameRingTypeDef *ring);
+void video_frame_ring_release(VIDEO_FrameRingTypeDef *ring, VIDEO_FrameTypeDef *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
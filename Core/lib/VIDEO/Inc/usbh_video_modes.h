@@ -0,0 +1,88 @@
+#ifndef _USBH_VIDEO_MODES_H
+#define _USBH_VIDEO_MODES_H
+
+#include "usbh_video.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Capability table of the camera.
+// Every (format, frame, frame interval) the camera declares in its VideoStreaming descriptors is one mode,
+// the table is built once when the VIDEO class is initialized. A mode is selected from it under constraints
+// (frame size, bandwidth, framebuffer memory, frame rate), the selected mode is negotiated with PROBE/COMMIT.
+// Only formats the stream parser handles are listed: MJPEG and uncompressed YUY2.
+
+// Maximum number of modes, the rest of the descriptors is ignored (20 bytes each)
+#ifndef UVC_MAX_MODES
+#define UVC_MAX_MODES 48
+#endif
+
+// Mode flags
+#define VIDEO_MODE_DEFAULT_INTERVAL 0x01  // dwDefaultFrameInterval of the frame
+#define VIDEO_MODE_DEFAULT_FRAME    0x02  // bDefaultFrameIndex of the format
+
+// Frames per second * 100 of a 100 ns frame interval
+#define VIDEO_MODE_FPS_X100(interval) (((interval) != 0) ? (uint32_t) (1000000000UL / (interval)) : 0)
+
+typedef struct _VIDEO_Mode {
+  uint32_t interval;    // dwFrameInterval, 100 ns units
+  uint32_t frame_size;  // framebuffer bytes: exact for uncompressed frames, dwMaxVideoFrameBufferSize for MJPEG
+  uint32_t bandwidth;   // bytes per second of "frame_size" frames at "interval", worst case the bus has to carry
+  uint16_t width;
+  uint16_t height;
+  uint8_t format;  // USBH_VIDEO_TargetFormat_t
+  uint8_t bFormatIndex;
+  uint8_t bFrameIndex;
+  uint8_t flags;  // VIDEO_MODE_*
+} VIDEO_ModeTypeDef;
+
+// Constraints of the mode selection, 0 - not constrained (see the fields).
+// Constraints are relaxed one by one when no mode meets all of them: frame rate, then framebuffer memory
+// of MJPEG modes (compressed frames are usually far smaller than dwMaxVideoFrameBufferSize), then bandwidth.
+// MJPEG frames longer than the framebuffer are truncated. Format and framebuffer memory of uncompressed
+// modes are never relaxed.
+typedef struct {
+  uint8_t formats;          // accepted formats, bits (1 << USBH_VIDEO_TargetFormat_t); 0 - USBH_VIDEO_Target_Format
+  uint16_t width;           // wanted frame size: exact match, else the biggest smaller frame, else the smallest one;
+  uint16_t height;          // 0 - USBH_VIDEO_Target_Width/Height
+  uint32_t max_bandwidth;   // bytes per second; 0 - isochronous bandwidth of the biggest usable alt setting
+  uint32_t max_frame_size;  // framebuffer bytes; 0 - UVC_FRAME_DATA_LIMIT, never more
+  uint32_t min_fps_x100;    // lowest acceptable frame rate * 100; 0 - any
+} VIDEO_ModeConstraintsTypeDef;
+
+// Constraints used when the VIDEO class is initialized, set by the application before the camera is attached
+extern VIDEO_ModeConstraintsTypeDef USBH_VIDEO_Mode_Constraints;
+
+// Builds the table from the parsed class specific descriptors and the streaming alt settings of the camera.
+// Returns the number of modes.
+uint8_t video_modes_build(USBH_HandleTypeDef *phost);
+
+// Table built by "video_modes_build", valid while the camera is attached
+const VIDEO_ModeTypeDef *video_modes_table(uint8_t *num);
+
+// Isochronous bandwidth of the biggest usable alt setting, bytes per second
+uint32_t video_modes_bus_bandwidth(void);
+
+// Best mode under "constraints", NULL if the camera has no mode of an accepted format.
+// The mode is remembered as the selected one.
+const VIDEO_ModeTypeDef *video_modes_select(const VIDEO_ModeConstraintsTypeDef *constraints);
+
+// Mode selected when the VIDEO class was initialized or by the last mode switch, NULL if none
+const VIDEO_ModeTypeDef *video_modes_selected(void);
+
+// Mode of the table with these indexes and frame interval (0 - default interval of the frame), NULL if none
+const VIDEO_ModeTypeDef *video_modes_find(uint8_t bFormatIndex, uint8_t bFrameIndex, uint32_t interval);
+
+// 1 if the stream parser assembles frames of "mode": MJPEG (longer frames than UVC_FRAME_DATA_LIMIT are
+// truncated), or uncompressed frames that fit into UVC_FRAME_DATA_LIMIT
+uint8_t video_modes_assembled(const VIDEO_ModeTypeDef *mode);
+
+// Remember "mode" as the selected one, host task
+void video_modes_set_selected(const VIDEO_ModeTypeDef *mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
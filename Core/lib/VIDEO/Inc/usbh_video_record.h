@@ -0,0 +1,90 @@
+#ifndef _USBH_VIDEO_RECORD_H
+#define _USBH_VIDEO_RECORD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Record mode of the isochronous input stream (UVC_RECORD): every URB is written to a binary log
+// in a RAM ring, so field captures can be replayed offline with the exact packet boundaries.
+//
+// Log is a sequence of records, little-endian, no padding:
+//   VIDEO_RecordHeaderTypeDef, then "length" bytes
+//   VIDEO_RECORD_STREAM - stream parameters (VIDEO_RecordStreamTypeDef), written when recording starts
+//                         and when the stream is (re)started
+//   VIDEO_RECORD_PACKET - received packet, the payload as the OTG core wrote it
+//   VIDEO_RECORD_LOST   - URB was not completed, no payload
+//
+// The producer is the one that handles URBs (USB host task, or the OTG interrupt with UVC_ISR_FAST_PATH).
+// Records are written whole or dropped when the ring is full, the producer never waits.
+// "video_record_read" drains the ring from any other task, e.g. to a UART or a file. Without a reader
+// the ring fills up once from its start: after "video_record_stop" it holds "used" bytes of the log at
+// "video_record_buf" and can be dumped by the debugger.
+
+#ifndef UVC_RECORD
+#define UVC_RECORD 0
+#endif
+
+// Ring size in bytes, must be a power of 2
+#ifndef UVC_RECORD_RING_SIZE
+#define UVC_RECORD_RING_SIZE 16384
+#endif
+
+#define VIDEO_RECORD_MAGIC   0x43565555U  // "UUVC"
+#define VIDEO_RECORD_VERSION 2  // 2: timestamps are bus frame numbers
+
+typedef enum {
+  VIDEO_RECORD_STREAM = 0,
+  VIDEO_RECORD_PACKET,
+  VIDEO_RECORD_LOST,
+} VIDEO_RecordTypeTypeDef;
+
+#pragma pack(1)
+typedef struct {
+  uint32_t timestamp;  // bus frame number when the URB was done (microframes at HS, frames at FS, 14 bits)
+  uint16_t length;     // bytes following the header
+  uint8_t channel;     // isochronous channel index (ping-pong: 0 - even, 1 - odd (micro)frames)
+  uint8_t type;        // VIDEO_RecordTypeTypeDef
+} VIDEO_RecordHeaderTypeDef;
+
+typedef struct {
+  uint32_t magic;       // VIDEO_RECORD_MAGIC
+  uint8_t version;      // VIDEO_RECORD_VERSION
+  uint8_t high_speed;   // timestamps count microframes
+  uint8_t format;       // USBH_VIDEO_TargetFormat_t
+  uint8_t channels;     // isochronous channels in use
+  uint32_t clock_hz;    // camera clock, dwClockFrequency
+  uint16_t xfer_size;   // bytes per (micro)frame of the alt setting
+  uint16_t interval;    // service interval in timestamp ticks
+  uint32_t frame_size;  // dwMaxVideoFrameSize
+} VIDEO_RecordStreamTypeDef;
+#pragma pack()
+
+typedef struct {
+  uint32_t records;        // records written
+  uint32_t dropped;        // records dropped, the ring was full
+  uint32_t used;           // bytes in the ring now
+} VIDEO_RecordStatsTypeDef;
+
+// Control, any task
+void video_record_start(void);
+void video_record_stop(void);
+
+// Producer: stream (re)started with "stream" parameters
+void video_record_stream(const VIDEO_RecordStreamTypeDef *stream);
+// Producer: URB of "channel" done at "timestamp", "data" is NULL for VIDEO_RECORD_LOST
+void video_record_urb(uint8_t channel, uint32_t timestamp, uint8_t type, const uint8_t *data, uint16_t length);
+
+// Consumer: up to "len" bytes of the log are moved to "buf", returns the number of bytes
+uint32_t video_record_read(uint8_t *buf, uint32_t len);
+void video_record_get_stats(VIDEO_RecordStatsTypeDef *stats);
+
+extern uint8_t video_record_buf[UVC_RECORD_RING_SIZE];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _USBH_VIDEO_STARTUP_H
+#define _USBH_VIDEO_STARTUP_H
+
+#include <stdint.h>
+
+#include "usbh_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Startup timeline of the camera: when each step from the port connect to the first delivered frame was done.
+// Enumeration steps are marked from the user events of the host core, passed on by the application user
+// callback to "video_startup_user_event", the rest by the VIDEO class. Only the first occurrence of a step is
+// kept; the timeline is cleared when a device is connected, it stays valid after the first frame until the
+// next connect.
+//
+// Times are microseconds since CONNECT from the DWT cycle counter. Steps more than 2^32 core cycles
+// apart (25 s at 168 MHz) are not timed correctly.
+
+typedef enum {
+  VIDEO_STARTUP_CONNECT = 0,   // device connected, before the attach wait (HOST_USER_DEVICE_DETECTED)
+  VIDEO_STARTUP_RESET,         // port reset done, port enabled (HOST_USER_CONNECTION)
+  VIDEO_STARTUP_ADDRESS,       // SET_ADDRESS done (HOST_USER_ADDRESS_ASSIGNED)
+  VIDEO_STARTUP_CONFIG,        // SET_CONFIGURATION done (HOST_USER_CONFIGURED)
+  VIDEO_STARTUP_CLASS_INIT,    // VIDEO class initialized, mode selected
+  VIDEO_STARTUP_COMMIT,        // SET_CUR(COMMIT) done
+  VIDEO_STARTUP_FIRST_PACKET,  // first isochronous packet received
+  VIDEO_STARTUP_FIRST_FRAME,   // first frame delivered to the frame ring
+  VIDEO_STARTUP_EVENTS
+} VIDEO_StartupEventTypeDef;
+
+typedef struct {
+  uint32_t time_us[VIDEO_STARTUP_EVENTS];  // since CONNECT, valid if the step is marked
+  uint32_t marked;                         // bits (1 << VIDEO_StartupEventTypeDef)
+  uint16_t idVendor;                       // camera, set at CLASS_INIT
+  uint16_t idProduct;
+} VIDEO_StartupTypeDef;
+
+// Clear the timeline, called when a device is connected
+void video_startup_reset(void);
+
+// Mark the enumeration step of a user event "id" (HOST_USER_*) of the host the camera is attached to, other
+// events are ignored. Called from the user callback of USBH_Init, host task.
+void video_startup_user_event(USBH_HandleTypeDef *phost, uint8_t id);
+
+// Mark a step, ignored if it is marked already. Host task or OTG interrupt (first packet and frame with UVC_ISR_FAST_PATH).
+void video_startup_mark(VIDEO_StartupEventTypeDef event);
+
+// Camera the timeline belongs to
+void video_startup_set_device(uint16_t idVendor, uint16_t idProduct);
+
+// Copy of the timeline, any task
+void video_startup_read(VIDEO_StartupTypeDef *timeline);
+
+// Printable step name
+const char *video_startup_event_name(VIDEO_StartupEventTypeDef event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
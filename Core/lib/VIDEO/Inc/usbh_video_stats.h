@@ -0,0 +1,61 @@
+#ifndef _USBH_VIDEO_STATS_H
+#define _USBH_VIDEO_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming statistics of the UVC pipeline.
+// Counters are monotonic, they are incremented by the single producer (USB host task, or the OTG
+// interrupt with UVC_ISR_FAST_PATH) in "video_stats_live" without any locking.
+// After every packet the producer publishes them into one of two copies (sequence latch):
+// a reader takes the copy that is not being written and retries only if the producer has
+// published again meanwhile. Readers never wait for the producer, any task may take a snapshot.
+
+// Window of the fps and throughput estimation, microseconds of host time
+#ifndef VIDEO_STATS_WINDOW_US
+#define VIDEO_STATS_WINDOW_US 1000000
+#endif
+
+typedef struct {
+  // Packets
+  uint32_t packets;              // isochronous packets received, including empty ones
+  uint32_t empty_packets;        // zero-length packets
+  uint32_t header_only_packets;  // packets with a payload header and no data
+  uint32_t bad_packets;          // packets with an invalid payload header, ignored
+  uint32_t error_packets;        // packets with the ERR bit set in the payload header
+  uint32_t lost_packets;         // URBs that were not completed (transaction error, frame overrun)
+  uint32_t missed_uframes;       // service intervals without a transfer between two URBs
+  uint64_t payload_bytes;        // payload bytes received, headers are not counted
+
+  // Frames
+  uint32_t fid_without_eof;      // FID toggled while the previous packet had no EOF
+  uint32_t frames_delivered;     // frames passed to the frame ring
+  uint32_t frames_truncated;     // frames longer than UVC_UNCOMP_FRAME_SIZE, cut
+  uint32_t frames_bad;           // EOF without a detected frame start, frame data discarded
+  uint32_t frames_dropped;       // completed frames reclaimed because the consumer was slow
+  uint32_t frames_skipped;       // frames not captured, the consumer held every other framebuffer
+
+  // Rates over the last VIDEO_STATS_WINDOW_US, updated when a frame is completed.
+  // A reader gets 0 when no frame was completed during the last window.
+  uint32_t fps_x100;             // frames per second * 100
+  uint32_t bytes_per_sec;        // payload throughput
+  uint32_t last_frame_tick;      // HAL tick when the last frame was completed
+} VIDEO_StatsTypeDef;
+
+// Producer side: counters updated in place, "video_stats_publish" makes them visible to readers
+extern VIDEO_StatsTypeDef video_stats_live;
+
+void video_stats_frame_done(uint32_t now_us);
+void video_stats_publish(void);
+
+// Consumer side: consistent snapshot of the last published counters
+void video_stats_read(VIDEO_StatsTypeDef *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
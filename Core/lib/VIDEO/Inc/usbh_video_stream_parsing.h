@@ -2,6 +2,7 @@
 #define _USBH_VIDEO_STREAM_PARSING_H
 
 #include "usbh_video.h"
+#include "usbh_video_frame_ring.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -10,19 +11,53 @@ extern "C" {
 #define UVC_HEADER_SIZE_POS      0
 #define UVC_HEADER_BIT_FIELD_POS 1
 
+// bmHeaderInfo bits
 #define UVC_HEADER_FID_BIT       (1 << 0)
 #define UVC_HEADER_EOF_BIT       (1 << 1)
+#define UVC_HEADER_PTS_BIT       (1 << 2)
+#define UVC_HEADER_SCR_BIT       (1 << 3)
+#define UVC_HEADER_STI_BIT       (1 << 5)
 #define UVC_HEADER_ERR_BIT       (1 << 6)
+#define UVC_HEADER_EOH_BIT       (1 << 7)
 
-#define UVC_HEADER_SIZE          12
+// Payload header length is given by bHeaderLength: 2 bytes + optional PTS (4 bytes) + optional SCR (6 bytes)
+#define UVC_HEADER_MIN_SIZE      2
+#define UVC_HEADER_SIZE          12  // maximum header length
+#define UVC_HEADER_PTS_SIZE      4
+#define UVC_HEADER_SCR_SIZE      6
+#define UVC_HEADER_SCR_SOF_MASK  0x07FF
 
+// In zero-copy mode every framebuffer keeps this many bytes in front of the frame data,
+// so the header of the first packet has a place to land. Must keep (headroom - header) 4-byte aligned.
+#if UVC_ZERO_COPY_RX
+#define UVC_FRAME_HEADROOM UVC_HEADER_SIZE
+#else
+#define UVC_FRAME_HEADROOM 0
+#endif
+
+// Maximum number of frame bytes that fit into a UVC_MAX_FRAME_SIZE framebuffer
+#define UVC_FRAME_DATA_LIMIT (((UVC_MAX_FRAME_SIZE - UVC_FRAME_HEADROOM) < UVC_UNCOMP_FRAME_SIZE) ? (UVC_MAX_FRAME_SIZE - UVC_FRAME_HEADROOM) : UVC_UNCOMP_FRAME_SIZE)
 
+uint8_t *video_stream_rx_buffer(uint16_t max_len);
 int video_stream_process_packet(uint16_t size);
-void video_stream_init_buffers(uint8_t *buffer0, uint8_t *buffer1);
+uint8_t *video_stream_rx_staging(uint8_t index);
+int video_stream_process_staged(uint8_t index, uint16_t size);
+void video_stream_drop_packet(void);
+void video_stream_retry_packet(void);
+void video_stream_deliver_frame(void);
+void video_stream_init_buffers(uint8_t *pool);
+uint32_t video_stream_resize_buffers(uint32_t frame_size);
+VIDEO_FrameTypeDef *video_stream_get_frame(void);
+void video_stream_release_frame(VIDEO_FrameTypeDef *frame);
 void video_stream_ready_update(void);
-typedef void(*videoPacketArrived)(uint8_t* data,uint32_t len);
+// Called from the USB host task for every completed frame, frame is valid until the next frame starts.
+// With UVC_ISR_FAST_PATH it gets a copy of the frame descriptor and the next frame may already be
+// started in the same framebuffer when it is called, frames should be taken with "video_stream_get_frame" then.
+typedef void(*videoPacketArrived)(VIDEO_FrameTypeDef* frame);
 
 void videoPacketArrivedCallback(videoPacketArrived callback);
+
+extern VIDEO_FrameRingTypeDef uvc_frame_ring;
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,126 @@
+#ifndef _USBH_VIDEO_TRACE_H
+#define _USBH_VIDEO_TRACE_H
+
+#include <stdio.h>
+
+#include "usbh_video.h"
+
+// Trace output of the VIDEO class, levels are set per subsystem in "usbh_video.h":
+// 0 - nothing, all trace calls compile to nothing
+// 1 - errors
+// 2 - events (frame boundaries, state changes, descriptor dumps)
+// 3 - debug (every packet, packet hex dumps)
+
+#define UVC_TRACE_PRINT(...) \
+  do {                       \
+    printf(__VA_ARGS__);     \
+    printf("\n");            \
+  } while (0)
+
+#define UVC_TRACE_PRINT_TAG(tag, ...) \
+  do {                                \
+    printf(tag);                      \
+    UVC_TRACE_PRINT(__VA_ARGS__);     \
+  } while (0)
+
+#define UVC_TRACE_NONE(...) \
+  do {                      \
+  } while (0)
+
+// Stream parser - called for every received packet
+#if (UVC_TRACE_PARSER > 0)
+#define UVC_PARSER_ERR(...) UVC_TRACE_PRINT_TAG("UVC PARSER ERROR: ", __VA_ARGS__)
+#else
+#define UVC_PARSER_ERR(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_PARSER > 1)
+#define UVC_PARSER_LOG(...) UVC_TRACE_PRINT_TAG("UVC PARSER: ", __VA_ARGS__)
+#else
+#define UVC_PARSER_LOG(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_PARSER > 2)
+#define UVC_PARSER_DBG(...) UVC_TRACE_PRINT_TAG("UVC PARSER DEBUG: ", __VA_ARGS__)
+#define UVC_PARSER_DUMP(buf, len)                \
+  do {                                           \
+    for (uint32_t i = 0; i < (len); i++) {       \
+      if (i % 32 == 0) {                         \
+        printf("\n");                            \
+      }                                          \
+      printf("%02X ", ((uint8_t *) (buf))[i]);   \
+    }                                            \
+    printf("\n");                                \
+  } while (0)
+#else
+#define UVC_PARSER_DBG(...)       UVC_TRACE_NONE()
+#define UVC_PARSER_DUMP(buf, len) UVC_TRACE_NONE()
+#endif
+
+// Isochronous pipe - URB handling
+#if (UVC_TRACE_ISOC > 0)
+#define UVC_ISOC_ERR(...) UVC_TRACE_PRINT_TAG("UVC ISOC ERROR: ", __VA_ARGS__)
+#else
+#define UVC_ISOC_ERR(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_ISOC > 1)
+#define UVC_ISOC_LOG(...) UVC_TRACE_PRINT_TAG("UVC ISOC: ", __VA_ARGS__)
+#else
+#define UVC_ISOC_LOG(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_ISOC > 2)
+#define UVC_ISOC_DBG(...) UVC_TRACE_PRINT_TAG("UVC ISOC DEBUG: ", __VA_ARGS__)
+#else
+#define UVC_ISOC_DBG(...) UVC_TRACE_NONE()
+#endif
+
+// Class-specific control requests (probe/commit, streaming interface)
+#if (UVC_TRACE_CTRL > 0)
+#define UVC_CTRL_ERR(...) UVC_TRACE_PRINT_TAG("UVC CTRL ERROR: ", __VA_ARGS__)
+#else
+#define UVC_CTRL_ERR(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_CTRL > 1)
+#define UVC_CTRL_LOG(...) UVC_TRACE_PRINT(__VA_ARGS__)
+#else
+#define UVC_CTRL_LOG(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_CTRL > 2)
+#define UVC_CTRL_DBG(...) UVC_TRACE_PRINT_TAG("UVC CTRL DEBUG: ", __VA_ARGS__)
+#else
+#define UVC_CTRL_DBG(...) UVC_TRACE_NONE()
+#endif
+
+// Descriptor parsing
+#if (UVC_TRACE_DESC > 0)
+#define UVC_DESC_ERR(...) UVC_TRACE_PRINT_TAG("UVC DESC ERROR: ", __VA_ARGS__)
+#else
+#define UVC_DESC_ERR(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_DESC > 1)
+#define UVC_DESC_LOG(...) UVC_TRACE_PRINT(__VA_ARGS__)
+#else
+#define UVC_DESC_LOG(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_DESC > 2)
+#define UVC_DESC_DBG(...) UVC_TRACE_PRINT_TAG("UVC DESC DEBUG: ", __VA_ARGS__)
+#else
+#define UVC_DESC_DBG(...) UVC_TRACE_NONE()
+#endif
+
+// Camera clock recovery
+#if (UVC_TRACE_CLOCK > 0)
+#define UVC_CLOCK_ERR(...) UVC_TRACE_PRINT_TAG("UVC CLOCK ERROR: ", __VA_ARGS__)
+#else
+#define UVC_CLOCK_ERR(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_CLOCK > 1)
+#define UVC_CLOCK_LOG(...) UVC_TRACE_PRINT_TAG("UVC CLOCK: ", __VA_ARGS__)
+#else
+#define UVC_CLOCK_LOG(...) UVC_TRACE_NONE()
+#endif
+#if (UVC_TRACE_CLOCK > 2)
+#define UVC_CLOCK_DBG(...) UVC_TRACE_PRINT_TAG("UVC CLOCK DEBUG: ", __VA_ARGS__)
+#else
+#define UVC_CLOCK_DBG(...) UVC_TRACE_NONE()
+#endif
+
+#endif
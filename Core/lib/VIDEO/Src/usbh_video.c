@@ -1,12 +1,22 @@
 // UVC HOST video capture for STM32 by ILIASAM
-// Search for "GRXFSIZ" to change RX FIFO size
+// RX FIFO is sized for the selected endpoint by "USBH_LL_SetFifoLayout" (usbh_conf.c)
 // See mor info at "usbh_video_stram_parsing.c" file
 
 /* Includes ------------------------------------------------------------------*/
 #include "usbh_video.h"
 
+#include "dwt_prof.h"
+#include "usbh_conf_ext.h"
+#include "usbh_video_cache.h"
+#include "usbh_video_clock.h"
+#include "usbh_video_controls.h"
 #include "usbh_video_desc_parsing.h"
+#include "usbh_video_modes.h"
+#include "usbh_video_record.h"
+#include "usbh_video_startup.h"
+#include "usbh_video_stats.h"
 #include "usbh_video_stream_parsing.h"
+#include "usbh_video_trace.h"
 #if USBH_USE_OS
 #include "cmsis_os2.h"
 #endif
@@ -15,11 +25,26 @@ static USBH_StatusTypeDef USBH_VIDEO_InterfaceInit(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef USBH_VIDEO_InterfaceDeInit(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef USBH_VIDEO_SOFProcess(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef USBH_VIDEO_ClassRequest(USBH_HandleTypeDef *phost);
-static USBH_StatusTypeDef USBH_VIDEO_CSRequest(USBH_HandleTypeDef *phost, uint8_t feature, uint8_t channel);
-
 static USBH_StatusTypeDef USBH_VIDEO_HandleCSRequest(USBH_HandleTypeDef *phost);
+static void USBH_VIDEO_ProbeDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context);
+static void USBH_VIDEO_CommitDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context);
+static void USBH_VIDEO_RequestProbe(VIDEO_HandleTypeDef *VIDEO_Handle, const VIDEO_ModeTypeDef *mode);
+static USBH_StatusTypeDef USBH_VIDEO_QueueNegotiation(USBH_HandleTypeDef *phost);
+static void USBH_VIDEO_RetryNegotiation(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle);
+static USBH_StatusTypeDef USBH_VIDEO_QueueSetInterface(USBH_HandleTypeDef *phost, uint8_t alt_setting, VIDEO_CtrlDoneTypeDef done, void *context);
+static void USBH_VS_Setup(VIDEO_HandleTypeDef *VIDEO_Handle, uint8_t request, uint16_t request_type, USB_Setup_TypeDef *setup);
+static void USBH_VIDEO_SuspendDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context);
+static void USBH_VIDEO_StopPipes(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle);
+static void USBH_VIDEO_OpenPipes(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle);
+static void USBH_VIDEO_SwitchStopped(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context);
 
 static USBH_StatusTypeDef USBH_VIDEO_InputStream(USBH_HandleTypeDef *phost);
+static uint8_t USBH_VIDEO_PipeHook(USBH_HandleTypeDef *phost, uint8_t pipe, USBH_URBStateTypeDef urb_state, void *context);
+static int USBH_VIDEO_HandleURB(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle, uint8_t index, USBH_URBStateTypeDef result);
+static void USBH_VIDEO_SubmitURB(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle, uint8_t index);
+#if UVC_RECORD
+static void USBH_VIDEO_RecordStream(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle);
+#endif
 void print_Probe(VIDEO_ProbeTypedef probe);
 USBH_ClassTypeDef VIDEO_Class = {
     "VIDEO",
@@ -35,8 +60,16 @@ USBH_ClassTypeDef VIDEO_Class = {
 // This struct is used for PROBE control request ( Setup Packet )
 VIDEO_ProbeTypedef ProbeParams;
 
-// Buffer to store received UVC data packet
-volatile uint8_t tmp_packet_framebuffer[UVC_RX_FIFO_SIZE_LIMIT] = {0};
+// Cache key of the attached camera, and whether its cached state is committed without PROBE (usbh_video_cache.h)
+static VIDEO_CacheKeyTypeDef cache_key;
+static uint8_t cache_hit;
+
+// Buffers to store received UVC data packets, one per isochronous channel (OTG DMA needs 32-bit alignment)
+volatile uint8_t tmp_packet_framebuffer[UVC_ISOC_URBS][UVC_RX_FIFO_SIZE_LIMIT] __attribute__((aligned(4))) = {0};
+
+// Isochronous channels in use and the pipe of channel "index"
+#define USBH_VIDEO_URBS(handle)        (((handle)->camera.pingpong != 0) ? 2U : 1U)
+#define USBH_VIDEO_PIPE(handle, index) (((index) == 0) ? (handle)->camera.Pipe : (handle)->camera.PongPipe)
 
 /** @defgroup Private_Functions
  * @{
@@ -52,9 +85,7 @@ static USBH_StatusTypeDef USBH_VIDEO_InterfaceInit(USBH_HandleTypeDef *phost) {
   USBH_StatusTypeDef status = USBH_FAIL;
   USBH_StatusTypeDef out_status;
   VIDEO_HandleTypeDef *VIDEO_Handle;
-  uint8_t interface, index;
-
-  uint16_t ep_size_in = 0;
+  uint8_t interface;
 
   interface = USBH_FindInterface(phost, CC_VIDEO, USB_SUBCLASS_VIDEOCONTROL, 0x00);
 
@@ -66,6 +97,8 @@ static USBH_StatusTypeDef USBH_VIDEO_InterfaceInit(USBH_HandleTypeDef *phost) {
     phost->pActiveClass->pData = (VIDEO_HandleTypeDef *) USBH_malloc(sizeof(VIDEO_HandleTypeDef));
     VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
     USBH_memset(VIDEO_Handle, 0, sizeof(VIDEO_HandleTypeDef));
+    video_ctrl_init(&VIDEO_Handle->ctrl);
+    VIDEO_Handle->control_interface = phost->device.CfgDesc.Itf_Desc[interface].bInterfaceNumber;
 
     /* 1st Step:  Find IN Video Interfaces */
     out_status = USBH_VIDEO_FindStreamingIN(phost);
@@ -76,71 +109,196 @@ static USBH_StatusTypeDef USBH_VIDEO_InterfaceInit(USBH_HandleTypeDef *phost) {
       return USBH_FAIL;
     }
 
-    /* 2nd Step:  Select Video Streaming Interfaces with best endpoint size*/
-    for (index = 0; index < VIDEO_MAX_VIDEO_STD_INTERFACE; index++) {
-      if (VIDEO_Handle->stream_in[index].valid == 1) {
-        uint16_t ep_size = VIDEO_Handle->stream_in[index].EpSize;
-        // if (ep_size == 512)
-        if ((ep_size > ep_size_in) && (ep_size <= UVC_RX_FIFO_SIZE_LIMIT)) {
-          ep_size_in = ep_size;
-          VIDEO_Handle->camera.interface = VIDEO_Handle->stream_in[index].interface;
-          VIDEO_Handle->camera.AltSettings = VIDEO_Handle->stream_in[index].AltSettings;
-          VIDEO_Handle->camera.Ep = VIDEO_Handle->stream_in[index].Ep;
-          VIDEO_Handle->camera.EpSize = VIDEO_Handle->stream_in[index].EpSize;
-          VIDEO_Handle->camera.Poll = VIDEO_Handle->stream_in[index].Poll;
-          VIDEO_Handle->camera.supported = 1;
-        }
-      }
-    }
-    USBH_DbgLog("Selected EP size: %d bytes", ep_size_in);
+    /* 2nd Step:  Select Video Streaming Interface with the biggest endpoint, final alt setting is selected after PROBE */
+    USBH_VIDEO_SelectAltSetting(phost, 0);
 
     /* 3rd Step:  Find and Parse Video interfaces */
     USBH_VIDEO_ParseCSDescriptors(phost);
 
-    /* 4rd Step:  Find desrcroptors for target settings */
-    USBH_VIDEO_AnalyseFormatDescriptors(&VIDEO_Handle->class_desc);
-    if (USBH_VIDEO_Best_bFormatIndex == -1) {
-      status = USBH_FAIL;
-      return USBH_FAIL;
-    }
+    // Camera clock is needed to map payload PTS/SCR to the host time
+    VIDEO_HeaderDescTypeDef *header = VIDEO_Handle->class_desc.cs_desc.HeaderDesc;
+    video_clock_init((header != NULL) ? LE32(header->dwClockFrequency) : 0);
 
-    int frameIdx = USBH_VIDEO_AnalyseFrameDescriptors(&VIDEO_Handle->class_desc);
-    if (frameIdx == -1) {
+    // Controls of the camera terminal and the units, they are queried before PROBE (see USBH_VIDEO_HandleCSRequest)
+    video_controls_build(phost);
+
+    /* 4rd Step:  Build the capability table and select the mode for the target settings */
+    video_modes_build(phost);
+    const VIDEO_ModeTypeDef *mode = video_modes_select(&USBH_VIDEO_Mode_Constraints);
+    if (mode == NULL) {
       status = USBH_FAIL;
       return USBH_FAIL;
     }
-    memset(&ProbeParams, 0, sizeof(ProbeParams));
-    // Set needed params, at commit stage this parameters must be receied during "GET_CUR"
-    ProbeParams.bmHint = 1;
-    ProbeParams.bFormatIndex = USBH_VIDEO_Best_bFormatIndex;
-    ProbeParams.bFrameIndex = USBH_VIDEO_Best_bFrameIndex;
-    ProbeParams.dwMaxVideoFrameSize = VIDEO_Handle->class_desc.vs_desc.MJPEGFrame[frameIdx]->dwMaxVideoFrameBufferSize;
-    ProbeParams.dwMaxPayloadTransferSize = ep_size_in;
-
-    // Maximum framerate can be selected here
-    // ProbeParams.dwFrameInterval = 333333;  // 30 FPS
-    ProbeParams.dwFrameInterval = USBH_VIDEO_Best_dwDefaultFrameInterval;  // 30 FPS
-    // ProbeParams.dwFrameInterval = 2000000;//5 FPS
+    USBH_VIDEO_Best_bFormatIndex = mode->bFormatIndex;
+    USBH_VIDEO_Best_bFrameIndex = mode->bFrameIndex;
+    USBH_VIDEO_Best_dwDefaultFrameInterval = mode->interval;
+
+    USBH_VIDEO_RequestProbe(VIDEO_Handle, mode);
     print_Probe(ProbeParams);
 
+    // Known camera: the state it committed last time is committed again
+    VIDEO_CacheEntryTypeDef cached;
+    video_cache_key(phost, &USBH_VIDEO_Mode_Constraints, &cache_key);
+    cache_hit = (video_cache_lookup(&cache_key, &cached) == USBH_OK) && (memcmp(&cached.mode, mode, sizeof(*mode)) == 0);
+    if (cache_hit) {
+      UVC_CTRL_LOG("Cached state of %04X:%04X, PROBE is skipped", cache_key.idVendor, cache_key.idProduct);
+      ProbeParams = cached.commit;
+    }
+
+    // Pipe is opened when the alt setting is selected
     if (VIDEO_Handle->camera.supported == 1) {
       VIDEO_Handle->camera.Pipe = USBH_AllocPipe(phost, VIDEO_Handle->camera.Ep);
-
-      /* Open pipe for IN endpoint */
-      USBH_OpenPipe(phost, VIDEO_Handle->camera.Pipe, VIDEO_Handle->camera.Ep, phost->device.address, phost->device.speed, USB_EP_TYPE_ISOC,
-                    VIDEO_Handle->camera.EpSize);
-
-      USBH_LL_SetToggle(phost, VIDEO_Handle->camera.Pipe, 0);
+#if UVC_ISOC_PINGPONG
+      VIDEO_Handle->camera.PongPipe = USBH_AllocPipe(phost, VIDEO_Handle->camera.Ep);
+      if (VIDEO_Handle->camera.PongPipe == 0xFF) {
+        UVC_ISOC_ERR("No host channel for ping-pong transfers");
+        VIDEO_Handle->camera.PongPipe = 0;
+      }
+#endif
     }
 
     VIDEO_Handle->req_state = VIDEO_REQ_INIT;
     VIDEO_Handle->control_state = VIDEO_CONTROL_INIT;
 
+    video_startup_set_device(phost->device.DevDesc.idVendor, phost->device.DevDesc.idProduct);
+    video_startup_mark(VIDEO_STARTUP_CLASS_INIT);
     status = USBH_OK;
   }
   return status;
 }
 
+/**
+ * @brief  Fill "ProbeParams" with the PROBE state requested for "mode".
+ * @param  VIDEO_Handle: VIDEO handle
+ * @param  mode: Selected mode
+ * @retval None
+ */
+static void USBH_VIDEO_RequestProbe(VIDEO_HandleTypeDef *VIDEO_Handle, const VIDEO_ModeTypeDef *mode) {
+  memset(&ProbeParams, 0, sizeof(ProbeParams));
+  // Set needed params, at commit stage this parameters must be receied during "GET_CUR"
+  ProbeParams.bmHint = 1;
+  ProbeParams.bFormatIndex = mode->bFormatIndex;
+  ProbeParams.bFrameIndex = mode->bFrameIndex;
+  ProbeParams.dwMaxVideoFrameSize = mode->frame_size;
+  ProbeParams.dwMaxPayloadTransferSize = VIDEO_Handle->camera.XferSize;
+
+  // Frame rate of the selected mode, see USBH_VIDEO_Mode_Constraints
+  ProbeParams.dwFrameInterval = mode->interval;
+}
+
+/**
+ * @brief  USBH_VIDEO_SelectAltSetting
+ *         Select the streaming alt setting with the smallest isochronous bandwidth that still
+ *         carries "payload_size" bytes per (micro)frame. Biggest one is selected if
+ *         "payload_size" is 0 (not negotiated yet) or no alt setting is big enough.
+ *         Pipes are not touched, USBH_VIDEO_OpenPipes opens them for the selected endpoint.
+ * @param  phost: Host handle
+ * @param  payload_size: dwMaxPayloadTransferSize returned by the camera
+ * @retval 1 if an alt setting was selected
+ */
+uint8_t USBH_VIDEO_SelectAltSetting(USBH_HandleTypeDef *phost, uint32_t payload_size) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  int best = -1;
+  int biggest = -1;
+  uint16_t best_size = 0;
+  uint16_t biggest_size = 0;
+
+  for (int index = 0; index < VIDEO_MAX_VIDEO_STD_INTERFACE; index++) {
+    VIDEO_STREAMING_IN_HandleTypeDef *stream = &VIDEO_Handle->stream_in[index];
+    if (stream->valid != 1)
+      continue;
+
+    // High-bandwidth endpoints deliver up to 3 transactions per microframe
+    uint16_t ep_packet = UVC_EP_PACKET_SIZE(stream->EpSize);
+    uint8_t ep_mult = (phost->device.speed == USBH_SPEED_HIGH) ? UVC_EP_MULT(stream->EpSize) : 1;
+    uint16_t ep_size = (uint16_t) (ep_packet * ep_mult);
+    UVC_ISOC_LOG("Alt setting %d: wMaxPacketSize 0x%04X, %d x %d = %d bytes", stream->AltSettings, stream->EpSize, ep_mult, ep_packet, ep_size);
+
+    if ((ep_size > UVC_RX_FIFO_SIZE_LIMIT) || (ep_mult > UVC_ISOC_MAX_MULT))
+      continue;
+
+    if (ep_size > biggest_size) {
+      biggest = index;
+      biggest_size = ep_size;
+    }
+    if ((payload_size != 0) && (ep_size >= payload_size) && ((best < 0) || (ep_size < best_size))) {
+      best = index;
+      best_size = ep_size;
+    }
+  }
+
+  if (best < 0) {
+    if ((payload_size != 0) && (biggest >= 0)) {
+      UVC_ISOC_ERR("No alt setting for %lu bytes payload, using %d bytes", (unsigned long) payload_size, biggest_size);
+    }
+    best = biggest;
+    best_size = biggest_size;
+  }
+  if (best < 0)
+    return 0;
+
+  VIDEO_STREAMING_IN_HandleTypeDef *stream = &VIDEO_Handle->stream_in[best];
+  VIDEO_Handle->camera.interface = stream->interface;
+  VIDEO_Handle->camera.AltSettings = stream->AltSettings;
+  VIDEO_Handle->camera.Ep = stream->Ep;
+  VIDEO_Handle->camera.EpSize = stream->EpSize;
+  VIDEO_Handle->camera.XferSize = best_size;
+  VIDEO_Handle->camera.Poll = stream->Poll;
+  // Isochronous bInterval is an exponent: 2^(bInterval - 1) (micro)frames
+  VIDEO_Handle->camera.interval = (uint16_t) (1U << (((stream->Poll >= 1) && (stream->Poll <= 16)) ? (stream->Poll - 1) : 0));
+  VIDEO_Handle->camera.pingpong = (UVC_ISOC_PINGPONG && (VIDEO_Handle->camera.PongPipe != 0) && (VIDEO_Handle->camera.interval == 1)) ? 1 : 0;
+  VIDEO_Handle->camera.supported = 1;
+  UVC_ISOC_LOG("Selected alt setting %d: %d bytes per transfer, payload %lu bytes", stream->AltSettings, best_size,
+               (unsigned long) payload_size);
+  return 1;
+}
+
+/**
+ * @brief  USBH_VIDEO_PipeHook
+ *         Called from the OTG interrupt when the isochronous URB state changes.
+ *         Host thread is woken up only for the video pipe events, "USBH_VIDEO_InputStream"
+ *         runs when a packet has landed.
+ *         With UVC_ISR_FAST_PATH the packet is handled here and the host thread is woken up
+ *         only when a frame is completed or a packet is lost.
+ *         Completion time is taken here: "phost->Timer" to count missed (micro)frames and the bus frame
+ *         number for the camera clock, "phost->Timer" loses the SOFs whose interrupts were coalesced.
+ * @param  phost: Host handle
+ * @param  pipe: Pipe index
+ * @param  urb_state: New URB state
+ * @param  context: VIDEO handle
+ * @retval 1 - event is handled
+ */
+static uint8_t USBH_VIDEO_PipeHook(USBH_HandleTypeDef *phost, uint8_t pipe, USBH_URBStateTypeDef urb_state, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) context;
+  uint8_t index = (pipe == VIDEO_Handle->camera.Pipe) ? 0 : (UVC_ISOC_URBS - 1);
+
+  VIDEO_Handle->camera.urb_timer[index] = phost->Timer;
+  VIDEO_Handle->camera.urb_frame[index] = USBH_LL_GetCurrentFrame(phost);
+#if UVC_ISR_FAST_PATH
+  if (VIDEO_Handle->steam_in_state == VIDEO_STATE_DATA_IN) {
+    int event = USBH_VIDEO_HandleURB(phost, VIDEO_Handle, index, urb_state);
+    if (event == 0)
+      return 1;
+    __atomic_fetch_add((event > 0) ? &VIDEO_Handle->camera.frame_events : &VIDEO_Handle->camera.lost_events, 1, __ATOMIC_RELEASE);
+  } else
+#endif
+  {
+    (void) urb_state;
+    __atomic_fetch_add(&VIDEO_Handle->camera.urb_events[index], 1, __ATOMIC_RELEASE);
+  }
+#if (USBH_USE_OS == 1U)
+  uint32_t msg = (uint32_t) USBH_URB_EVENT;
+#if (osCMSIS < 0x20000U)
+  (void) osMessagePut(phost->os_event, msg, 0U);
+#else
+  (void) osMessageQueuePut(phost->os_event, &msg, 0U, 0U);
+#endif
+#else
+  (void) phost;
+#endif
+  return 1;
+}
+
 /**
  * @brief  USBH_VIDEO_InterfaceDeInit
  *         The function DeInit the Pipes used for the Video class.
@@ -150,11 +308,22 @@ static USBH_StatusTypeDef USBH_VIDEO_InterfaceInit(USBH_HandleTypeDef *phost) {
 USBH_StatusTypeDef USBH_VIDEO_InterfaceDeInit(USBH_HandleTypeDef *phost) {
   VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
 
+  // Init failed before the handle was allocated (no VIDEO CONTROL interface)
+  if (VIDEO_Handle == NULL)
+    return USBH_OK;
+
   if (VIDEO_Handle->camera.Pipe != 0x00) {
+    USBH_LL_RegisterChannelHook(phost, VIDEO_Handle->camera.Pipe, NULL, NULL);
     USBH_ClosePipe(phost, VIDEO_Handle->camera.Pipe);
     USBH_FreePipe(phost, VIDEO_Handle->camera.Pipe);
     VIDEO_Handle->camera.Pipe = 0; /* Reset the pipe as Free */
   }
+  if (VIDEO_Handle->camera.PongPipe != 0x00) {
+    USBH_LL_RegisterChannelHook(phost, VIDEO_Handle->camera.PongPipe, NULL, NULL);
+    USBH_ClosePipe(phost, VIDEO_Handle->camera.PongPipe);
+    USBH_FreePipe(phost, VIDEO_Handle->camera.PongPipe);
+    VIDEO_Handle->camera.PongPipe = 0;
+  }
 
   if (phost->pActiveClass->pData) {
     USBH_free(phost->pActiveClass->pData);
@@ -173,20 +342,11 @@ USBH_StatusTypeDef USBH_VIDEO_InterfaceDeInit(USBH_HandleTypeDef *phost) {
 static USBH_StatusTypeDef USBH_VIDEO_ClassRequest(USBH_HandleTypeDef *phost) {
   VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
   USBH_StatusTypeDef status = USBH_BUSY;
-  USBH_StatusTypeDef req_status = USBH_BUSY;
 
   /* Switch VIDEO REQ state machine */
   switch (VIDEO_Handle->req_state) {
     case VIDEO_REQ_INIT:
-    case VIDEO_REQ_SET_DEFAULT_IN_INTERFACE:
-      if (VIDEO_Handle->camera.supported == 1) {
-        req_status = USBH_SetInterface(phost, VIDEO_Handle->camera.interface, 0);
-
-        if (req_status == USBH_OK) {
-          VIDEO_Handle->req_state = VIDEO_REQ_SET_IN_INTERFACE;
-        }
-      } else {
-        VIDEO_Handle->req_state = VIDEO_REQ_SET_DEFAULT_IN_INTERFACE; 
+      if (VIDEO_Handle->camera.supported != 1) {
 #if (USBH_USE_OS == 1)
         phost->os_msg = (uint32_t) USBH_URB_EVENT;
 #if (osCMSIS < 0x20000U)
@@ -195,27 +355,43 @@ static USBH_StatusTypeDef USBH_VIDEO_ClassRequest(USBH_HandleTypeDef *phost) {
         (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
 #endif
 #endif
+        break;
       }
-      break;
+#if (UVC_FAST_START == 0U)
+      // Streaming interface is at alt setting 0 after SET_CONFIGURATION, it is selected again for the cameras that need it
+      if (USBH_VIDEO_QueueSetInterface(phost, 0, NULL, NULL) != USBH_OK)
+        break;
+#endif
+      VIDEO_Handle->req_state = VIDEO_REQ_CS_REQUESTS;
+      // fall through
 
+    // Control table is queried before the stream is started
     case VIDEO_REQ_CS_REQUESTS:
-      if (USBH_VIDEO_HandleCSRequest(phost) == USBH_OK) {
-        VIDEO_Handle->req_state = VIDEO_REQ_SET_IN_INTERFACE;
-      }
-      break;
-
-    case VIDEO_REQ_SET_IN_INTERFACE:
-      if (VIDEO_Handle->camera.supported == 1) {
-        req_status = USBH_SetInterface(phost, VIDEO_Handle->camera.interface, VIDEO_Handle->camera.AltSettings);
+      if (USBH_VIDEO_HandleCSRequest(phost) != USBH_OK)
+        break;
+      VIDEO_Handle->req_state = VIDEO_REQ_PROBE;
+      // fall through
 
-        if (req_status == USBH_OK) {
-          VIDEO_Handle->req_state = VIDEO_REQ_IDLE;
-          VIDEO_Handle->steam_in_state = VIDEO_STATE_START_IN;
-        }
-      } else {
-        VIDEO_Handle->req_state = VIDEO_REQ_SET_IN_INTERFACE;
+    // PROBE/COMMIT is done with alt setting 0, then the camera reports the payload size
+    // and the smallest alt setting that carries it is selected, see USBH_VIDEO_QueueNegotiation.
+    case VIDEO_REQ_RESUME:
+    case VIDEO_REQ_PROBE:
+      VIDEO_Handle->negotiation_retries = UVC_NEGOTIATION_RETRIES;
+      VIDEO_Handle->negotiated = 0;
+      if (USBH_VIDEO_QueueNegotiation(phost) != USBH_OK) {
+        break;  // queue is full, retried when the queued requests are done
+      }
+      VIDEO_Handle->req_state = VIDEO_REQ_PROBE_WAIT;
+      // First request is started now
+      // fall through
+
+    case VIDEO_REQ_PROBE_WAIT:
+      if (video_ctrl_process(phost, &VIDEO_Handle->ctrl) == USBH_OK) {
+        VIDEO_Handle->req_state = VIDEO_REQ_IDLE;
+        // Without a committed state the stream stays stopped, USBH_UVC_VIDEO_RESUME negotiates it again
+        VIDEO_Handle->steam_in_state = VIDEO_Handle->negotiated ? VIDEO_STATE_START_IN : VIDEO_STATE_SUPEND;
 #if (USBH_USE_OS == 1)
-        phost->os_msg = (uint32_t) USBH_URB_EVENT;
+        phost->os_msg = (uint32_t) USBH_CLASS_EVENT;
 #if (osCMSIS < 0x20000U)
         (void) osMessagePut(phost->os_event, phost->os_msg, 0U);
 #else
@@ -236,22 +412,8 @@ static USBH_StatusTypeDef USBH_VIDEO_ClassRequest(USBH_HandleTypeDef *phost) {
       (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
 #endif
 #endif
-    case VIDEO_REQ_RESUME:
-      USBH_VS_SetCur(phost, VS_PROBE_CONTROL << 8);
-      USBH_VS_GetCur(phost, VS_PROBE_CONTROL << 8);
-      USBH_VS_SetCur(phost, VS_COMMIT_CONTROL << 8);
-      VIDEO_Handle->req_state = VIDEO_REQ_IDLE;
-      VIDEO_Handle->steam_in_state = VIDEO_STATE_START_IN;
-
-      // #if (USBH_USE_OS == 1)
-      //       phost->os_msg = (uint32_t) USBH_URB_EVENT;
-      // #if (osCMSIS < 0x20000U)
-      //       (void) osMessagePut(phost->os_event, phost->os_msg, 0U);
-      // #else
-      //       (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-      // #endif
-      // #endif
       break;
+
     default:
       break;
   }
@@ -260,35 +422,52 @@ static USBH_StatusTypeDef USBH_VIDEO_ClassRequest(USBH_HandleTypeDef *phost) {
 
 /**
  * @brief  USBH_VIDEO_CSRequest
- *         The function is responsible for handling AC Specific requests for a specific feature and channel
- *         for Video class.
+ *         Queue a class specific request of a control of the VideoControl interface
+ *         (Camera Terminal, Processing Unit, Extension Unit). Can be called from any task.
  * @param  phost: Host handle
- * @retval USBH Status
+ * @param  request: UVC_SET_CUR, UVC_GET_CUR, UVC_GET_MIN ... UVC_GET_DEF
+ * @param  unit: bTerminalID or bUnitID of the entity
+ * @param  selector: Control selector
+ * @param  data: Value sent or received, "length" bytes, used until "done" is called
+ * @param  length: wLength, size of the control
+ * @param  done: Completion callback, called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued
  */
-static USBH_StatusTypeDef USBH_VIDEO_CSRequest(USBH_HandleTypeDef *phost, uint8_t feature, uint8_t channel) {
-  USBH_StatusTypeDef status = USBH_BUSY;
+USBH_StatusTypeDef USBH_VIDEO_CSRequest(USBH_HandleTypeDef *phost, uint8_t request, uint8_t unit, uint8_t selector, uint8_t *data, uint16_t length,
+                                        VIDEO_CtrlDoneTypeDef done, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  USB_Setup_TypeDef setup;
 
-  return status;
+  setup.b.bmRequestType = ((request & UVC_GET_) ? USB_D2H : USB_H2D) | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_CLASS;
+  setup.b.bRequest = request;
+  setup.b.wValue.w = (uint16_t) (selector << 8);
+  setup.b.wIndex.w = (uint16_t) ((unit << 8) | VIDEO_Handle->control_interface);
+  setup.b.wLength.w = length;
+
+  return video_ctrl_submit(&VIDEO_Handle->ctrl, &setup, data, done, context);
 }
 
 /**
  * @brief  USBH_VIDEO_HandleCSRequest
- *         The function is responsible for handling VC Specific requests for a all features
- *         and associated channels for Video class.
+ *         Query the control table of the camera (usbh_video_controls.h): GET_INFO and the ranges of
+ *         all controls, one after another through the control request queue.
+ *         With UVC_FAST_START the stream is started first, the table is queried by USBH_VIDEO_Process.
  * @param  phost: Host handle
- * @retval USBH Status
+ * @retval USBH_OK when all controls are queried, USBH_BUSY otherwise
  */
 static USBH_StatusTypeDef USBH_VIDEO_HandleCSRequest(USBH_HandleTypeDef *phost) {
-  USBH_StatusTypeDef status = USBH_BUSY;
-  USBH_StatusTypeDef cs_status = USBH_BUSY;
+#if (UVC_FAST_START == 1U)
+  return USBH_OK;
+#else
   VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
 
-  cs_status = USBH_VIDEO_CSRequest(phost, VIDEO_Handle->temp_feature, 0);
-
-  if (cs_status != USBH_BUSY) {
-  }
-
-  return status;
+  // Next query is queued by the completion of the last one
+  video_controls_query(phost);
+  if (video_ctrl_process(phost, &VIDEO_Handle->ctrl) != USBH_OK)
+    return USBH_BUSY;
+  return video_controls_query(phost);
+#endif
 }
 
 /**
@@ -302,8 +481,14 @@ USBH_StatusTypeDef USBH_VIDEO_Process(USBH_HandleTypeDef *phost) {
   USBH_StatusTypeDef status = USBH_OK;
   VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
 
+  // Requests submitted by the application while streaming (SUSPEND, controls), and the control table with UVC_FAST_START
+  video_controls_query(phost);
+  video_ctrl_process(phost, &VIDEO_Handle->ctrl);
+
   if (VIDEO_Handle->camera.supported == 1) {
+    DWT_PROF_BEGIN(DWT_PROF_VIDEO_INPUT);
     USBH_VIDEO_InputStream(phost);
+    DWT_PROF_END(DWT_PROF_VIDEO_INPUT);
   }
 
   return status;
@@ -316,40 +501,55 @@ USBH_StatusTypeDef USBH_VIDEO_Process(USBH_HandleTypeDef *phost) {
  */
 
 static USBH_StatusTypeDef USBH_VIDEO_InputStream(USBH_HandleTypeDef *phost) {
-  // Called from USB_HOST_fast_class_call
+  // Runs in the host thread, woken up by "USBH_VIDEO_PipeHook"
   USBH_StatusTypeDef status = USBH_BUSY;
   VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
-  USBH_URBStateTypeDef result;
 
   switch (VIDEO_Handle->steam_in_state) {
     case VIDEO_STATE_START_IN:
-      USBH_IsocReceiveData(phost, (uint8_t *) tmp_packet_framebuffer, UVC_RX_FIFO_SIZE_LIMIT, VIDEO_Handle->camera.Pipe);
+      VIDEO_Handle->camera.packets = 0;
+#if UVC_RECORD
+      USBH_VIDEO_RecordStream(phost, VIDEO_Handle);
+#endif
+      // State is changed first - with UVC_ISR_FAST_PATH the interrupt handles the URB as soon as it is done
       VIDEO_Handle->steam_in_state = VIDEO_STATE_DATA_IN;
+      for (uint8_t index = 0; index < USBH_VIDEO_URBS(VIDEO_Handle); index++) {
+        USBH_VIDEO_SubmitURB(phost, VIDEO_Handle, index);
+      }
       break;
 
     case VIDEO_STATE_DATA_IN:
-      result = USBH_LL_GetURBState(phost, VIDEO_Handle->camera.Pipe);
-      if ((result == USBH_URB_DONE) && ((phost->Timer - VIDEO_Handle->camera.timer) >= VIDEO_Handle->camera.Poll)) {
-        VIDEO_Handle->camera.timer = phost->Timer;
-        volatile uint32_t rxlen = USBH_LL_GetLastXferSize(phost, VIDEO_Handle->camera.Pipe);  // Return the last transfered packet size.
-        int ret = video_stream_process_packet((uint16_t) rxlen);
-        memset((void *) tmp_packet_framebuffer, 0, rxlen);
-        // if (ret == 1) {
-        //   USBH_UVC_VIDEO_SUSPEND(phost);
-        //   VIDEO_Handle->steam_in_state = VIDEO_STATE_SUPEND;
-        //   break;
-        // }
-        USBH_IsocReceiveData(phost, (uint8_t *) tmp_packet_framebuffer, UVC_RX_FIFO_SIZE_LIMIT, VIDEO_Handle->camera.Pipe);
-      } else {
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t) USBH_URB_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void) osMessagePut(phost->os_event, phost->os_msg, 0U);
+#if UVC_ISR_FAST_PATH
+      // Packets are handled in the OTG interrupt, only the events come here
+      if (__atomic_exchange_n(&VIDEO_Handle->camera.lost_events, 0, __ATOMIC_ACQUIRE) != 0) {
+        UVC_ISOC_DBG("URB errors: %lu", (unsigned long) VIDEO_Handle->camera.urb_errors);
+      }
+      if (__atomic_exchange_n(&VIDEO_Handle->camera.frame_events, 0, __ATOMIC_ACQUIRE) != 0) {
+        UVC_ISOC_DBG("missed (micro)frames %lu, URB errors %lu", (unsigned long) video_stats_live.missed_uframes,
+                     (unsigned long) VIDEO_Handle->camera.urb_errors);
+        video_stream_deliver_frame();
+      }
 #else
-        (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      // URBs are handled in the order they were completed. Nothing has landed yet if the
+      // host thread was woken up by another event.
+      for (;;) {
+        int index = -1;
+        for (uint8_t i = 0; i < USBH_VIDEO_URBS(VIDEO_Handle); i++) {
+          if (__atomic_load_n(&VIDEO_Handle->camera.urb_events[i], __ATOMIC_ACQUIRE) == 0)
+            continue;
+          if ((index < 0) || ((int32_t) (VIDEO_Handle->camera.urb_timer[i] - VIDEO_Handle->camera.urb_timer[index]) < 0))
+            index = i;
+        }
+        if (index < 0)
+          break;
+
+        __atomic_store_n(&VIDEO_Handle->camera.urb_events[index], 0, __ATOMIC_RELAXED);
+        if (USBH_VIDEO_HandleURB(phost, VIDEO_Handle, (uint8_t) index, USBH_LL_GetURBState(phost, USBH_VIDEO_PIPE(VIDEO_Handle, index))) > 0) {
+          UVC_ISOC_DBG("missed (micro)frames %lu, URB errors %lu", (unsigned long) video_stats_live.missed_uframes,
+                       (unsigned long) VIDEO_Handle->camera.urb_errors);
+        }
       }
+#endif
       break;
     case VIDEO_STATE_ERROR:
       VIDEO_Handle->req_state = VIDEO_REQ_INIT;
@@ -372,97 +572,577 @@ static USBH_StatusTypeDef USBH_VIDEO_SOFProcess(USBH_HandleTypeDef *phost) {
   return USBH_OK;
 }
 
+/**
+ * @brief  Submit the next URB of the isochronous channel.
+ *         One channel: URB goes to the place selected by the parser (framebuffer write cursor in zero-copy mode).
+ *         Ping-pong: URB goes to the staging buffer of the channel and waits for the next (micro)frame of its parity.
+ * @param  phost: Host handle
+ * @param  VIDEO_Handle: VIDEO handle
+ * @param  index: Channel index
+ * @retval None
+ */
+static void USBH_VIDEO_SubmitURB(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle, uint8_t index) {
+  uint16_t size = VIDEO_Handle->camera.XferSize;
+  uint8_t *buf = VIDEO_Handle->camera.pingpong ? video_stream_rx_staging(index) : video_stream_rx_buffer(size);
+
+  VIDEO_Handle->camera.urb_buf[index] = buf;
+  USBH_IsocReceiveData(phost, buf, size, USBH_VIDEO_PIPE(VIDEO_Handle, index));
+}
+
+#if UVC_RECORD
+/**
+ * @brief  Stream parameters for the record log, written before the first URB is submitted.
+ * @param  phost: Host handle
+ * @param  VIDEO_Handle: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_RecordStream(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle) {
+  VIDEO_HeaderDescTypeDef *header = VIDEO_Handle->class_desc.cs_desc.HeaderDesc;
+  VIDEO_RecordStreamTypeDef stream = {0};
+
+  stream.high_speed = (phost->device.speed == USBH_SPEED_HIGH);
+  stream.format = (uint8_t) USBH_VIDEO_Target_Format;
+  stream.channels = (uint8_t) USBH_VIDEO_URBS(VIDEO_Handle);
+  stream.clock_hz = (header != NULL) ? LE32(header->dwClockFrequency) : 0;
+  stream.xfer_size = VIDEO_Handle->camera.XferSize;
+  stream.interval = VIDEO_Handle->camera.interval;
+  stream.frame_size = ProbeParams.dwMaxVideoFrameSize;
+  video_record_stream(&stream);
+}
+#endif
+
+/**
+ * @brief  Handle the URB of a video channel and submit the next one.
+ *         Isochronous timing is kept by the channel (odd/even frame), URB is handled as soon as it is done.
+ *         Called by the host thread or, with UVC_ISR_FAST_PATH, from the OTG interrupt.
+ * @param  phost: Host handle
+ * @param  VIDEO_Handle: VIDEO handle
+ * @param  index: Channel index
+ * @param  result: URB state of the channel
+ * @retval 1 - frame is completed, -1 - packet is lost, 0 - otherwise
+ */
+static int USBH_VIDEO_HandleURB(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle, uint8_t index, USBH_URBStateTypeDef result) {
+  int event = 0;
+
+  if (result == USBH_URB_IDLE)
+    return 0;  // still in flight
+
+  // Every service interval without a transfer between two URBs is a missed (micro)frame
+  uint32_t done = VIDEO_Handle->camera.urb_timer[index];
+  if ((VIDEO_Handle->camera.packets != 0) && (VIDEO_Handle->camera.interval != 0)) {
+    uint32_t intervals = (done - VIDEO_Handle->camera.timer) / VIDEO_Handle->camera.interval;
+    if (intervals > 1)
+      video_stats_live.missed_uframes += intervals - 1;
+  }
+  VIDEO_Handle->camera.timer = done;
+  VIDEO_Handle->camera.packets++;
+
+  if (result == USBH_URB_DONE) {
+    video_startup_mark(VIDEO_STARTUP_FIRST_PACKET);
+    uint32_t rxlen = USBH_LL_GetLastXferSize(phost, USBH_VIDEO_PIPE(VIDEO_Handle, index));  // Return the last transfered packet size.
+    UVC_ISOC_DBG("URB done: %lu bytes", (unsigned long) rxlen);
+#if UVC_RECORD
+    // Recorded before parsing: in zero-copy mode the parser puts back the frame bytes under the header
+    video_record_urb(index, VIDEO_Handle->camera.urb_frame[index], VIDEO_RECORD_PACKET, VIDEO_Handle->camera.urb_buf[index], (uint16_t) rxlen);
+#endif
+    video_clock_packet_received(VIDEO_Handle->camera.urb_frame[index], phost->device.speed == USBH_SPEED_HIGH);
+    int processed = VIDEO_Handle->camera.pingpong ? video_stream_process_staged(index, (uint16_t) rxlen) : video_stream_process_packet((uint16_t) rxlen);
+    if (processed > 0)
+      event = 1;
+  } else if (result == USBH_URB_NOTREADY) {
+    // Transaction error the HAL retries: the channel is already re-enabled for the next (micro)frame,
+    // the packet of this one is lost but the URB is still in flight and must not be submitted again
+    VIDEO_Handle->camera.urb_errors++;
+    UVC_ISOC_DBG("URB retried");
+#if UVC_RECORD
+    video_record_urb(index, VIDEO_Handle->camera.urb_frame[index], VIDEO_RECORD_LOST, NULL, 0);
+#endif
+    video_stream_retry_packet();
+    return -1;
+  } else {
+    // Transaction error or missed frame, the packet is lost
+    VIDEO_Handle->camera.urb_errors++;
+    UVC_ISOC_DBG("URB state %d", result);
+#if UVC_RECORD
+    video_record_urb(index, VIDEO_Handle->camera.urb_frame[index], VIDEO_RECORD_LOST, NULL, 0);
+#endif
+    video_stream_drop_packet();
+    event = -1;
+  }
+
+  USBH_VIDEO_SubmitURB(phost, VIDEO_Handle, index);
+  return event;
+}
+
 //*****************************************************************************
 //*****************************************************************************
 
-USBH_StatusTypeDef USBH_VS_SetCur(USBH_HandleTypeDef *phost, uint16_t request_type) {
-  uint16_t wLength = 26;
+/**
+ * @brief  Queue SET_CUR of a VideoStreaming control, "ProbeParams" is sent when the request starts.
+ * @param  phost: Host handle
+ * @param  request_type: wValue, control selector << 8 (VS_PROBE_CONTROL, VS_COMMIT_CONTROL)
+ * @param  done: Completion callback, called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued
+ */
+USBH_StatusTypeDef USBH_VS_SetCur(USBH_HandleTypeDef *phost, uint16_t request_type, VIDEO_CtrlDoneTypeDef done, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  USB_Setup_TypeDef setup;
 
-  // H2D - host to device
-  phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_CLASS;
+  USBH_VS_Setup(VIDEO_Handle, UVC_SET_CUR, request_type, &setup);
+  return video_ctrl_submit(&VIDEO_Handle->ctrl, &setup, (uint8_t *) &ProbeParams, done, context);
+}
 
-  VIDEO_HandleTypeDef *VIDEO_Handle;
-  VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
-
-  phost->Control.setup.b.bRequest = UVC_SET_CUR;
-  phost->Control.setup.b.wValue.w = request_type;
-  phost->Control.setup.b.wIndex.w = VIDEO_Handle->camera.interface;  // Video Streaming interface number
-  phost->Control.setup.b.wLength.w = wLength;
-
-  USBH_StatusTypeDef status;
-  do {
-    status = USBH_CtlReq(phost, (uint8_t *) &ProbeParams, wLength);
-#if USBH_USE_OS == 1
-    osDelay(50);
-#endif
-  } while (status == USBH_BUSY);
+/**
+ * @brief  Queue GET_CUR of a VideoStreaming control.
+ * @param  phost: Host handle
+ * @param  request_type: wValue, control selector << 8 (VS_PROBE_CONTROL, VS_COMMIT_CONTROL)
+ * @param  probe: Received state, cleared now, valid when "done" is called with USBH_OK
+ * @param  done: Completion callback, called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued
+ */
+USBH_StatusTypeDef USBH_VS_GetCur(USBH_HandleTypeDef *phost, uint16_t request_type, VIDEO_ProbeTypedef *probe, VIDEO_CtrlDoneTypeDef done,
+                                  void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  USB_Setup_TypeDef setup;
+
+  memset(probe, 0, sizeof(*probe));
+  USBH_VS_Setup(VIDEO_Handle, UVC_GET_CUR, request_type, &setup);
+  return video_ctrl_submit(&VIDEO_Handle->ctrl, &setup, (uint8_t *) probe, done, context);
+}
+
+/**
+ * @brief  Setup packet of a VideoStreaming control request with the PROBE state as data.
+ * @param  VIDEO_Handle: VIDEO handle
+ * @param  request: UVC_SET_CUR (host to device) or UVC_GET_CUR (device to host)
+ * @param  request_type: wValue, control selector << 8 (VS_PROBE_CONTROL, VS_COMMIT_CONTROL)
+ * @param  setup: Setup packet
+ * @retval None
+ */
+static void USBH_VS_Setup(VIDEO_HandleTypeDef *VIDEO_Handle, uint8_t request, uint16_t request_type, USB_Setup_TypeDef *setup) {
+  setup->b.bmRequestType = ((request == UVC_SET_CUR) ? USB_H2D : USB_D2H) | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_CLASS;
+  setup->b.bRequest = request;
+  setup->b.wValue.w = request_type;
+  setup->b.wIndex.w = VIDEO_Handle->camera.interface;  // Video Streaming interface number
+  setup->b.wLength.w = 26;                              // UVC 1.0 size of the PROBE state
+}
+
+/**
+ * @brief  GET_CUR(PROBE) is done: the returned state is committed if it is valid, otherwise the
+ *         negotiation is started again.
+ * @param  phost: Host handle
+ * @param  status: Request status
+ * @param  context: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_ProbeDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) context;
+
+  UVC_CTRL_LOG("***Get Probe***");
+  print_Probe(VIDEO_Handle->probe_rx);
+  if ((status != USBH_OK) || (USBH_VIDEO_CheckProbe(&ProbeParams, &VIDEO_Handle->probe_rx) != USBH_OK)) {
+    UVC_CTRL_ERR("PROBE: status %d", status);
+    USBH_VIDEO_RetryNegotiation(phost, VIDEO_Handle);
+    return;
+  }
+  ProbeParams = VIDEO_Handle->probe_rx;
+  if (USBH_VS_SetCur(phost, VS_COMMIT_CONTROL << 8, USBH_VIDEO_CommitDone, VIDEO_Handle) != USBH_OK) {
+    UVC_CTRL_ERR("COMMIT is not queued");
+    USBH_VIDEO_RetryNegotiation(phost, VIDEO_Handle);
+  }
+}
+
+/**
+ * @brief  Queue the stream negotiation: SET_CUR(PROBE) and GET_CUR(PROBE), SET_CUR(COMMIT) is queued
+ *         by the GET_CUR completion when the camera returned a valid state.
+ *         Both PROBE requests are queued or none: a SET_CUR without its GET_CUR would change the camera
+ *         state with nobody waiting for the result.
+ *         A cached camera gets only SET_CUR(COMMIT) of its cached state.
+ * @param  phost: Host handle
+ * @retval USBH_OK if the requests are queued
+ */
+static USBH_StatusTypeDef USBH_VIDEO_QueueNegotiation(USBH_HandleTypeDef *phost) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (cache_hit)
+    return USBH_VS_SetCur(phost, VS_COMMIT_CONTROL << 8, USBH_VIDEO_CommitDone, VIDEO_Handle);
+
+  VIDEO_CtrlRequestTypeDef probe[2] = {
+      {.data = (uint8_t *) &ProbeParams},
+      {.data = (uint8_t *) &VIDEO_Handle->probe_rx, .done = USBH_VIDEO_ProbeDone, .context = VIDEO_Handle},
+  };
+  USBH_VS_Setup(VIDEO_Handle, UVC_SET_CUR, VS_PROBE_CONTROL << 8, &probe[0].setup);
+  USBH_VS_Setup(VIDEO_Handle, UVC_GET_CUR, VS_PROBE_CONTROL << 8, &probe[1].setup);
+  memset(&VIDEO_Handle->probe_rx, 0, sizeof(VIDEO_Handle->probe_rx));
+  return video_ctrl_submit_batch(&VIDEO_Handle->ctrl, probe, 2);
+}
 
+/**
+ * @brief  PROBE, COMMIT or queueing the SET_INTERFACE after it failed: the selected mode is negotiated again
+ *         from PROBE while attempts are left,
+ *         then the stream is not started (see VIDEO_REQ_PROBE_WAIT).
+ * @param  phost: Host handle
+ * @param  VIDEO_Handle: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_RetryNegotiation(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle) {
+  if (VIDEO_Handle->negotiation_retries != 0) {
+    VIDEO_Handle->negotiation_retries--;
+    USBH_VIDEO_RequestProbe(VIDEO_Handle, video_modes_selected());
+    if (USBH_VIDEO_QueueNegotiation(phost) == USBH_OK)
+      return;
+  }
+  UVC_CTRL_ERR("Stream is not negotiated, it is not started");
+}
+
+/**
+ * @brief  SET_CUR(COMMIT) is done: the alt setting for the committed payload size is selected and its
+ *         SET_INTERFACE is queued, the frame ring is carved for the committed frame size and the pipes are
+ *         opened, the stream is started when the queue is empty.
+ *         Committed state is cached; if the camera refuses COMMIT (of a cached state too) or SET_INTERFACE
+ *         can not be queued, it is negotiated again.
+ * @param  phost: Host handle
+ * @param  status: Request status
+ * @param  context: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_CommitDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) context;
+  const VIDEO_ModeTypeDef *mode = video_modes_selected();
+
+  video_startup_mark(VIDEO_STARTUP_COMMIT);
+  if (status != USBH_OK) {
+    UVC_CTRL_ERR("COMMIT: status %d", status);
+    if (cache_hit) {
+      cache_hit = 0;
+      video_cache_forget(&cache_key);
+    }
+    USBH_VIDEO_RetryNegotiation(phost, VIDEO_Handle);
+    return;
+  }
+  USBH_VIDEO_SelectAltSetting(phost, ProbeParams.dwMaxPayloadTransferSize);
+  if (USBH_VIDEO_QueueSetInterface(phost, VIDEO_Handle->camera.AltSettings, NULL, NULL) != USBH_OK) {
+    UVC_CTRL_ERR("SET_INTERFACE %d is not queued", VIDEO_Handle->camera.AltSettings);
+    USBH_VIDEO_RetryNegotiation(phost, VIDEO_Handle);
+    return;
+  }
+  VIDEO_Handle->negotiated = 1;
+  video_cache_store(&cache_key, mode, &ProbeParams);
+  // No frame is captured until the stream starts, the frame ring is carved for the committed frame size
+  video_stream_resize_buffers(ProbeParams.dwMaxVideoFrameSize);
+  USBH_VIDEO_OpenPipes(phost, VIDEO_Handle);
+}
+
+/**
+ * @brief  Queue SET_INTERFACE of the streaming interface.
+ * @param  phost: Host handle
+ * @param  alt_setting: Alt setting, 0 stops the stream
+ * @param  done: Completion callback, called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued
+ */
+static USBH_StatusTypeDef USBH_VIDEO_QueueSetInterface(USBH_HandleTypeDef *phost, uint8_t alt_setting, VIDEO_CtrlDoneTypeDef done, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  USB_Setup_TypeDef setup;
+
+  setup.b.bmRequestType = USB_H2D | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_STANDARD;
+  setup.b.bRequest = USB_REQ_SET_INTERFACE;
+  setup.b.wValue.w = alt_setting;
+  setup.b.wIndex.w = VIDEO_Handle->camera.interface;
+  setup.b.wLength.w = 0U;
+
+  return video_ctrl_submit(&VIDEO_Handle->ctrl, &setup, NULL, done, context);
+}
+
+/**
+ * @brief  Check the PROBE state returned by the camera (GET_CUR) before it is committed.
+ *         Camera may change the negotiable fields, but not the format and the frame.
+ * @param  request: PROBE state sent by SET_CUR
+ * @param  response: PROBE state returned by the camera
+ * @retval USBH_OK if the stream can be started with "response"
+ */
+USBH_StatusTypeDef USBH_VIDEO_CheckProbe(const VIDEO_ProbeTypedef *request, const VIDEO_ProbeTypedef *response) {
+  if ((response->bFormatIndex != request->bFormatIndex) || (response->bFrameIndex != request->bFrameIndex)) {
+    UVC_CTRL_ERR("PROBE: format %d, frame %d returned for format %d, frame %d", response->bFormatIndex, response->bFrameIndex,
+                 request->bFormatIndex, request->bFrameIndex);
+    return USBH_FAIL;
+  }
+  if ((response->dwMaxVideoFrameSize == 0) || (response->dwMaxPayloadTransferSize == 0)) {
+    UVC_CTRL_ERR("PROBE: frame size %lu, payload size %lu", (unsigned long) response->dwMaxVideoFrameSize,
+                 (unsigned long) response->dwMaxPayloadTransferSize);
+    return USBH_FAIL;
+  }
   return USBH_OK;
 }
 
-USBH_StatusTypeDef USBH_VS_GetCur(USBH_HandleTypeDef *phost, uint16_t request_type) {
-  memset(&ProbeParams, 0, sizeof(ProbeParams));
-  uint16_t wLength = 26;
+/**
+ * @brief  Stop the video stream: SET_INTERFACE with alt setting 0 of the streaming interface is queued.
+ *         Can be called from any task, stream state is VIDEO_STATE_SUPEND when the request is done.
+ * @param  phost: Host handle
+ * @retval USBH_OK if the request is queued
+ */
+USBH_StatusTypeDef USBH_UVC_VIDEO_SUSPEND(USBH_HandleTypeDef *phost) {
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL))
+    return USBH_FAIL;
 
-  // H2D - host to device
-  phost->Control.setup.b.bmRequestType = USB_D2H | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_CLASS;
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
 
-  VIDEO_HandleTypeDef *VIDEO_Handle;
-  VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
-
-  phost->Control.setup.b.bRequest = UVC_GET_CUR;
-  phost->Control.setup.b.wValue.w = request_type;
-  phost->Control.setup.b.wIndex.w = VIDEO_Handle->camera.interface;  // Video Streaming interface number
-  phost->Control.setup.b.wLength.w = wLength;
-
-  USBH_StatusTypeDef status;
-  do {
-    status = USBH_CtlReq(phost, (uint8_t *) &ProbeParams, wLength);
-#if USBH_USE_OS == 1
-    osDelay(50);
+  USBH_StatusTypeDef status = USBH_VIDEO_QueueSetInterface(phost, 0, USBH_VIDEO_SuspendDone, VIDEO_Handle);
+#if (USBH_USE_OS == 1U)
+  phost->os_msg = (uint32_t) USBH_CLASS_EVENT;
+#if (osCMSIS < 0x20000U)
+  (void) osMessagePut(phost->os_event, phost->os_msg, 0U);
+#else
+  (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
 #endif
-  } while (status == USBH_BUSY);
-  USBH_UsrLog("***Get Probe***\r\n");
-  print_Probe(ProbeParams);
-  if (status == USBH_OK) {
-    if (ProbeParams.dwMaxVideoFrameSize > 0) {
-      return USBH_OK;
-    } else
-      return USBH_FAIL;
+#endif
+  return status;
+}
+
+/**
+ * @brief  SET_INTERFACE(0) of USBH_UVC_VIDEO_SUSPEND is done, URBs are not resubmitted any more.
+ * @param  phost: Host handle
+ * @param  status: Request status
+ * @param  context: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_SuspendDone(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) context;
+
+  UVC_CTRL_LOG("usb video suspend:%d", status);
+  // Frame ring is carved again on resume, no URB may land in it any more
+  USBH_VIDEO_StopPipes(phost, VIDEO_Handle);
+}
+
+/**
+ * @brief  Stop the stream: URBs are not resubmitted any more, the channels are halted and the URBs
+ *         in flight are dropped. Pipes are opened again when the alt setting is selected.
+ * @param  phost: Host handle
+ * @param  VIDEO_Handle: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_StopPipes(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle) {
+  VIDEO_Handle->steam_in_state = VIDEO_STATE_SUPEND;
+  for (uint8_t index = 0; index < USBH_VIDEO_URBS(VIDEO_Handle); index++) {
+    USBH_ClosePipe(phost, USBH_VIDEO_PIPE(VIDEO_Handle, index));
   }
+}
 
-  return status;
+/**
+ * @brief  Open the isochronous pipes for the selected alt setting (USBH_VIDEO_SelectAltSetting):
+ *         the FIFOs are carved for its packet size and the channels are set up. Host task, while the
+ *         pipes are closed.
+ * @param  phost: Host handle
+ * @param  VIDEO_Handle: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_OpenPipes(USBH_HandleTypeDef *phost, VIDEO_HandleTypeDef *VIDEO_Handle) {
+  if (VIDEO_Handle->camera.Pipe == 0)
+    return;
+
+  USBH_FifoLayoutTypeDef layout;
+  uint8_t ep_mult = (phost->device.speed == USBH_SPEED_HIGH) ? UVC_EP_MULT(VIDEO_Handle->camera.EpSize) : 1;
+  if (USBH_LL_SetFifoLayout(phost, UVC_EP_PACKET_SIZE(VIDEO_Handle->camera.EpSize), ep_mult, 0, &layout) == USBH_OK) {
+    UVC_ISOC_LOG("FIFO words: RX %d, NPTX %d, PTX %d, total %d", layout.rx, layout.nptx, layout.ptx, layout.total);
+  } else {
+    UVC_ISOC_ERR("FIFO is too small for %d bytes per transfer", VIDEO_Handle->camera.XferSize);
+  }
+
+  /* Open pipes for IN endpoint, with ping-pong the channels take even and odd (micro)frames */
+  for (uint8_t index = 0; index < USBH_VIDEO_URBS(VIDEO_Handle); index++) {
+    uint8_t pipe = USBH_VIDEO_PIPE(VIDEO_Handle, index);
+    USBH_OpenPipe(phost, pipe, VIDEO_Handle->camera.Ep, phost->device.address, phost->device.speed, USB_EP_TYPE_ISOC, VIDEO_Handle->camera.EpSize);
+
+    USBH_LL_SetToggle(phost, pipe, 0);
+    if (VIDEO_Handle->camera.pingpong) {
+      USBH_LL_SetFrameParity(phost, pipe, (index == 0) ? USBH_FRAME_EVEN : USBH_FRAME_ODD);
+    }
+    VIDEO_Handle->camera.urb_events[index] = 0;
+    USBH_LL_RegisterChannelHook(phost, pipe, USBH_VIDEO_PipeHook, VIDEO_Handle);
+  }
+  UVC_ISOC_LOG("Interval %d, %s", VIDEO_Handle->camera.interval, VIDEO_Handle->camera.pingpong ? "ping-pong channels" : "one channel");
 }
 
-USBH_StatusTypeDef USBH_UVC_VIDEO_SUSPEND(USBH_HandleTypeDef *phost) {
-  VIDEO_HandleTypeDef *VIDEO_Handle;
-  VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+/**
+ * @brief  Take a snapshot of the streaming statistics.
+ *         Can be called from any task, the capture is never blocked by it.
+ * @param  phost: Host handle
+ * @param  stats: Snapshot of the counters
+ * @retval USBH_OK, USBH_FAIL if the VIDEO class is not active on this host
+ */
+USBH_StatusTypeDef USBH_VIDEO_GetStats(USBH_HandleTypeDef *phost, VIDEO_StatsTypeDef *stats) {
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL)) {
+    memset(stats, 0, sizeof(*stats));
+    return USBH_FAIL;
+  }
 
-  phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_STANDARD;
+  video_stats_read(stats);
+  return USBH_OK;
+}
 
-  phost->Control.setup.b.bRequest = USB_REQ_SET_INTERFACE;
-  phost->Control.setup.b.wValue.w = 0;
-  phost->Control.setup.b.wIndex.w = 0;
-  phost->Control.setup.b.wLength.w = 0U;
+/**
+ * @brief  Read the startup timeline of the camera: connect, enumeration, PROBE/COMMIT and the first frame.
+ *         Can be called from any task, steps not done yet are not marked.
+ * @param  phost: Host handle
+ * @param  timeline: Copy of the timeline
+ * @retval USBH_OK, USBH_FAIL if the VIDEO class is not active on this host
+ */
+USBH_StatusTypeDef USBH_VIDEO_GetStartup(USBH_HandleTypeDef *phost, VIDEO_StartupTypeDef *timeline) {
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL)) {
+    memset(timeline, 0, sizeof(*timeline));
+    return USBH_FAIL;
+  }
+
+  video_startup_read(timeline);
+  return USBH_OK;
+}
+
+/**
+ * @brief  Tell whether the stream is stopped and stays stopped: no PROBE/COMMIT, alt setting selection or mode
+ *         switch is in progress and the isochronous pipes are closed. Can be called from any task. Work that
+ *         stalls the flash (erase, programming) waits until it is 1.
+ * @param  phost: Host handle
+ * @retval 1 if the stream is stopped or the VIDEO class is not active on this host, 0 otherwise
+ */
+uint8_t USBH_VIDEO_IsStopped(USBH_HandleTypeDef *phost) {
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL))
+    return 1;
+
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  // COMMIT is done before the alt setting is selected and the stream is started, the request state is IDLE
+  // only when all of it is done
+  if (__atomic_load_n(&VIDEO_Handle->req_state, __ATOMIC_ACQUIRE) != VIDEO_REQ_IDLE)
+    return 0;
+  if (__atomic_load_n(&VIDEO_Handle->switch_mode, __ATOMIC_ACQUIRE) != NULL)
+    return 0;
+
+  VIDEO_StreamStateTypeDef state = __atomic_load_n(&VIDEO_Handle->steam_in_state, __ATOMIC_RELAXED);
+  return ((state == VIDEO_STATE_SUPEND) || (state == VIDEO_STATE_ERROR)) ? 1U : 0U;
+}
 
-  USBH_StatusTypeDef status;
-  do {
-    status = USBH_CtlReq(phost, NULL, 0U);
-#if USBH_USE_OS == 1
-    osDelay(100);
+/**
+ * @brief  Switch the stream to another mode of the capability table (video_modes_table) without a USB reset.
+ *         Stream is stopped with SET_INTERFACE(0), the mode is negotiated with PROBE/COMMIT, the frame ring
+ *         is carved for its frame size and the stream is started at the alt setting for its payload size.
+ *         USBH_VIDEO_Target_Format follows the format of the mode. Frames of the previous mode that were not
+ *         taken are dropped; while the application holds a frame the frame ring keeps its layout.
+ *         Can be called from any task, video_modes_selected() returns the new mode once the stream is stopped.
+ * @param  phost: Host handle
+ * @param  bFormatIndex: Format of the mode
+ * @param  bFrameIndex: Frame of the mode
+ * @param  interval: Frame interval of the mode, 100 ns units, 0 - default interval of the frame
+ * @retval USBH_OK if the switch is started, USBH_BUSY while the stream is negotiated or another switch runs,
+ *         USBH_FAIL if the VIDEO class is not active, the camera has no such mode or its frames can not be
+ *         assembled (uncompressed frames bigger than UVC_FRAME_DATA_LIMIT)
+ */
+USBH_StatusTypeDef USBH_VIDEO_SwitchMode(USBH_HandleTypeDef *phost, uint8_t bFormatIndex, uint8_t bFrameIndex, uint32_t interval) {
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL))
+    return USBH_FAIL;
+
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  const VIDEO_ModeTypeDef *mode = video_modes_find(bFormatIndex, bFrameIndex, interval);
+  if (mode == NULL) {
+    UVC_CTRL_ERR("Switch: no mode %d/%d, interval %lu", bFormatIndex, bFrameIndex, (unsigned long) interval);
+    return USBH_FAIL;
+  }
+  if (!video_modes_assembled(mode)) {
+    UVC_CTRL_ERR("Switch: mode %d/%d: %lu bytes frames do not fit into the frame ring", bFormatIndex, bFrameIndex,
+                 (unsigned long) mode->frame_size);
+    return USBH_FAIL;
+  }
+  if (VIDEO_Handle->req_state != VIDEO_REQ_IDLE)
+    return USBH_BUSY;
+
+  const VIDEO_ModeTypeDef *idle = NULL;
+  if (!__atomic_compare_exchange_n(&VIDEO_Handle->switch_mode, &idle, mode, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return USBH_BUSY;
+
+  UVC_CTRL_LOG("Switch to mode %d/%d: %d x %d, interval %lu", mode->bFormatIndex, mode->bFrameIndex, mode->width, mode->height,
+               (unsigned long) mode->interval);
+  USBH_StatusTypeDef status = USBH_VIDEO_QueueSetInterface(phost, 0, USBH_VIDEO_SwitchStopped, VIDEO_Handle);
+  if (status != USBH_OK) {
+    __atomic_store_n(&VIDEO_Handle->switch_mode, NULL, __ATOMIC_RELEASE);
+    return status;
+  }
+#if (USBH_USE_OS == 1U)
+  phost->os_msg = (uint32_t) USBH_CLASS_EVENT;
+#if (osCMSIS < 0x20000U)
+  (void) osMessagePut(phost->os_event, phost->os_msg, 0U);
+#else
+  (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
+#endif
+#endif
+  return USBH_OK;
+}
+
+/**
+ * @brief  SET_INTERFACE(0) of USBH_VIDEO_SwitchMode is done: the channels are halted, the new mode is
+ *         selected and its negotiation is started by the class request state machine, as on resume.
+ * @param  phost: Host handle
+ * @param  status: Request status
+ * @param  context: VIDEO handle
+ * @retval None
+ */
+static void USBH_VIDEO_SwitchStopped(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) context;
+  const VIDEO_ModeTypeDef *mode = VIDEO_Handle->switch_mode;
+
+  if (status != USBH_OK) {
+    UVC_CTRL_ERR("Switch: SET_INTERFACE 0: status %d", status);
+  }
+
+  USBH_VIDEO_StopPipes(phost, VIDEO_Handle);
+
+  USBH_VIDEO_Target_Format = (USBH_VIDEO_TargetFormat_t) mode->format;
+  USBH_VIDEO_Best_bFormatIndex = mode->bFormatIndex;
+  USBH_VIDEO_Best_bFrameIndex = mode->bFrameIndex;
+  USBH_VIDEO_Best_dwDefaultFrameInterval = mode->interval;
+  video_modes_set_selected(mode);
+
+  // Negotiated from the biggest alt setting as after the connect, the pipes stay closed until COMMIT
+  USBH_VIDEO_SelectAltSetting(phost, 0);
+  USBH_VIDEO_RequestProbe(VIDEO_Handle, mode);
+
+  // Switched mode is cached under the constraints that name it, the cached mode is compared anyway.
+  // Key is made of the fields only, the same mode gives the same key after any switch or reconnect.
+  const VIDEO_ModeConstraintsTypeDef constraints = {
+      .formats = (uint8_t) (1U << mode->format),
+      .width = mode->width,
+      .height = mode->height,
+      .max_bandwidth = 0,
+      .max_frame_size = 0,
+      .min_fps_x100 = VIDEO_MODE_FPS_X100(mode->interval),
+  };
+  VIDEO_CacheEntryTypeDef cached;
+  video_cache_key(phost, &constraints, &cache_key);
+  cache_hit = (video_cache_lookup(&cache_key, &cached) == USBH_OK) && (memcmp(&cached.mode, mode, sizeof(*mode)) == 0);
+  if (cache_hit) {
+    UVC_CTRL_LOG("Cached state of mode %d/%d, PROBE is skipped", mode->bFormatIndex, mode->bFrameIndex);
+    ProbeParams = cached.commit;
+  }
+
+  __atomic_store_n(&VIDEO_Handle->switch_mode, NULL, __ATOMIC_RELEASE);
+  VIDEO_Handle->req_state = VIDEO_REQ_RESUME;
+  phost->gState = HOST_CLASS_REQUEST;
+#if (USBH_USE_OS == 1U)
+  phost->os_msg = (uint32_t) USBH_CLASS_EVENT;
+#if (osCMSIS < 0x20000U)
+  (void) osMessagePut(phost->os_event, phost->os_msg, 0U);
+#else
+  (void) osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
+#endif
 #endif
-  } while (status == USBH_BUSY);
-  USBH_UsrLog("usb video suspend:%d\r\n", status);
-  VIDEO_Handle->steam_in_state = VIDEO_STATE_SUPEND;
-  return status;
 }
 
 USBH_StatusTypeDef USBH_UVC_VIDEO_RESUME(USBH_HandleTypeDef *phost) {
-  VIDEO_HandleTypeDef *VIDEO_Handle;
-  VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL))
+    return USBH_FAIL;
+
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
   if (VIDEO_Handle->steam_in_state == VIDEO_STATE_SUPEND) {
     phost->gState = HOST_CLASS_REQUEST;
-    USBH_UsrLog("usb video resume\r\n");
+    UVC_CTRL_LOG("usb video resume");
     VIDEO_Handle->req_state = VIDEO_REQ_RESUME;
 #if (USBH_USE_OS == 1U)
     phost->os_msg = (uint32_t) USBH_CLASS_EVENT;
@@ -477,19 +1157,19 @@ USBH_StatusTypeDef USBH_UVC_VIDEO_RESUME(USBH_HandleTypeDef *phost) {
 }
 
 void print_Probe(VIDEO_ProbeTypedef probe) {
-  USBH_UsrLog("bmHint: %x", probe.bmHint);
-  USBH_UsrLog("bFormatIndex: %d", probe.bFormatIndex);
-  USBH_UsrLog("bFrameIndex: %d", probe.bFrameIndex);
-  USBH_UsrLog("dwFrameInterval: %u", probe.dwFrameInterval);
-  USBH_UsrLog("wKeyFrameRate: %d", probe.wKeyFrameRate);
-  USBH_UsrLog("wPFrameRate: %d", probe.wPFrameRate);
-  USBH_UsrLog("wCompQuality: %d", probe.wCompQuality);
-  USBH_UsrLog("wCompWindowSize: %d", probe.wCompWindowSize);
-  USBH_UsrLog("wDelay: %d", probe.wDelay);
-  USBH_UsrLog("dwMaxVideoFrameSize: %u", probe.dwMaxVideoFrameSize);
-  USBH_UsrLog("dwMaxPayloadTransferSize: %u", probe.dwMaxPayloadTransferSize);
-  USBH_UsrLog("dwClockFrequency: %u", probe.dwClockFrequency);
-  USBH_UsrLog("bmFramingInfo: %u", probe.bmFramingInfo);
-  USBH_UsrLog("bMinVersion: %u", probe.bMinVersion);
-  USBH_UsrLog("bMaxVersion: %u", probe.bMaxVersion);
+  UVC_CTRL_LOG("bmHint: %x", probe.bmHint);
+  UVC_CTRL_LOG("bFormatIndex: %d", probe.bFormatIndex);
+  UVC_CTRL_LOG("bFrameIndex: %d", probe.bFrameIndex);
+  UVC_CTRL_LOG("dwFrameInterval: %u", probe.dwFrameInterval);
+  UVC_CTRL_LOG("wKeyFrameRate: %d", probe.wKeyFrameRate);
+  UVC_CTRL_LOG("wPFrameRate: %d", probe.wPFrameRate);
+  UVC_CTRL_LOG("wCompQuality: %d", probe.wCompQuality);
+  UVC_CTRL_LOG("wCompWindowSize: %d", probe.wCompWindowSize);
+  UVC_CTRL_LOG("wDelay: %d", probe.wDelay);
+  UVC_CTRL_LOG("dwMaxVideoFrameSize: %u", probe.dwMaxVideoFrameSize);
+  UVC_CTRL_LOG("dwMaxPayloadTransferSize: %u", probe.dwMaxPayloadTransferSize);
+  UVC_CTRL_LOG("dwClockFrequency: %u", probe.dwClockFrequency);
+  UVC_CTRL_LOG("bmFramingInfo: %u", probe.bmFramingInfo);
+  UVC_CTRL_LOG("bMinVersion: %u", probe.bMinVersion);
+  UVC_CTRL_LOG("bMaxVersion: %u", probe.bMaxVersion);
 }
@@ -0,0 +1,146 @@
+
+#include "usbh_video_bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "usbh_video_clock.h"
+#include "usbh_video_stream_parsing.h"
+
+#if UVC_BENCH
+
+// Packets timed together, keeps the clock reads out of the per-packet cost
+#define BENCH_BATCH 64
+
+// Lossy pattern, repeats every BENCH_PATTERN packets
+#define BENCH_PATTERN 1000
+#define BENCH_LOST    0x01
+#define BENCH_SHORT   0x02
+#define BENCH_ERR     0x04
+
+#define BENCH_CLOCK_HZ 48000000U
+
+extern USBH_VIDEO_TargetFormat_t USBH_VIDEO_Target_Format;
+
+const VIDEO_BenchCaseTypeDef video_bench_cases[] = {
+    {192, USBH_VIDEO_MJPEG, 15360, 0},   {512, USBH_VIDEO_MJPEG, 15360, 0},   {1024, USBH_VIDEO_MJPEG, 15360, 0},
+    {2048, USBH_VIDEO_MJPEG, 15360, 0},  {3072, USBH_VIDEO_MJPEG, 15360, 0},  {192, USBH_VIDEO_MJPEG, 15360, 1},
+    {512, USBH_VIDEO_MJPEG, 15360, 1},   {1024, USBH_VIDEO_MJPEG, 15360, 1},  {2048, USBH_VIDEO_MJPEG, 15360, 1},
+    {3072, USBH_VIDEO_MJPEG, 15360, 1},  {192, USBH_VIDEO_YUY2, 24576, 0},    {512, USBH_VIDEO_YUY2, 24576, 0},
+    {1024, USBH_VIDEO_YUY2, 24576, 0},   {2048, USBH_VIDEO_YUY2, 24576, 0},   {3072, USBH_VIDEO_YUY2, 24576, 0},
+    {192, USBH_VIDEO_YUY2, 24576, 1},    {512, USBH_VIDEO_YUY2, 24576, 1},    {1024, USBH_VIDEO_YUY2, 24576, 1},
+    {2048, USBH_VIDEO_YUY2, 24576, 1},   {3072, USBH_VIDEO_YUY2, 24576, 1},
+};
+const uint32_t video_bench_cases_num = sizeof(video_bench_cases) / sizeof(video_bench_cases[0]);
+
+static uint8_t bench_pattern[BENCH_PATTERN];
+
+// Same pattern on every run: 1% lost, 1% short, 0.1% ERR packets
+static void video_bench_make_pattern(uint8_t lossy) {
+  uint32_t x = 0x2545F491U;
+
+  memset(bench_pattern, 0, sizeof(bench_pattern));
+  if (!lossy)
+    return;
+  for (uint32_t i = 0; i < BENCH_PATTERN; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    uint32_t r = x % 1000U;
+    if (r < 10U)
+      bench_pattern[i] |= BENCH_LOST;
+    else if (r < 20U)
+      bench_pattern[i] |= BENCH_SHORT;
+    else if (r < 21U)
+      bench_pattern[i] |= BENCH_ERR;
+  }
+}
+
+void video_bench_run(const VIDEO_BenchCaseTypeDef *bench, uint32_t packets, const VIDEO_BenchClockTypeDef *clock, uint8_t *pool,
+                     VIDEO_BenchResultTypeDef *result) {
+  uint16_t max_data = bench->packet_size - UVC_HEADER_SIZE;
+  uint32_t frame_pos = 0;
+  uint32_t pts = 0;
+  uint8_t fid = 0;
+  uint32_t done = 0;
+
+  memset(result, 0, sizeof(*result));
+  video_bench_make_pattern(bench->lossy);
+  USBH_VIDEO_Target_Format = bench->format;
+  video_clock_init(BENCH_CLOCK_HZ);
+  video_stream_init_buffers(pool);
+
+  while (done < packets) {
+    uint32_t batch = ((packets - done) < BENCH_BATCH) ? (packets - done) : BENCH_BATCH;
+    uint32_t start = clock->ticks();
+
+    for (uint32_t i = 0; i < batch; i++, done++) {
+      uint8_t event = bench_pattern[done % BENCH_PATTERN];
+      uint8_t *packet = video_stream_rx_buffer(bench->packet_size);
+
+      uint32_t n = bench->frame_size - frame_pos;
+      if (n > max_data)
+        n = max_data;
+      if ((event & BENCH_SHORT) && (n > 1))
+        n /= 2;
+
+      uint8_t info = UVC_HEADER_EOH_BIT | UVC_HEADER_PTS_BIT | UVC_HEADER_SCR_BIT | fid;
+      frame_pos += n;
+      if (frame_pos == bench->frame_size) {
+        info |= UVC_HEADER_EOF_BIT;
+        frame_pos = 0;
+        fid ^= UVC_HEADER_FID_BIT;
+        pts += BENCH_CLOCK_HZ / 30U;
+      }
+      if (event & BENCH_ERR)
+        info |= UVC_HEADER_ERR_BIT;
+
+      if (event & BENCH_LOST) {
+        video_stream_drop_packet();
+        result->lost++;
+        continue;
+      }
+
+      uint32_t stc = pts + done;
+      uint16_t sof = (uint16_t) ((done >> 3) & UVC_HEADER_SCR_SOF_MASK);
+      packet[0] = UVC_HEADER_SIZE;
+      packet[1] = info;
+      memcpy(&packet[2], &pts, 4);
+      memcpy(&packet[6], &stc, 4);
+      memcpy(&packet[10], &sof, 2);
+
+      if (video_stream_process_packet((uint16_t) (UVC_HEADER_SIZE + n)) > 0) {
+        VIDEO_FrameTypeDef *frame = video_stream_get_frame();
+        if (frame != NULL) {
+          result->frames++;
+          video_stream_release_frame(frame);
+        }
+      }
+      result->bytes += UVC_HEADER_SIZE + n;
+    }
+    result->ticks += (uint32_t) (clock->ticks() - start);
+  }
+
+  result->packets = done;
+  if (result->ticks != 0) {
+    uint64_t ticks_per_packet_x1000 = (result->ticks * 1000U) / result->packets;
+    result->ns_per_packet_x10 = (uint32_t) ((ticks_per_packet_x1000 * 10000000U) / clock->hz);
+    result->mb_per_sec_x100 = (uint32_t) ((result->bytes * clock->hz / result->ticks) / 10000U);
+    result->frames_per_sec = (uint32_t) (((uint64_t) result->frames * clock->hz) / result->ticks);
+  }
+}
+
+void video_bench_run_all(uint32_t packets, const VIDEO_BenchClockTypeDef *clock, uint8_t *pool) {
+  VIDEO_BenchResultTypeDef result;
+
+  printf("bench: format packet stream   ns/packet      MB/s  frames/s  (%lu packets per case)\n", (unsigned long) packets);
+  for (uint32_t i = 0; i < video_bench_cases_num; i++) {
+    const VIDEO_BenchCaseTypeDef *bench = &video_bench_cases[i];
+    video_bench_run(bench, packets, clock, pool, &result);
+    printf("bench: %-6s %6u %-6s %7lu.%lu %7lu.%02lu %9lu\n", (bench->format == USBH_VIDEO_MJPEG) ? "MJPEG" : "YUY2", bench->packet_size,
+           bench->lossy ? "lossy" : "clean", (unsigned long) (result.ns_per_packet_x10 / 10), (unsigned long) (result.ns_per_packet_x10 % 10),
+           (unsigned long) (result.mb_per_sec_x100 / 100), (unsigned long) (result.mb_per_sec_x100 % 100), (unsigned long) result.frames_per_sec);
+  }
+}
+
+#endif
@@ -0,0 +1,320 @@
+// Cache of the negotiated streaming state of known cameras, see usbh_video_cache.h
+
+#include "usbh_video_cache.h"
+
+#include <string.h>
+
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_stream_parsing.h"
+#include "usbh_video_trace.h"
+
+// Storage record: magic, check (hash of the rest), flags, entry. Magic changes with the entry layout,
+// records of another layout make the block look full, it is erased by the next flush.
+#define VIDEO_CACHE_MAGIC        (0x55564300UL | (uint32_t) sizeof(VIDEO_CacheEntryTypeDef))
+#define VIDEO_CACHE_ERASED       0xFFFFFFFFUL
+#define VIDEO_CACHE_VALID        1UL  // entry is stored
+#define VIDEO_CACHE_DELETED      0UL  // entry of the key is dropped
+#define VIDEO_CACHE_ENTRY_WORDS  ((sizeof(VIDEO_CacheEntryTypeDef) + 3U) / 4U)
+#define VIDEO_CACHE_RECORD_WORDS (3U + VIDEO_CACHE_ENTRY_WORDS)
+
+typedef enum {
+  VIDEO_CACHE_SLOT_FREE = 0,
+  VIDEO_CACHE_SLOT_VALID,
+  VIDEO_CACHE_SLOT_DELETED,  // kept until the deletion is flushed
+} VIDEO_CacheSlotStateTypeDef;
+
+typedef struct {
+  VIDEO_CacheEntryTypeDef entry;
+  uint8_t state;             // VIDEO_CacheSlotStateTypeDef
+  uint32_t used;             // LRU stamp
+  volatile uint32_t seq;     // odd while the host task changes the slot
+  uint32_t flushed_seq;      // "seq" of the last flushed state, flush task only
+} VIDEO_CacheSlotTypeDef;
+
+static VIDEO_CacheSlotTypeDef cache_slots[UVC_CACHE_ENTRIES];
+static uint32_t cache_clock;  // LRU stamps
+
+static const VIDEO_CacheStorageTypeDef *cache_storage;
+static uint32_t cache_append;  // offset of the first free record of the storage
+
+// FNV-1a
+static uint32_t video_cache_hash(uint32_t hash, const void *data, uint32_t len) {
+  const uint8_t *p = (const uint8_t *) data;
+
+  for (uint32_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Value as 4 bytes, LSB first: keys do not depend on struct padding or byte order
+static uint32_t video_cache_hash_u32(uint32_t hash, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    hash ^= (uint8_t) (value >> (8 * i));
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+#define VIDEO_CACHE_HASH_INIT 2166136261UL
+
+void video_cache_key(USBH_HandleTypeDef *phost, const VIDEO_ModeConstraintsTypeDef *constraints, VIDEO_CacheKeyTypeDef *key) {
+  uint16_t cfg_len = phost->device.CfgDesc.wTotalLength;
+  uint32_t hash = VIDEO_CACHE_HASH_INIT;
+
+  if (cfg_len > USBH_MAX_SIZE_CONFIGURATION)
+    cfg_len = USBH_MAX_SIZE_CONFIGURATION;
+
+  memset(key, 0, sizeof(*key));
+  key->idVendor = phost->device.DevDesc.idVendor;
+  key->idProduct = phost->device.DevDesc.idProduct;
+  key->bcdDevice = phost->device.DevDesc.bcdDevice;
+  key->speed = phost->device.speed;
+  key->cfg_hash = video_cache_hash(VIDEO_CACHE_HASH_INIT, phost->device.CfgDesc_Raw, cfg_len);
+  // Zero constraints are replaced by the target settings, so both are hashed. Field by field, the padding
+  // of the constraints is whatever the caller left on the stack
+  hash = video_cache_hash_u32(hash, constraints->formats);
+  hash = video_cache_hash_u32(hash, constraints->width);
+  hash = video_cache_hash_u32(hash, constraints->height);
+  hash = video_cache_hash_u32(hash, constraints->max_bandwidth);
+  hash = video_cache_hash_u32(hash, constraints->max_frame_size);
+  hash = video_cache_hash_u32(hash, constraints->min_fps_x100);
+  hash = video_cache_hash_u32(hash, (uint32_t) USBH_VIDEO_Target_Format);
+  hash = video_cache_hash_u32(hash, (uint32_t) USBH_VIDEO_Target_Width);
+  hash = video_cache_hash_u32(hash, (uint32_t) USBH_VIDEO_Target_Height);
+  hash = video_cache_hash_u32(hash, (uint32_t) UVC_FRAME_DATA_LIMIT);
+  key->select_hash = hash;
+}
+
+// Slot of "key", with "deleted" also a slot where the key is dropped
+static VIDEO_CacheSlotTypeDef *video_cache_find(const VIDEO_CacheKeyTypeDef *key, uint8_t deleted) {
+  for (int i = 0; i < UVC_CACHE_ENTRIES; i++) {
+    VIDEO_CacheSlotTypeDef *slot = &cache_slots[i];
+    if ((slot->state == VIDEO_CACHE_SLOT_VALID) || (deleted && (slot->state == VIDEO_CACHE_SLOT_DELETED))) {
+      if (memcmp(&slot->entry.key, key, sizeof(*key)) == 0)
+        return slot;
+    }
+  }
+  return NULL;
+}
+
+// Slot for a new key: free one, then a deleted one that is flushed (or no storage), then the least recently used entry
+static VIDEO_CacheSlotTypeDef *video_cache_victim(void) {
+  VIDEO_CacheSlotTypeDef *lru = NULL;
+
+  for (int i = 0; i < UVC_CACHE_ENTRIES; i++) {
+    VIDEO_CacheSlotTypeDef *slot = &cache_slots[i];
+    if (slot->state == VIDEO_CACHE_SLOT_FREE)
+      return slot;
+    if ((slot->state == VIDEO_CACHE_SLOT_DELETED) && ((cache_storage == NULL) || (slot->seq == slot->flushed_seq)))
+      return slot;
+    if ((slot->state == VIDEO_CACHE_SLOT_VALID) && ((lru == NULL) || ((int32_t) (slot->used - lru->used) < 0)))
+      lru = slot;
+  }
+  return lru;
+}
+
+// Host task side of the slot seqlock
+static void video_cache_begin(VIDEO_CacheSlotTypeDef *slot) {
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void video_cache_end(VIDEO_CacheSlotTypeDef *slot) {
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+USBH_StatusTypeDef video_cache_lookup(const VIDEO_CacheKeyTypeDef *key, VIDEO_CacheEntryTypeDef *entry) {
+  VIDEO_CacheSlotTypeDef *slot = video_cache_find(key, 0);
+
+  if (slot == NULL)
+    return USBH_FAIL;
+  // LRU stamp is not flushed, the slot seqlock is not needed
+  slot->used = ++cache_clock;
+  *entry = slot->entry;
+  return USBH_OK;
+}
+
+// "loaded" - entry comes from the storage, it is flushed already.
+// USBH_BUSY if every slot holds a deletion that is not flushed yet, the entry is not kept.
+static USBH_StatusTypeDef video_cache_put(const VIDEO_CacheEntryTypeDef *entry, uint8_t loaded) {
+  // Slot where the key is dropped is reused, so a pending deletion is never flushed after the new entry
+  VIDEO_CacheSlotTypeDef *slot = video_cache_find(&entry->key, 1);
+
+  if (slot == NULL)
+    slot = video_cache_victim();
+  if (slot == NULL)
+    return USBH_BUSY;
+  video_cache_begin(slot);
+  slot->entry = *entry;
+  slot->state = VIDEO_CACHE_SLOT_VALID;
+  slot->used = ++cache_clock;
+  video_cache_end(slot);
+  if (loaded)
+    slot->flushed_seq = slot->seq;
+  return USBH_OK;
+}
+
+void video_cache_store(const VIDEO_CacheKeyTypeDef *key, const VIDEO_ModeTypeDef *mode, const VIDEO_ProbeTypedef *commit) {
+  VIDEO_CacheEntryTypeDef entry;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.key = *key;
+  entry.mode = *mode;
+  entry.commit = *commit;
+
+  // Same state again (reconnect of a cached camera) is not written to the storage again
+  VIDEO_CacheSlotTypeDef *slot = video_cache_find(key, 0);
+  if ((slot != NULL) && (memcmp(&slot->entry, &entry, sizeof(entry)) == 0)) {
+    slot->used = ++cache_clock;
+    return;
+  }
+  if (video_cache_put(&entry, 0) != USBH_OK) {
+    UVC_CTRL_ERR("Cache: %04X:%04X not stored, deletions are not flushed yet", key->idVendor, key->idProduct);
+    return;
+  }
+  UVC_CTRL_LOG("Cache: %04X:%04X stored", key->idVendor, key->idProduct);
+}
+
+void video_cache_forget(const VIDEO_CacheKeyTypeDef *key) {
+  VIDEO_CacheSlotTypeDef *slot = video_cache_find(key, 0);
+
+  if (slot == NULL)
+    return;
+  video_cache_begin(slot);
+  slot->state = VIDEO_CACHE_SLOT_DELETED;
+  video_cache_end(slot);
+  UVC_CTRL_LOG("Cache: %04X:%04X dropped", key->idVendor, key->idProduct);
+}
+
+void video_cache_clear(void) {
+  memset(cache_slots, 0, sizeof(cache_slots));
+  cache_clock = 0;
+}
+
+// Record of "entry" with "flags"
+static void video_cache_record(uint32_t *record, const VIDEO_CacheEntryTypeDef *entry, uint32_t flags) {
+  memset(record, 0, VIDEO_CACHE_RECORD_WORDS * 4U);
+  record[0] = VIDEO_CACHE_MAGIC;
+  record[2] = flags;
+  memcpy(&record[3], entry, sizeof(*entry));
+  record[1] = video_cache_hash(VIDEO_CACHE_HASH_INIT, &record[2], (VIDEO_CACHE_RECORD_WORDS - 2U) * 4U);
+}
+
+void video_cache_attach_storage(const VIDEO_CacheStorageTypeDef *storage) {
+  uint32_t record[VIDEO_CACHE_RECORD_WORDS];
+  uint32_t offset = 0;
+  uint32_t loaded = 0;
+
+  cache_storage = storage;
+  if (storage == NULL)
+    return;
+
+  for (; (offset + sizeof(record)) <= storage->size; offset += sizeof(record)) {
+    memcpy(record, storage->base + offset, sizeof(record));
+    if (record[0] == VIDEO_CACHE_ERASED)
+      break;
+    if (record[0] != VIDEO_CACHE_MAGIC) {
+      UVC_CTRL_ERR("Cache: unknown record at %lu, storage is rewritten by the next flush", (unsigned long) offset);
+      offset = storage->size;
+      break;
+    }
+    // Record torn by a reset while it was programmed
+    if (record[1] != video_cache_hash(VIDEO_CACHE_HASH_INIT, &record[2], (VIDEO_CACHE_RECORD_WORDS - 2U) * 4U))
+      continue;
+
+    VIDEO_CacheEntryTypeDef entry;
+    memcpy(&entry, &record[3], sizeof(entry));
+    if (record[2] == VIDEO_CACHE_VALID) {
+      (void) video_cache_put(&entry, 1);
+    } else {
+      VIDEO_CacheSlotTypeDef *slot = video_cache_find(&entry.key, 0);
+      if (slot != NULL)
+        slot->state = VIDEO_CACHE_SLOT_FREE;
+    }
+  }
+  cache_append = offset;
+  for (int i = 0; i < UVC_CACHE_ENTRIES; i++) {
+    if (cache_slots[i].state == VIDEO_CACHE_SLOT_VALID)
+      loaded++;
+  }
+  UVC_CTRL_LOG("Cache: %lu entries loaded, %lu of %lu bytes used", (unsigned long) loaded, (unsigned long) cache_append,
+               (unsigned long) storage->size);
+}
+
+uint32_t video_cache_dirty(void) {
+  uint32_t dirty = 0;
+
+  for (int i = 0; i < UVC_CACHE_ENTRIES; i++) {
+    if (__atomic_load_n(&cache_slots[i].seq, __ATOMIC_ACQUIRE) != cache_slots[i].flushed_seq)
+      dirty++;
+  }
+  return dirty;
+}
+
+// Consistent copy of a slot, returns its "seq"
+static uint32_t video_cache_snapshot(VIDEO_CacheSlotTypeDef *slot, VIDEO_CacheEntryTypeDef *entry, uint8_t *state) {
+  uint32_t seq;
+
+  do {
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    *entry = slot->entry;
+    *state = slot->state;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1U) || (seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED)));
+  return seq;
+}
+
+// Storage is full: erased and every valid entry is written again
+static USBH_StatusTypeDef video_cache_compact(void) {
+  uint32_t record[VIDEO_CACHE_RECORD_WORDS];
+
+  UVC_CTRL_LOG("Cache: storage is full, erased");
+  if (cache_storage->erase() != USBH_OK)
+    return USBH_FAIL;
+  cache_append = 0;
+  for (int i = 0; i < UVC_CACHE_ENTRIES; i++) {
+    VIDEO_CacheEntryTypeDef entry;
+    uint8_t state;
+    uint32_t seq = video_cache_snapshot(&cache_slots[i], &entry, &state);
+    if (state == VIDEO_CACHE_SLOT_VALID) {
+      video_cache_record(record, &entry, VIDEO_CACHE_VALID);
+      if (cache_storage->program(cache_append, record, VIDEO_CACHE_RECORD_WORDS) != USBH_OK)
+        return USBH_FAIL;
+      cache_append += sizeof(record);
+    }
+    cache_slots[i].flushed_seq = seq;
+  }
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef video_cache_flush(void) {
+  uint32_t record[VIDEO_CACHE_RECORD_WORDS];
+
+  if (cache_storage == NULL)
+    return USBH_FAIL;
+
+  for (int i = 0; i < UVC_CACHE_ENTRIES; i++) {
+    VIDEO_CacheSlotTypeDef *slot = &cache_slots[i];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == slot->flushed_seq)
+      continue;
+
+    VIDEO_CacheEntryTypeDef entry;
+    uint8_t state;
+    uint32_t seq = video_cache_snapshot(slot, &entry, &state);
+    if (state == VIDEO_CACHE_SLOT_FREE) {
+      slot->flushed_seq = seq;
+      continue;
+    }
+    if ((cache_append + sizeof(record)) > cache_storage->size)
+      return video_cache_compact();
+
+    video_cache_record(record, &entry, (state == VIDEO_CACHE_SLOT_VALID) ? VIDEO_CACHE_VALID : VIDEO_CACHE_DELETED);
+    if (cache_storage->program(cache_append, record, VIDEO_CACHE_RECORD_WORDS) != USBH_OK)
+      return USBH_FAIL;
+    cache_append += sizeof(record);
+    slot->flushed_seq = seq;
+  }
+  return USBH_OK;
+}
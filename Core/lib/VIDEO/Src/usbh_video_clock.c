@@ -0,0 +1,178 @@
+
+#include "usbh_video_clock.h"
+
+#include <string.h>
+
+#include "usbh_conf.h"
+#include "usbh_video_trace.h"
+
+// Microframes in the 11-bit USB frame number range
+#define VIDEO_CLOCK_MICROFRAMES_MASK 0x3FFF
+
+// SCR older than this (microframes) is not used - packet was delayed or SOF field is broken
+#define VIDEO_CLOCK_MAX_SCR_AGE (8 * 100)
+
+// Sample further than this from the current mapping means that camera clock was restarted
+#define VIDEO_CLOCK_MAX_ERROR_US 10000
+
+typedef struct {
+  // Host time
+  uint32_t cycles_per_us;
+  uint32_t last_cycles;
+  uint32_t cycles_rem;
+  uint32_t host_us;
+
+  // Last received packet
+  uint32_t packet_us;
+  uint16_t packet_microframe;
+
+  // SCR samples: camera STC and host time of the same USB frame
+  uint32_t stc[VIDEO_CLOCK_SAMPLES];
+  uint32_t host[VIDEO_CLOCK_SAMPLES];
+  uint32_t head;
+  uint32_t count;
+  uint16_t last_sof;
+
+  // host = ref_host + offset + slope * (device - ref_stc)
+  uint32_t ref_stc;
+  uint32_t ref_host;
+  float slope;  // microseconds per camera clock tick
+  float offset;
+
+  VIDEO_ClockStateTypeDef state;
+} VIDEO_ClockTypeDef;
+
+static VIDEO_ClockTypeDef video_clock;
+
+static void video_clock_reset_samples(void) {
+  video_clock.head = 0;
+  video_clock.count = 0;
+  video_clock.state.valid = false;
+  video_clock.state.samples = 0;
+}
+
+// Least-squares line through the samples, relative to the newest one and centered on the means to keep the numbers
+// small. Single precision only: the Cortex-M4F FPU has no double and with UVC_ISR_FAST_PATH this runs in the OTG
+// interrupt. Its error (about 1 ppm of the slope) is well below the 125 us jitter of the host time samples.
+static void video_clock_update(void) {
+  VIDEO_ClockTypeDef *clk = &video_clock;
+  uint32_t newest = (clk->head + VIDEO_CLOCK_SAMPLES - 1) % VIDEO_CLOCK_SAMPLES;
+  float sx = 0.0f, sy = 0.0f, sxx = 0.0f, sxy = 0.0f;
+
+  if (clk->count < 4)
+    return;
+
+  for (uint32_t i = 0; i < clk->count; i++) {
+    uint32_t index = (newest + VIDEO_CLOCK_SAMPLES - i) % VIDEO_CLOCK_SAMPLES;
+    sx += (float) (int32_t) (clk->stc[index] - clk->stc[newest]);
+    sy += (float) (int32_t) (clk->host[index] - clk->host[newest]);
+  }
+  float mx = sx / (float) clk->count;
+  float my = sy / (float) clk->count;
+  for (uint32_t i = 0; i < clk->count; i++) {
+    uint32_t index = (newest + VIDEO_CLOCK_SAMPLES - i) % VIDEO_CLOCK_SAMPLES;
+    float dx = (float) (int32_t) (clk->stc[index] - clk->stc[newest]) - mx;
+    float dy = (float) (int32_t) (clk->host[index] - clk->host[newest]) - my;
+    sxx += dx * dx;
+    sxy += dx * dy;
+  }
+
+  if (sxx <= 0.0f)
+    return;
+  float slope = sxy / sxx;
+  if (slope <= 0.0f)
+    return;
+
+  clk->ref_stc = clk->stc[newest];
+  clk->ref_host = clk->host[newest];
+  clk->slope = slope;
+  clk->offset = my - slope * mx;
+
+  clk->state.valid = true;
+  clk->state.samples = clk->count;
+  clk->state.measured_hz = (uint32_t) (1000000.0f / slope + 0.5f);
+  if (clk->state.clock_hz != 0) {
+    // Relative to the nominal clock, the difference of two ~1e7 values would lose the ppm in single precision
+    clk->state.drift_ppm = (int32_t) ((1000000.0f / (slope * (float) clk->state.clock_hz) - 1.0f) * 1000000.0f);
+  }
+}
+
+//****************************************************************************
+
+void video_clock_init(uint32_t clock_hz) {
+  memset(&video_clock, 0, sizeof(video_clock));
+  video_clock.state.clock_hz = clock_hz;
+  video_clock.cycles_per_us = SystemCoreClock / 1000000U;
+
+  // Start DWT cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  video_clock.last_cycles = VIDEO_CLOCK_HOST_CYCLES();
+
+  UVC_CLOCK_LOG("camera clock: %lu Hz", (unsigned long) clock_hz);
+}
+
+uint32_t video_clock_host_time_us(void) {
+  uint32_t cycles = VIDEO_CLOCK_HOST_CYCLES();
+
+  // Cycle counter wraps every few seconds, so elapsed time is accumulated
+  video_clock.cycles_rem += cycles - video_clock.last_cycles;
+  video_clock.last_cycles = cycles;
+  if (video_clock.cycles_per_us != 0) {
+    uint32_t us = video_clock.cycles_rem / video_clock.cycles_per_us;
+    video_clock.host_us += us;
+    video_clock.cycles_rem -= us * video_clock.cycles_per_us;
+  }
+  return video_clock.host_us;
+}
+
+void video_clock_packet_received(uint32_t frame_number, bool high_speed) {
+  video_clock.packet_us = video_clock_host_time_us();
+  video_clock.packet_microframe = (uint16_t) ((high_speed ? frame_number : (frame_number << 3)) & VIDEO_CLOCK_MICROFRAMES_MASK);
+}
+
+void video_clock_add_scr(uint32_t stc, uint16_t sof) {
+  VIDEO_ClockTypeDef *clk = &video_clock;
+
+  if ((clk->count != 0) && (((sof - clk->last_sof) & 0x7FF) < VIDEO_CLOCK_SAMPLE_PERIOD))
+    return;
+
+  // Host time of the USB frame "sof": packet arrival time minus microframes passed since then
+  uint16_t age = (clk->packet_microframe - (uint16_t) (sof << 3)) & VIDEO_CLOCK_MICROFRAMES_MASK;
+  if (age > VIDEO_CLOCK_MAX_SCR_AGE)
+    return;
+  uint32_t host = clk->packet_us - (uint32_t) age * 125U;
+
+  uint32_t expected;
+  if (video_clock_device_to_host(stc, &expected)) {
+    int32_t error = (int32_t) (host - expected);
+    if ((error > VIDEO_CLOCK_MAX_ERROR_US) || (error < -VIDEO_CLOCK_MAX_ERROR_US)) {
+      UVC_CLOCK_ERR("camera clock jump: %ld us", (long) error);
+      video_clock_reset_samples();
+    }
+  }
+
+  clk->stc[clk->head] = stc;
+  clk->host[clk->head] = host;
+  clk->head = (clk->head + 1) % VIDEO_CLOCK_SAMPLES;
+  if (clk->count < VIDEO_CLOCK_SAMPLES)
+    clk->count++;
+  clk->last_sof = sof;
+
+  video_clock_update();
+}
+
+bool video_clock_device_to_host(uint32_t device_time, uint32_t *host_time_us) {
+  VIDEO_ClockTypeDef *clk = &video_clock;
+
+  if (!clk->state.valid)
+    return false;
+
+  float delta = clk->offset + clk->slope * (float) (int32_t) (device_time - clk->ref_stc);
+  *host_time_us = clk->ref_host + (uint32_t) (int32_t) (delta + ((delta < 0.0f) ? -0.5f : 0.5f));
+  return true;
+}
+
+void video_clock_get_state(VIDEO_ClockStateTypeDef *state) {
+  *state = video_clock.state;
+}
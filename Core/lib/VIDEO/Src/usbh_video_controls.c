@@ -0,0 +1,564 @@
+// Control table of the camera and control requests, see usbh_video_controls.h
+
+#include "usbh_video_controls.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "usbh_video_trace.h"
+
+// Input Terminal type of a camera
+#define UVC_ITT_CAMERA 0x0201
+
+// Longest value kept in the table
+#define VIDEO_CONTROL_VALUE_SIZE 4
+
+// UVC definition of a standard control: bit of bmControls, selector and size
+typedef struct {
+  uint8_t id;  // VIDEO_ControlIdTypeDef
+  uint8_t bit;
+  uint8_t selector;
+  uint8_t size;
+  uint8_t flags;
+} VIDEO_ControlDefTypeDef;
+
+// Camera Terminal bmControls (USB_Video_Class_1.1.pdf, 3.7.2.3), PanTilt (Absolute) is 8 bytes and not listed
+static const VIDEO_ControlDefTypeDef video_controls_ct[] = {
+    {VIDEO_CONTROL_SCANNING_MODE, 0, 0x01, 1, 0},
+    {VIDEO_CONTROL_AE_MODE, 1, 0x02, 1, VIDEO_CONTROL_BITMAP},
+    {VIDEO_CONTROL_AE_PRIORITY, 2, 0x03, 1, 0},
+    {VIDEO_CONTROL_EXPOSURE_TIME_ABSOLUTE, 3, 0x04, 4, 0},
+    {VIDEO_CONTROL_EXPOSURE_TIME_RELATIVE, 4, 0x05, 1, VIDEO_CONTROL_SIGNED},
+    {VIDEO_CONTROL_FOCUS_ABSOLUTE, 5, 0x06, 2, 0},
+    {VIDEO_CONTROL_FOCUS_RELATIVE, 6, 0x07, 2, VIDEO_CONTROL_COMPOSITE},
+    {VIDEO_CONTROL_IRIS_ABSOLUTE, 7, 0x09, 2, 0},
+    {VIDEO_CONTROL_IRIS_RELATIVE, 8, 0x0A, 1, VIDEO_CONTROL_SIGNED},
+    {VIDEO_CONTROL_ZOOM_ABSOLUTE, 9, 0x0B, 2, 0},
+    {VIDEO_CONTROL_ZOOM_RELATIVE, 10, 0x0C, 3, VIDEO_CONTROL_COMPOSITE},
+    {VIDEO_CONTROL_PANTILT_RELATIVE, 12, 0x0E, 4, VIDEO_CONTROL_COMPOSITE},
+    {VIDEO_CONTROL_ROLL_ABSOLUTE, 13, 0x0F, 2, VIDEO_CONTROL_SIGNED},
+    {VIDEO_CONTROL_ROLL_RELATIVE, 14, 0x10, 2, VIDEO_CONTROL_COMPOSITE},
+    {VIDEO_CONTROL_FOCUS_AUTO, 17, 0x08, 1, 0},
+    {VIDEO_CONTROL_PRIVACY, 18, 0x11, 1, 0},
+};
+
+// Processing Unit bmControls (USB_Video_Class_1.1.pdf, 3.7.2.5)
+static const VIDEO_ControlDefTypeDef video_controls_pu[] = {
+    {VIDEO_CONTROL_BRIGHTNESS, 0, 0x02, 2, VIDEO_CONTROL_SIGNED},
+    {VIDEO_CONTROL_CONTRAST, 1, 0x03, 2, 0},
+    {VIDEO_CONTROL_HUE, 2, 0x06, 2, VIDEO_CONTROL_SIGNED},
+    {VIDEO_CONTROL_SATURATION, 3, 0x07, 2, 0},
+    {VIDEO_CONTROL_SHARPNESS, 4, 0x08, 2, 0},
+    {VIDEO_CONTROL_GAMMA, 5, 0x09, 2, 0},
+    {VIDEO_CONTROL_WHITE_BALANCE_TEMPERATURE, 6, 0x0A, 2, 0},
+    {VIDEO_CONTROL_WHITE_BALANCE_COMPONENT, 7, 0x0C, 4, VIDEO_CONTROL_COMPOSITE},
+    {VIDEO_CONTROL_BACKLIGHT_COMPENSATION, 8, 0x01, 2, 0},
+    {VIDEO_CONTROL_GAIN, 9, 0x04, 2, 0},
+    {VIDEO_CONTROL_POWER_LINE_FREQUENCY, 10, 0x05, 1, 0},
+    {VIDEO_CONTROL_HUE_AUTO, 11, 0x10, 1, 0},
+    {VIDEO_CONTROL_WHITE_BALANCE_TEMPERATURE_AUTO, 12, 0x0B, 1, 0},
+    {VIDEO_CONTROL_WHITE_BALANCE_COMPONENT_AUTO, 13, 0x0D, 1, 0},
+    {VIDEO_CONTROL_DIGITAL_MULTIPLIER, 14, 0x0E, 2, 0},
+    {VIDEO_CONTROL_DIGITAL_MULTIPLIER_LIMIT, 15, 0x0F, 2, 0},
+    {VIDEO_CONTROL_ANALOG_VIDEO_STANDARD, 16, 0x11, 1, 0},
+    {VIDEO_CONTROL_ANALOG_LOCK_STATUS, 17, 0x12, 1, 0},
+};
+
+static const char *const video_controls_names[VIDEO_CONTROLS] = {
+    "scanning mode", "AE mode", "AE priority", "exposure time", "exposure time (relative)", "focus", "focus (relative)", "focus auto",
+    "iris", "iris (relative)", "zoom", "zoom (relative)", "pan/tilt (relative)", "roll", "roll (relative)", "privacy",
+    "backlight compensation", "brightness", "contrast", "gain", "power line frequency", "hue", "saturation", "sharpness", "gamma",
+    "white balance temperature", "white balance temperature auto", "white balance component", "white balance component auto",
+    "digital multiplier", "digital multiplier limit", "hue auto", "analog video standard", "analog lock status", "extension",
+};
+
+// Queries of one control, in this order
+typedef enum {
+  VIDEO_QUERY_LEN = 0,
+  VIDEO_QUERY_INFO,
+  VIDEO_QUERY_MIN,
+  VIDEO_QUERY_MAX,
+  VIDEO_QUERY_RES,
+  VIDEO_QUERY_DEF,
+  VIDEO_QUERY_DONE,
+} VIDEO_ControlQueryTypeDef;
+
+static const uint8_t video_controls_query_request[VIDEO_QUERY_DONE] = {UVC_GET_LEN, UVC_GET_INFO, UVC_GET_MIN, UVC_GET_MAX, UVC_GET_RES, UVC_GET_DEF};
+
+// Request of USBH_VIDEO_GetControl/SetControl, slots are claimed by the producers (any task) and freed by the host task
+typedef struct {
+  volatile uint32_t busy;
+  VIDEO_ControlTypeDef *control;
+  VIDEO_ControlDoneTypeDef done;
+  VIDEO_ControlDataDoneTypeDef data_done;  // USBH_VIDEO_GetUnitControl/SetUnitControl
+  void *context;
+  int32_t value;  // SET_CUR
+  uint8_t *buf;   // bytes of USBH_VIDEO_GetUnitControl/SetUnitControl, owned by the caller
+  uint8_t data[VIDEO_CONTROL_VALUE_SIZE] __attribute__((aligned(4)));
+} VIDEO_ControlReqTypeDef;
+
+static VIDEO_ControlTypeDef video_controls[UVC_MAX_CONTROLS];
+static uint8_t video_controls_num = 0;
+static volatile uint8_t video_controls_done = 0;
+static VIDEO_ControlReqTypeDef video_controls_req[UVC_CTRL_QUEUE_LEN];
+
+// Query in progress: control, its next query and the answer buffer
+static uint8_t query_index;
+static uint8_t query_step;
+static uint8_t query_busy;
+static uint8_t query_buf[VIDEO_CONTROL_VALUE_SIZE] __attribute__((aligned(4)));
+
+static VIDEO_ControlTypeDef *video_controls_add(uint8_t id, uint8_t unit, uint8_t selector, uint16_t size, uint8_t flags) {
+  if (video_controls_num >= UVC_MAX_CONTROLS) {
+    UVC_DESC_ERR("Control table is full, control %d of unit %d is ignored", selector, unit);
+    return NULL;
+  }
+  VIDEO_ControlTypeDef *control = &video_controls[video_controls_num++];
+  memset(control, 0, sizeof(*control));
+  control->id = id;
+  control->unit = unit;
+  control->selector = selector;
+  control->size = size;
+  control->flags = flags;
+  return control;
+}
+
+// Controls of "defs" set in the bitmap "bm" of "bm_size" bytes
+static void video_controls_add_bitmap(uint8_t unit, const uint8_t *bm, uint8_t bm_size, const VIDEO_ControlDefTypeDef *defs, uint8_t defs_num) {
+  for (uint8_t i = 0; i < defs_num; i++) {
+    uint8_t bit = defs[i].bit;
+    if (((bit / 8U) < bm_size) && (bm[bit / 8U] & (1U << (bit % 8U))))
+      video_controls_add(defs[i].id, unit, defs[i].selector, defs[i].size, defs[i].flags);
+  }
+}
+
+uint8_t video_controls_build(USBH_HandleTypeDef *phost) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  const VIDEO_ClassSpecificDescTypedef *class_desc = &VIDEO_Handle->class_desc;
+
+  __atomic_store_n(&video_controls_done, 0, __ATOMIC_RELEASE);
+  video_controls_num = 0;
+  query_index = 0;
+  query_step = VIDEO_QUERY_LEN;
+  query_busy = 0;
+  // Requests of the previous camera are never completed, its request queue is gone
+  memset(video_controls_req, 0, sizeof(video_controls_req));
+
+  // Camera Terminal: bControlSize and bmControls follow the fields of every Input Terminal
+  for (uint8_t i = 0; i < class_desc->InputTerminalNum; i++) {
+    const VIDEO_ITDescTypeDef *it = class_desc->cs_desc.InputTerminalDesc[i];
+    if ((LE16(it->wTerminalType) != UVC_ITT_CAMERA) || (it->bLength < 15) || (it->bLength < (15U + it->bControlSize)))
+      continue;
+    video_controls_add_bitmap(it->bTerminalID, it->bmControls, it->bControlSize, video_controls_ct,
+                              sizeof(video_controls_ct) / sizeof(video_controls_ct[0]));
+  }
+
+  // Processing Unit, length is checked by the descriptor parser
+  for (uint8_t i = 0; i < class_desc->ProcessingUnitNum; i++) {
+    const VIDEO_PUDescTypeDef *pu = class_desc->cs_desc.ProcessingUnitDesc[i];
+    video_controls_add_bitmap(pu->bUnitID, pu->bmControls, pu->bControlSize, video_controls_pu,
+                              sizeof(video_controls_pu) / sizeof(video_controls_pu[0]));
+  }
+
+  // Extension Unit: control N is bit N-1, its size is queried
+  for (uint8_t i = 0; i < class_desc->ExtensionUnitNum; i++) {
+    const VIDEO_XUDescTypeDef *xu = class_desc->cs_desc.ExtensionUnitDesc[i];
+    const uint8_t *pdesc = (const uint8_t *) xu;
+    uint8_t bm_size = pdesc[22 + xu->bNrInPins];
+    const uint8_t *bm = pdesc + 23 + xu->bNrInPins;
+    for (uint16_t bit = 0; bit < (bm_size * 8U); bit++) {
+      if (bm[bit / 8U] & (1U << (bit % 8U)))
+        video_controls_add(VIDEO_CONTROL_XU, xu->bUnitID, (uint8_t) (bit + 1U), 0, VIDEO_CONTROL_COMPOSITE);
+    }
+  }
+
+  UVC_DESC_LOG("%d controls", video_controls_num);
+  return video_controls_num;
+}
+
+// Little-endian value of "control", sign extended
+static int32_t video_controls_decode(const VIDEO_ControlTypeDef *control, const uint8_t *data) {
+  uint32_t size = (control->size < VIDEO_CONTROL_VALUE_SIZE) ? control->size : VIDEO_CONTROL_VALUE_SIZE;
+  uint32_t value = 0;
+
+  for (uint32_t i = 0; i < size; i++) {
+    value |= (uint32_t) data[i] << (8U * i);
+  }
+  if ((control->flags & VIDEO_CONTROL_SIGNED) && (size > 0) && (size < 4) && (value & (1UL << (8U * size - 1U))))
+    value |= ~0UL << (8U * size);
+  return (int32_t) value;
+}
+
+static void video_controls_encode(int32_t value, uint8_t *data) {
+  for (uint32_t i = 0; i < VIDEO_CONTROL_VALUE_SIZE; i++) {
+    data[i] = (uint8_t) ((uint32_t) value >> (8U * i));
+  }
+}
+
+// Next query of "control" starting at "step", VIDEO_QUERY_DONE if none
+static uint8_t video_controls_next_step(const VIDEO_ControlTypeDef *control, uint8_t step) {
+  for (; step < VIDEO_QUERY_DONE; step++) {
+    switch (step) {
+      case VIDEO_QUERY_LEN:
+        if (control->id == VIDEO_CONTROL_XU)
+          return step;
+        break;
+      case VIDEO_QUERY_INFO:
+        if (control->size != 0)
+          return step;
+        break;
+      case VIDEO_QUERY_MIN:
+      case VIDEO_QUERY_MAX:
+        if (control->flags & VIDEO_CONTROL_BITMAP)
+          break;
+        // fall through
+      default:
+        // Values are kept for readable controls of up to 4 bytes
+        if ((control->info & VIDEO_CONTROL_INFO_GET) && (control->size <= VIDEO_CONTROL_VALUE_SIZE))
+          return step;
+        break;
+    }
+  }
+  return VIDEO_QUERY_DONE;
+}
+
+static void video_controls_query_done(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_ControlTypeDef *control = &video_controls[query_index];
+
+  if (status == USBH_OK) {
+    switch (query_step) {
+      case VIDEO_QUERY_LEN:
+        control->size = LE16(query_buf);
+        break;
+      case VIDEO_QUERY_INFO:
+        control->info = query_buf[0];
+        break;
+      case VIDEO_QUERY_MIN:
+        control->min = video_controls_decode(control, query_buf);
+        control->valid |= VIDEO_CONTROL_HAS_MIN;
+        break;
+      case VIDEO_QUERY_MAX:
+        control->max = video_controls_decode(control, query_buf);
+        control->valid |= VIDEO_CONTROL_HAS_MAX;
+        break;
+      case VIDEO_QUERY_RES:
+        control->res = video_controls_decode(control, query_buf);
+        control->valid |= VIDEO_CONTROL_HAS_RES;
+        break;
+      case VIDEO_QUERY_DEF:
+        control->def = video_controls_decode(control, query_buf);
+        control->valid |= VIDEO_CONTROL_HAS_DEF;
+        break;
+      default:
+        break;
+    }
+  }
+  query_step++;
+  query_busy = 0;
+  video_controls_query(phost);
+}
+
+USBH_StatusTypeDef video_controls_query(USBH_HandleTypeDef *phost) {
+  if (video_controls_done)
+    return USBH_OK;
+  if (query_busy)
+    return USBH_BUSY;
+
+  while (query_index < video_controls_num) {
+    VIDEO_ControlTypeDef *control = &video_controls[query_index];
+    query_step = video_controls_next_step(control, query_step);
+    if (query_step == VIDEO_QUERY_DONE) {
+      UVC_CTRL_DBG("Control %s of unit %d, selector %d: info 0x%02X, min %ld, max %ld, res %ld, def %ld", video_controls_name(control->id),
+                   control->unit, control->selector, control->info, (long) control->min, (long) control->max, (long) control->res,
+                   (long) control->def);
+      query_index++;
+      query_step = VIDEO_QUERY_LEN;
+      continue;
+    }
+
+    uint16_t length = (query_step == VIDEO_QUERY_LEN) ? 2U : (query_step == VIDEO_QUERY_INFO) ? 1U : control->size;
+    memset(query_buf, 0, sizeof(query_buf));
+    if (USBH_VIDEO_CSRequest(phost, video_controls_query_request[query_step], control->unit, control->selector, query_buf, length,
+                             video_controls_query_done, NULL) != USBH_OK) {
+      return USBH_BUSY;  // queue is full, queued by the next call
+    }
+    query_busy = 1;
+    return USBH_BUSY;
+  }
+
+  UVC_CTRL_LOG("%d controls queried", video_controls_num);
+  __atomic_store_n(&video_controls_done, 1, __ATOMIC_RELEASE);
+  return USBH_OK;
+}
+
+uint8_t video_controls_ready(void) {
+  return __atomic_load_n(&video_controls_done, __ATOMIC_ACQUIRE);
+}
+
+const VIDEO_ControlTypeDef *video_controls_table(uint8_t *num) {
+  *num = video_controls_num;
+  return video_controls;
+}
+
+const VIDEO_ControlTypeDef *video_controls_find(VIDEO_ControlIdTypeDef id) {
+  if (!video_controls_ready())
+    return NULL;
+  for (uint8_t i = 0; i < video_controls_num; i++) {
+    if ((video_controls[i].id == id) && (video_controls[i].info != 0))
+      return &video_controls[i];
+  }
+  return NULL;
+}
+
+const VIDEO_ControlTypeDef *video_controls_find_unit(uint8_t unit, uint8_t selector) {
+  if (!video_controls_ready())
+    return NULL;
+  for (uint8_t i = 0; i < video_controls_num; i++) {
+    if ((video_controls[i].unit == unit) && (video_controls[i].selector == selector) && (video_controls[i].info != 0))
+      return &video_controls[i];
+  }
+  return NULL;
+}
+
+const char *video_controls_name(VIDEO_ControlIdTypeDef id) {
+  return ((unsigned) id < VIDEO_CONTROLS) ? video_controls_names[id] : "?";
+}
+
+//*****************************************************************************
+// GET_CUR / SET_CUR
+
+static VIDEO_ControlReqTypeDef *video_controls_claim(void) {
+  for (uint32_t i = 0; i < UVC_CTRL_QUEUE_LEN; i++) {
+    uint32_t idle = 0;
+    if (__atomic_compare_exchange_n(&video_controls_req[i].busy, &idle, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      return &video_controls_req[i];
+  }
+  return NULL;
+}
+
+static void video_controls_release(VIDEO_ControlReqTypeDef *req) {
+  __atomic_store_n(&req->busy, 0, __ATOMIC_RELEASE);
+}
+
+static void video_controls_get_done(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_ControlReqTypeDef *req = (VIDEO_ControlReqTypeDef *) context;
+  VIDEO_ControlTypeDef *control = req->control;
+  VIDEO_ControlDoneTypeDef done = req->done;
+  void *done_context = req->context;
+  int32_t value = video_controls_decode(control, req->data);
+
+  // Slot is free before the callback, it may submit the next request
+  video_controls_release(req);
+  if (status == USBH_OK) {
+    control->cur = value;
+    control->valid |= VIDEO_CONTROL_HAS_CUR;
+  }
+  if (done != NULL)
+    done(phost, status, control, value, done_context);
+}
+
+static void video_controls_set_done(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_ControlReqTypeDef *req = (VIDEO_ControlReqTypeDef *) context;
+  VIDEO_ControlTypeDef *control = req->control;
+  VIDEO_ControlDoneTypeDef done = req->done;
+  void *done_context = req->context;
+  int32_t value = req->value;
+
+  video_controls_release(req);
+  if (status == USBH_OK) {
+    control->cur = value;
+    control->valid |= VIDEO_CONTROL_HAS_CUR;
+  } else {
+    UVC_CTRL_ERR("SET_CUR %s = %ld: status %d", video_controls_name(control->id), (long) value, status);
+  }
+  if (done != NULL)
+    done(phost, status, control, value, done_context);
+}
+
+static void video_controls_data_done(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, void *context) {
+  VIDEO_ControlReqTypeDef *req = (VIDEO_ControlReqTypeDef *) context;
+  VIDEO_ControlTypeDef *control = req->control;
+  VIDEO_ControlDataDoneTypeDef done = req->data_done;
+  void *done_context = req->context;
+  uint8_t *data = req->buf;
+
+  video_controls_release(req);
+  // Short controls keep the value of GetControl/SetControl up to date
+  if ((status == USBH_OK) && (control->size <= VIDEO_CONTROL_VALUE_SIZE)) {
+    control->cur = video_controls_decode(control, data);
+    control->valid |= VIDEO_CONTROL_HAS_CUR;
+  }
+  if (status != USBH_OK) {
+    UVC_CTRL_ERR("Control %d/%d: status %d", control->unit, control->selector, status);
+  }
+  if (done != NULL)
+    done(phost, status, control, data, control->size, done_context);
+}
+
+// VIDEO class is active and the table is queried
+static USBH_StatusTypeDef video_controls_active(USBH_HandleTypeDef *phost) {
+  if ((phost->pActiveClass != &VIDEO_Class) || (phost->pActiveClass->pData == NULL))
+    return USBH_FAIL;
+  if (!video_controls_ready())
+    return USBH_BUSY;
+  return USBH_OK;
+}
+
+// Control "id" of the active VIDEO class that supports the "info" requests
+static USBH_StatusTypeDef video_controls_lookup(USBH_HandleTypeDef *phost, VIDEO_ControlIdTypeDef id, uint8_t info, VIDEO_ControlTypeDef **control) {
+  USBH_StatusTypeDef status = video_controls_active(phost);
+  if (status != USBH_OK)
+    return status;
+
+  *control = (VIDEO_ControlTypeDef *) video_controls_find(id);
+  if ((*control == NULL) || (((*control)->info & info) == 0) || ((*control)->size > VIDEO_CONTROL_VALUE_SIZE))
+    return USBH_NOT_SUPPORTED;
+  return USBH_OK;
+}
+
+// Queue GET_CUR or SET_CUR of control "selector" of unit "unit" with the bytes of the caller
+static USBH_StatusTypeDef video_controls_unit_request(USBH_HandleTypeDef *phost, uint8_t request, uint8_t unit, uint8_t selector, uint8_t *data,
+                                                      uint16_t length, VIDEO_ControlDataDoneTypeDef done, void *context) {
+  USBH_StatusTypeDef status = video_controls_active(phost);
+  if (status != USBH_OK)
+    return status;
+
+  uint8_t info = (request == UVC_GET_CUR) ? VIDEO_CONTROL_INFO_GET : VIDEO_CONTROL_INFO_SET;
+  VIDEO_ControlTypeDef *control = (VIDEO_ControlTypeDef *) video_controls_find_unit(unit, selector);
+  if ((control == NULL) || ((control->info & info) == 0))
+    return USBH_NOT_SUPPORTED;
+  if ((data == NULL) || (length != control->size)) {
+    UVC_CTRL_ERR("Control %d/%d: %u bytes, GET_LEN %u", unit, selector, length, control->size);
+    return USBH_NOT_SUPPORTED;
+  }
+
+  VIDEO_ControlReqTypeDef *req = video_controls_claim();
+  if (req == NULL)
+    return USBH_FAIL;
+  req->control = control;
+  req->data_done = done;
+  req->context = context;
+  req->buf = data;
+  status = USBH_VIDEO_CSRequest(phost, request, unit, selector, data, length, video_controls_data_done, req);
+  if (status != USBH_OK)
+    video_controls_release(req);
+  return status;
+}
+
+/**
+ * @brief  Queue GET_CUR of a control of the table.
+ *         Can be called from any task, "done" gets the current value.
+ * @param  phost: Host handle
+ * @param  id: Control
+ * @param  done: Completion callback, called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued, USBH_BUSY while the controls are queried,
+ *         USBH_NOT_SUPPORTED if the camera has no readable control "id",
+ *         USBH_FAIL if the VIDEO class is not active or the queue is full
+ */
+USBH_StatusTypeDef USBH_VIDEO_GetControl(USBH_HandleTypeDef *phost, VIDEO_ControlIdTypeDef id, VIDEO_ControlDoneTypeDef done, void *context) {
+  VIDEO_ControlTypeDef *control;
+  USBH_StatusTypeDef status = video_controls_lookup(phost, id, VIDEO_CONTROL_INFO_GET, &control);
+  if (status != USBH_OK)
+    return status;
+
+  VIDEO_ControlReqTypeDef *req = video_controls_claim();
+  if (req == NULL)
+    return USBH_FAIL;
+  req->control = control;
+  req->done = done;
+  req->context = context;
+  memset(req->data, 0, sizeof(req->data));
+  status = USBH_VIDEO_CSRequest(phost, UVC_GET_CUR, control->unit, control->selector, req->data, control->size, video_controls_get_done, req);
+  if (status != USBH_OK)
+    video_controls_release(req);
+  return status;
+}
+
+/**
+ * @brief  Queue SET_CUR of a control of the table.
+ *         Value is checked against the GET_MIN/GET_MAX range and rounded down to a GET_RES step from GET_MIN;
+ *         a bitmap control (VIDEO_CONTROL_AE_MODE) takes one bit of its GET_RES. Composite controls are sent as is.
+ *         Requests run in the order they are queued: an automatic mode is switched off before its control is set.
+ *         Can be called from any task.
+ * @param  phost: Host handle
+ * @param  id: Control
+ * @param  value: New value
+ * @param  done: Completion callback with the value sent, called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued, USBH_BUSY while the controls are queried,
+ *         USBH_NOT_SUPPORTED if the camera has no writable control "id" or the value is out of its range,
+ *         USBH_FAIL if the VIDEO class is not active or the queue is full
+ */
+USBH_StatusTypeDef USBH_VIDEO_SetControl(USBH_HandleTypeDef *phost, VIDEO_ControlIdTypeDef id, int32_t value, VIDEO_ControlDoneTypeDef done,
+                                         void *context) {
+  VIDEO_ControlTypeDef *control;
+  USBH_StatusTypeDef status = video_controls_lookup(phost, id, VIDEO_CONTROL_INFO_SET, &control);
+  if (status != USBH_OK)
+    return status;
+
+  if (control->flags & VIDEO_CONTROL_BITMAP) {
+    if ((value == 0) || (value & (value - 1)) || ((control->valid & VIDEO_CONTROL_HAS_RES) && ((value & control->res) == 0))) {
+      UVC_CTRL_ERR("%s: mode 0x%lX is not supported", video_controls_name(id), (unsigned long) value);
+      return USBH_NOT_SUPPORTED;
+    }
+  } else if ((control->flags & VIDEO_CONTROL_COMPOSITE) == 0) {
+    if (((control->valid & VIDEO_CONTROL_HAS_MIN) && (value < control->min)) || ((control->valid & VIDEO_CONTROL_HAS_MAX) && (value > control->max))) {
+      UVC_CTRL_ERR("%s: %ld is out of %ld..%ld", video_controls_name(id), (long) value, (long) control->min, (long) control->max);
+      return USBH_NOT_SUPPORTED;
+    }
+    if ((control->valid & VIDEO_CONTROL_HAS_MIN) && (control->valid & VIDEO_CONTROL_HAS_RES) && (control->res > 1))
+      value = control->min + ((value - control->min) / control->res) * control->res;
+  }
+
+  VIDEO_ControlReqTypeDef *req = video_controls_claim();
+  if (req == NULL)
+    return USBH_FAIL;
+  req->control = control;
+  req->done = done;
+  req->context = context;
+  req->value = value;
+  video_controls_encode(value, req->data);
+  status = USBH_VIDEO_CSRequest(phost, UVC_SET_CUR, control->unit, control->selector, req->data, control->size, video_controls_set_done, req);
+  if (status != USBH_OK)
+    video_controls_release(req);
+  return status;
+}
+
+/**
+ * @brief  Queue GET_CUR of a control found by its unit and selector, Extension Unit controls of any length included.
+ *         Can be called from any task.
+ * @param  phost: Host handle
+ * @param  unit: bUnitID or bTerminalID
+ * @param  selector: Control selector
+ * @param  data: Buffer of the value, kept by the caller until "done" is called
+ * @param  length: Size of "data", the size of the control (GET_LEN of the Extension Unit controls)
+ * @param  done: Completion callback with "data", called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued, USBH_BUSY while the controls are queried,
+ *         USBH_NOT_SUPPORTED if the camera has no readable control "selector" of "unit" or "length" is not its size,
+ *         USBH_FAIL if the VIDEO class is not active or the queue is full
+ */
+USBH_StatusTypeDef USBH_VIDEO_GetUnitControl(USBH_HandleTypeDef *phost, uint8_t unit, uint8_t selector, uint8_t *data, uint16_t length,
+                                             VIDEO_ControlDataDoneTypeDef done, void *context) {
+  return video_controls_unit_request(phost, UVC_GET_CUR, unit, selector, data, length, done, context);
+}
+
+/**
+ * @brief  Queue SET_CUR of a control found by its unit and selector, Extension Unit controls of any length included.
+ *         Bytes are sent as is, no range check. Can be called from any task.
+ * @param  phost: Host handle
+ * @param  unit: bUnitID or bTerminalID
+ * @param  selector: Control selector
+ * @param  data: New value, kept by the caller until "done" is called
+ * @param  length: Size of "data", the size of the control (GET_LEN of the Extension Unit controls)
+ * @param  done: Completion callback with "data", called by the host task, may be NULL
+ * @param  context: Argument of "done"
+ * @retval USBH_OK if the request is queued, USBH_BUSY while the controls are queried,
+ *         USBH_NOT_SUPPORTED if the camera has no writable control "selector" of "unit" or "length" is not its size,
+ *         USBH_FAIL if the VIDEO class is not active or the queue is full
+ */
+USBH_StatusTypeDef USBH_VIDEO_SetUnitControl(USBH_HandleTypeDef *phost, uint8_t unit, uint8_t selector, uint8_t *data, uint16_t length,
+                                             VIDEO_ControlDataDoneTypeDef done, void *context) {
+  return video_controls_unit_request(phost, UVC_SET_CUR, unit, selector, data, length, done, context);
+}
@@ -0,0 +1,101 @@
+// Class specific control request queue of the VIDEO class, see usbh_video_ctrl.h
+
+#include "usbh_video_ctrl.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "usbh_video_trace.h"
+
+static inline uint32_t ctrl_load_state(VIDEO_CtrlSlotTypeDef *slot) {
+  return __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+}
+
+static inline void ctrl_store_state(VIDEO_CtrlSlotTypeDef *slot, uint32_t state) {
+  __atomic_store_n(&slot->state, state, __ATOMIC_RELEASE);
+}
+
+void video_ctrl_init(VIDEO_CtrlQueueTypeDef *queue) {
+  memset(queue, 0, sizeof(*queue));
+}
+
+USBH_StatusTypeDef video_ctrl_submit(VIDEO_CtrlQueueTypeDef *queue, const USB_Setup_TypeDef *setup, uint8_t *data, VIDEO_CtrlDoneTypeDef done,
+                                     void *context) {
+  VIDEO_CtrlRequestTypeDef request = {*setup, data, done, context};
+
+  return video_ctrl_submit_batch(queue, &request, 1);
+}
+
+USBH_StatusTypeDef video_ctrl_submit_batch(VIDEO_CtrlQueueTypeDef *queue, const VIDEO_CtrlRequestTypeDef *requests, uint32_t count) {
+  uint32_t ticket = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+  if ((count == 0) || (count > UVC_CTRL_QUEUE_LEN))
+    return USBH_FAIL;
+
+  // Slot of a ticket is FREE once the host task is done with the request one lap before,
+  // the tickets of the batch are taken together so its requests are never split by another producer
+  do {
+    for (uint32_t i = 0; i < count; i++) {
+      if (ctrl_load_state(&queue->slot[(ticket + i) % UVC_CTRL_QUEUE_LEN]) != VIDEO_CTRL_FREE) {
+        UVC_CTRL_ERR("Control queue is full, request 0x%02X dropped", requests[0].setup.b.bRequest);
+        return USBH_FAIL;
+      }
+    }
+  } while (!__atomic_compare_exchange_n(&queue->tail, &ticket, ticket + count, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  for (uint32_t i = 0; i < count; i++) {
+    VIDEO_CtrlSlotTypeDef *slot = &queue->slot[(ticket + i) % UVC_CTRL_QUEUE_LEN];
+    ctrl_store_state(slot, VIDEO_CTRL_WRITING);
+    slot->setup = requests[i].setup;
+    slot->data = requests[i].data;
+    slot->done = requests[i].done;
+    slot->context = requests[i].context;
+    ctrl_store_state(slot, VIDEO_CTRL_READY);
+  }
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef video_ctrl_process(USBH_HandleTypeDef *phost, VIDEO_CtrlQueueTypeDef *queue) {
+  for (;;) {
+    VIDEO_CtrlSlotTypeDef *slot = &queue->slot[queue->head % UVC_CTRL_QUEUE_LEN];
+
+    if (!queue->active) {
+      if (queue->head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE))
+        return USBH_OK;
+      // Ticket is taken, the producer is still writing the request
+      if (ctrl_load_state(slot) != VIDEO_CTRL_READY)
+        return USBH_BUSY;
+      // Standard request of the host (SET_INTERFACE) is running
+      if (phost->RequestState != CMD_SEND)
+        return USBH_BUSY;
+
+      phost->Control.setup = slot->setup;
+      queue->active = 1;
+      UVC_CTRL_DBG("Control request 0x%02X, wValue 0x%04X started", slot->setup.b.bRequest, slot->setup.b.wValue.w);
+      // First call only arms the SETUP stage, the host task is woken up by the control transfer events
+      return USBH_CtlReq(phost, slot->data, slot->setup.b.wLength.w);
+    }
+
+    USBH_StatusTypeDef status = USBH_CtlReq(phost, slot->data, slot->setup.b.wLength.w);
+    if (status == USBH_BUSY)
+      return USBH_BUSY;
+
+    VIDEO_CtrlDoneTypeDef done = slot->done;
+    void *context = slot->context;
+    queue->active = 0;
+    queue->head++;
+    queue->done++;
+    if (status != USBH_OK) {
+      queue->failed++;
+      UVC_CTRL_ERR("Control request 0x%02X, wValue 0x%04X: status %d", slot->setup.b.bRequest, slot->setup.b.wValue.w, status);
+    }
+    ctrl_store_state(slot, VIDEO_CTRL_FREE);
+    if (done != NULL)
+      done(phost, status, context);
+    // Next request is started right away
+  }
+}
+
+uint32_t video_ctrl_pending(const VIDEO_CtrlQueueTypeDef *queue) {
+  return __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) - queue->head;
+}
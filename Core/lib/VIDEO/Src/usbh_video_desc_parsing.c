@@ -3,6 +3,7 @@
 #include "usbh_video_desc_parsing.h"
 
 #include "usbh_conf.h"
+#include "usbh_video_trace.h"
 
 void printf_frame(VIDEO_MJPEGFrameDescTypeDef *MJPEGFrame);
 void printf_format(VIDEO_MJPEGFormatDescTypeDef *MJPEGFormat);
@@ -19,10 +20,8 @@ USBH_VIDEO_TargetFormat_t USBH_VIDEO_Target_Format = UVC_CAPTURE_MODE;
 int USBH_VIDEO_Target_Width = UVC_TARGET_WIDTH;    // Width in pixels
 int USBH_VIDEO_Target_Height = UVC_TARGET_HEIGHT;  // Height in pixels
 
-// Value of "bFormatIndex" for target settings (set in USBH_VIDEO_AnalyseFormatDescriptors)
+// Values of "bFormatIndex" and "bFrameIndex" for target settings (mode selected in USBH_VIDEO_InterfaceInit, see usbh_video_modes.h)
 int USBH_VIDEO_Best_bFormatIndex = -1;
-
-// Value of "bFrameIndex" for target settings (set in USBH_VIDEO_AnalyseFrameDescriptors)
 int USBH_VIDEO_Best_bFrameIndex = -1;
 uint32_t USBH_VIDEO_Best_dwDefaultFrameInterval = 333333;
 
@@ -40,10 +39,11 @@ USBH_StatusTypeDef USBH_VIDEO_FindStreamingIN(USBH_HandleTypeDef *phost) {
 
   // Look For VIDEOSTREAMING IN interface (data FROM camera)
   alt_settings = 0;
-  for (interface = 0; interface < USBH_MAX_NUM_INTERFACES; interface++) {
+  for (interface = 0; (interface < USBH_MAX_NUM_INTERFACES) && (alt_settings < VIDEO_MAX_VIDEO_STD_INTERFACE); interface++) {
     if ((phost->device.CfgDesc.Itf_Desc[interface].bInterfaceClass == CC_VIDEO) &&
         (phost->device.CfgDesc.Itf_Desc[interface].bInterfaceSubClass == USB_SUBCLASS_VIDEOSTREAMING)) {
-      if ((phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bEndpointAddress & 0x80) &&  // is IN EP
+      if ((phost->device.CfgDesc.Itf_Desc[interface].bNumEndpoints > 0) &&
+          (phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bEndpointAddress & 0x80) &&  // is IN EP
           (phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].wMaxPacketSize > 0)) {
         VIDEO_Handle->stream_in[alt_settings].Ep = phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bEndpointAddress;
         VIDEO_Handle->stream_in[alt_settings].EpSize = phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].wMaxPacketSize;
@@ -72,31 +72,43 @@ USBH_StatusTypeDef USBH_VIDEO_ParseCSDescriptors(USBH_HandleTypeDef *phost) {
   // Pointer to header of descriptor
   USBH_DescHeader_t *pdesc;
   uint16_t ptr;
-  int8_t itf_index = 0;
-  int8_t itf_number = 0;
-  int8_t alt_setting;
+  uint8_t itf_index = 0xFF;
+  uint8_t itf_number = 0;
+  uint8_t alt_setting;
   VIDEO_HandleTypeDef *VIDEO_Handle;
 
   VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
   pdesc = (USBH_DescHeader_t *) (phost->device.CfgDesc_Raw);
   ptr = USB_LEN_CFG_DESC;
 
-  VIDEO_Handle->class_desc.InputTerminalNum = 0;
-  VIDEO_Handle->class_desc.OutputTerminalNum = 0;
-  VIDEO_Handle->class_desc.ASNum = 0;
+  // Pointers of a previous device must not survive a parse that stops early
+  memset(&VIDEO_Handle->class_desc, 0, sizeof(VIDEO_Handle->class_desc));
 
   while (ptr < phost->device.CfgDesc.wTotalLength) {
     pdesc = USBH_GetNextDesc((uint8_t *) pdesc, &ptr);
+    if (ptr >= phost->device.CfgDesc.wTotalLength)
+      break;
+
+    // Zero length would never move to the next descriptor, the rest of the configuration is ignored
+    if ((pdesc->bLength < 3) || ((ptr + pdesc->bLength) > phost->device.CfgDesc.wTotalLength)) {
+      UVC_DESC_ERR("Bad descriptor at %d: length %d", ptr, pdesc->bLength);
+      return USBH_FAIL;
+    }
 
     switch (pdesc->bDescriptorType) {
       case USB_DESC_TYPE_INTERFACE:
+        if (pdesc->bLength < USB_INTERFACE_DESC_SIZE) {
+          itf_index = 0xFF;
+          break;
+        }
         itf_number = *((uint8_t *) pdesc + 2);  // bInterfaceNumber
         alt_setting = *((uint8_t *) pdesc + 3);
         itf_index = USBH_FindInterfaceIndex(phost, itf_number, alt_setting);
         break;
 
       case USB_DESC_TYPE_CS_INTERFACE:  // 0x24 - Class specific descriptor
-        if (itf_number <= phost->device.CfgDesc.bNumInterfaces) {
+        // Interfaces that were not parsed by the host core (0xFF) are skipped
+        if (itf_index < USBH_MAX_NUM_INTERFACES) {
           ParseCSDescriptors(&VIDEO_Handle->class_desc, phost->device.CfgDesc.Itf_Desc[itf_index].bInterfaceSubClass, (uint8_t *) pdesc);
         }
         break;
@@ -108,6 +120,44 @@ USBH_StatusTypeDef USBH_VIDEO_ParseCSDescriptors(USBH_HandleTypeDef *phost) {
   return USBH_OK;
 }
 
+// Shortest class specific descriptor that has all fields used by the driver, 0 - not used
+static uint8_t CSDescriptorMinLength(uint8_t vs_subclass, uint8_t subtype) {
+  if (vs_subclass == USB_SUBCLASS_VIDEOCONTROL) {
+    switch (subtype) {
+      case UVC_VC_HEADER:
+        return 12;  // up to bInCollection
+      case UVC_VC_INPUT_TERMINAL:
+        return 8;  // up to iTerminal
+      case UVC_VC_OUTPUT_TERMINAL:
+        return sizeof(VIDEO_OTDescTypeDef);
+      case UVC_VC_SELECTOR_UNIT:
+        return 6;  // bNrInPins = 0
+      case UVC_VC_PROCESSING_UNIT:
+        return 8;  // up to bControlSize
+      case UVC_VC_EXTENSION_UNIT:
+        return 23;  // bNrInPins = 0, up to bControlSize
+      default:
+        return 0;
+    }
+  } else if (vs_subclass == USB_SUBCLASS_VIDEOSTREAMING) {
+    switch (subtype) {
+      case UVC_VS_INPUT_HEADER:
+        return 13;  // bNumFormats = 0
+      case UVC_VS_FORMAT_MJPEG:
+        return sizeof(VIDEO_MJPEGFormatDescTypeDef);
+      case UVC_VS_FRAME_MJPEG:
+        return sizeof(VIDEO_MJPEGFrameDescTypeDef);
+      case UVC_VS_FORMAT_UNCOMPRESSED:
+        return sizeof(VIDEO_UncompFormatDescTypeDef);
+      case UVC_VS_FRAME_UNCOMPRESSED:
+        return sizeof(VIDEO_UncompFrameDescTypeDef);
+      default:
+        return 0;
+    }
+  }
+  return 0;
+}
+
 /**
  * @brief  Parse Class specific descriptor
  * @param  vs_subclass: bInterfaceSubClass
@@ -117,6 +167,12 @@ USBH_StatusTypeDef USBH_VIDEO_ParseCSDescriptors(USBH_HandleTypeDef *phost) {
 USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc, uint8_t vs_subclass, uint8_t *pdesc) {
   uint8_t desc_number = 0;
 
+  // "pdesc[0]" bytes are valid, the descriptor is cast to a struct only when all its fields are there
+  if ((pdesc[0] < 3) || (pdesc[0] < CSDescriptorMinLength(vs_subclass, pdesc[2]))) {
+    UVC_DESC_ERR("Descriptor %d is too short: %d bytes", (pdesc[0] < 3) ? 0 : pdesc[2], pdesc[0]);
+    return USBH_FAIL;
+  }
+
   if (vs_subclass == USB_SUBCLASS_VIDEOCONTROL) {
     switch (pdesc[2]) {
       case UVC_VC_HEADER:
@@ -124,15 +180,38 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
         break;
 
       case UVC_VC_INPUT_TERMINAL:
-        class_desc->cs_desc.InputTerminalDesc[class_desc->InputTerminalNum++] = (VIDEO_ITDescTypeDef *) pdesc;
+        if (class_desc->InputTerminalNum < VIDEO_MAX_NUM_IN_TERMINAL)
+          class_desc->cs_desc.InputTerminalDesc[class_desc->InputTerminalNum++] = (VIDEO_ITDescTypeDef *) pdesc;
         break;
 
       case UVC_VC_OUTPUT_TERMINAL:
-        class_desc->cs_desc.OutputTerminalDesc[class_desc->OutputTerminalNum++] = (VIDEO_OTDescTypeDef *) pdesc;
+        if (class_desc->OutputTerminalNum < VIDEO_MAX_NUM_OUT_TERMINAL)
+          class_desc->cs_desc.OutputTerminalDesc[class_desc->OutputTerminalNum++] = (VIDEO_OTDescTypeDef *) pdesc;
         break;
 
       case UVC_VC_SELECTOR_UNIT:
-        class_desc->cs_desc.SelectorUnitDesc[class_desc->SelectorUnitNum++] = (VIDEO_SelectorDescTypeDef *) pdesc;
+        if (class_desc->SelectorUnitNum < VIDEO_MAX_NUM_SELECTOR_UNIT)
+          class_desc->cs_desc.SelectorUnitDesc[class_desc->SelectorUnitNum++] = (VIDEO_SelectorDescTypeDef *) pdesc;
+        break;
+
+      // Units are kept only if their bmControls is inside bLength, see usbh_video_controls.c
+      case UVC_VC_PROCESSING_UNIT:
+        if (pdesc[0] < (8U + pdesc[7])) {
+          UVC_DESC_ERR("Processing Unit %d: bControlSize %d does not fit into %d bytes", pdesc[3], pdesc[7], pdesc[0]);
+          return USBH_FAIL;
+        }
+        if (class_desc->ProcessingUnitNum < VIDEO_MAX_NUM_PROCESSING_UNIT)
+          class_desc->cs_desc.ProcessingUnitDesc[class_desc->ProcessingUnitNum++] = (VIDEO_PUDescTypeDef *) pdesc;
+        break;
+
+      case UVC_VC_EXTENSION_UNIT:
+        // bNrInPins (21) moves bControlSize and bmControls
+        if ((pdesc[0] < (23U + pdesc[21])) || (pdesc[0] < (23U + pdesc[21] + pdesc[22 + pdesc[21]]))) {
+          UVC_DESC_ERR("Extension Unit %d: controls do not fit into %d bytes", pdesc[3], pdesc[0]);
+          return USBH_FAIL;
+        }
+        if (class_desc->ExtensionUnitNum < VIDEO_MAX_NUM_EXTENSION_UNIT)
+          class_desc->cs_desc.ExtensionUnitDesc[class_desc->ExtensionUnitNum++] = (VIDEO_XUDescTypeDef *) pdesc;
         break;
 
       default:
@@ -148,16 +227,26 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
         //***** MJPEG *****
 
       case UVC_VS_FORMAT_MJPEG:
-        if (class_desc->MJPEGFormatNum < VIDEO_MAX_MJPEG_FORMAT)
+        // Modes take the format of a frame from the nearest stored format before it: frames of a format
+        // that is not stored would be taken for the previous one, so they are skipped
+        class_desc->FormatSkipped = (class_desc->MJPEGFormatNum >= VIDEO_MAX_MJPEG_FORMAT);
+        if (!class_desc->FormatSkipped) {
           class_desc->vs_desc.MJPEGFormat[class_desc->MJPEGFormatNum] = (VIDEO_MJPEGFormatDescTypeDef *) pdesc;
-        printf_format(class_desc->vs_desc.MJPEGFormat[class_desc->MJPEGFormatNum]);
-        class_desc->MJPEGFormatNum++;
+          printf_format(class_desc->vs_desc.MJPEGFormat[class_desc->MJPEGFormatNum]);
+          class_desc->MJPEGFormatNum++;
+        } else {
+          UVC_DESC_ERR("MJPEG format %d: more than %d formats, it is ignored", pdesc[3], VIDEO_MAX_MJPEG_FORMAT);
+        }
         break;
 
       case UVC_VS_FRAME_MJPEG:
         desc_number = class_desc->MJPEGFrameNum;
 
-        if (desc_number < VIDEO_MAX_MJPEG_FRAME_D) {
+        if (class_desc->FormatSkipped) {
+          break;
+        } else if (desc_number >= VIDEO_MAX_MJPEG_FRAME_D) {
+          UVC_DESC_ERR("MJPEG frame %d: more than %d frames, it is ignored", pdesc[3], VIDEO_MAX_MJPEG_FRAME_D);
+        } else {
           class_desc->vs_desc.MJPEGFrame[desc_number] = (VIDEO_MJPEGFrameDescTypeDef *) pdesc;
           /* In order to prevent data errors caused by the data size end on some platforms, manually calculate the data exceeding 1 byte */
           class_desc->vs_desc.MJPEGFrame[desc_number]->wWidth = LE16(pdesc + 5);
@@ -167,7 +256,7 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
           class_desc->vs_desc.MJPEGFrame[desc_number]->dwMaxVideoFrameBufferSize = LE32(pdesc + 17);
           class_desc->vs_desc.MJPEGFrame[desc_number]->dwDefaultFrameInterval = LE32(pdesc + 21);
 
-          USBH_DbgLog("MJPEG Frame detected: %d x %d", class_desc->vs_desc.MJPEGFrame[desc_number]->wWidth,
+          UVC_DESC_DBG("MJPEG Frame detected: %d x %d", class_desc->vs_desc.MJPEGFrame[desc_number]->wWidth,
                       class_desc->vs_desc.MJPEGFrame[desc_number]->wHeight);
           printf_frame(class_desc->vs_desc.MJPEGFrame[desc_number]);
           class_desc->MJPEGFrameNum++;
@@ -177,8 +266,11 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
         //***** UNCOMPRESSED *****
 
       case UVC_VS_FORMAT_UNCOMPRESSED:
-        if (class_desc->UncompFormatNum < VIDEO_MAX_UNCOMP_FORMAT)
+        class_desc->FormatSkipped = (class_desc->UncompFormatNum >= VIDEO_MAX_UNCOMP_FORMAT);
+        if (!class_desc->FormatSkipped)
           class_desc->vs_desc.UncompFormat[class_desc->UncompFormatNum++] = (VIDEO_UncompFormatDescTypeDef *) pdesc;
+        else
+          UVC_DESC_ERR("Uncompressed format %d: more than %d formats, it is ignored", pdesc[3], VIDEO_MAX_UNCOMP_FORMAT);
         break;
 
         //-------
@@ -186,7 +278,11 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
       case UVC_VS_FRAME_UNCOMPRESSED:
         desc_number = class_desc->UncompFrameNum;
 
-        if (desc_number < VIDEO_MAX_UNCOMP_FRAME_D) {
+        if (class_desc->FormatSkipped) {
+          break;
+        } else if (desc_number >= VIDEO_MAX_UNCOMP_FRAME_D) {
+          UVC_DESC_ERR("Uncompressed frame %d: more than %d frames, it is ignored", pdesc[3], VIDEO_MAX_UNCOMP_FRAME_D);
+        } else {
           class_desc->vs_desc.UncompFrame[desc_number] = (VIDEO_UncompFrameDescTypeDef *) pdesc;
           /* In order to prevent data errors caused by the data size end on some platforms, manually calculate the data exceeding 1 byte */
           class_desc->vs_desc.UncompFrame[desc_number]->wWidth = LE16(pdesc + 5);
@@ -196,9 +292,9 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
           class_desc->vs_desc.UncompFrame[desc_number]->dwMaxVideoFrameBufferSize = LE32(pdesc + 17);
           class_desc->vs_desc.UncompFrame[desc_number]->dwDefaultFrameInterval = LE32(pdesc + 21);
 
-          USBH_DbgLog("Uncompressed Frame detected: %d x %d", class_desc->vs_desc.UncompFrame[desc_number]->wWidth,
+          UVC_DESC_DBG("Uncompressed Frame detected: %d x %d", class_desc->vs_desc.UncompFrame[desc_number]->wWidth,
                       class_desc->vs_desc.UncompFrame[desc_number]->wHeight);
-          printf_frame(class_desc->vs_desc.MJPEGFrame[desc_number]);
+          printf_frame((VIDEO_MJPEGFrameDescTypeDef *) class_desc->vs_desc.UncompFrame[desc_number]);
           class_desc->UncompFrameNum++;
         }
         break;
@@ -211,114 +307,37 @@ USBH_StatusTypeDef ParseCSDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc
   return USBH_OK;
 }
 
-/*
- * Check if camera have needed Format descriptor (base for MJPEG/Uncompressed frames)
- */
-void USBH_VIDEO_AnalyseFormatDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc) {
-  USBH_VIDEO_Best_bFormatIndex = -1;
-
-  if (USBH_VIDEO_Target_Format == USBH_VIDEO_MJPEG) {
-    for (int i = 0; i < class_desc->MJPEGFormatNum; i++) {
-      printf_format(class_desc->vs_desc.MJPEGFormat[i]);
-    }
-    if (class_desc->MJPEGFormatNum != 1) {
-      USBH_ErrLog("Not supported MJPEG descriptors number: %d", class_desc->MJPEGFormatNum);
-    } else {
-      VIDEO_MJPEGFormatDescTypeDef *mjpeg_format_desc;
-      mjpeg_format_desc = class_desc->vs_desc.MJPEGFormat[0];
-      USBH_VIDEO_Best_bFormatIndex = mjpeg_format_desc->bFormatIndex;
-    }
-    return;
-  } else if (USBH_VIDEO_Target_Format == USBH_VIDEO_YUY2) {
-    if (class_desc->UncompFormatNum != 1) {
-      USBH_ErrLog("Not supported UNCOMP descriptors number: %d", class_desc->UncompFormatNum);
-      return;
-    } else {
-      // Camera have a single Format descriptor, so we need to check if this descriptor is really YUY2
-      VIDEO_UncompFormatDescTypeDef *uncomp_format_desc;
-      uncomp_format_desc = class_desc->vs_desc.UncompFormat[0];
-
-      if (memcmp(&uncomp_format_desc->guidFormat, "YUY2", 4) != 0) {
-        USBH_ErrLog("Not supported UNCOMP descriptor type");
-        return;
-      } else {
-        // Found!
-        USBH_VIDEO_Best_bFormatIndex = uncomp_format_desc->bFormatIndex;
-      }
-    }
-  }
-}
-
-/*
- * Check if camera have needed Frame descriptor (whith target image width)
- */
-int USBH_VIDEO_AnalyseFrameDescriptors(VIDEO_ClassSpecificDescTypedef *class_desc) {
-  USBH_VIDEO_Best_bFrameIndex = -1;
-  int result = -1;
-
-  if (USBH_VIDEO_Target_Format == USBH_VIDEO_MJPEG) {
-    for (uint8_t i = 0; i < class_desc->MJPEGFrameNum; i++) {
-      VIDEO_MJPEGFrameDescTypeDef *mjpeg_frame_desc;
-      mjpeg_frame_desc = class_desc->vs_desc.MJPEGFrame[i];
-      printf_frame(class_desc->vs_desc.MJPEGFrame[i]);
-      if ((mjpeg_frame_desc->wWidth == USBH_VIDEO_Target_Width) && (mjpeg_frame_desc->wHeight == USBH_VIDEO_Target_Height)) {
-        // Found!
-        USBH_VIDEO_Best_bFrameIndex = mjpeg_frame_desc->bFrameIndex;
-        USBH_VIDEO_Best_dwDefaultFrameInterval = mjpeg_frame_desc->dwDefaultFrameInterval;
-        USBH_UsrLog("*** found frame ***\r\n");
-        printf_frame(class_desc->vs_desc.MJPEGFrame[i]);
-        return i;
-      }
-    }
-  } else if (USBH_VIDEO_Target_Format == USBH_VIDEO_YUY2) {
-    for (uint8_t i = 0; i < class_desc->UncompFrameNum; i++) {
-      VIDEO_UncompFrameDescTypeDef *uncomp_frame_desc;
-      uncomp_frame_desc = class_desc->vs_desc.UncompFrame[i];
-      printf_frame(class_desc->vs_desc.MJPEGFrame[i]);
-      if ((uncomp_frame_desc->wWidth == USBH_VIDEO_Target_Width) && (uncomp_frame_desc->wHeight == USBH_VIDEO_Target_Height)) {
-        // Found!
-        USBH_VIDEO_Best_bFrameIndex = uncomp_frame_desc->bFrameIndex;
-        USBH_VIDEO_Best_dwDefaultFrameInterval = uncomp_frame_desc->dwDefaultFrameInterval;
-        USBH_UsrLog("*** found frame ***\r\n");
-        printf_frame(class_desc->vs_desc.MJPEGFrame[i]);
-        return i;
-      }
-    }
-  }
-  return result;
-}
-
 void printf_frame(VIDEO_MJPEGFrameDescTypeDef *MJPEGFrame) {
   if (MJPEGFrame != NULL) {
-    USBH_UsrLog("VideoStreaming Interface Descriptor");
-    USBH_UsrLog(" bLength:%d", MJPEGFrame->bLength);
-    USBH_UsrLog(" bDescriptorType:%d", MJPEGFrame->bDescriptorType);
-    USBH_UsrLog(" bDescriptorSubtype:%d (%s)", MJPEGFrame->bDescriptorSubtype,
+    UVC_DESC_LOG("VideoStreaming Interface Descriptor");
+    UVC_DESC_LOG(" bLength:%d", MJPEGFrame->bLength);
+    UVC_DESC_LOG(" bDescriptorType:%d", MJPEGFrame->bDescriptorType);
+    UVC_DESC_LOG(" bDescriptorSubtype:%d (%s)", MJPEGFrame->bDescriptorSubtype,
                 MJPEGFrame->bDescriptorSubtype <= UVC_VS_FORMAT_VP8_SIMULCAST ? descriptor_subtype[MJPEGFrame->bDescriptorSubtype] : "not found");
-    USBH_UsrLog(" bFrameIndex:%d", MJPEGFrame->bFrameIndex);
-    USBH_UsrLog(" bmCapabilities:%d", MJPEGFrame->bmCapabilities);
-    USBH_UsrLog(" wWidth:%d", MJPEGFrame->wWidth);
-    USBH_UsrLog(" wHeight:%d", MJPEGFrame->wHeight);
-    USBH_UsrLog(" dwMinBitRate:%lu", MJPEGFrame->dwMinBitRate);
-    USBH_UsrLog(" dwMaxBitRate:%lu", MJPEGFrame->dwMaxBitRate);
-    USBH_UsrLog(" dwMaxVideoFrameBufferSize:%lu", MJPEGFrame->dwMaxVideoFrameBufferSize);
-    USBH_UsrLog(" dwDefaultFrameInterval:%lu", MJPEGFrame->dwDefaultFrameInterval);
-    USBH_UsrLog(" bFrameIntervalType:%d\r\n", MJPEGFrame->bFrameIntervalType);
+    UVC_DESC_LOG(" bFrameIndex:%d", MJPEGFrame->bFrameIndex);
+    UVC_DESC_LOG(" bmCapabilities:%d", MJPEGFrame->bmCapabilities);
+    UVC_DESC_LOG(" wWidth:%d", MJPEGFrame->wWidth);
+    UVC_DESC_LOG(" wHeight:%d", MJPEGFrame->wHeight);
+    UVC_DESC_LOG(" dwMinBitRate:%lu", (unsigned long) MJPEGFrame->dwMinBitRate);
+    UVC_DESC_LOG(" dwMaxBitRate:%lu", (unsigned long) MJPEGFrame->dwMaxBitRate);
+    UVC_DESC_LOG(" dwMaxVideoFrameBufferSize:%lu", (unsigned long) MJPEGFrame->dwMaxVideoFrameBufferSize);
+    UVC_DESC_LOG(" dwDefaultFrameInterval:%lu", (unsigned long) MJPEGFrame->dwDefaultFrameInterval);
+    UVC_DESC_LOG(" bFrameIntervalType:%d", MJPEGFrame->bFrameIntervalType);
   }
 }
 void printf_format(VIDEO_MJPEGFormatDescTypeDef *MJPEGFormat) {
   if (MJPEGFormat != NULL) {
-    USBH_UsrLog("VideoStreaming Interface Descriptor");
-    USBH_UsrLog(" bLength:%d", MJPEGFormat->bLength);
-    USBH_UsrLog(" bDescriptorType:%d", MJPEGFormat->bDescriptorType);
-    USBH_UsrLog(" bDescriptorSubtype:%d (%s)", MJPEGFormat->bDescriptorSubtype,
+    UVC_DESC_LOG("VideoStreaming Interface Descriptor");
+    UVC_DESC_LOG(" bLength:%d", MJPEGFormat->bLength);
+    UVC_DESC_LOG(" bDescriptorType:%d", MJPEGFormat->bDescriptorType);
+    UVC_DESC_LOG(" bDescriptorSubtype:%d (%s)", MJPEGFormat->bDescriptorSubtype,
                 MJPEGFormat->bDescriptorSubtype <= UVC_VS_FORMAT_VP8_SIMULCAST ? descriptor_subtype[MJPEGFormat->bDescriptorSubtype] : "not found");
-    USBH_UsrLog(" bFormatIndex:%d", MJPEGFormat->bFormatIndex);
-    USBH_UsrLog(" bNumFrameDescriptors:%d", MJPEGFormat->bNumFrameDescriptors);
-    USBH_UsrLog(" bmFlags:%d", MJPEGFormat->bmFlags);
-    USBH_UsrLog(" bDefaultFrameIndex:%d", MJPEGFormat->bDefaultFrameIndex);
-    USBH_UsrLog(" bAspectRatioX:%d", MJPEGFormat->bAspectRatioX);
-    USBH_UsrLog(" bmInterlaceFlags:%d", MJPEGFormat->bmInterlaceFlags);
-    USBH_UsrLog(" bCopyProtect:%d", MJPEGFormat->bCopyProtect);
+    UVC_DESC_LOG(" bFormatIndex:%d", MJPEGFormat->bFormatIndex);
+    UVC_DESC_LOG(" bNumFrameDescriptors:%d", MJPEGFormat->bNumFrameDescriptors);
+    UVC_DESC_LOG(" bmFlags:%d", MJPEGFormat->bmFlags);
+    UVC_DESC_LOG(" bDefaultFrameIndex:%d", MJPEGFormat->bDefaultFrameIndex);
+    UVC_DESC_LOG(" bAspectRatioX:%d", MJPEGFormat->bAspectRatioX);
+    UVC_DESC_LOG(" bmInterlaceFlags:%d", MJPEGFormat->bmInterlaceFlags);
+    UVC_DESC_LOG(" bCopyProtect:%d", MJPEGFormat->bCopyProtect);
   }
 }
@@ -0,0 +1,173 @@
+
+#include "usbh_video_frame_ring.h"
+
+#include <stddef.h>
+
+// On Cortex-M4 these are LDREX/STREX loops with DMB barriers
+static inline uint32_t ring_load_state(VIDEO_FrameSlotTypeDef *slot) {
+  return __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store_state(VIDEO_FrameSlotTypeDef *slot, uint32_t state) {
+  __atomic_store_n(&slot->state, state, __ATOMIC_RELEASE);
+}
+
+static inline bool ring_cas_state(VIDEO_FrameSlotTypeDef *slot, uint32_t expected, uint32_t desired) {
+  return __atomic_compare_exchange_n(&slot->state, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Sequence numbers are allowed to wrap
+static inline bool ring_seq_before(uint32_t a, uint32_t b) {
+  return (int32_t) (a - b) < 0;
+}
+
+// Find READY slot with the smallest (oldest == true) or the biggest sequence number, -1 if none
+static int ring_find_ready(VIDEO_FrameRingTypeDef *ring, bool oldest) {
+  int found = -1;
+  uint32_t found_seq = 0;
+
+  for (uint32_t i = 0; i < ring->count; i++) {
+    VIDEO_FrameSlotTypeDef *slot = &ring->slot[i];
+    if (ring_load_state(slot) != VIDEO_FRAME_READY)
+      continue;
+
+    uint32_t seq = slot->frame.seq;
+    if ((found < 0) || (oldest ? ring_seq_before(seq, found_seq) : ring_seq_before(found_seq, seq))) {
+      found = (int) i;
+      found_seq = seq;
+    }
+  }
+  return found;
+}
+
+static VIDEO_FrameSlotTypeDef *ring_prepare_slot(VIDEO_FrameSlotTypeDef *slot) {
+  slot->frame.len = 0;
+  slot->frame.flags = 0;
+  slot->frame.pts = 0;
+  slot->frame.scr_stc = 0;
+  slot->frame.scr_sof = 0;
+  slot->frame.capture_time = 0;
+  slot->frame.delivery_time = 0;
+  return slot;
+}
+
+//****************************************************************************
+
+// Slots are placed one after another in the pool, all of them FREE
+static void ring_carve(VIDEO_FrameRingTypeDef *ring, uint8_t *pool, uint32_t count, uint32_t buffer_size, uint32_t headroom) {
+  ring->count = count;
+  ring->buffer_size = buffer_size;
+
+  for (uint32_t i = 0; i < count; i++) {
+    VIDEO_FrameSlotTypeDef *slot = &ring->slot[i];
+    slot->buffer = pool + (i * buffer_size);
+    slot->frame.data = slot->buffer + headroom;
+    slot->frame.len = 0;
+    slot->frame.seq = 0;
+    slot->frame.timestamp = 0;
+    slot->frame.flags = 0;
+    slot->frame.pts = 0;
+    slot->frame.scr_stc = 0;
+    slot->frame.scr_sof = 0;
+    slot->frame.capture_time = 0;
+    slot->frame.delivery_time = 0;
+    ring_store_state(slot, VIDEO_FRAME_FREE);
+  }
+}
+
+bool video_frame_ring_init(VIDEO_FrameRingTypeDef *ring, uint8_t *pool, uint32_t count, uint32_t buffer_size, uint32_t headroom,
+                           VIDEO_FrameDropPolicyTypeDef policy) {
+  if ((ring == NULL) || (pool == NULL) || (count == 0) || (count > VIDEO_FRAME_RING_MAX_SLOTS) || (headroom >= buffer_size))
+    return false;
+
+  ring->policy = policy;
+  ring->next_seq = 0;
+  ring->completed = 0;
+  ring->dropped_oldest = 0;
+  ring->dropped_newest = 0;
+  ring->overruns = 0;
+  ring_carve(ring, pool, count, buffer_size, headroom);
+  return true;
+}
+
+bool video_frame_ring_resize(VIDEO_FrameRingTypeDef *ring, uint8_t *pool, uint32_t count, uint32_t buffer_size, uint32_t headroom) {
+  if ((ring == NULL) || (pool == NULL) || (count == 0) || (count > VIDEO_FRAME_RING_MAX_SLOTS) || (headroom >= buffer_size))
+    return false;
+
+  // Completed frames are taken back, the consumer cannot take them any more. A slot it holds stays valid,
+  // so the layout is not changed then.
+  bool held = false;
+  for (uint32_t i = 0; i < ring->count; i++) {
+    VIDEO_FrameSlotTypeDef *slot = &ring->slot[i];
+    if (ring_cas_state(slot, VIDEO_FRAME_READY, VIDEO_FRAME_FREE) || ring_cas_state(slot, VIDEO_FRAME_FILLING, VIDEO_FRAME_FREE))
+      continue;
+    if (ring_load_state(slot) == VIDEO_FRAME_HELD)
+      held = true;
+  }
+  if (held)
+    return false;
+
+  ring_carve(ring, pool, count, buffer_size, headroom);
+  return true;
+}
+
+// Producer: get a slot to capture the next frame into.
+// Returns NULL if the consumer holds all other slots - the new frame has to be skipped.
+VIDEO_FrameSlotTypeDef *video_frame_ring_begin(VIDEO_FrameRingTypeDef *ring) {
+  for (uint32_t i = 0; i < ring->count; i++) {
+    if (ring_cas_state(&ring->slot[i], VIDEO_FRAME_FREE, VIDEO_FRAME_FILLING))
+      return ring_prepare_slot(&ring->slot[i]);
+  }
+
+  // Consumer is slow - reclaim one of the completed frames
+  bool oldest = (ring->policy == VIDEO_FRAME_DROP_OLDEST);
+  for (;;) {
+    int index = ring_find_ready(ring, oldest);
+    if (index < 0)
+      break;
+
+    // Consumer may take this slot at the same time, then try another one
+    if (ring_cas_state(&ring->slot[index], VIDEO_FRAME_READY, VIDEO_FRAME_FILLING)) {
+      if (oldest)
+        ring->dropped_oldest++;
+      else
+        ring->dropped_newest++;
+      return ring_prepare_slot(&ring->slot[index]);
+    }
+  }
+
+  ring->overruns++;
+  return NULL;
+}
+
+// Producer: frame in the slot is complete ("frame.len", "frame.timestamp", "frame.delivery_time" and "frame.flags" must be set)
+void video_frame_ring_commit(VIDEO_FrameRingTypeDef *ring, VIDEO_FrameSlotTypeDef *slot) {
+  slot->frame.seq = ring->next_seq++;
+  ring->completed++;
+  // Frame data and descriptor become visible to the consumer together with the state
+  ring_store_state(slot, VIDEO_FRAME_READY);
+}
+
+// Consumer: take the oldest completed frame, NULL if there is none.
+// Frame stays valid until "video_frame_ring_release" is called.
+VIDEO_FrameTypeDef *video_frame_ring_acquire(VIDEO_FrameRingTypeDef *ring) {
+  for (;;) {
+    int index = ring_find_ready(ring, true);
+    if (index < 0)
+      return NULL;
+
+    // Producer may reclaim this slot at the same time, then try another one
+    if (ring_cas_state(&ring->slot[index], VIDEO_FRAME_READY, VIDEO_FRAME_HELD))
+      return &ring->slot[index].frame;
+  }
+}
+
+// Consumer: give the frame back to the producer
+void video_frame_ring_release(VIDEO_FrameRingTypeDef *ring, VIDEO_FrameTypeDef *frame) {
+  (void) ring;
+  if (frame == NULL)
+    return;
+
+  VIDEO_FrameSlotTypeDef *slot = (VIDEO_FrameSlotTypeDef *) ((uint8_t *) frame - offsetof(VIDEO_FrameSlotTypeDef, frame));
+  ring_store_state(slot, VIDEO_FRAME_FREE);
+}
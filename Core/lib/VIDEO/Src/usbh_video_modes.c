@@ -0,0 +1,282 @@
+// Capability table of the camera and mode selection, see usbh_video_modes.h
+
+#include "usbh_video_modes.h"
+
+#include <string.h>
+
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_stream_parsing.h"
+#include "usbh_video_trace.h"
+
+// Intervals taken from one frame descriptor: discrete list, or min/default/max of a continuous range
+#define VIDEO_MODES_FRAME_INTERVALS 8
+
+// Selection passes, constraints are relaxed in this order
+typedef enum {
+  VIDEO_RELAX_NONE = 0,
+  VIDEO_RELAX_FPS,
+  VIDEO_RELAX_MJPEG_FRAME_SIZE,
+  VIDEO_RELAX_BANDWIDTH,
+  VIDEO_RELAX_NUM,
+} VIDEO_ModeRelaxTypeDef;
+
+VIDEO_ModeConstraintsTypeDef USBH_VIDEO_Mode_Constraints = {0};
+
+static VIDEO_ModeTypeDef video_modes[UVC_MAX_MODES];
+static uint8_t video_modes_num = 0;
+static uint32_t video_modes_bus = 0;
+static const VIDEO_ModeTypeDef *video_modes_current = NULL;
+
+// Format descriptor the frame belongs to: frame descriptors follow their format descriptor,
+// all parsed descriptors point into "CfgDesc_Raw", so it is the nearest format before the frame
+static const uint8_t *video_modes_frame_format(const VIDEO_ClassSpecificDescTypedef *class_desc, const void *frame) {
+  const uint8_t *format = NULL;
+
+  for (uint8_t i = 0; i < class_desc->MJPEGFormatNum; i++) {
+    const uint8_t *desc = (const uint8_t *) class_desc->vs_desc.MJPEGFormat[i];
+    if ((desc < (const uint8_t *) frame) && ((format == NULL) || (desc > format)))
+      format = desc;
+  }
+  for (uint8_t i = 0; i < class_desc->UncompFormatNum; i++) {
+    const uint8_t *desc = (const uint8_t *) class_desc->vs_desc.UncompFormat[i];
+    if ((desc < (const uint8_t *) frame) && ((format == NULL) || (desc > format)))
+      format = desc;
+  }
+  return format;
+}
+
+// Frame intervals of a frame descriptor, only the ones inside bLength are used
+static uint8_t video_modes_frame_intervals(const VIDEO_MJPEGFrameDescTypeDef *frame, uint32_t *intervals) {
+  const uint8_t *pdesc = (const uint8_t *) frame;
+  uint8_t num = 0;
+
+  if (frame->bFrameIntervalType == 0) {
+    // Continuous: dwMinFrameInterval, dwMaxFrameInterval, dwFrameIntervalStep
+    if (frame->bLength >= (sizeof(VIDEO_MJPEGFrameDescTypeDef) + 12)) {
+      intervals[num++] = LE32(pdesc + 26);
+      intervals[num++] = frame->dwDefaultFrameInterval;
+      intervals[num++] = LE32(pdesc + 30);
+    }
+  } else {
+    uint8_t declared = (uint8_t) ((frame->bLength - sizeof(VIDEO_MJPEGFrameDescTypeDef)) / 4);
+    if (declared > frame->bFrameIntervalType)
+      declared = frame->bFrameIntervalType;
+    for (uint8_t i = 0; (i < declared) && (num < VIDEO_MODES_FRAME_INTERVALS); i++) {
+      intervals[num++] = LE32(pdesc + 26 + 4 * i);
+    }
+  }
+  if (num == 0)
+    intervals[num++] = frame->dwDefaultFrameInterval;
+  return num;
+}
+
+static void video_modes_add_frame(USBH_VIDEO_TargetFormat_t format, uint8_t bFormatIndex, uint8_t bDefaultFrameIndex, uint32_t frame_size,
+                                  const VIDEO_MJPEGFrameDescTypeDef *frame) {
+  uint32_t intervals[VIDEO_MODES_FRAME_INTERVALS];
+  uint8_t num = video_modes_frame_intervals(frame, intervals);
+
+  for (uint8_t i = 0; i < num; i++) {
+    uint32_t interval = intervals[i];
+    uint8_t duplicate = 0;
+
+    for (uint8_t j = 0; j < i; j++) {
+      if (intervals[j] == interval)
+        duplicate = 1;
+    }
+    if ((interval == 0) || duplicate)
+      continue;
+    if (video_modes_num >= UVC_MAX_MODES) {
+      UVC_DESC_ERR("More than %d modes, the rest is ignored", UVC_MAX_MODES);
+      return;
+    }
+
+    VIDEO_ModeTypeDef *mode = &video_modes[video_modes_num++];
+    mode->interval = interval;
+    mode->frame_size = frame_size;
+    mode->bandwidth = (uint32_t) (((uint64_t) frame_size * 10000000U) / interval);
+    mode->width = frame->wWidth;
+    mode->height = frame->wHeight;
+    mode->format = (uint8_t) format;
+    mode->bFormatIndex = bFormatIndex;
+    mode->bFrameIndex = frame->bFrameIndex;
+    mode->flags = ((interval == frame->dwDefaultFrameInterval) ? VIDEO_MODE_DEFAULT_INTERVAL : 0) |
+                  ((frame->bFrameIndex == bDefaultFrameIndex) ? VIDEO_MODE_DEFAULT_FRAME : 0);
+  }
+}
+
+// Isochronous bytes per second of the biggest alt setting "USBH_VIDEO_SelectAltSetting" can use
+static uint32_t video_modes_alt_bandwidth(USBH_HandleTypeDef *phost, const VIDEO_HandleTypeDef *VIDEO_Handle) {
+  uint32_t best = 0;
+
+  for (int index = 0; index < VIDEO_MAX_VIDEO_STD_INTERFACE; index++) {
+    const VIDEO_STREAMING_IN_HandleTypeDef *stream = &VIDEO_Handle->stream_in[index];
+    if (stream->valid != 1)
+      continue;
+
+    uint8_t ep_mult = (phost->device.speed == USBH_SPEED_HIGH) ? UVC_EP_MULT(stream->EpSize) : 1;
+    uint32_t ep_size = (uint32_t) UVC_EP_PACKET_SIZE(stream->EpSize) * ep_mult;
+    uint32_t interval = 1U << (((stream->Poll >= 1) && (stream->Poll <= 16)) ? (stream->Poll - 1) : 0);
+    if ((ep_size > UVC_RX_FIFO_SIZE_LIMIT) || (ep_mult > UVC_ISOC_MAX_MULT))
+      continue;
+
+    uint32_t bandwidth = (ep_size * ((phost->device.speed == USBH_SPEED_HIGH) ? 8000U : 1000U)) / interval;
+    if (bandwidth > best)
+      best = bandwidth;
+  }
+  return best;
+}
+
+uint8_t video_modes_build(USBH_HandleTypeDef *phost) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  VIDEO_ClassSpecificDescTypedef *class_desc = &VIDEO_Handle->class_desc;
+
+  video_modes_num = 0;
+  video_modes_current = NULL;
+  video_modes_bus = video_modes_alt_bandwidth(phost, VIDEO_Handle);
+
+  for (uint8_t i = 0; i < class_desc->MJPEGFrameNum; i++) {
+    VIDEO_MJPEGFrameDescTypeDef *frame = class_desc->vs_desc.MJPEGFrame[i];
+    const uint8_t *format = video_modes_frame_format(class_desc, frame);
+    if ((format == NULL) || (format[2] != UVC_VS_FORMAT_MJPEG))
+      continue;
+
+    const VIDEO_MJPEGFormatDescTypeDef *mjpeg = (const VIDEO_MJPEGFormatDescTypeDef *) format;
+    video_modes_add_frame(USBH_VIDEO_MJPEG, mjpeg->bFormatIndex, mjpeg->bDefaultFrameIndex, frame->dwMaxVideoFrameBufferSize, frame);
+  }
+
+  for (uint8_t i = 0; i < class_desc->UncompFrameNum; i++) {
+    VIDEO_UncompFrameDescTypeDef *frame = class_desc->vs_desc.UncompFrame[i];
+    const uint8_t *format = video_modes_frame_format(class_desc, frame);
+    if ((format == NULL) || (format[2] != UVC_VS_FORMAT_UNCOMPRESSED))
+      continue;
+
+    // Stream parser knows only YUY2 of the uncompressed formats
+    const VIDEO_UncompFormatDescTypeDef *uncomp = (const VIDEO_UncompFormatDescTypeDef *) format;
+    if (memcmp(uncomp->guidFormat, "YUY2", 4) != 0)
+      continue;
+
+    uint8_t bpp = (uncomp->bBitsPerPixel != 0) ? uncomp->bBitsPerPixel : 16;
+    uint32_t frame_size = ((uint32_t) frame->wWidth * frame->wHeight * bpp) / 8U;
+    video_modes_add_frame(USBH_VIDEO_YUY2, uncomp->bFormatIndex, uncomp->bDefaultFrameIndex, frame_size, (const VIDEO_MJPEGFrameDescTypeDef *) frame);
+  }
+
+  UVC_DESC_LOG("%d modes, isochronous bandwidth %lu B/s", video_modes_num, (unsigned long) video_modes_bus);
+#if (UVC_TRACE_DESC > 1)
+  for (uint8_t i = 0; i < video_modes_num; i++) {
+    const VIDEO_ModeTypeDef *mode = &video_modes[i];
+    UVC_DESC_LOG(" %s %d/%d: %d x %d, %lu.%02lu fps, frame %lu B, %lu B/s%s", (mode->format == USBH_VIDEO_MJPEG) ? "MJPEG" : "YUY2",
+                 mode->bFormatIndex, mode->bFrameIndex, mode->width, mode->height, (unsigned long) (VIDEO_MODE_FPS_X100(mode->interval) / 100),
+                 (unsigned long) (VIDEO_MODE_FPS_X100(mode->interval) % 100), (unsigned long) mode->frame_size, (unsigned long) mode->bandwidth, (mode->flags & VIDEO_MODE_DEFAULT_INTERVAL) ? " (default)" : "");
+  }
+#endif
+  return video_modes_num;
+}
+
+const VIDEO_ModeTypeDef *video_modes_table(uint8_t *num) {
+  *num = video_modes_num;
+  return video_modes;
+}
+
+uint32_t video_modes_bus_bandwidth(void) {
+  return video_modes_bus;
+}
+
+const VIDEO_ModeTypeDef *video_modes_selected(void) {
+  return video_modes_current;
+}
+
+const VIDEO_ModeTypeDef *video_modes_find(uint8_t bFormatIndex, uint8_t bFrameIndex, uint32_t interval) {
+  for (uint8_t i = 0; i < video_modes_num; i++) {
+    const VIDEO_ModeTypeDef *mode = &video_modes[i];
+    if ((mode->bFormatIndex != bFormatIndex) || (mode->bFrameIndex != bFrameIndex))
+      continue;
+    if ((mode->interval == interval) || ((interval == 0) && (mode->flags & VIDEO_MODE_DEFAULT_INTERVAL)))
+      return mode;
+  }
+  return NULL;
+}
+
+void video_modes_set_selected(const VIDEO_ModeTypeDef *mode) {
+  video_modes_current = mode;
+}
+
+uint8_t video_modes_assembled(const VIDEO_ModeTypeDef *mode) {
+  if (mode->format == USBH_VIDEO_MJPEG)
+    return 1;
+  return ((mode->format == USBH_VIDEO_YUY2) && (mode->frame_size <= UVC_FRAME_DATA_LIMIT)) ? 1U : 0U;
+}
+
+static int video_modes_allowed(const VIDEO_ModeTypeDef *mode, const VIDEO_ModeConstraintsTypeDef *c, VIDEO_ModeRelaxTypeDef relax) {
+  if (((c->formats & (1U << mode->format)) == 0) || !video_modes_assembled(mode))
+    return 0;
+  if ((relax < VIDEO_RELAX_FPS) && (VIDEO_MODE_FPS_X100(mode->interval) < c->min_fps_x100))
+    return 0;
+  if ((relax < VIDEO_RELAX_BANDWIDTH) && (c->max_bandwidth != 0) && (mode->bandwidth > c->max_bandwidth))
+    return 0;
+  if (mode->frame_size > c->max_frame_size) {
+    // Every uncompressed frame has this size, all of them would be truncated
+    if ((mode->format != USBH_VIDEO_MJPEG) || (relax < VIDEO_RELAX_MJPEG_FRAME_SIZE))
+      return 0;
+  }
+  return 1;
+}
+
+// 0 - wanted frame size, 1 - smaller frame, 2 - bigger frame
+static uint8_t video_modes_size_class(const VIDEO_ModeTypeDef *mode, const VIDEO_ModeConstraintsTypeDef *c) {
+  if ((mode->width == c->width) && (mode->height == c->height))
+    return 0;
+  if ((c->width == 0) || (c->height == 0) || ((mode->width <= c->width) && (mode->height <= c->height)))
+    return 1;
+  return 2;
+}
+
+// 1 if "mode" is better than "best": frame size closest to the wanted one, then frame rate, then bandwidth
+static int video_modes_better(const VIDEO_ModeTypeDef *mode, const VIDEO_ModeTypeDef *best, const VIDEO_ModeConstraintsTypeDef *c) {
+  uint8_t mode_class = video_modes_size_class(mode, c);
+  uint8_t best_class = video_modes_size_class(best, c);
+  uint32_t mode_area = (uint32_t) mode->width * mode->height;
+  uint32_t best_area = (uint32_t) best->width * best->height;
+
+  if (mode_class != best_class)
+    return mode_class < best_class;
+  if (mode_area != best_area)
+    return (mode_class == 2) ? (mode_area < best_area) : (mode_area > best_area);
+  if (mode->interval != best->interval)
+    return mode->interval < best->interval;
+  return mode->bandwidth < best->bandwidth;
+}
+
+const VIDEO_ModeTypeDef *video_modes_select(const VIDEO_ModeConstraintsTypeDef *constraints) {
+  VIDEO_ModeConstraintsTypeDef c = *constraints;
+
+  if (c.formats == 0)
+    c.formats = (uint8_t) (1U << USBH_VIDEO_Target_Format);
+  if ((c.width == 0) || (c.height == 0)) {
+    c.width = (uint16_t) USBH_VIDEO_Target_Width;
+    c.height = (uint16_t) USBH_VIDEO_Target_Height;
+  }
+  if (c.max_bandwidth == 0)
+    c.max_bandwidth = video_modes_bus;
+  if ((c.max_frame_size == 0) || (c.max_frame_size > UVC_FRAME_DATA_LIMIT))
+    c.max_frame_size = UVC_FRAME_DATA_LIMIT;
+
+  for (VIDEO_ModeRelaxTypeDef relax = VIDEO_RELAX_NONE; relax < VIDEO_RELAX_NUM; relax++) {
+    const VIDEO_ModeTypeDef *best = NULL;
+
+    for (uint8_t i = 0; i < video_modes_num; i++) {
+      const VIDEO_ModeTypeDef *mode = &video_modes[i];
+      if (video_modes_allowed(mode, &c, relax) && ((best == NULL) || video_modes_better(mode, best, &c)))
+        best = mode;
+    }
+    if (best != NULL) {
+      UVC_DESC_LOG("Selected mode %d/%d: %d x %d, %lu.%02lu fps, %lu B/s (relaxed %d)", best->bFormatIndex, best->bFrameIndex, best->width,
+                   best->height, (unsigned long) (VIDEO_MODE_FPS_X100(best->interval) / 100),
+                   (unsigned long) (VIDEO_MODE_FPS_X100(best->interval) % 100), (unsigned long) best->bandwidth, relax);
+      video_modes_current = best;
+      return best;
+    }
+  }
+  UVC_DESC_ERR("No mode of format 0x%02X", c.formats);
+  video_modes_current = NULL;
+  return NULL;
+}
@@ -0,0 +1,109 @@
+
+#include "usbh_video_record.h"
+
+#include <string.h>
+
+#if UVC_RECORD
+
+#define RECORD_RING_MASK (UVC_RECORD_RING_SIZE - 1U)
+
+#if (UVC_RECORD_RING_SIZE & RECORD_RING_MASK) != 0
+#error "UVC_RECORD_RING_SIZE must be a power of 2"
+#endif
+
+uint8_t video_record_buf[UVC_RECORD_RING_SIZE];
+
+// Free-running positions: "ring_head" is moved by the producer, "ring_tail" by the consumer
+static volatile uint32_t ring_head = 0;
+static volatile uint32_t ring_tail = 0;
+
+static volatile uint8_t recording = 0;
+static volatile uint8_t stream_pending = 0;  // stream record is written before the next URB record
+static uint8_t stream_valid = 0;
+static VIDEO_RecordStreamTypeDef stream_info;
+
+static volatile uint32_t records = 0;
+static volatile uint32_t dropped = 0;
+
+static void ring_copy_in(uint32_t pos, const uint8_t *data, uint32_t len) {
+  uint32_t offset = pos & RECORD_RING_MASK;
+  uint32_t first = UVC_RECORD_RING_SIZE - offset;
+
+  if (first > len)
+    first = len;
+  memcpy(&video_record_buf[offset], data, first);
+  memcpy(video_record_buf, data + first, len - first);
+}
+
+// Record is written whole or not at all
+static uint8_t ring_put(uint8_t channel, uint32_t timestamp, uint8_t type, const uint8_t *data, uint16_t length) {
+  VIDEO_RecordHeaderTypeDef header = {timestamp, length, channel, type};
+  uint32_t head = ring_head;
+  uint32_t used = head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+  if ((sizeof(header) + length) > (UVC_RECORD_RING_SIZE - used)) {
+    dropped++;
+    return 0;
+  }
+
+  ring_copy_in(head, (const uint8_t *) &header, sizeof(header));
+  if (length != 0)
+    ring_copy_in(head + sizeof(header), data, length);
+  __atomic_store_n(&ring_head, head + sizeof(header) + length, __ATOMIC_RELEASE);
+  records++;
+  return 1;
+}
+
+void video_record_start(void) {
+  stream_pending = 1;
+  recording = 1;
+}
+
+void video_record_stop(void) {
+  recording = 0;
+}
+
+void video_record_stream(const VIDEO_RecordStreamTypeDef *stream) {
+  stream_info = *stream;
+  stream_info.magic = VIDEO_RECORD_MAGIC;
+  stream_info.version = VIDEO_RECORD_VERSION;
+  stream_valid = 1;
+  stream_pending = 1;
+}
+
+void video_record_urb(uint8_t channel, uint32_t timestamp, uint8_t type, const uint8_t *data, uint16_t length) {
+  if (!recording || !stream_valid)
+    return;
+
+  // Every log starts with the stream parameters, the replay configures the parser from them
+  if (stream_pending) {
+    if (!ring_put(0, timestamp, VIDEO_RECORD_STREAM, (const uint8_t *) &stream_info, sizeof(stream_info)))
+      return;
+    stream_pending = 0;
+  }
+  ring_put(channel, timestamp, type, data, (data != NULL) ? length : 0);
+}
+
+uint32_t video_record_read(uint8_t *buf, uint32_t len) {
+  uint32_t tail = ring_tail;
+  uint32_t used = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) - tail;
+  uint32_t offset = tail & RECORD_RING_MASK;
+
+  if (len > used)
+    len = used;
+  uint32_t first = UVC_RECORD_RING_SIZE - offset;
+  if (first > len)
+    first = len;
+  memcpy(buf, &video_record_buf[offset], first);
+  memcpy(buf + first, video_record_buf, len - first);
+  __atomic_store_n(&ring_tail, tail + len, __ATOMIC_RELEASE);
+  return len;
+}
+
+void video_record_get_stats(VIDEO_RecordStatsTypeDef *stats) {
+  stats->records = records;
+  stats->dropped = dropped;
+  stats->used = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+}
+
+#endif
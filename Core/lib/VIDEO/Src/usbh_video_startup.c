@@ -0,0 +1,83 @@
+// Startup timeline of the camera, see usbh_video_startup.h
+
+#include "usbh_video_startup.h"
+
+#include <string.h>
+
+#include "usbh_conf.h"
+#include "usbh_video_clock.h"
+
+static const char *const startup_event_names[VIDEO_STARTUP_EVENTS] = {
+    "connect", "reset", "address", "config", "class init", "commit", "first packet", "first frame",
+};
+
+static VIDEO_StartupTypeDef startup;
+static uint32_t startup_cycles;  // cycle counter at CONNECT
+
+void video_startup_reset(void) {
+  __atomic_store_n(&startup.marked, 0, __ATOMIC_RELEASE);
+  memset(startup.time_us, 0, sizeof(startup.time_us));
+  startup.idVendor = 0;
+  startup.idProduct = 0;
+
+  // Cycle counter is started here, the VIDEO class starts it only when a camera is initialized
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  startup_cycles = VIDEO_CLOCK_HOST_CYCLES();
+}
+
+void video_startup_user_event(USBH_HandleTypeDef *phost, uint8_t id) {
+  switch (id) {
+    case HOST_USER_DEVICE_DETECTED:
+      // Timeline starts with the first attempt, reset retries are not a new connection
+      if (phost->device.RstCnt == 0U)
+        video_startup_reset();
+      video_startup_mark(VIDEO_STARTUP_CONNECT);
+      break;
+    case HOST_USER_CONNECTION:
+      video_startup_mark(VIDEO_STARTUP_RESET);
+      break;
+    case HOST_USER_ADDRESS_ASSIGNED:
+      video_startup_mark(VIDEO_STARTUP_ADDRESS);
+      break;
+    case HOST_USER_CONFIGURED:
+      video_startup_mark(VIDEO_STARTUP_CONFIG);
+      break;
+    default:
+      break;
+  }
+}
+
+void video_startup_mark(VIDEO_StartupEventTypeDef event) {
+  uint32_t bit = 1UL << event;
+
+  // Called for every packet until the first one is marked, so the check comes first
+  if ((__atomic_load_n(&startup.marked, __ATOMIC_RELAXED) & bit) != 0)
+    return;
+
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  uint32_t elapsed = VIDEO_CLOCK_HOST_CYCLES() - startup_cycles;
+  startup.time_us[event] = (cycles_per_us != 0) ? (elapsed / cycles_per_us) : 0;
+  __atomic_fetch_or(&startup.marked, bit, __ATOMIC_RELEASE);
+}
+
+void video_startup_set_device(uint16_t idVendor, uint16_t idProduct) {
+  startup.idVendor = idVendor;
+  startup.idProduct = idProduct;
+}
+
+void video_startup_read(VIDEO_StartupTypeDef *timeline) {
+  memset(timeline, 0, sizeof(*timeline));
+  timeline->marked = __atomic_load_n(&startup.marked, __ATOMIC_ACQUIRE);
+  // Only the marked steps are copied, a step marked after the load above is left out
+  for (int event = 0; event < VIDEO_STARTUP_EVENTS; event++) {
+    if (timeline->marked & (1UL << event))
+      timeline->time_us[event] = startup.time_us[event];
+  }
+  timeline->idVendor = startup.idVendor;
+  timeline->idProduct = startup.idProduct;
+}
+
+const char *video_startup_event_name(VIDEO_StartupEventTypeDef event) {
+  return ((unsigned) event < VIDEO_STARTUP_EVENTS) ? startup_event_names[event] : "?";
+}
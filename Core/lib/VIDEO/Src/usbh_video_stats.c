@@ -0,0 +1,76 @@
+
+#include "usbh_video_stats.h"
+
+#include <string.h>
+
+#include "usbh_conf.h"
+
+VIDEO_StatsTypeDef video_stats_live;
+
+// Published copies: while "stats_seq" is odd the producer writes copy 0, while it is even - copy 1
+static VIDEO_StatsTypeDef stats_copy[2];
+static volatile uint32_t stats_seq = 0;
+
+// Rate window
+static uint32_t window_start_us;
+static uint32_t window_frames;
+static uint64_t window_bytes;
+static uint8_t window_valid = 0;
+
+// Producer: frame is completed at "now_us" (host time), must be called before "video_stats_publish"
+void video_stats_frame_done(uint32_t now_us) {
+  VIDEO_StatsTypeDef *stats = &video_stats_live;
+
+  stats->frames_delivered++;
+  stats->last_frame_tick = HAL_GetTick();
+  // After a stall or a stream restart (host time starts over) the window would average over the gap
+  if (window_valid && ((now_us - window_start_us) > (2U * VIDEO_STATS_WINDOW_US)))
+    window_valid = 0;
+  if (!window_valid) {
+    window_start_us = now_us;
+    window_frames = 0;
+    window_bytes = stats->payload_bytes;
+    window_valid = 1;
+    return;
+  }
+
+  window_frames++;
+  uint32_t elapsed = now_us - window_start_us;
+  if (elapsed >= VIDEO_STATS_WINDOW_US) {
+    stats->fps_x100 = (uint32_t) (((uint64_t) window_frames * 100000000ULL) / elapsed);
+    stats->bytes_per_sec = (uint32_t) (((stats->payload_bytes - window_bytes) * 1000000ULL) / elapsed);
+    window_start_us = now_us;
+    window_frames = 0;
+    window_bytes = stats->payload_bytes;
+  }
+}
+
+// Producer: make the live counters visible to readers
+void video_stats_publish(void) {
+  uint32_t seq = stats_seq;
+
+  __atomic_store_n(&stats_seq, seq + 1, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  stats_copy[0] = video_stats_live;
+  __atomic_store_n(&stats_seq, seq + 2, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  stats_copy[1] = video_stats_live;
+}
+
+// Consumer: copy that is not being written now is taken, it is valid if the producer did not move on
+void video_stats_read(VIDEO_StatsTypeDef *stats) {
+  uint32_t seq;
+
+  do {
+    seq = __atomic_load_n(&stats_seq, __ATOMIC_ACQUIRE);
+    memcpy(stats, &stats_copy[(seq & 1U) ? 1 : 0], sizeof(*stats));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&stats_seq, __ATOMIC_RELAXED) != seq);
+
+  // Rates are recomputed by the producer only when a frame completes: when the stream stalls they would keep the
+  // last values, so they are aged here - no frame over a whole window means no frames and no throughput
+  if ((stats->frames_delivered == 0) || ((HAL_GetTick() - stats->last_frame_tick) > (VIDEO_STATS_WINDOW_US / 1000U))) {
+    stats->fps_x100 = 0;
+    stats->bytes_per_sec = 0;
+  }
+}
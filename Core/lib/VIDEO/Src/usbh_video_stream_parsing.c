@@ -3,8 +3,14 @@
 
 #include <stdbool.h>
 
+#include "dwt_prof.h"
 #include "usbh_video.h"
+#include "usbh_video_clock.h"
 #include "usbh_video_desc_parsing.h"
+#include "usbh_video_frame_ring.h"
+#include "usbh_video_startup.h"
+#include "usbh_video_stats.h"
+#include "usbh_video_trace.h"
 
 
 uint8_t uvc_prev_fid_state = 0;
@@ -22,149 +28,515 @@ bool uvc_frame_start_detected = true;
 // Previous packet was EOF
 bool uvc_prev_packet_eof = true;
 
-extern volatile uint8_t tmp_packet_framebuffer[UVC_RX_FIFO_SIZE_LIMIT];
-
-// Pointers to a framebuffers to store captured frame
+extern volatile uint8_t tmp_packet_framebuffer[UVC_ISOC_URBS][UVC_RX_FIFO_SIZE_LIMIT];
 
 videoPacketArrived videoCallback = NULL;
 
-uint8_t* uvc_framebuffer0_ptr = NULL;
-uint8_t* uvc_framebuffer1_ptr = NULL;
+#if UVC_ISR_FAST_PATH
+// Descriptor of the last completed frame, passed to "videoCallback" by "video_stream_deliver_frame".
+// It is a copy: the slot itself may be taken, released and refilled before the host thread runs.
+// The interrupt writes it with "uvc_completed_gen" odd, the host thread copies it again if the
+// generation changed meanwhile.
+static VIDEO_FrameTypeDef uvc_completed_frame;
+static volatile uint32_t uvc_completed_gen = 0;
+static uint32_t uvc_delivered_gen = 0;
+#endif
+
+// Framebuffers to store captured frames
+VIDEO_FrameRingTypeDef uvc_frame_ring;
+
+// Pool of the frame ring (UVC_FRAME_RING_SLOTS * UVC_MAX_FRAME_SIZE bytes) and the frame bytes that fit into one of its framebuffers
+static uint8_t* uvc_frame_pool = NULL;
+static uint32_t uvc_frame_data_limit = UVC_FRAME_DATA_LIMIT;
+
+// Committed dwMaxVideoFrameSize, the exact size of uncompressed frames; 0 - unknown
+static uint32_t uvc_frame_size = 0;
+
+// Slot that is FILLING now, NULL if the consumer holds all other slots
+VIDEO_FrameSlotTypeDef* uvc_curr_slot = NULL;
 
 // Pointer to a buffer that is FILLING now
 uint8_t* uvc_curr_framebuffer_ptr = NULL;
 
+// VIDEO_FRAME_FLAG_xxx of the frame that is FILLING now
+uint32_t uvc_curr_frame_flags = 0;
+
+// Buffer given to the URB that is in flight now (see "video_stream_rx_buffer")
+uint8_t* uvc_rx_packet_ptr = NULL;
+
+#if UVC_INTEGRITY_CHECK
+// Number of payloads that were corrupted while copied into the framebuffer
+volatile uint32_t uvc_integrity_errors = 0;
+#endif
+
+#if UVC_ZERO_COPY_RX
+// Frame bytes covered by the header of the in-flight packet, they are put back when the packet lands
+uint8_t uvc_zc_stash[UVC_HEADER_SIZE];
+uint8_t uvc_zc_stash_len = 0;
+bool uvc_zc_stash_valid = false;
+#endif
+
+// Payload header length of the last packet, used to place the next URB
+uint8_t uvc_rx_header_len = UVC_HEADER_SIZE;
+
 extern USBH_VIDEO_TargetFormat_t USBH_VIDEO_Target_Format;
 
 //****************************************************************************
 
 void video_stream_add_packet_data(uint8_t* buf, uint16_t data_size);
+static int video_stream_parse_packet(uint16_t size);
 uint8_t video_stream_switch_buffers(void);
+uint8_t video_stream_begin_frame(void);
 
 void videoPacketArrivedCallback(videoPacketArrived callback) {
   videoCallback = callback;
 }
 
+// First byte of the frame data in the current framebuffer
+static inline uint8_t* video_stream_frame_data(void) {
+  return uvc_curr_slot->frame.data;
+}
+
 //****************************************************************************
-// size - new packet size
-int video_stream_process_packet(uint16_t size) {
-  printf("size:%d\r\n", size);
-  for (uint32_t i = 0; i < size; i++) {
-    if (i % 1024 == 0) {
-      printf("\r\n");
+// Returns a buffer for the next isochronous URB, "max_len" bytes can be written there.
+// Zero-copy mode: URB is placed so that the packet header covers the last "uvc_rx_header_len" bytes
+// of the frame and the payload lands exactly at the frame write cursor. The covered bytes are
+// stashed here and restored in "video_stream_process_packet".
+// If the cursor is not 32-bit aligned (OTG DMA requirement) or the packet may not fit, the
+// staging buffer is used and the payload is copied as before.
+uint8_t* video_stream_rx_buffer(uint16_t max_len) {
+  uvc_rx_packet_ptr = (uint8_t*) tmp_packet_framebuffer[0];
+
+#if UVC_ZERO_COPY_RX
+  uvc_zc_stash_valid = false;
+  if (uvc_parsing_initialized && (uvc_curr_slot != NULL)) {
+    uint8_t* rx_ptr = video_stream_frame_data() + uvc_curr_frame_length - uvc_rx_header_len;
+
+    if ((((uintptr_t) rx_ptr & 0x03U) == 0U) && ((rx_ptr + max_len) <= (uvc_curr_framebuffer_ptr + uvc_frame_ring.buffer_size))) {
+      memcpy(uvc_zc_stash, rx_ptr, uvc_rx_header_len);
+      uvc_zc_stash_len = uvc_rx_header_len;
+      uvc_zc_stash_valid = true;
+      uvc_rx_packet_ptr = rx_ptr;
+    }
+  }
+#endif
+
+  return uvc_rx_packet_ptr;
+}
+
+// UVC_ISOC_PINGPONG: buffer for the next URB of the isochronous channel "index".
+// Position of the packet in the frame is not known while the previous packet is in flight,
+// so every channel has its own staging buffer and the payload is copied.
+uint8_t* video_stream_rx_staging(uint8_t index) {
+#if UVC_ZERO_COPY_RX
+  uvc_zc_stash_valid = false;
+#endif
+  return (uint8_t*) tmp_packet_framebuffer[index];
+}
+
+// Packet of "size" bytes was received into the buffer returned by "video_stream_rx_staging"
+int video_stream_process_staged(uint8_t index, uint16_t size) {
+  uvc_rx_packet_ptr = (uint8_t*) tmp_packet_framebuffer[index];
+  return video_stream_process_packet(size);
+}
+
+// Put back frame bytes that were covered by the header of a packet received in place
+static inline void video_stream_zc_restore(uint8_t* packet, uint8_t stash_len) {
+#if UVC_ZERO_COPY_RX
+  if (stash_len != 0) {
+    memcpy(packet, uvc_zc_stash, stash_len);
+  }
+#else
+  (void) packet;
+  (void) stash_len;
+#endif
+}
+
+static inline uint32_t video_stream_get_le32(const uint8_t* buf) {
+  return (uint32_t) buf[0] | ((uint32_t) buf[1] << 8) | ((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+// Take PTS and SCR from the payload header if they are present
+static void video_stream_parse_clocks(const uint8_t* header, uint8_t header_len) {
+  uint8_t info = header[UVC_HEADER_BIT_FIELD_POS];
+  uint8_t needed = UVC_HEADER_MIN_SIZE;
+
+  if (info & UVC_HEADER_PTS_BIT)
+    needed += UVC_HEADER_PTS_SIZE;
+  if (info & UVC_HEADER_SCR_BIT)
+    needed += UVC_HEADER_SCR_SIZE;
+
+  // Header fields are valid only when the header is complete and long enough for them
+  if (((info & UVC_HEADER_EOH_BIT) == 0) || (header_len < needed)) {
+    if (info & (UVC_HEADER_PTS_BIT | UVC_HEADER_SCR_BIT)) {
+      UVC_PARSER_DBG("bad header: length %d, info 0x%02X", header_len, info);
     }
-    printf("%02X ", tmp_packet_framebuffer[i]);
+    return;
+  }
+
+  const uint8_t* field = &header[UVC_HEADER_MIN_SIZE];
+  VIDEO_FrameTypeDef* frame = &uvc_curr_slot->frame;
+
+  if (info & UVC_HEADER_PTS_BIT) {
+    // PTS is the same in all packets of the frame, the first one is kept
+    if ((uvc_curr_frame_flags & VIDEO_FRAME_FLAG_PTS) == 0) {
+      frame->pts = video_stream_get_le32(field);
+      uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_PTS;
+    }
+    field += UVC_HEADER_PTS_SIZE;
+  }
+  if (info & UVC_HEADER_SCR_BIT) {
+    // SCR is sampled per packet, the latest one is kept
+    frame->scr_stc = video_stream_get_le32(field);
+    frame->scr_sof = ((uint16_t) field[4] | ((uint16_t) field[5] << 8)) & UVC_HEADER_SCR_SOF_MASK;
+    uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_SCR;
+    video_clock_add_scr(frame->scr_stc, frame->scr_sof);
+  }
+}
+
+// Packet in the buffer returned by "video_stream_rx_buffer" was lost (URB error).
+// Frame bytes covered by the buffer are put back, the frame is marked as damaged.
+void video_stream_drop_packet(void) {
+#if UVC_ZERO_COPY_RX
+  if (uvc_zc_stash_valid) {
+    video_stream_zc_restore(uvc_rx_packet_ptr, uvc_zc_stash_len);
+    uvc_zc_stash_valid = false;
   }
-  printf("\r\n");
+#endif
+  video_stream_retry_packet();
+}
+
+// Packet is lost but its URB is still in flight (the channel retries in the next (micro)frame),
+// the receive buffer stays as it is
+void video_stream_retry_packet(void) {
+  if (uvc_curr_slot != NULL) {
+    uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_ERROR;
+  }
+  video_stats_live.lost_packets++;
+  video_stats_publish();
+}
+
+//****************************************************************************
+// size - new packet size, packet is located in the buffer returned by "video_stream_rx_buffer"
+int video_stream_process_packet(uint16_t size) {
+  DWT_PROF_BEGIN(DWT_PROF_PARSE_PACKET);
+  int result = video_stream_parse_packet(size);
+  video_stats_publish();
+  DWT_PROF_END(DWT_PROF_PARSE_PACKET);
+  return result;
+}
+
+static int video_stream_parse_packet(uint16_t size) {
+  uint8_t* packet = uvc_rx_packet_ptr;
+  uint8_t header[UVC_HEADER_SIZE];
+  uint8_t stash_len = 0;
+
+  if (packet == NULL)
+    return 0;
+
+  video_stats_live.packets++;
+  UVC_PARSER_DBG("packet size:%d", size);
+  UVC_PARSER_DUMP(packet, size);
 
-  if ((size < 2) && (size > UVC_RX_FIFO_SIZE_LIMIT))
+#if UVC_ZERO_COPY_RX
+  if (uvc_zc_stash_valid) {
+    // Header landed on top of the frame data, frame bytes are put back after the payload is in place
+    stash_len = uvc_zc_stash_len;
+    uvc_zc_stash_valid = false;
+  }
+#endif
+
+  if (size == 0) {
+    video_stats_live.empty_packets++;
+    video_stream_zc_restore(packet, stash_len);
+    return 0;  // empty packet
+  }
+
+  uint8_t header_len = packet[UVC_HEADER_SIZE_POS];
+  if ((size > UVC_RX_FIFO_SIZE_LIMIT) || (header_len < UVC_HEADER_MIN_SIZE) || (header_len > UVC_HEADER_SIZE) || (header_len > size)) {
+    UVC_PARSER_DBG("bad packet: size %d, header length %d", size, header_len);
+    video_stats_live.bad_packets++;
+    video_stream_zc_restore(packet, stash_len);
     return 0;  // error
+  }
+
+  memcpy(header, packet, header_len);
+  uint8_t* payload = packet + header_len;
+  uint16_t data_size = size - header_len;
+  // Next URB is placed for the header length that camera uses now
+  uvc_rx_header_len = header_len;
+
+  video_stats_live.payload_bytes += data_size;
+  if (data_size == 0)
+    video_stats_live.header_only_packets++;
 
   if (!uvc_parsing_initialized) {
-    video_stream_switch_buffers();  // try to switch buffers
+    video_stream_zc_restore(packet, stash_len);
+    return 0;  // no framebuffers yet
   }
 
-  if (size <= UVC_HEADER_SIZE) {
-  } else if (size > UVC_HEADER_SIZE) {
-    // Get FID bit state
-    if (tmp_packet_framebuffer[UVC_HEADER_BIT_FIELD_POS] & UVC_HEADER_ERR_BIT) {
-    USBH_UsrLog("uvc error bit is set\r\n");
-    }
-    uint8_t masked_fid = (tmp_packet_framebuffer[UVC_HEADER_BIT_FIELD_POS] & UVC_HEADER_FID_BIT);
-    if ((masked_fid != uvc_prev_fid_state) && (uvc_prev_packet_eof == true)) {
-      // Detected FIRST packet of the frame
-      USBH_UsrLog("find a new frame\r\n");
-      uvc_curr_frame_length = 0;
-      uvc_frame_start_detected = true;
+  uint8_t info = header[UVC_HEADER_BIT_FIELD_POS];
+  uint8_t masked_fid = (info & UVC_HEADER_FID_BIT);
+  bool new_frame = (masked_fid != uvc_prev_fid_state) && (uvc_prev_packet_eof == true);
+  // Uncompressed frame that missed bytes never reaches its size, the next one starts with the FID anyway
+  if ((masked_fid != uvc_prev_fid_state) && (USBH_VIDEO_Target_Format == USBH_VIDEO_YUY2))
+    new_frame = true;
+  if ((masked_fid != uvc_prev_fid_state) && !uvc_prev_packet_eof)
+    video_stats_live.fid_without_eof++;
+  uvc_prev_fid_state = masked_fid;
+  uvc_prev_packet_eof = (info & UVC_HEADER_EOF_BIT) != 0;
+
+  if (uvc_curr_slot == NULL) {
+    // Previous frame was skipped, there is no slot to capture into (packet is in the staging buffer).
+    // Next slot is requested at the frame start only, so every skipped frame is counted once.
+    if (!new_frame || !video_stream_begin_frame())
+      return 0;
+  }
+
+  // Payload is at the write cursor if the header has the expected length
+  bool in_place = (stash_len != 0) && (stash_len == header_len);
+  // Frame bytes under the header are needed unless the frame is restarted
+  bool keep_stash = (stash_len != 0);
+
+  if (new_frame) {
+    // Detected FIRST packet of the frame
+    UVC_PARSER_LOG("new frame");
+    if (uvc_curr_frame_length != 0) {
+      // Payload was received at the old write cursor - it has to be moved to the frame start
+      in_place = false;
+      keep_stash = false;
     }
-    uvc_prev_fid_state = masked_fid;
+    uvc_curr_frame_length = 0;
+    uvc_curr_frame_flags = 0;
+    uvc_frame_start_detected = true;
+  }
+  if (info & UVC_HEADER_ERR_BIT) {
+    UVC_PARSER_DBG("error bit is set");
+    video_stats_live.error_packets++;
+    uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_ERROR;
+  }
+  video_stream_parse_clocks(header, header_len);
 
-    uint16_t data_size = size - UVC_HEADER_SIZE;
-    video_stream_add_packet_data((uint8_t*) (tmp_packet_framebuffer + UVC_HEADER_SIZE), data_size);
+  if (in_place) {
+    // Payload is already in the framebuffer, only the write cursor is moved
+    video_stream_zc_restore(packet, stash_len);
     uvc_curr_frame_length += data_size;
+    if (uvc_curr_frame_length > uvc_frame_data_limit) {
+      uvc_curr_frame_length = uvc_frame_data_limit;
+      uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_TRUNCATED;
+    }
+  } else {
+    // Payload may overlap the stashed bytes (short header), so it is moved first
+    video_stream_add_packet_data(payload, data_size);
+    if (keep_stash) {
+      video_stream_zc_restore(packet, stash_len);
+    }
+  }
 
-    if (tmp_packet_framebuffer[UVC_HEADER_BIT_FIELD_POS] & UVC_HEADER_EOF_BIT)  // Last packet in frame
-    {
-      uvc_prev_packet_eof = true;
-      if (uvc_frame_start_detected == false) {
-        USBH_UsrLog("find a bad frame\r\n");
-        uvc_curr_frame_length = 0;
-        return -1;  // Bad frame data
-      }
+  // Uncompressed frame is also complete when all its bytes are received
+  if ((USBH_VIDEO_Target_Format == USBH_VIDEO_YUY2) && (uvc_frame_size != 0) && (uvc_curr_frame_length >= uvc_frame_size))
+    uvc_prev_packet_eof = true;
 
-      if (USBH_VIDEO_Target_Format == USBH_VIDEO_MJPEG) {
-        USBH_UsrLog("frame size:%d", uvc_curr_frame_length);
-        // for (uint32_t i = 0; i < uvc_curr_frame_length; i++) {
-        //   if (i % 1024 == 0) {
-        //     printf("\r\n");
-        //   }
-        //   printf("%02X ", uvc_framebuffer1_ptr[i]);
-        // }
-        // printf("\r\n");
-        // call frame arrived
-        if (videoCallback != NULL) {
-          videoCallback(uvc_curr_framebuffer_ptr, uvc_curr_frame_length);
-        }
-        video_stream_switch_buffers();
-        return 1;
+  if (uvc_prev_packet_eof)  // Last packet in frame
+  {
+    if (uvc_frame_start_detected == false) {
+      if (uvc_curr_frame_length != 0) {
+        UVC_PARSER_DBG("bad frame");
+        video_stats_live.frames_bad++;
       }
-    } else {
-      uvc_prev_packet_eof = false;
+      uvc_curr_frame_length = 0;
+      uvc_curr_frame_flags = 0;
+      return -1;  // Bad frame data
     }
 
-    // if ((USBH_VIDEO_Target_Format == USBH_VIDEO_YUY2) && (uvc_curr_frame_length >= UVC_UNCOMP_FRAME_SIZE)) {
-    //   if (uvc_frame_start_detected == 0)
-    //     return -1;  // Bad frame data
-
-    //   video_stream_switch_buffers();
-    //   USBH_UsrLog("UVC_UNCOMP_FRAME:");
-    //   //        for (uint32_t i = 0; i < uvc_curr_frame_length; i++) {
-    //   //          if (i % 1024 == 0) {
-    //   //            printf("\r\n");
-    //   //          }
-    //   //          printf("%02X ", uvc_framebuffer1_ptr[i]);
-    //   //        }
-    // }
-    return 0;
+    UVC_PARSER_LOG("frame size:%d", uvc_curr_frame_length);
+    video_stream_switch_buffers();
+    return 1;
   }
   return 0;
 }
 
 // Must be called when full fame is captured
 uint8_t video_stream_switch_buffers(void) {
-  if (uvc_curr_framebuffer_ptr == uvc_framebuffer0_ptr)
-    uvc_curr_framebuffer_ptr = uvc_framebuffer1_ptr;
-  else
-    uvc_curr_framebuffer_ptr = uvc_framebuffer0_ptr;
+  VIDEO_FrameSlotTypeDef* slot = uvc_curr_slot;
+
+  slot->frame.len = uvc_curr_frame_length;
+  slot->frame.timestamp = HAL_GetTick();
+  slot->frame.delivery_time = video_clock_host_time_us();
+  if ((uvc_curr_frame_flags & VIDEO_FRAME_FLAG_PTS) && video_clock_device_to_host(slot->frame.pts, &slot->frame.capture_time)) {
+    uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_CAPTURE;
+  }
+  slot->frame.flags = uvc_curr_frame_flags;
+  video_frame_ring_commit(&uvc_frame_ring, slot);
+  video_startup_mark(VIDEO_STARTUP_FIRST_FRAME);
+
+  if (uvc_curr_frame_flags & VIDEO_FRAME_FLAG_TRUNCATED)
+    video_stats_live.frames_truncated++;
+  video_stats_frame_done(slot->frame.delivery_time);
+
+#if UVC_ISR_FAST_PATH
+  // Interrupt context - callback is called later by the host thread
+  uint32_t gen = uvc_completed_gen;
+  __atomic_store_n(&uvc_completed_gen, gen + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  uvc_completed_frame = slot->frame;
+  __atomic_store_n(&uvc_completed_gen, gen + 2, __ATOMIC_RELEASE);
+#else
+  // call frame arrived, slot is not reused by the producer until the next "video_frame_ring_begin"
+  if (videoCallback != NULL) {
+    DWT_PROF_BEGIN(DWT_PROF_FRAME_CALLBACK);
+    videoCallback(&slot->frame);
+    DWT_PROF_END(DWT_PROF_FRAME_CALLBACK);
+  }
+#endif
+  return video_stream_begin_frame();
+}
+
+// UVC_ISR_FAST_PATH: call "videoCallback" for the last frame completed in the interrupt (host thread).
+// Frames completed while the host thread was busy are reported once, with the latest one.
+void video_stream_deliver_frame(void) {
+#if UVC_ISR_FAST_PATH
+  VIDEO_FrameTypeDef frame;
+  uint32_t gen;
+  do {
+    gen = __atomic_load_n(&uvc_completed_gen, __ATOMIC_ACQUIRE);
+    frame = uvc_completed_frame;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((gen & 1U) || (gen != __atomic_load_n(&uvc_completed_gen, __ATOMIC_RELAXED)));
+
+  if ((gen != uvc_delivered_gen) && (videoCallback != NULL)) {
+    DWT_PROF_BEGIN(DWT_PROF_FRAME_CALLBACK);
+    videoCallback(&frame);
+    DWT_PROF_END(DWT_PROF_FRAME_CALLBACK);
+  }
+  uvc_delivered_gen = gen;
+#endif
+}
+
+// Take the next slot from the frame ring, returns 0 if the frame has to be skipped
+uint8_t video_stream_begin_frame(void) {
+  uvc_curr_slot = video_frame_ring_begin(&uvc_frame_ring);
+  uvc_curr_framebuffer_ptr = (uvc_curr_slot != NULL) ? uvc_curr_slot->buffer : NULL;
+
+  // Frame ring counts consumer drops, they are mirrored into the published statistics
+  video_stats_live.frames_dropped = uvc_frame_ring.dropped_oldest + uvc_frame_ring.dropped_newest;
+  video_stats_live.frames_skipped = uvc_frame_ring.overruns;
 
   uvc_frame_start_detected = false;
   uvc_curr_frame_length = 0;
-  return 1;
+  uvc_curr_frame_flags = 0;
+  return (uvc_curr_slot != NULL) ? 1 : 0;
+}
+
+#if UVC_INTEGRITY_CHECK
+// CRC-32 (IEEE 802.3), 4-bit table to keep flash usage small
+static uint32_t video_stream_crc32(const uint8_t* buf, uint32_t len) {
+  static const uint32_t crc_table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                         0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (uint32_t i = 0; i < len; i++) {
+    crc = (crc >> 4) ^ crc_table[(crc ^ buf[i]) & 0x0F];
+    crc = (crc >> 4) ^ crc_table[(crc ^ (buf[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
 }
+#endif
 
 // Add data from received packet to the image framebuffer
 // buf - pointer to the data source
 void video_stream_add_packet_data(uint8_t* buf, uint16_t data_size) {
-  if ((uvc_curr_frame_length + data_size) > UVC_UNCOMP_FRAME_SIZE) {
-    uvc_curr_frame_length = UVC_UNCOMP_FRAME_SIZE;
+  if ((uvc_curr_frame_length + data_size) > uvc_frame_data_limit) {
+    uvc_curr_frame_length = uvc_frame_data_limit;
+    uvc_curr_frame_flags |= VIDEO_FRAME_FLAG_TRUNCATED;
     return;
   }
-  // Copy data to a current framebuffer
-  memcpy((void*) (uvc_curr_framebuffer_ptr + uvc_curr_frame_length), buf, data_size);
-  for (int i = 0; i < data_size; i++) {
-    if (*(uvc_curr_framebuffer_ptr + uvc_curr_frame_length + i) != buf[i]) {
-      printf("error %d,%02X,%02X\r\n", i, *(uvc_curr_framebuffer_ptr + uvc_curr_frame_length + i), *(buf + i));
-    }
+  uint8_t* dst = video_stream_frame_data() + uvc_curr_frame_length;
+#if UVC_INTEGRITY_CHECK
+  // Source may be overwritten by memmove, so its CRC is taken before the copy
+  uint32_t crc = video_stream_crc32(buf, data_size);
+#endif
+  // Copy data to a current framebuffer (source can be inside of the same framebuffer in zero-copy mode)
+  memmove((void*) dst, buf, data_size);
+#if UVC_INTEGRITY_CHECK
+  if (video_stream_crc32(dst, data_size) != crc) {
+    uvc_integrity_errors++;
+    UVC_PARSER_ERR("payload corrupted at offset %lu", (unsigned long) uvc_curr_frame_length);
   }
+#endif
   uvc_curr_frame_length += data_size;
 }
 
-void video_stream_init_buffers(uint8_t* buffer0, uint8_t* buffer1) {
-  if ((buffer0 == NULL) || (buffer1 == NULL))
+// Nothing of a previous stream is carried into the next frame. FID is kept: cameras go on toggling it
+// when the stream is restarted, so the first frame is detected by its FID as usual.
+static void video_stream_restart(void) {
+  uvc_prev_packet_eof = true;
+  uvc_rx_header_len = UVC_HEADER_SIZE;
+#if UVC_ZERO_COPY_RX
+  uvc_zc_stash_valid = false;
+#endif
+  video_stream_begin_frame();
+}
+
+// One slot is held by the application, the capture needs another one
+_Static_assert((UVC_FRAME_RING_SLOTS >= 2) && (UVC_FRAME_RING_SLOTS <= VIDEO_FRAME_RING_MAX_SLOTS), "UVC_FRAME_RING_SLOTS: 2 to VIDEO_FRAME_RING_MAX_SLOTS");
+
+// pool - UVC_FRAME_RING_SLOTS framebuffers of UVC_MAX_FRAME_SIZE bytes each, 32-bit aligned
+void video_stream_init_buffers(uint8_t* pool) {
+  if (pool == NULL)
+    return;
+
+  if (!video_frame_ring_init(&uvc_frame_ring, pool, UVC_FRAME_RING_SLOTS, UVC_MAX_FRAME_SIZE, UVC_FRAME_HEADROOM, UVC_FRAME_DROP_POLICY))
     return;
 
-  uvc_framebuffer0_ptr = buffer0;
-  uvc_framebuffer1_ptr = buffer1;
-  uvc_curr_framebuffer_ptr = uvc_framebuffer0_ptr;
+  uvc_frame_pool = pool;
+  uvc_frame_data_limit = UVC_FRAME_DATA_LIMIT;
+  uvc_prev_fid_state = 0;
+  video_stream_restart();
   uvc_parsing_initialized = true;
 }
+
+// Carve the pool into as many framebuffers for "frame_size" byte frames as fit (up to VIDEO_FRAME_RING_MAX_SLOTS),
+// never into fewer than UVC_FRAME_RING_SLOTS. Called by the host task while the stream is stopped, frames
+// of the previous stream that were not taken are dropped.
+// Returns the number of framebuffers, 0 if the application holds a frame and the layout is kept.
+uint32_t video_stream_resize_buffers(uint32_t frame_size) {
+  uint32_t pool_size = UVC_FRAME_RING_SLOTS * UVC_MAX_FRAME_SIZE;
+  uint32_t needed = frame_size + UVC_FRAME_HEADROOM;
+  uint32_t count = UVC_FRAME_RING_SLOTS;
+
+  if (!uvc_parsing_initialized)
+    return 0;
+
+  uvc_frame_size = frame_size;
+  if ((frame_size != 0) && (needed < UVC_MAX_FRAME_SIZE)) {
+    count = pool_size / needed;
+    if (count > VIDEO_FRAME_RING_MAX_SLOTS)
+      count = VIDEO_FRAME_RING_MAX_SLOTS;
+  }
+  // Spare bytes of the pool go to the framebuffers, slots stay 32-bit aligned
+  uint32_t buffer_size = (pool_size / count) & ~3UL;
+
+  uint32_t resized = 0;
+  if (video_frame_ring_resize(&uvc_frame_ring, uvc_frame_pool, count, buffer_size, UVC_FRAME_HEADROOM)) {
+    uvc_frame_data_limit = ((buffer_size - UVC_FRAME_HEADROOM) < UVC_FRAME_DATA_LIMIT) ? (buffer_size - UVC_FRAME_HEADROOM) : UVC_FRAME_DATA_LIMIT;
+    resized = count;
+    UVC_PARSER_LOG("frame ring: %lu x %lu bytes", (unsigned long) count, (unsigned long) buffer_size);
+  } else if (frame_size > uvc_frame_data_limit) {
+    UVC_PARSER_ERR("frame ring is not resized, a frame is held: frames over %lu bytes are truncated", (unsigned long) uvc_frame_data_limit);
+  }
+  video_stream_restart();
+  return resized;
+}
+
+// Take the oldest captured frame, NULL if there is none.
+// Frame must be given back with "video_stream_release_frame", capture continues into other slots meanwhile.
+VIDEO_FrameTypeDef* video_stream_get_frame(void) {
+  if (!uvc_parsing_initialized)
+    return NULL;
+  return video_frame_ring_acquire(&uvc_frame_ring);
+}
+
+void video_stream_release_frame(VIDEO_FrameTypeDef* frame) {
+  video_frame_ring_release(&uvc_frame_ring, frame);
+}
@@ -205,6 +205,9 @@ typedef struct
   uint8_t   toggle_out;         /*!< OUT transfer current toggle flag
                                      This parameter must be a number between Min_Data = 0 and Max_Data = 1      */
 
+  uint8_t   frame_parity;       /*!< Periodic channels: (micro)frame the next transfer is scheduled in.
+                                     This parameter can be any value of @ref USB_LL_HC_Frame_Parity             */
+
   uint32_t  dma_addr;           /*!< 32 bits aligned transfer buffer address.                                   */
 
   uint32_t  ErrCnt;             /*!< Host channel error count.                                                  */
@@ -395,6 +398,16 @@ typedef struct
 #define HC_PID_DATA1                           2U
 #define HC_PID_SETUP                           3U
 
+/** @defgroup USB_LL_HC_Frame_Parity USB Low Layer Host Channel Frame Parity
+  * @{
+  */
+#define HC_FRAME_NEXT                          0U
+#define HC_FRAME_EVEN                          1U
+#define HC_FRAME_ODD                           2U
+/**
+  * @}
+  */
+
 #define GRXSTS_PKTSTS_IN                       2U
 #define GRXSTS_PKTSTS_IN_XFER_COMP             3U
 #define GRXSTS_PKTSTS_DATA_TOGGLE_ERR          5U
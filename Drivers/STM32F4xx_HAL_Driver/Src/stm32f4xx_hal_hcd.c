@@ -55,6 +55,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx_hal.h"
+#include "dwt_prof.h"
 
 /** @addtogroup STM32F4xx_HAL_Driver
   * @{
@@ -225,6 +226,7 @@ HAL_StatusTypeDef HAL_HCD_HC_Init(HCD_HandleTypeDef *hhcd,
   }
 
   hhcd->hc[ch_num].speed = speed;
+  hhcd->hc[ch_num].frame_parity = HC_FRAME_NEXT;
 
   status =  USB_HC_Init(hhcd->Instance,
                         ch_num,
@@ -256,6 +258,27 @@ HAL_StatusTypeDef HAL_HCD_HC_Halt(HCD_HandleTypeDef *hhcd, uint8_t ch_num)
   return status;
 }
 
+/**
+  * @brief  Select the (micro)frame parity of the next transfers of a periodic channel.
+  *         Two channels of the same endpoint armed for even and odd (micro)frames
+  *         keep a transfer queued while the other one is being handled.
+  * @param  hhcd HCD handle
+  * @param  ch_num Channel number.
+  *         This parameter can be a value from 1 to 15
+  * @param  parity Frame parity.
+  *          This parameter can be one of these values:
+  *            HC_FRAME_NEXT: next (micro)frame (default)
+  *            HC_FRAME_EVEN: even (micro)frame
+  *            HC_FRAME_ODD: odd (micro)frame
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_HCD_HC_SetFrameParity(HCD_HandleTypeDef *hhcd, uint8_t ch_num, uint8_t parity)
+{
+  hhcd->hc[ch_num].frame_parity = parity;
+
+  return HAL_OK;
+}
+
 /**
   * @brief  DeInitialize the host driver.
   * @param  hhcd HCD handle
@@ -469,6 +492,27 @@ HAL_StatusTypeDef HAL_HCD_HC_SubmitRequest(HCD_HandleTypeDef *hhcd,
 
     case EP_TYPE_ISOC:
       hhcd->hc[ch_num].data_pid = HC_PID_DATA0;
+
+      /* High-bandwidth IN: the device sends DATA2/DATA1/DATA0 for 3 transactions
+         and DATA1/DATA0 for 2, expected PID is taken from HCCHAR Multi Count */
+      if ((direction == 1U) && (hhcd->hc[ch_num].speed == HCD_DEVICE_SPEED_HIGH))
+      {
+        uint32_t USBx_BASE = (uint32_t)hhcd->Instance;
+        uint32_t multi_count = (USBx_HC((uint32_t)ch_num)->HCCHAR & USB_OTG_HCCHAR_MC) >> USB_OTG_HCCHAR_MC_Pos;
+
+        if (multi_count == 3U)
+        {
+          hhcd->hc[ch_num].data_pid = HC_PID_DATA2;
+        }
+        else if (multi_count == 2U)
+        {
+          hhcd->hc[ch_num].data_pid = HC_PID_DATA1;
+        }
+        else
+        {
+          /* ... */
+        }
+      }
       break;
 
     default:
@@ -1230,6 +1274,11 @@ static void HCD_HC_IN_IRQHandler(HCD_HandleTypeDef *hhcd, uint8_t chnum)
 
   if ((USBx_HC(ch_num)->HCINT & USB_OTG_HCINT_FRMOR) == USB_OTG_HCINT_FRMOR)
   {
+    if (hhcd->hc[ch_num].ep_type == EP_TYPE_ISOC)
+    {
+      /* The (micro)frame of the transfer has passed, report it as an error when the channel is halted */
+      hhcd->hc[ch_num].state = HC_HALTED;
+    }
     (void)USB_HC_Halt(hhcd->Instance, (uint8_t)ch_num);
     __HAL_HCD_CLEAR_HC_INT(ch_num, USB_OTG_HCINT_FRMOR);
   }
@@ -1325,6 +1374,11 @@ static void HCD_HC_IN_IRQHandler(HCD_HandleTypeDef *hhcd, uint8_t chnum)
       hhcd->hc[ch_num].ErrCnt++;
       hhcd->hc[ch_num].urb_state = URB_ERROR;
     }
+    else if (hhcd->hc[ch_num].state == HC_HALTED)
+    {
+      /* Isochronous frame overrun */
+      hhcd->hc[ch_num].urb_state = URB_ERROR;
+    }
     else
     {
       /* ... */
@@ -1586,8 +1640,10 @@ static void HCD_RXQLVL_IRQHandler(HCD_HandleTypeDef *hhcd)
       {
         if ((hhcd->hc[ch_num].xfer_count + pktcnt) <= hhcd->hc[ch_num].xfer_len)
         {
+          DWT_PROF_BEGIN(DWT_PROF_READ_PACKET);
           (void)USB_ReadPacket(hhcd->Instance,
                                hhcd->hc[ch_num].xfer_buff, (uint16_t)pktcnt);
+          DWT_PROF_END(DWT_PROF_READ_PACKET);
 
           /* manage multiple Xfer */
           hhcd->hc[ch_num].xfer_buff += pktcnt;
@@ -1930,7 +1930,15 @@ HAL_StatusTypeDef USB_HC_StartXfer(USB_OTG_GlobalTypeDef *USBx, USB_OTG_HCTypeDe
     USBx_HC(ch_num)->HCDMA = (uint32_t)hc->xfer_buff;
   }
 
-  is_oddframe = (((uint32_t)USBx_HOST->HFNUM & 0x01U) != 0U) ? 0U : 1U;
+  if (hc->frame_parity == HC_FRAME_NEXT)
+  {
+    is_oddframe = (((uint32_t)USBx_HOST->HFNUM & 0x01U) != 0U) ? 0U : 1U;
+  }
+  else
+  {
+    /* Periodic transfer is pre-armed for a (micro)frame of the given parity */
+    is_oddframe = (hc->frame_parity == HC_FRAME_ODD) ? 1U : 0U;
+  }
   USBx_HC(ch_num)->HCCHAR &= ~USB_OTG_HCCHAR_ODDFRM;
   USBx_HC(ch_num)->HCCHAR |= (uint32_t)is_oddframe << 29;
 
@@ -58,6 +58,9 @@ extern "C" {
 #define HOST_USER_CONNECTION                    0x04U
 #define HOST_USER_DISCONNECTION                 0x05U
 #define HOST_USER_UNRECOVERED_ERROR             0x06U
+#define HOST_USER_DEVICE_DETECTED               0x07U
+#define HOST_USER_ADDRESS_ASSIGNED              0x08U
+#define HOST_USER_CONFIGURED                    0x09U
 
 
 /**
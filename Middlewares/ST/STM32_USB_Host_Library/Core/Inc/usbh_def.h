@@ -57,6 +57,21 @@ extern "C" {
 #define USBH_DEV_RESET_TIMEOUT                        1000U
 #endif
 
+/* Wait after the device is connected, before the port reset (ms) */
+#ifndef USBH_ATTACH_DELAY
+#define USBH_ATTACH_DELAY                             200U
+#endif
+
+/* Wait after the port reset, before the first request (ms) */
+#ifndef USBH_RESET_RECOVERY_DELAY
+#define USBH_RESET_RECOVERY_DELAY                     100U
+#endif
+
+/* Poll period of the port enabled state during the port reset (ms) */
+#ifndef USBH_RESET_POLL_DELAY
+#define USBH_RESET_POLL_DELAY                         10U
+#endif
+
 #define ValBit(VAR,POS)                               (VAR & (1 << POS))
 #define SetBit(VAR,POS)                               (VAR |= (1 << POS))
 #define ClrBit(VAR,POS)                               (VAR &= ((1 << POS)^255))
@@ -21,6 +21,12 @@
 /* Includes ------------------------------------------------------------------*/
 #include "usbh_core.h"
 
+/* Profiling probe around USBH_Process, usbh_conf.h may define it */
+#ifndef USBH_PROCESS_PROF_BEGIN
+#define USBH_PROCESS_PROF_BEGIN()
+#define USBH_PROCESS_PROF_END()
+#endif
+
 
 /** @addtogroup USBH_LIB
   * @{
@@ -489,9 +495,15 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
       {
         USBH_UsrLog("USB Device Connected");
 
-        /* Wait for 200 ms after connection */
+        /* user callback for device detected, before the attach wait (again on a reset retry) */
+        if (phost->pUser != NULL)
+        {
+          phost->pUser(phost, HOST_USER_DEVICE_DETECTED);
+        }
+
+        /* Wait for USBH_ATTACH_DELAY ms after connection */
         phost->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
-        USBH_Delay(200U);
+        USBH_Delay(USBH_ATTACH_DELAY);
         (void)USBH_LL_ResetPort(phost);
 
         /* Make sure to start with Default address */
@@ -535,8 +547,8 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
         }
         else
         {
-          phost->Timeout += 10U;
-          USBH_Delay(10U);
+          phost->Timeout += USBH_RESET_POLL_DELAY;
+          USBH_Delay(USBH_RESET_POLL_DELAY);
         }
       }
 #if (USBH_USE_OS == 1U)
@@ -556,8 +568,8 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
         phost->pUser(phost, HOST_USER_CONNECTION);
       }
 
-      /* Wait for 100 ms after Reset */
-      USBH_Delay(100U);
+      /* Wait for USBH_RESET_RECOVERY_DELAY ms after Reset */
+      USBH_Delay(USBH_RESET_RECOVERY_DELAY);
 
       phost->device.speed = (uint8_t)USBH_LL_GetSpeed(phost);
 
@@ -642,6 +654,11 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
       {
         phost->gState = HOST_SET_WAKEUP_FEATURE;
         USBH_UsrLog("Default configuration set.");
+
+        if (phost->pUser != NULL)
+        {
+          phost->pUser(phost, HOST_USER_CONFIGURED);
+        }
       }
 
 #if (USBH_USE_OS == 1U)
@@ -939,6 +956,10 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
 
         /* user callback for device address assigned */
         USBH_UsrLog("Address (#%d) assigned.", phost->device.address);
+        if (phost->pUser != NULL)
+        {
+          phost->pUser(phost, HOST_USER_ADDRESS_ASSIGNED);
+        }
         phost->EnumState = ENUM_GET_CFG_DESC;
 
         /* modify control channels to update device address */
@@ -1337,7 +1358,9 @@ static void USBH_Process_OS(void const *argument)
     event = osMessageGet(((USBH_HandleTypeDef *)argument)->os_event, osWaitForever);
     if (event.status == osEventMessage)
     {
+      USBH_PROCESS_PROF_BEGIN();
       USBH_Process((USBH_HandleTypeDef *)argument);
+      USBH_PROCESS_PROF_END();
     }
   }
 }
@@ -1352,7 +1375,9 @@ static void USBH_Process_OS(void *argument)
                                &((USBH_HandleTypeDef *)argument)->os_msg, NULL, osWaitForever);
     if (status == osOK)
     {
+      USBH_PROCESS_PROF_BEGIN();
       USBH_Process((USBH_HandleTypeDef *)argument);
+      USBH_PROCESS_PROF_END();
     }
   }
 }
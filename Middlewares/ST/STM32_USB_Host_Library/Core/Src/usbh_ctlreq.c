@@ -436,6 +436,13 @@ static USBH_StatusTypeDef USBH_ParseCfgDesc(USBH_HandleTypeDef *phost, uint8_t *
     while ((if_ix < USBH_MAX_NUM_INTERFACES) && (ptr < cfg_desc->wTotalLength))
     {
       pdesc = USBH_GetNextDesc((uint8_t *)(void *)pdesc, &ptr);
+
+      /* A zero length descriptor would never let the parsing move on */
+      if ((ptr < cfg_desc->wTotalLength) && (pdesc->bLength == 0U))
+      {
+        return USBH_NOT_SUPPORTED;
+      }
+
       if (pdesc->bDescriptorType == USB_DESC_TYPE_INTERFACE)
       {
         /* Make sure that the interface descriptor's bLength is equal to USB_INTERFACE_DESC_SIZE */
@@ -450,10 +457,16 @@ static USBH_StatusTypeDef USBH_ParseCfgDesc(USBH_HandleTypeDef *phost, uint8_t *
         ep_ix = 0U;
         pep = (USBH_EpDescTypeDef *)NULL;
 
-        while ((ep_ix < pif->bNumEndpoints) && (ptr < cfg_desc->wTotalLength))
+        /* Endpoints beyond USBH_MAX_NUM_ENDPOINTS are not parsed, the interface is then not supported */
+        while ((ep_ix < pif->bNumEndpoints) && (ep_ix < USBH_MAX_NUM_ENDPOINTS) && (ptr < cfg_desc->wTotalLength))
         {
           pdesc = USBH_GetNextDesc((uint8_t *)(void *)pdesc, &ptr);
 
+          if ((ptr < cfg_desc->wTotalLength) && (pdesc->bLength == 0U))
+          {
+            return USBH_NOT_SUPPORTED;
+          }
+
           if (pdesc->bDescriptorType == USB_DESC_TYPE_ENDPOINT)
           {
             /* Check if the endpoint is appartening to an audio streaming interface */
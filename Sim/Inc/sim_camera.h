@@ -0,0 +1,123 @@
+#ifndef __SIM_CAMERA_H__
+#define __SIM_CAMERA_H__
+
+#include <stdint.h>
+
+#include "sim_hcd.h"
+#include "usbh_video.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Synthetic UVC 1.1 camera for the simulated host controller.
+// Descriptors are built from the configuration: MJPEG and uncompressed (YUY2) formats with their frames
+// and discrete frame intervals, one streaming alt setting per isochronous packet size (alt setting 0 has
+// no bandwidth). The camera answers the standard requests and PROBE/COMMIT: the committed format, frame
+// and the nearest supported interval are streamed, dwMaxPayloadTransferSize is the smallest alt setting
+// that carries the frame rate. Camera terminal and processing unit controls (exposure, gain, white balance,
+// power line frequency...) answer GET_INFO/MIN/MAX/RES/DEF/CUR and SET_CUR; a control of an automatic mode
+// that is on refuses SET_CUR. Controls do not change the stream. Frames are sent as payloads with FID/EOF/PTS/SCR headers, PTS is the
+// camera clock (STC) at the frame start, SCR - the STC and the 1 ms bus frame number of the packet.
+// Idle (micro)frames carry zero-length packets.
+//
+// Bus and camera impairments are drawn from a seeded generator, every run with the same seed is the same.
+
+#define SIM_CAMERA_EP             0x81
+#define SIM_CAMERA_DESC_SIZE      USBH_MAX_SIZE_CONFIGURATION
+#define SIM_CAMERA_MAX_FORMATS    5   // one over the MJPEG formats the host keeps with the default formats
+#define SIM_CAMERA_MAX_FRAMES     6   // per format
+#define SIM_CAMERA_MAX_INTERVALS  4   // per frame
+#define SIM_CAMERA_MAX_ALTS       VIDEO_MAX_VIDEO_STD_INTERFACE
+#define SIM_CAMERA_CONTROLS       8
+
+typedef enum {
+  SIM_CAMERA_MJPEG = 0,
+  SIM_CAMERA_YUY2,
+} SIM_CameraEncodingTypeDef;
+
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  uint32_t intervals[SIM_CAMERA_MAX_INTERVALS];  // 100 ns units, the first one is the default, 0 - unused
+} SIM_CameraFrameTypeDef;
+
+typedef struct {
+  SIM_CameraEncodingTypeDef encoding;
+  uint8_t frames_num;
+  SIM_CameraFrameTypeDef frames[SIM_CAMERA_MAX_FRAMES];
+} SIM_CameraFormatTypeDef;
+
+// Probabilities are in parts per million
+typedef struct {
+  uint32_t jitter_us;        // every frame starts up to this late
+  uint32_t loss_ppm;         // packet is lost on the bus (URB error), its data is missing from the frame
+  uint32_t err_ppm;          // packet has the ERR bit set
+  uint32_t short_ppm;        // packet carries less data than the payload size allows
+  int32_t clock_drift_ppm;   // camera clock against the bus clock
+  uint8_t no_eof;            // EOF bit is never set, a frame ends by its size or by the FID toggle of the next one
+  uint32_t seed;
+} SIM_CameraImpairTypeDef;
+
+typedef struct {
+  uint8_t formats_num;
+  SIM_CameraFormatTypeDef formats[SIM_CAMERA_MAX_FORMATS];
+  uint8_t alts_num;
+  uint16_t alt_packets[SIM_CAMERA_MAX_ALTS];  // wMaxPacketSize of alt settings 1..n, bits 12:11 - additional transactions
+  uint8_t mjpeg_ratio;                        // MJPEG frame bytes = width * height * 2 / ratio
+  uint32_t clock_hz;                          // dwClockFrequency, PTS/SCR clock
+  SIM_CameraImpairTypeDef impair;
+} SIM_CameraConfigTypeDef;
+
+typedef struct {
+  uint32_t frames_sent;
+  uint32_t packets_sent;
+  uint32_t packets_lost;
+  uint32_t packets_err;
+  uint32_t packets_short;
+  uint32_t control_sets;  // SET_CUR of a control accepted
+} SIM_CameraCountersTypeDef;
+
+typedef struct {
+  SIM_DeviceTypeDef device;
+  SIM_CameraConfigTypeDef config;
+  SIM_CameraCountersTypeDef counters;
+
+  uint8_t cfg_desc[SIM_CAMERA_DESC_SIZE];
+  uint16_t cfg_len;
+
+  uint8_t configuration;
+  uint8_t alt;  // of the streaming interface
+  VIDEO_ProbeTypedef probe;
+  VIDEO_ProbeTypedef commit;
+  int32_t controls[SIM_CAMERA_CONTROLS];  // current values, defaults after a reset
+
+  // Stream of the committed format
+  SIM_CameraEncodingTypeDef encoding;
+  uint32_t frame_bytes;
+  uint32_t interval;    // 100 ns units
+  uint16_t payload;     // bytes per (micro)frame, alt setting and dwMaxPayloadTransferSize
+  uint8_t fid;
+  uint8_t in_frame;
+  uint32_t frame_pos;
+  uint32_t pts;
+  uint64_t frame_time;  // nominal start of the next frame, 100 ns units of bus time
+  uint64_t next_frame;  // with the jitter
+  uint32_t rng;
+} SIM_CameraTypeDef;
+
+// MJPEG 160x120/320x240/640x480 and YUY2 160x120/320x240 at 30/15/5 fps, alt settings of
+// 192, 512, 1024, 2x1024 and 3x1024 bytes, 48 MHz clock, no impairments
+extern const SIM_CameraConfigTypeDef sim_camera_default;
+
+// Returns -1 if the descriptors of "config" do not fit into SIM_CAMERA_DESC_SIZE bytes
+int sim_camera_init(SIM_CameraTypeDef *camera, const SIM_CameraConfigTypeDef *config);
+
+// Bytes of one frame of "format"/"frame" (0-based indexes)
+uint32_t sim_camera_frame_bytes(const SIM_CameraConfigTypeDef *config, uint8_t format, uint8_t frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_CAMERA_H__ */
@@ -0,0 +1,47 @@
+#ifndef __SIM_FUZZ_H__
+#define __SIM_FUZZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_hcd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fuzz harnesses of the host-native build (Src/fuzz_*.c).
+// Every harness implements the libFuzzer entry point. With -DUVC_FUZZ_ENGINE=libfuzzer (clang) libFuzzer
+// drives it, otherwise Src/fuzz_main.c does: corpus files are run once, then random mutations of them
+// or of the harness seed.
+
+// Harness: one input, returns 0
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Harness: valid input to start the mutations from, up to "max" bytes are written to "buf", returns the length
+size_t fuzz_seed(uint8_t *buf, size_t max);
+
+// Property that must hold for any input, a violation is reported as a crash
+#define FUZZ_CHECK(cond)                                                               \
+  do {                                                                                 \
+    if (!(cond)) {                                                                     \
+      fprintf(stderr, "fuzz: check failed at %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      abort();                                                                         \
+    }                                                                                  \
+  } while (0)
+
+// Enumeration of "device" at "speed" by the host library with the VIDEO class on the simulated bus.
+// "USBH_Process" runs until the class is active and then "stream_frames" more (micro)frames, or until
+// "max_frames" (micro)frames have passed. "active" is called while the class is active, before the device is
+// detached, "phost->pActiveClass->pData" is the VIDEO handle then.
+// Returns 1 if the class became active.
+int sim_fuzz_enumerate(const SIM_DeviceTypeDef *device, USBH_SpeedTypeDef speed, uint32_t stream_frames, uint32_t max_frames,
+                       void (*active)(USBH_HandleTypeDef *phost));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_FUZZ_H__ */
@@ -0,0 +1,83 @@
+#ifndef __SIM_HCD_H__
+#define __SIM_HCD_H__
+
+#include <stdint.h>
+
+#include "usbh_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated host controller of the host-native build, replaces usbh_conf.c of the target.
+// It implements the USBH_LL_* driver interface of the USB host library and the extensions of
+// usbh_conf_ext.h for one host handle with one device on the root port.
+//
+// Time is simulated: every "sim_hcd_step" is one bus (micro)frame - the SOF counter is incremented
+// and the periodic transfers armed for that (micro)frame are executed, their completion hooks are
+// called as the OTG interrupt would call them. The application runs "USBH_Process" between steps.
+// Control transfers are completed as soon as they are submitted, so the blocking control requests of
+// the class return without any step. "USBH_Delay" advances the time (SOFs and periodic transfers go on).
+
+// Simulated core clock, DWT->CYCCNT counts it
+#define SIM_HCD_CORE_CLOCK 168000000U
+
+// Device callbacks return values
+#define SIM_STALL      (-1)  // control: request is stalled
+#define SIM_XACT_ERROR (-1)  // periodic: transaction error, URB_NOTREADY and retried twice as by the HAL, then URB_ERROR
+#define SIM_NAK        (-2)  // periodic: no data (interrupt endpoints), URB_NOTREADY
+
+typedef struct {
+  void *context;
+
+  // Control request. Requests with an IN data stage or without data stage are handled at the SETUP stage:
+  // up to "length" (wLength) bytes are written to "data", returns the data stage length.
+  // Requests with an OUT data stage are handled when the data stage is sent, "data" holds "length" bytes.
+  // Returns SIM_STALL to stall the request.
+  int (*control)(void *context, const USB_Setup_TypeDef *setup, uint8_t *data, uint16_t length);
+
+  // Periodic IN transfer of endpoint "ep_addr" in (micro)frame "frame" (bus SOF counter): up to "length"
+  // bytes (all transactions of the (micro)frame) are written to "data". Returns the received length,
+  // SIM_XACT_ERROR or SIM_NAK.
+  int (*periodic_in)(void *context, uint8_t ep_addr, uint32_t frame, uint8_t *data, uint16_t length);
+
+  // Bus reset, optional
+  void (*reset)(void *context);
+} SIM_DeviceTypeDef;
+
+// Connect "device" to the root port, it is enumerated at "speed" (USBH_SPEED_HIGH or USBH_SPEED_FULL).
+// The device structure must stay valid until it is detached.
+void sim_hcd_attach(const SIM_DeviceTypeDef *device, USBH_SpeedTypeDef speed);
+void sim_hcd_detach(void);
+
+// One bus (micro)frame: 125 us at high speed, 1 ms otherwise
+void sim_hcd_step(void);
+
+// Run "USBH_Process" once per (micro)frame for "frames" (micro)frames
+void sim_hcd_run(USBH_HandleTypeDef *phost, uint32_t frames);
+
+// Bus (micro)frames since the start of the simulation
+uint32_t sim_hcd_frame(void);
+
+// Bus (micro)frame number as HFNUM of the host core: 14 bits, restarts at every port reset. The device sees it
+// in the SOF packets, USBH_LL_GetCurrentFrame returns it.
+uint32_t sim_hcd_frame_number(void);
+
+// Every "every"-th SOF interrupt is coalesced with the next one (0 - none): "phost->Timer" counts the
+// interrupts and falls behind the bus frame number, as on a busy target
+void sim_hcd_set_sof_coalesce(uint32_t every);
+
+// Speed of the attached device, (micro)frame length
+USBH_SpeedTypeDef sim_hcd_speed(void);
+
+// Simulated time since the start of the simulation
+uint64_t sim_hcd_time_us(void);
+
+// Periodic URBs submitted while the previous URB of the pipe was still armed
+uint32_t sim_hcd_active_submits(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_HCD_H__ */
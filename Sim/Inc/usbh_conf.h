@@ -0,0 +1,137 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/Inc/usbh_conf.h
+  * @brief          : USB host library configuration of the host-native build.
+  ******************************************************************************
+  * Same library configuration as USB_HOST/Target/usbh_conf.h, without OS: the
+  * host state machine is run by the simulation loop. The low level driver is
+  * the simulated host controller (sim_hcd.c), it also emulates the few
+  * Cortex-M registers the VIDEO class reads (DWT cycle counter, core clock,
+  * HAL tick) from the simulated time.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBH_CONF__H__
+#define __USBH_CONF__H__
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Exported defines ----------------------------------------------------------*/
+
+#define USBH_MAX_NUM_ENDPOINTS      10U
+#define USBH_MAX_NUM_INTERFACES      10U
+#define USBH_MAX_NUM_CONFIGURATION      5U
+#define USBH_KEEP_CFG_DESCRIPTOR      1U
+#define USBH_MAX_NUM_SUPPORTED_CLASS      1U
+#define USBH_MAX_SIZE_CONFIGURATION      1024U
+#define USBH_MAX_DATA_BUFFER      1024U
+
+/* Library trace, 1 - user messages only (the simulation runs many enumerations) */
+#ifndef USBH_DEBUG_LEVEL
+#define USBH_DEBUG_LEVEL      1U
+#endif
+
+#define USBH_USE_OS      0U
+
+/* Fast start, see USB_HOST/Target/usbh_conf.h (VBUS is not simulated) */
+#ifndef UVC_FAST_START
+#define UVC_FAST_START      0U
+#endif
+
+#if (UVC_FAST_START == 1U)
+#define USBH_ATTACH_DELAY            100U
+#define USBH_RESET_RECOVERY_DELAY    10U
+#define USBH_RESET_POLL_DELAY        1U
+#endif
+
+/* #define for FS and HS identification */
+#define HOST_HS 		0
+#define HOST_FS 		1
+
+#ifndef __IO
+#define __IO volatile
+#endif
+
+/* Endpoint types of stm32f4xx_ll_usb.h, used by the descriptor parser */
+#define EP_TYPE_CTRL      0U
+#define EP_TYPE_ISOC      1U
+#define EP_TYPE_BULK      2U
+#define EP_TYPE_INTR      3U
+#define EP_TYPE_MSK       3U
+
+/* Exported macros -----------------------------------------------------------*/
+
+/* Memory management macros */
+#define USBH_malloc         malloc
+#define USBH_free           free
+#define USBH_memset         memset
+#define USBH_memcpy         memcpy
+
+/* DEBUG macros */
+#if (USBH_DEBUG_LEVEL > 0U)
+#define  USBH_UsrLog(...)   do { \
+                            printf(__VA_ARGS__); \
+                            printf("\n"); \
+} while (0)
+#else
+#define USBH_UsrLog(...) do {} while (0)
+#endif
+
+#if (USBH_DEBUG_LEVEL > 1U)
+#define  USBH_ErrLog(...) do { \
+                            printf("ERROR: "); \
+                            printf(__VA_ARGS__); \
+                            printf("\n"); \
+} while (0)
+#else
+#define USBH_ErrLog(...) do {} while (0)
+#endif
+
+#if (USBH_DEBUG_LEVEL > 2U)
+#define  USBH_DbgLog(...)   do { \
+                            printf("DEBUG : "); \
+                            printf(__VA_ARGS__); \
+                            printf("\n"); \
+} while (0)
+#else
+#define USBH_DbgLog(...) do {} while (0)
+#endif
+
+/* Cortex-M facade, driven by the simulated time (sim_hcd.c) ------------------*/
+
+typedef struct
+{
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} SIM_DWT_TypeDef;
+
+typedef struct
+{
+  volatile uint32_t DEMCR;
+} SIM_CoreDebug_TypeDef;
+
+extern SIM_DWT_TypeDef sim_dwt;
+extern SIM_CoreDebug_TypeDef sim_core_debug;
+extern uint32_t SystemCoreClock;
+
+#define DWT                         (&sim_dwt)
+#define CoreDebug                   (&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+/* Milliseconds of simulated time */
+uint32_t HAL_GetTick(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_CONF__H__ */
@@ -0,0 +1,108 @@
+// Fuzz harness of the configuration descriptor parsing: the synthetic camera returns the input as its
+// configuration descriptor, the USB host library parses it and the VIDEO class takes its streaming
+// interfaces and class specific descriptors from it (USBH_VIDEO_FindStreamingIN, USBH_VIDEO_ParseCSDescriptors,
+// video_modes_build, video_controls_build), then the control queries, PROBE/COMMIT and streaming run as far
+// as the descriptors allow.
+// Input: target format (bit 0: YUY2), configuration descriptor.
+
+#include <string.h>
+
+#include "sim_camera.h"
+#include "sim_fuzz.h"
+#include "usbh_video.h"
+#include "usbh_video_cache.h"
+#include "usbh_video_controls.h"
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_modes.h"
+#include "usbh_video_stream_parsing.h"
+
+// Streaming after the class is active, enough for a few URBs
+#define FUZZ_DESC_STREAM_FRAMES 64
+// Enumeration of a valid camera takes less than 300 ms of bus time
+#define FUZZ_DESC_MAX_FRAMES 4000
+
+static uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+static SIM_CameraTypeDef camera;
+static SIM_DeviceTypeDef device;
+static const uint8_t *fuzz_desc;
+static uint16_t fuzz_desc_len;
+
+static int fuzz_desc_control(void *context, const USB_Setup_TypeDef *setup, uint8_t *data, uint16_t length) {
+  if ((setup->b.bmRequestType == (USB_D2H | USB_REQ_RECIPIENT_DEVICE | USB_REQ_TYPE_STANDARD)) && (setup->b.bRequest == USB_REQ_GET_DESCRIPTOR) &&
+      ((setup->b.wValue.w >> 8) == USB_DESC_TYPE_CONFIGURATION)) {
+    uint16_t len = (fuzz_desc_len < length) ? fuzz_desc_len : length;
+    memcpy(data, fuzz_desc, len);
+    return len;
+  }
+  return camera.device.control(camera.device.context, setup, data, length);
+}
+
+static int fuzz_desc_periodic_in(void *context, uint8_t ep_addr, uint32_t frame, uint8_t *data, uint16_t length) {
+  return camera.device.periodic_in(camera.device.context, ep_addr, frame, data, length);
+}
+
+static void fuzz_desc_reset(void *context) {
+  camera.device.reset(camera.device.context);
+}
+
+static void fuzz_desc_active(USBH_HandleTypeDef *phost) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+  VIDEO_ClassSpecificDescTypedef *class_desc = &VIDEO_Handle->class_desc;
+
+  FUZZ_CHECK(class_desc->InputTerminalNum <= VIDEO_MAX_NUM_IN_TERMINAL);
+  FUZZ_CHECK(class_desc->OutputTerminalNum <= VIDEO_MAX_NUM_OUT_TERMINAL);
+  FUZZ_CHECK(class_desc->SelectorUnitNum <= VIDEO_MAX_NUM_SELECTOR_UNIT);
+  FUZZ_CHECK(class_desc->ProcessingUnitNum <= VIDEO_MAX_NUM_PROCESSING_UNIT);
+  FUZZ_CHECK(class_desc->ExtensionUnitNum <= VIDEO_MAX_NUM_EXTENSION_UNIT);
+  FUZZ_CHECK(class_desc->InputHeaderNum <= VIDEO_MAX_NUM_IN_HEADER);
+  FUZZ_CHECK(class_desc->MJPEGFormatNum <= VIDEO_MAX_MJPEG_FORMAT);
+  FUZZ_CHECK(class_desc->MJPEGFrameNum <= VIDEO_MAX_MJPEG_FRAME_D);
+  FUZZ_CHECK(class_desc->UncompFormatNum <= VIDEO_MAX_UNCOMP_FORMAT);
+  FUZZ_CHECK(class_desc->UncompFrameNum <= VIDEO_MAX_UNCOMP_FRAME_D);
+  uint8_t modes_num;
+  const VIDEO_ModeTypeDef *modes = video_modes_table(&modes_num);
+  const VIDEO_ModeTypeDef *mode = video_modes_selected();
+  FUZZ_CHECK(modes_num <= UVC_MAX_MODES);
+  FUZZ_CHECK((mode != NULL) && (mode >= modes) && (mode < &modes[modes_num]) && (mode->interval != 0));
+  uint8_t controls_num;
+  const VIDEO_ControlTypeDef *controls = video_controls_table(&controls_num);
+  FUZZ_CHECK(controls_num <= UVC_MAX_CONTROLS);
+  FUZZ_CHECK(video_controls_ready());
+  for (uint8_t i = 0; i < controls_num; i++) {
+    FUZZ_CHECK(controls[i].id < VIDEO_CONTROLS);
+    FUZZ_CHECK((controls[i].info == 0) || (controls[i].size != 0));
+  }
+  if (VIDEO_Handle->camera.supported)
+    FUZZ_CHECK((VIDEO_Handle->camera.XferSize != 0) && (VIDEO_Handle->camera.XferSize <= UVC_RX_FIFO_SIZE_LIMIT));
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if ((size < 1) || (size > (1U + USBH_MAX_SIZE_CONFIGURATION)))
+    return 0;
+
+  USBH_VIDEO_Target_Format = (data[0] & 0x01) ? USBH_VIDEO_YUY2 : USBH_VIDEO_MJPEG;
+  fuzz_desc = data + 1;
+  fuzz_desc_len = (uint16_t) (size - 1);
+
+  // Every input negotiates from scratch, a state cached by an earlier input would skip PROBE
+  video_cache_clear();
+  video_stream_init_buffers((uint8_t *) uvc_frame_pool);
+  sim_camera_init(&camera, &sim_camera_default);
+  device.context = &camera;
+  device.control = fuzz_desc_control;
+  device.periodic_in = fuzz_desc_periodic_in;
+  device.reset = fuzz_desc_reset;
+  sim_fuzz_enumerate(&device, USBH_SPEED_HIGH, FUZZ_DESC_STREAM_FRAMES, FUZZ_DESC_MAX_FRAMES, fuzz_desc_active);
+  return 0;
+}
+
+// Descriptors of the synthetic camera, MJPEG target
+size_t fuzz_seed(uint8_t *buf, size_t max) {
+  sim_camera_init(&camera, &sim_camera_default);
+  if (max < (1U + camera.cfg_len))
+    return 0;
+  buf[0] = 0;
+  memcpy(buf + 1, camera.cfg_desc, camera.cfg_len);
+  return 1U + camera.cfg_len;
+}
@@ -0,0 +1,193 @@
+// Driver of the fuzz harnesses when libFuzzer is not available (gcc), see sim_fuzz.h.
+// Usage: fuzz_<harness> [-n runs] [-s seed] [-t seconds] [-w file] [input...]
+// Inputs are run once each, then "runs" random mutations of them (of the harness seed if there are none).
+// Every mutated input is written to "fuzz-crash.bin" before it is run, so a crash leaves it behind.
+// An input that runs longer than "-t" seconds (10) is a hang and aborts the run as well.
+// "-w" writes the harness seed to "file" and exits, e.g. to start a libFuzzer corpus.
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_fuzz.h"
+
+#define FUZZ_MAX_INPUT  4096
+#define FUZZ_MAX_CORPUS 64
+#define FUZZ_MUTATIONS  8
+#define FUZZ_CRASH_FILE "fuzz-crash.bin"
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+} FuzzInputTypeDef;
+
+static FuzzInputTypeDef corpus[FUZZ_MAX_CORPUS];
+static uint32_t corpus_num = 0;
+static uint32_t rng = 1;
+
+static void fuzz_timeout(int sig) {
+  static const char msg[] = "fuzz: input runs too long, hang\n";
+
+  (void) sig;
+  (void) write(STDERR_FILENO, msg, sizeof(msg) - 1);
+  abort();
+}
+
+// Every input is run with the hang watchdog
+static void run_input(const uint8_t *data, size_t size, unsigned timeout) {
+  alarm(timeout);
+  LLVMFuzzerTestOneInput(data, size);
+  alarm(0);
+}
+
+static uint32_t fuzz_random(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static int load_input(const char *path, uint8_t *buf, size_t *size) {
+  FILE *f = fopen(path, "rb");
+
+  if (f == NULL)
+    return -1;
+  *size = fread(buf, 1, FUZZ_MAX_INPUT, f);
+  fclose(f);
+  return 0;
+}
+
+static void write_input(const char *path, const uint8_t *data, size_t size) {
+  FILE *f = fopen(path, "wb");
+
+  if (f != NULL) {
+    fwrite(data, 1, size, f);
+    fclose(f);
+  }
+}
+
+static void add_corpus(const uint8_t *data, size_t size) {
+  if ((corpus_num >= FUZZ_MAX_CORPUS) || (size == 0))
+    return;
+  corpus[corpus_num].data = malloc(size);
+  if (corpus[corpus_num].data == NULL)
+    return;
+  memcpy(corpus[corpus_num].data, data, size);
+  corpus[corpus_num].size = size;
+  corpus_num++;
+}
+
+// Byte level mutations, the harness input formats keep the lengths in the data, so they are hit as well
+static size_t mutate(uint8_t *buf, size_t size) {
+  static const uint8_t interesting[] = {0x00, 0x01, 0x02, 0x03, 0x07, 0x08, 0x09, 0x0C, 0x1A, 0x24, 0x7F, 0x80, 0xFE, 0xFF};
+  uint32_t count = 1 + fuzz_random() % FUZZ_MUTATIONS;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t pos = (size != 0) ? fuzz_random() % size : 0;
+
+    switch (fuzz_random() % 6) {
+      case 0:  // bit flip
+        if (size != 0)
+          buf[pos] ^= (uint8_t) (1U << (fuzz_random() % 8));
+        break;
+      case 1:  // random byte
+        if (size != 0)
+          buf[pos] = (uint8_t) fuzz_random();
+        break;
+      case 2:  // interesting byte
+        if (size != 0)
+          buf[pos] = interesting[fuzz_random() % sizeof(interesting)];
+        break;
+      case 3:  // truncate
+        size = pos;
+        break;
+      case 4: {  // remove a block
+        uint32_t n = 1 + fuzz_random() % 32;
+        if ((pos + n) <= size) {
+          memmove(&buf[pos], &buf[pos + n], size - pos - n);
+          size -= n;
+        }
+        break;
+      }
+      default: {  // duplicate a block
+        uint32_t n = 1 + fuzz_random() % 32;
+        if (((pos + n) <= size) && ((size + n) <= FUZZ_MAX_INPUT)) {
+          memmove(&buf[pos + n], &buf[pos], size - pos);
+          size += n;
+        }
+        break;
+      }
+    }
+  }
+  return size;
+}
+
+int main(int argc, char **argv) {
+  static uint8_t buf[FUZZ_MAX_INPUT];
+  uint32_t runs = 10000;
+  unsigned timeout = 10;
+  const char *seed_file = NULL;
+  size_t size;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:t:w:")) != -1) {
+    switch (opt) {
+      case 'n':
+        runs = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        rng = (uint32_t) strtoul(optarg, NULL, 0);
+        if (rng == 0)
+          rng = 1;
+        break;
+      case 't':
+        timeout = (unsigned) strtoul(optarg, NULL, 0);
+        break;
+      case 'w':
+        seed_file = optarg;
+        break;
+      default:
+        printf("usage: %s [-n runs] [-s seed] [-t seconds] [-w file] [input...]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  signal(SIGALRM, fuzz_timeout);
+  if (seed_file != NULL) {
+    size = fuzz_seed(buf, sizeof(buf));
+    write_input(seed_file, buf, size);
+    return 0;
+  }
+
+  for (int i = optind; i < argc; i++) {
+    if (load_input(argv[i], buf, &size) != 0) {
+      printf("fuzz: cannot read %s\n", argv[i]);
+      return 2;
+    }
+    run_input(buf, size, timeout);
+    add_corpus(buf, size);
+  }
+  if (corpus_num == 0) {
+    size = fuzz_seed(buf, sizeof(buf));
+    run_input(buf, size, timeout);
+    add_corpus(buf, size);
+  }
+  if (corpus_num == 0)
+    return 0;
+
+  for (uint32_t run = 0; run < runs; run++) {
+    const FuzzInputTypeDef *input = &corpus[fuzz_random() % corpus_num];
+
+    memcpy(buf, input->data, input->size);
+    size = mutate(buf, input->size);
+    // Written before the run, a crash leaves the input behind
+    write_input(FUZZ_CRASH_FILE, buf, size);
+    run_input(buf, size, timeout);
+  }
+  remove(FUZZ_CRASH_FILE);
+  printf("fuzz: %lu inputs, %lu runs\n", (unsigned long) (argc - optind), (unsigned long) runs);
+  return 0;
+}
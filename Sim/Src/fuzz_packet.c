@@ -0,0 +1,106 @@
+// Fuzz harness of the stream parser: the input is a sequence of isochronous URBs that are fed into
+// "video_stream_process_packet" the way the VIDEO class feeds them, frames are taken and released.
+// Input: flags (bit 0: YUY2 target, bit 1: ping-pong staging buffers), then URBs:
+//   [status][length, 2 bytes LE][length bytes] - status bit 0: URB is lost, the data is not used;
+//   length is cut to the transfer size, the last URB may be shorter than its length
+
+#include <string.h>
+
+#include "sim_fuzz.h"
+#include "usbh_video.h"
+#include "usbh_video_clock.h"
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_stream_parsing.h"
+
+#define FUZZ_PACKET_XFER_SIZE UVC_RX_FIFO_SIZE_LIMIT
+#define FUZZ_PACKET_CLOCK_HZ  48000000U
+
+#define FUZZ_PACKET_YUY2     0x01
+#define FUZZ_PACKET_PINGPONG 0x02
+#define FUZZ_PACKET_LOST     0x01
+
+static uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+static void fuzz_packet_frames(void) {
+  VIDEO_FrameTypeDef *frame;
+  volatile uint8_t sum = 0;
+
+  while ((frame = video_stream_get_frame()) != NULL) {
+    FUZZ_CHECK(frame->len <= UVC_FRAME_DATA_LIMIT);
+    // Whole frame is read, so a frame that is not inside its buffer is caught by the sanitizer
+    for (uint32_t i = 0; i < frame->len; i++)
+      sum += frame->data[i];
+    video_stream_release_frame(frame);
+  }
+  (void) sum;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < 1)
+    return 0;
+
+  uint8_t flags = data[0];
+  size_t pos = 1;
+  uint8_t channel = 0;
+
+  USBH_VIDEO_Target_Format = (flags & FUZZ_PACKET_YUY2) ? USBH_VIDEO_YUY2 : USBH_VIDEO_MJPEG;
+  video_clock_init(FUZZ_PACKET_CLOCK_HZ);
+  video_stream_init_buffers((uint8_t *) uvc_frame_pool);
+
+  while ((size - pos) >= 3) {
+    uint8_t status = data[pos];
+    uint16_t len = (uint16_t) (data[pos + 1] | (data[pos + 2] << 8));
+    pos += 3;
+    if (len > FUZZ_PACKET_XFER_SIZE)
+      len = FUZZ_PACKET_XFER_SIZE;
+    if (len > (size - pos))
+      len = (uint16_t) (size - pos);
+
+    uint8_t *buf = (flags & FUZZ_PACKET_PINGPONG) ? video_stream_rx_staging(channel) : video_stream_rx_buffer(FUZZ_PACKET_XFER_SIZE);
+    // Data of a lost URB is not used, but the controller may have written it
+    memcpy(buf, &data[pos], len);
+    if (status & FUZZ_PACKET_LOST) {
+      video_stream_drop_packet();
+    } else {
+      video_clock_packet_received((uint32_t) pos, 1);
+      if (flags & FUZZ_PACKET_PINGPONG)
+        video_stream_process_staged(channel, len);
+      else
+        video_stream_process_packet(len);
+    }
+    pos += len;
+    channel = (uint8_t) ((channel + 1U) % UVC_ISOC_URBS);
+    fuzz_packet_frames();
+  }
+  return 0;
+}
+
+// Two MJPEG frames of three packets each, PTS and SCR in every header
+size_t fuzz_seed(uint8_t *buf, size_t max) {
+  const uint16_t payload = 200;
+  size_t len = 0;
+
+  if (max < (1U + 6U * (3U + UVC_HEADER_SIZE + payload)))
+    return 0;
+  buf[len++] = 0;
+  for (uint32_t i = 0; i < 6; i++) {
+    uint8_t fid = (uint8_t) ((i / 3) & 1U);
+    uint8_t eof = ((i % 3) == 2) ? UVC_HEADER_EOF_BIT : 0;
+    uint32_t pts = (i / 3) * (FUZZ_PACKET_CLOCK_HZ / 30U);
+    uint32_t stc = pts + i * 6000U;
+    uint16_t sof = (uint16_t) i;
+    uint16_t n = UVC_HEADER_SIZE + payload;
+
+    buf[len++] = 0;
+    buf[len++] = (uint8_t) n;
+    buf[len++] = (uint8_t) (n >> 8);
+    buf[len] = UVC_HEADER_SIZE;
+    buf[len + 1] = UVC_HEADER_EOH_BIT | UVC_HEADER_PTS_BIT | UVC_HEADER_SCR_BIT | fid | eof;
+    memcpy(&buf[len + 2], &pts, 4);
+    memcpy(&buf[len + 6], &stc, 4);
+    memcpy(&buf[len + 10], &sof, 2);
+    memset(&buf[len + UVC_HEADER_SIZE], (int) (0x10 + i), payload);
+    len += n;
+  }
+  return len;
+}
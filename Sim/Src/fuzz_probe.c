@@ -0,0 +1,89 @@
+// Fuzz harness of the PROBE/COMMIT negotiation: the synthetic camera answers GET_CUR(PROBE) with the input,
+// the VIDEO class checks the answer (USBH_VIDEO_CheckProbe), commits and selects the alt setting for the
+// returned payload size, then streams with it.
+// Input: target format (bit 0: YUY2), full speed bus (bit 1), PROBE state returned by the camera.
+
+#include <string.h>
+
+#include "sim_camera.h"
+#include "sim_fuzz.h"
+#include "usbh_video.h"
+#include "usbh_video_cache.h"
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_stream_parsing.h"
+
+#define FUZZ_PROBE_STREAM_FRAMES 64
+#define FUZZ_PROBE_MAX_FRAMES    4000
+
+static uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+static SIM_CameraTypeDef camera;
+static SIM_DeviceTypeDef device;
+static const uint8_t *fuzz_probe;
+static uint16_t fuzz_probe_len;
+
+static int fuzz_probe_control(void *context, const USB_Setup_TypeDef *setup, uint8_t *data, uint16_t length) {
+  if ((setup->b.bmRequestType == (USB_D2H | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_CLASS)) && (setup->b.bRequest == UVC_GET_CUR) &&
+      ((setup->b.wValue.w >> 8) == VS_PROBE_CONTROL)) {
+    uint16_t len = (fuzz_probe_len < length) ? fuzz_probe_len : length;
+    memcpy(data, fuzz_probe, len);
+    return len;
+  }
+  return camera.device.control(camera.device.context, setup, data, length);
+}
+
+static int fuzz_probe_periodic_in(void *context, uint8_t ep_addr, uint32_t frame, uint8_t *data, uint16_t length) {
+  return camera.device.periodic_in(camera.device.context, ep_addr, frame, data, length);
+}
+
+static void fuzz_probe_reset(void *context) {
+  camera.device.reset(camera.device.context);
+}
+
+static void fuzz_probe_active(USBH_HandleTypeDef *phost) {
+  VIDEO_HandleTypeDef *VIDEO_Handle = (VIDEO_HandleTypeDef *) phost->pActiveClass->pData;
+
+  // Whatever the camera answered, the selected alt setting is one the host can receive
+  FUZZ_CHECK(VIDEO_Handle->camera.supported == 1);
+  FUZZ_CHECK((VIDEO_Handle->camera.XferSize != 0) && (VIDEO_Handle->camera.XferSize <= UVC_RX_FIFO_SIZE_LIMIT));
+  FUZZ_CHECK(VIDEO_Handle->camera.interval != 0);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if ((size < 1) || (size > (1U + sizeof(VIDEO_ProbeTypedef))))
+    return 0;
+
+  USBH_VIDEO_Target_Format = (data[0] & 0x01) ? USBH_VIDEO_YUY2 : USBH_VIDEO_MJPEG;
+  fuzz_probe = data + 1;
+  fuzz_probe_len = (uint16_t) (size - 1);
+
+  // Every input negotiates from scratch, a state cached by an earlier input would skip PROBE
+  video_cache_clear();
+  video_stream_init_buffers((uint8_t *) uvc_frame_pool);
+  sim_camera_init(&camera, &sim_camera_default);
+  device.context = &camera;
+  device.control = fuzz_probe_control;
+  device.periodic_in = fuzz_probe_periodic_in;
+  device.reset = fuzz_probe_reset;
+  sim_fuzz_enumerate(&device, (data[0] & 0x02) ? USBH_SPEED_FULL : USBH_SPEED_HIGH, FUZZ_PROBE_STREAM_FRAMES, FUZZ_PROBE_MAX_FRAMES, fuzz_probe_active);
+  return 0;
+}
+
+// PROBE state the camera returns for the MJPEG target
+size_t fuzz_seed(uint8_t *buf, size_t max) {
+  VIDEO_ProbeTypedef probe;
+
+  if (max < (1U + sizeof(probe)))
+    return 0;
+  memset(&probe, 0, sizeof(probe));
+  probe.bmHint = 1;
+  probe.bFormatIndex = 1;
+  probe.bFrameIndex = 2;
+  probe.dwFrameInterval = 333333;
+  probe.dwMaxVideoFrameSize = sim_camera_frame_bytes(&sim_camera_default, 0, 1);
+  probe.dwMaxPayloadTransferSize = 0x400;
+  probe.dwClockFrequency = sim_camera_default.clock_hz;
+  buf[0] = 0;
+  memcpy(buf + 1, &probe, sizeof(probe));
+  return 1U + sizeof(probe);
+}
@@ -0,0 +1,788 @@
+
+#include "sim_camera.h"
+
+#include <string.h>
+
+#include "usbh_video_stream_parsing.h"
+
+#define SIM_CAMERA_VC_ITF 0
+#define SIM_CAMERA_VS_ITF 1
+
+// Entity IDs
+#define SIM_CAMERA_IT_ID 1
+#define SIM_CAMERA_OT_ID 2
+#define SIM_CAMERA_PU_ID 3
+
+#define SIM_CAMERA_PROBE_SIZE 26  // UVC 1.0 part, all the class sends
+
+#define SIM_REQ_TYPE_MASK      0x60U
+#define SIM_REQ_RECIPIENT_MASK 0x1FU
+
+#define SIM_FPS(fps) (10000000U / (fps))
+
+const SIM_CameraConfigTypeDef sim_camera_default = {
+    .formats_num = 2,
+    .formats =
+        {
+            {
+                .encoding = SIM_CAMERA_MJPEG,
+                .frames_num = 3,
+                .frames =
+                    {
+                        {160, 120, {SIM_FPS(30), SIM_FPS(15), SIM_FPS(5)}},
+                        {320, 240, {SIM_FPS(30), SIM_FPS(15), SIM_FPS(5)}},
+                        {640, 480, {SIM_FPS(30), SIM_FPS(15), SIM_FPS(5)}},
+                    },
+            },
+            {
+                .encoding = SIM_CAMERA_YUY2,
+                .frames_num = 3,
+                .frames =
+                    {
+                        {80, 60, {SIM_FPS(30), SIM_FPS(15), SIM_FPS(5)}},  // fits into the framebuffers of the host build
+                        {160, 120, {SIM_FPS(30), SIM_FPS(15), SIM_FPS(5)}},
+                        {320, 240, {SIM_FPS(30), SIM_FPS(15), SIM_FPS(5)}},
+                    },
+            },
+        },
+    .alts_num = 5,
+    .alt_packets = {0x00C0, 0x0200, 0x0400, 0x0C00, 0x1400},
+    .mjpeg_ratio = 10,
+    .clock_hz = 48000000,
+};
+
+// YUY2 GUID, 32595559-0000-0010-8000-00AA00389B71
+static const uint8_t sim_camera_yuy2_guid[16] = {'Y', 'U', 'Y', '2', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+static const uint8_t sim_camera_dev_desc[USB_DEVICE_DESC_SIZE] = {
+    USB_DEVICE_DESC_SIZE, USB_DESC_TYPE_DEVICE, 0x00, 0x02,
+    0xEF, 0x02, 0x01,   // miscellaneous, interface association
+    64,                 // bMaxPacketSize0
+    0x83, 0x04,         // idVendor
+    0x40, 0x57,         // idProduct
+    0x00, 0x01,         // bcdDevice
+    1, 2, 0,            // iManufacturer, iProduct, iSerialNumber
+    1,                  // bNumConfigurations
+};
+
+//****************************************************************************
+// Controls
+
+typedef struct {
+  uint8_t unit;
+  uint8_t selector;
+  uint8_t size;
+  uint8_t info;  // GET_INFO
+  int32_t min;   // bitmap controls: GET_MIN/GET_MAX stall, GET_RES is the bitmap of the modes
+  int32_t max;
+  int32_t res;
+  int32_t def;
+} SIM_CameraControlTypeDef;
+
+// Camera Terminal: AE mode, AE priority, exposure time; Processing Unit: brightness, white balance temperature,
+// gain, power line frequency, white balance temperature auto. Bits of bmControls in the descriptors.
+#define SIM_CAMERA_CT_CONTROLS 0x0EU
+#define SIM_CAMERA_PU_CONTROLS 0x1641U
+
+#define SIM_CAMERA_AE_MODE      0  // index in "sim_camera_controls"
+#define SIM_CAMERA_EXPOSURE     2
+#define SIM_CAMERA_WB_TEMP      4
+#define SIM_CAMERA_WB_TEMP_AUTO 7
+
+static const SIM_CameraControlTypeDef sim_camera_controls[SIM_CAMERA_CONTROLS] = {
+    {SIM_CAMERA_IT_ID, 0x02, 1, 0x03, 0, 0, 0x0B, 0x08},      // AE mode: manual, auto, aperture priority
+    {SIM_CAMERA_IT_ID, 0x03, 1, 0x03, 0, 1, 1, 0},            // AE priority
+    {SIM_CAMERA_IT_ID, 0x04, 4, 0x0F, 3, 2047, 1, 156},       // exposure time, 100 us; disabled in auto modes
+    {SIM_CAMERA_PU_ID, 0x02, 2, 0x03, -64, 64, 1, 0},         // brightness
+    {SIM_CAMERA_PU_ID, 0x0A, 2, 0x0F, 2800, 6500, 10, 4600},  // white balance temperature; disabled in auto mode
+    {SIM_CAMERA_PU_ID, 0x04, 2, 0x03, 0, 100, 1, 32},         // gain
+    {SIM_CAMERA_PU_ID, 0x05, 1, 0x03, 0, 2, 1, 1},            // power line frequency
+    {SIM_CAMERA_PU_ID, 0x0B, 1, 0x03, 0, 1, 1, 1},            // white balance temperature auto
+};
+
+static void sim_camera_reset_controls(SIM_CameraTypeDef *camera) {
+  for (uint8_t i = 0; i < SIM_CAMERA_CONTROLS; i++) {
+    camera->controls[i] = sim_camera_controls[i].def;
+  }
+}
+
+static int sim_camera_put_value(int32_t value, uint8_t size, uint8_t *data, uint16_t length) {
+  uint16_t n = (length < size) ? length : size;
+  for (uint16_t i = 0; i < n; i++) {
+    data[i] = (uint8_t) ((uint32_t) value >> (8U * i));
+  }
+  return n;
+}
+
+static int sim_camera_vc_request(SIM_CameraTypeDef *camera, const USB_Setup_TypeDef *setup, uint8_t *data, uint16_t length) {
+  uint8_t unit = (uint8_t) (setup->b.wIndex.w >> 8);
+  uint8_t selector = (uint8_t) (setup->b.wValue.w >> 8);
+  uint8_t index;
+
+  for (index = 0; index < SIM_CAMERA_CONTROLS; index++) {
+    if ((sim_camera_controls[index].unit == unit) && (sim_camera_controls[index].selector == selector))
+      break;
+  }
+  if (index == SIM_CAMERA_CONTROLS)
+    return SIM_STALL;
+
+  const SIM_CameraControlTypeDef *control = &sim_camera_controls[index];
+  uint8_t bitmap = (index == SIM_CAMERA_AE_MODE);
+  switch (setup->b.bRequest) {
+    case UVC_GET_INFO: {
+      uint8_t info = control->info;
+      // Controls of an automatic mode are disabled while it is on
+      if (((index == SIM_CAMERA_EXPOSURE) && (camera->controls[SIM_CAMERA_AE_MODE] & 0x0A)) ||
+          ((index == SIM_CAMERA_WB_TEMP) && (camera->controls[SIM_CAMERA_WB_TEMP_AUTO] != 0)))
+        info |= 0x04;
+      else
+        info &= (uint8_t) ~0x04U;
+      return sim_camera_put_value(info, 1, data, length);
+    }
+    case UVC_GET_CUR:
+      return sim_camera_put_value(camera->controls[index], control->size, data, length);
+    case UVC_GET_MIN:
+      return bitmap ? SIM_STALL : sim_camera_put_value(control->min, control->size, data, length);
+    case UVC_GET_MAX:
+      return bitmap ? SIM_STALL : sim_camera_put_value(control->max, control->size, data, length);
+    case UVC_GET_RES:
+      return sim_camera_put_value(control->res, control->size, data, length);
+    case UVC_GET_DEF:
+      return sim_camera_put_value(control->def, control->size, data, length);
+    case UVC_SET_CUR: {
+      if (length < control->size)
+        return SIM_STALL;
+      uint32_t raw = 0;
+      for (uint8_t i = 0; i < control->size; i++) {
+        raw |= (uint32_t) data[i] << (8U * i);
+      }
+      int32_t value = (int32_t) raw;
+      if ((control->min < 0) && (control->size < 4) && (raw & (1UL << (8U * control->size - 1U))))
+        value = (int32_t) (raw | (~0UL << (8U * control->size)));
+      // Out of range, or a control of an automatic mode that is on: the request fails as on a real camera
+      if (bitmap ? (((value & control->res) == 0) || (value & (value - 1))) : ((value < control->min) || (value > control->max)))
+        return SIM_STALL;
+      if (((index == SIM_CAMERA_EXPOSURE) && (camera->controls[SIM_CAMERA_AE_MODE] & 0x0A)) ||
+          ((index == SIM_CAMERA_WB_TEMP) && (camera->controls[SIM_CAMERA_WB_TEMP_AUTO] != 0)))
+        return SIM_STALL;
+      camera->controls[index] = value;
+      camera->counters.control_sets++;
+      return control->size;
+    }
+    default:
+      return SIM_STALL;
+  }
+}
+
+//****************************************************************************
+// Descriptors
+
+typedef struct {
+  uint8_t *buf;
+  uint16_t len;
+} SIM_DescWriterTypeDef;
+
+// Writes past SIM_CAMERA_DESC_SIZE are dropped, the length still counts them
+static void put8(SIM_DescWriterTypeDef *w, uint8_t value) {
+  if (w->len < SIM_CAMERA_DESC_SIZE)
+    w->buf[w->len] = value;
+  w->len++;
+}
+
+static void put16(SIM_DescWriterTypeDef *w, uint16_t value) {
+  put8(w, (uint8_t) value);
+  put8(w, (uint8_t) (value >> 8));
+}
+
+static void put32(SIM_DescWriterTypeDef *w, uint32_t value) {
+  put16(w, (uint16_t) value);
+  put16(w, (uint16_t) (value >> 16));
+}
+
+static void set16(SIM_DescWriterTypeDef *w, uint16_t pos, uint16_t value) {
+  if ((pos + 1U) < SIM_CAMERA_DESC_SIZE) {
+    w->buf[pos] = (uint8_t) value;
+    w->buf[pos + 1] = (uint8_t) (value >> 8);
+  }
+}
+
+static uint8_t sim_camera_intervals_num(const SIM_CameraFrameTypeDef *frame) {
+  uint8_t n = 0;
+  while ((n < SIM_CAMERA_MAX_INTERVALS) && (frame->intervals[n] != 0)) {
+    n++;
+  }
+  return n;
+}
+
+static void put_frame(SIM_DescWriterTypeDef *w, const SIM_CameraConfigTypeDef *cfg, uint8_t format, uint8_t frame) {
+  const SIM_CameraFrameTypeDef *frm = &cfg->formats[format].frames[frame];
+  uint8_t intervals = sim_camera_intervals_num(frm);
+  uint32_t bytes = sim_camera_frame_bytes(cfg, format, frame);
+  uint32_t min_interval = frm->intervals[0];
+  uint32_t max_interval = frm->intervals[0];
+
+  for (uint8_t i = 1; i < intervals; i++) {
+    if (frm->intervals[i] < min_interval)
+      min_interval = frm->intervals[i];
+    if (frm->intervals[i] > max_interval)
+      max_interval = frm->intervals[i];
+  }
+
+  put8(w, (uint8_t) (26 + 4 * intervals));
+  put8(w, USB_DESC_TYPE_CS_INTERFACE);
+  put8(w, (cfg->formats[format].encoding == SIM_CAMERA_MJPEG) ? UVC_VS_FRAME_MJPEG : UVC_VS_FRAME_UNCOMPRESSED);
+  put8(w, (uint8_t) (frame + 1));  // bFrameIndex
+  put8(w, 0);
+  put16(w, frm->width);
+  put16(w, frm->height);
+  put32(w, (uint32_t) (((uint64_t) bytes * 8U * 10000000U) / max_interval));  // dwMinBitRate
+  put32(w, (uint32_t) (((uint64_t) bytes * 8U * 10000000U) / min_interval));  // dwMaxBitRate
+  put32(w, bytes);
+  put32(w, frm->intervals[0]);
+  put8(w, intervals);  // discrete intervals
+  for (uint8_t i = 0; i < intervals; i++) {
+    put32(w, frm->intervals[i]);
+  }
+}
+
+static int sim_camera_build_desc(SIM_CameraTypeDef *camera) {
+  const SIM_CameraConfigTypeDef *cfg = &camera->config;
+  SIM_DescWriterTypeDef w = {camera->cfg_desc, 0};
+
+  // Configuration
+  put8(&w, USB_CONFIGURATION_DESC_SIZE);
+  put8(&w, USB_DESC_TYPE_CONFIGURATION);
+  put16(&w, 0);  // wTotalLength, set at the end
+  put8(&w, 2);   // bNumInterfaces
+  put8(&w, 1);   // bConfigurationValue
+  put8(&w, 0);
+  put8(&w, 0x80);
+  put8(&w, 250);
+
+  // Interface association
+  put8(&w, 8);
+  put8(&w, 0x0B);
+  put8(&w, SIM_CAMERA_VC_ITF);
+  put8(&w, 2);
+  put8(&w, CC_VIDEO);
+  put8(&w, USB_SUBCLASS_VIDEO_INTERFACE_COLLECTION);
+  put8(&w, 0);
+  put8(&w, 0);
+
+  // Video control interface
+  put8(&w, USB_INTERFACE_DESC_SIZE);
+  put8(&w, USB_DESC_TYPE_INTERFACE);
+  put8(&w, SIM_CAMERA_VC_ITF);
+  put8(&w, 0);
+  put8(&w, 0);  // no status endpoint
+  put8(&w, CC_VIDEO);
+  put8(&w, USB_SUBCLASS_VIDEOCONTROL);
+  put8(&w, 0);
+  put8(&w, 0);
+
+  uint16_t vc_header = w.len;
+  put8(&w, 13);
+  put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+  put8(&w, UVC_VC_HEADER);
+  put16(&w, 0x0110);  // bcdUVC
+  put16(&w, 0);       // wTotalLength of the VC descriptors, set below
+  put32(&w, cfg->clock_hz);
+  put8(&w, 1);  // bInCollection
+  put8(&w, SIM_CAMERA_VS_ITF);
+
+  // Camera terminal
+  put8(&w, 18);
+  put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+  put8(&w, UVC_VC_INPUT_TERMINAL);
+  put8(&w, SIM_CAMERA_IT_ID);
+  put16(&w, 0x0201);  // ITT_CAMERA
+  put8(&w, 0);
+  put8(&w, 0);
+  put16(&w, 0);
+  put16(&w, 0);
+  put16(&w, 0);
+  put8(&w, 3);  // bControlSize
+  put8(&w, (uint8_t) SIM_CAMERA_CT_CONTROLS);
+  put8(&w, 0);
+  put8(&w, 0);
+
+  // Processing unit
+  put8(&w, 12);
+  put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+  put8(&w, UVC_VC_PROCESSING_UNIT);
+  put8(&w, SIM_CAMERA_PU_ID);
+  put8(&w, SIM_CAMERA_IT_ID);
+  put16(&w, 0);  // wMaxMultiplier
+  put8(&w, 2);   // bControlSize
+  put16(&w, (uint16_t) SIM_CAMERA_PU_CONTROLS);
+  put8(&w, 0);  // iProcessing
+  put8(&w, 0);  // bmVideoStandards
+
+  put8(&w, 9);
+  put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+  put8(&w, UVC_VC_OUTPUT_TERMINAL);
+  put8(&w, SIM_CAMERA_OT_ID);
+  put16(&w, 0x0101);  // TT_STREAMING
+  put8(&w, 0);
+  put8(&w, SIM_CAMERA_PU_ID);
+  put8(&w, 0);
+  set16(&w, vc_header + 5, (uint16_t) (w.len - vc_header));
+
+  // Video streaming interface, alt setting 0 - no bandwidth
+  put8(&w, USB_INTERFACE_DESC_SIZE);
+  put8(&w, USB_DESC_TYPE_INTERFACE);
+  put8(&w, SIM_CAMERA_VS_ITF);
+  put8(&w, 0);
+  put8(&w, 0);
+  put8(&w, CC_VIDEO);
+  put8(&w, USB_SUBCLASS_VIDEOSTREAMING);
+  put8(&w, 0);
+  put8(&w, 0);
+
+  uint16_t vs_header = w.len;
+  put8(&w, (uint8_t) (13 + cfg->formats_num));
+  put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+  put8(&w, UVC_VS_INPUT_HEADER);
+  put8(&w, cfg->formats_num);
+  put16(&w, 0);  // wTotalLength of the VS descriptors, set below
+  put8(&w, SIM_CAMERA_EP);
+  put8(&w, 0);
+  put8(&w, SIM_CAMERA_OT_ID);
+  put8(&w, 0);
+  put8(&w, 0);
+  put8(&w, 0);
+  put8(&w, 1);  // bControlSize
+  for (uint8_t i = 0; i < cfg->formats_num; i++) {
+    put8(&w, 0);
+  }
+
+  for (uint8_t format = 0; format < cfg->formats_num; format++) {
+    const SIM_CameraFormatTypeDef *fmt = &cfg->formats[format];
+
+    if (fmt->encoding == SIM_CAMERA_MJPEG) {
+      put8(&w, 11);
+      put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+      put8(&w, UVC_VS_FORMAT_MJPEG);
+      put8(&w, (uint8_t) (format + 1));  // bFormatIndex
+      put8(&w, fmt->frames_num);
+      put8(&w, 1);  // fixed size samples
+      put8(&w, 1);  // bDefaultFrameIndex
+      put8(&w, 0);
+      put8(&w, 0);
+      put8(&w, 0);
+      put8(&w, 0);
+    } else {
+      put8(&w, 27);
+      put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+      put8(&w, UVC_VS_FORMAT_UNCOMPRESSED);
+      put8(&w, (uint8_t) (format + 1));  // bFormatIndex
+      put8(&w, fmt->frames_num);
+      for (uint8_t i = 0; i < sizeof(sim_camera_yuy2_guid); i++) {
+        put8(&w, sim_camera_yuy2_guid[i]);
+      }
+      put8(&w, 16);  // bBitsPerPixel
+      put8(&w, 1);   // bDefaultFrameIndex
+      put8(&w, 0);
+      put8(&w, 0);
+      put8(&w, 0);
+      put8(&w, 0);
+    }
+
+    for (uint8_t frame = 0; frame < fmt->frames_num; frame++) {
+      put_frame(&w, cfg, format, frame);
+    }
+
+    put8(&w, 6);
+    put8(&w, USB_DESC_TYPE_CS_INTERFACE);
+    put8(&w, UVC_VS_COLORFORMAT);
+    put8(&w, 1);
+    put8(&w, 1);
+    put8(&w, 4);
+  }
+  set16(&w, vs_header + 4, (uint16_t) (w.len - vs_header));
+
+  // Alt settings 1..n - isochronous endpoint of growing bandwidth
+  for (uint8_t alt = 0; alt < cfg->alts_num; alt++) {
+    put8(&w, USB_INTERFACE_DESC_SIZE);
+    put8(&w, USB_DESC_TYPE_INTERFACE);
+    put8(&w, SIM_CAMERA_VS_ITF);
+    put8(&w, (uint8_t) (alt + 1));
+    put8(&w, 1);
+    put8(&w, CC_VIDEO);
+    put8(&w, USB_SUBCLASS_VIDEOSTREAMING);
+    put8(&w, 0);
+    put8(&w, 0);
+
+    put8(&w, USB_ENDPOINT_DESC_SIZE);
+    put8(&w, USB_DESC_TYPE_ENDPOINT);
+    put8(&w, SIM_CAMERA_EP);
+    put8(&w, 0x05);  // isochronous, asynchronous
+    put16(&w, cfg->alt_packets[alt]);
+    put8(&w, 1);
+  }
+
+  if (w.len > SIM_CAMERA_DESC_SIZE)
+    return -1;
+  set16(&w, 2, w.len);
+  camera->cfg_len = w.len;
+  return 0;
+}
+
+static int sim_camera_string(uint8_t index, uint8_t *data, uint16_t length) {
+  static const char *const strings[] = {NULL, "Simulated", "UVC camera"};
+  uint8_t desc[64];
+
+  if (index == 0) {
+    desc[0] = 4;
+    desc[1] = USB_DESC_TYPE_STRING;
+    desc[2] = 0x09;
+    desc[3] = 0x04;
+  } else if (index < (sizeof(strings) / sizeof(strings[0]))) {
+    uint8_t n = 0;
+    for (const char *s = strings[index]; *s != '\0'; s++, n++) {
+      desc[2 + 2 * n] = (uint8_t) *s;
+      desc[3 + 2 * n] = 0;
+    }
+    desc[0] = (uint8_t) (2 + 2 * n);
+    desc[1] = USB_DESC_TYPE_STRING;
+  } else {
+    return SIM_STALL;
+  }
+
+  uint16_t n = (desc[0] < length) ? desc[0] : length;
+  memcpy(data, desc, n);
+  return n;
+}
+
+//****************************************************************************
+// Requests
+
+static uint8_t sim_camera_uframes_per_ms(void) {
+  return (sim_hcd_speed() == USBH_SPEED_HIGH) ? 8U : 1U;
+}
+
+// Bytes per (micro)frame of alt setting "alt" (1..n)
+static uint16_t sim_camera_alt_capacity(const SIM_CameraConfigTypeDef *cfg, uint8_t alt) {
+  uint16_t packet = cfg->alt_packets[alt - 1];
+  uint8_t mult = (sim_hcd_speed() == USBH_SPEED_HIGH) ? UVC_EP_MULT(packet) : 1U;
+  return (uint16_t) (UVC_EP_PACKET_SIZE(packet) * mult);
+}
+
+// PROBE: the camera fills in what it decides, unknown indexes are replaced by the defaults, the interval by the
+// nearest supported one. The frame is sent within half of the interval, the payload size is the smallest alt setting
+// which carries it.
+static void sim_camera_negotiate(SIM_CameraTypeDef *camera, VIDEO_ProbeTypedef *probe) {
+  const SIM_CameraConfigTypeDef *cfg = &camera->config;
+  uint8_t format = probe->bFormatIndex;
+  uint8_t frame = probe->bFrameIndex;
+
+  if ((format == 0) || (format > cfg->formats_num))
+    format = 1;
+  if ((frame == 0) || (frame > cfg->formats[format - 1].frames_num))
+    frame = 1;
+
+  const SIM_CameraFrameTypeDef *frm = &cfg->formats[format - 1].frames[frame - 1];
+  uint32_t interval = frm->intervals[0];
+  if (probe->dwFrameInterval != 0) {
+    for (uint8_t i = 1; i < sim_camera_intervals_num(frm); i++) {
+      uint32_t best_diff = (interval > probe->dwFrameInterval) ? (interval - probe->dwFrameInterval) : (probe->dwFrameInterval - interval);
+      uint32_t diff = (frm->intervals[i] > probe->dwFrameInterval) ? (frm->intervals[i] - probe->dwFrameInterval) : (probe->dwFrameInterval - frm->intervals[i]);
+      if (diff < best_diff)
+        interval = frm->intervals[i];
+    }
+  }
+
+  uint32_t bytes = sim_camera_frame_bytes(cfg, format - 1, frame - 1);
+  uint32_t uframes = (uint32_t) (((uint64_t) interval * sim_camera_uframes_per_ms()) / 20000U);  // 100 ns units, half
+  if (uframes == 0)
+    uframes = 1;
+  uint32_t need = (bytes + uframes - 1) / uframes + UVC_HEADER_SIZE;
+
+  uint16_t payload = 0;
+  uint16_t biggest = 0;
+  for (uint8_t alt = 1; alt <= cfg->alts_num; alt++) {
+    uint16_t capacity = sim_camera_alt_capacity(cfg, alt);
+    if (capacity > biggest)
+      biggest = capacity;
+    if ((capacity >= need) && ((payload == 0) || (capacity < payload)))
+      payload = capacity;
+  }
+  if (payload == 0)
+    payload = biggest;
+
+  probe->bFormatIndex = format;
+  probe->bFrameIndex = frame;
+  probe->dwFrameInterval = interval;
+  probe->dwMaxVideoFrameSize = bytes;
+  probe->dwMaxPayloadTransferSize = payload;
+  probe->dwClockFrequency = cfg->clock_hz;
+  probe->bmFramingInfo = 0x03;
+}
+
+// Streaming parameters of the committed format at the current alt setting
+static void sim_camera_start_stream(SIM_CameraTypeDef *camera) {
+  const SIM_CameraConfigTypeDef *cfg = &camera->config;
+  const VIDEO_ProbeTypedef *commit = &camera->commit;
+
+  camera->encoding = cfg->formats[commit->bFormatIndex - 1].encoding;
+  camera->frame_bytes = commit->dwMaxVideoFrameSize;
+  camera->interval = commit->dwFrameInterval;
+  camera->payload = (uint16_t) commit->dwMaxPayloadTransferSize;
+  if ((camera->alt != 0) && (sim_camera_alt_capacity(cfg, camera->alt) < camera->payload))
+    camera->payload = sim_camera_alt_capacity(cfg, camera->alt);
+
+  camera->in_frame = 0;
+  camera->frame_time = sim_hcd_time_us() * 10U;
+  camera->next_frame = camera->frame_time;
+}
+
+static int sim_camera_vs_request(SIM_CameraTypeDef *camera, const USB_Setup_TypeDef *setup, uint8_t *data, uint16_t length) {
+  uint8_t selector = (uint8_t) (setup->b.wValue.w >> 8);
+  VIDEO_ProbeTypedef *target;
+  uint16_t n = (length < SIM_CAMERA_PROBE_SIZE) ? length : SIM_CAMERA_PROBE_SIZE;
+
+  if (selector == VS_PROBE_CONTROL)
+    target = &camera->probe;
+  else if (selector == VS_COMMIT_CONTROL)
+    target = &camera->commit;
+  else
+    return SIM_STALL;
+
+  switch (setup->b.bRequest) {
+    case UVC_SET_CUR:
+      memcpy(target, data, n);
+      sim_camera_negotiate(camera, target);
+      if (target == &camera->commit)
+        sim_camera_start_stream(camera);
+      return n;
+
+    case UVC_GET_CUR:
+    case UVC_GET_MIN:
+    case UVC_GET_MAX:
+    case UVC_GET_DEF:
+      memcpy(data, target, n);
+      return n;
+
+    default:
+      return SIM_STALL;
+  }
+}
+
+static int sim_camera_control(void *context, const USB_Setup_TypeDef *setup, uint8_t *data, uint16_t length) {
+  SIM_CameraTypeDef *camera = (SIM_CameraTypeDef *) context;
+  uint8_t type = setup->b.bmRequestType & SIM_REQ_TYPE_MASK;
+
+  if (type == USB_REQ_TYPE_CLASS) {
+    if ((setup->b.bmRequestType & SIM_REQ_RECIPIENT_MASK) != USB_REQ_RECIPIENT_INTERFACE)
+      return SIM_STALL;
+    if ((setup->b.wIndex.w & 0xFFU) == SIM_CAMERA_VS_ITF)
+      return sim_camera_vs_request(camera, setup, data, length);
+    if ((setup->b.wIndex.w & 0xFFU) == SIM_CAMERA_VC_ITF)
+      return sim_camera_vc_request(camera, setup, data, length);
+    return SIM_STALL;
+  }
+  if (type != USB_REQ_TYPE_STANDARD)
+    return SIM_STALL;
+
+  switch (setup->b.bRequest) {
+    case USB_REQ_GET_DESCRIPTOR: {
+      const uint8_t *desc;
+      uint16_t len;
+      switch (setup->b.wValue.w >> 8) {
+        case USB_DESC_TYPE_DEVICE:
+          desc = sim_camera_dev_desc;
+          len = sizeof(sim_camera_dev_desc);
+          break;
+        case USB_DESC_TYPE_CONFIGURATION:
+          desc = camera->cfg_desc;
+          len = camera->cfg_len;
+          break;
+        case USB_DESC_TYPE_STRING:
+          return sim_camera_string((uint8_t) setup->b.wValue.w, data, length);
+        default:
+          return SIM_STALL;
+      }
+      if (len > length)
+        len = length;
+      memcpy(data, desc, len);
+      return len;
+    }
+
+    case USB_REQ_SET_CONFIGURATION:
+      camera->configuration = (uint8_t) setup->b.wValue.w;
+      return 0;
+
+    case USB_REQ_SET_INTERFACE:
+      if ((setup->b.wIndex.w & 0xFFU) == SIM_CAMERA_VS_ITF) {
+        if (setup->b.wValue.w > camera->config.alts_num)
+          return SIM_STALL;
+        camera->alt = (uint8_t) setup->b.wValue.w;
+        sim_camera_start_stream(camera);
+      }
+      return 0;
+
+    case USB_REQ_GET_STATUS:
+      memset(data, 0, (length < 2) ? length : 2);
+      return (length < 2) ? length : 2;
+
+    case USB_REQ_SET_ADDRESS:
+    case USB_REQ_CLEAR_FEATURE:
+    case USB_REQ_SET_FEATURE:
+      return 0;
+
+    default:
+      return SIM_STALL;
+  }
+}
+
+static void sim_camera_reset(void *context) {
+  SIM_CameraTypeDef *camera = (SIM_CameraTypeDef *) context;
+
+  camera->configuration = 0;
+  camera->alt = 0;
+  camera->in_frame = 0;
+  // Negotiated state is back to the power-on default
+  memset(&camera->probe, 0, sizeof(camera->probe));
+  sim_camera_negotiate(camera, &camera->probe);
+  camera->commit = camera->probe;
+  sim_camera_reset_controls(camera);
+}
+
+//****************************************************************************
+// Stream
+
+// xorshift32, the impairments of a run depend on the seed only
+static uint32_t sim_camera_random(SIM_CameraTypeDef *camera) {
+  uint32_t x = camera->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  camera->rng = x;
+  return x;
+}
+
+static uint8_t sim_camera_chance(SIM_CameraTypeDef *camera, uint32_t ppm) {
+  return (ppm != 0) && ((sim_camera_random(camera) % 1000000U) < ppm);
+}
+
+// Camera clock, runs "clock_drift_ppm" off the bus clock
+static uint32_t sim_camera_stc(const SIM_CameraTypeDef *camera) {
+  const SIM_CameraConfigTypeDef *cfg = &camera->config;
+  uint64_t ticks = (sim_hcd_time_us() * cfg->clock_hz) / 1000000U;
+  int64_t drift = ((int64_t) ticks * cfg->impair.clock_drift_ppm) / 1000000;
+  return (uint32_t) ((int64_t) ticks + drift);
+}
+
+// MJPEG frames are SOI, pattern, EOI; YUY2 frames - pattern only
+static uint8_t sim_camera_frame_byte(const SIM_CameraTypeDef *camera, uint32_t pos) {
+  if (camera->encoding == SIM_CAMERA_MJPEG) {
+    if (pos < 2)
+      return (pos == 0) ? 0xFF : 0xD8;  // SOI
+    if (pos >= (camera->frame_bytes - 2))
+      return (pos == (camera->frame_bytes - 2)) ? 0xFF : 0xD9;  // EOI
+  }
+  return (uint8_t) ((pos * 7U + camera->counters.frames_sent) & 0x7FU);
+}
+
+static int sim_camera_periodic_in(void *context, uint8_t ep_addr, uint32_t frame, uint8_t *data, uint16_t length) {
+  SIM_CameraTypeDef *camera = (SIM_CameraTypeDef *) context;
+  const SIM_CameraImpairTypeDef *impair = &camera->config.impair;
+  uint64_t now = sim_hcd_time_us() * 10U;  // 100 ns units
+  uint32_t stc = sim_camera_stc(camera);
+
+  if ((ep_addr != SIM_CAMERA_EP) || (camera->alt == 0))
+    return SIM_XACT_ERROR;  // nothing answers
+  if (length > camera->payload)
+    length = camera->payload;
+  if (length < UVC_HEADER_SIZE)
+    return 0;
+
+  if (!camera->in_frame && (now >= camera->next_frame)) {
+    camera->in_frame = 1;
+    camera->frame_pos = 0;
+    camera->fid ^= 1U;
+    camera->pts = stc;
+
+    // Frames which could not be sent in time are skipped, the camera does not catch up
+    camera->frame_time += camera->interval;
+    if (camera->frame_time < now)
+      camera->frame_time = now;
+    camera->next_frame = camera->frame_time;
+    if (impair->jitter_us != 0)
+      camera->next_frame += sim_camera_random(camera) % (impair->jitter_us * 10U + 1U);
+  }
+
+  if (!camera->in_frame)
+    return 0;  // idle (micro)frame, zero-length packet
+
+  uint32_t n = camera->frame_bytes - camera->frame_pos;
+  if (n > (uint32_t) (length - UVC_HEADER_SIZE))
+    n = length - UVC_HEADER_SIZE;
+  if ((n > 1) && sim_camera_chance(camera, impair->short_ppm)) {
+    n = 1 + sim_camera_random(camera) % (n - 1);
+    camera->counters.packets_short++;
+  }
+
+  uint8_t info = UVC_HEADER_EOH_BIT | UVC_HEADER_PTS_BIT | UVC_HEADER_SCR_BIT | camera->fid;
+  uint8_t last = ((camera->frame_pos + n) == camera->frame_bytes);
+  if (last && !impair->no_eof)
+    info |= UVC_HEADER_EOF_BIT;
+  if (sim_camera_chance(camera, impair->err_ppm)) {
+    info |= UVC_HEADER_ERR_BIT;
+    camera->counters.packets_err++;
+  }
+
+  // SCR is sampled with the frame number of the last SOF, microframes are not counted
+  uint32_t frame_number = sim_hcd_frame_number();
+  uint16_t sof = (uint16_t) (((sim_hcd_speed() == USBH_SPEED_HIGH) ? (frame_number >> 3) : frame_number) & UVC_HEADER_SCR_SOF_MASK);
+  data[0] = UVC_HEADER_SIZE;
+  data[1] = info;
+  memcpy(&data[2], &camera->pts, 4);
+  memcpy(&data[6], &stc, 4);
+  memcpy(&data[10], &sof, 2);
+  for (uint32_t i = 0; i < n; i++) {
+    data[UVC_HEADER_SIZE + i] = sim_camera_frame_byte(camera, camera->frame_pos + i);
+  }
+
+  camera->frame_pos += n;
+  if (last) {
+    camera->in_frame = 0;
+    camera->counters.frames_sent++;
+  }
+  camera->counters.packets_sent++;
+
+  // Lost on the bus: the camera has sent the data, the host sees a transaction error
+  if (sim_camera_chance(camera, impair->loss_ppm)) {
+    camera->counters.packets_lost++;
+    return SIM_XACT_ERROR;
+  }
+  return (int) (UVC_HEADER_SIZE + n);
+}
+
+//****************************************************************************
+
+uint32_t sim_camera_frame_bytes(const SIM_CameraConfigTypeDef *config, uint8_t format, uint8_t frame) {
+  const SIM_CameraFrameTypeDef *frm = &config->formats[format].frames[frame];
+  uint32_t bytes = (uint32_t) frm->width * frm->height * 2U;
+
+  if ((config->formats[format].encoding == SIM_CAMERA_MJPEG) && (config->mjpeg_ratio > 1))
+    bytes /= config->mjpeg_ratio;
+  return bytes;
+}
+
+int sim_camera_init(SIM_CameraTypeDef *camera, const SIM_CameraConfigTypeDef *config) {
+  memset(camera, 0, sizeof(*camera));
+  camera->config = *config;
+  camera->rng = (config->impair.seed != 0) ? config->impair.seed : 1U;
+  camera->device.context = camera;
+  camera->device.control = sim_camera_control;
+  camera->device.periodic_in = sim_camera_periodic_in;
+  camera->device.reset = sim_camera_reset;
+  if (sim_camera_build_desc(camera) != 0)
+    return -1;
+  sim_camera_negotiate(camera, &camera->probe);
+  camera->commit = camera->probe;
+  sim_camera_reset_controls(camera);
+  sim_camera_start_stream(camera);
+  return 0;
+}
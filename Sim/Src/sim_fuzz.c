@@ -0,0 +1,50 @@
+// Host side of the fuzz harnesses that present a device to the USB host library, see sim_fuzz.h
+
+#include "sim_fuzz.h"
+
+#include <string.h>
+
+#include "usbh_core.h"
+#include "usbh_video.h"
+
+// Disconnect is handled by the host state machine, a few (micro)frames are enough
+#define SIM_FUZZ_DETACH_FRAMES 8
+
+static USBH_HandleTypeDef hUsbHostFuzz;
+static uint8_t class_active = 0;
+
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id) {
+  if (id == HOST_USER_CLASS_ACTIVE)
+    class_active = 1;
+}
+
+int sim_fuzz_enumerate(const SIM_DeviceTypeDef *device, USBH_SpeedTypeDef speed, uint32_t stream_frames, uint32_t max_frames,
+                       void (*active)(USBH_HandleTypeDef *phost)) {
+  uint32_t frames = 0;
+  int result;
+
+  memset(&hUsbHostFuzz, 0, sizeof(hUsbHostFuzz));
+  class_active = 0;
+  USBH_Init(&hUsbHostFuzz, USBH_UserProcess, (speed == USBH_SPEED_HIGH) ? HOST_HS : HOST_FS);
+  USBH_RegisterClass(&hUsbHostFuzz, USBH_VIDEO_CLASS);
+  USBH_Start(&hUsbHostFuzz);
+  sim_hcd_attach(device, speed);
+
+  while (!class_active && (frames < max_frames)) {
+    sim_hcd_run(&hUsbHostFuzz, 1);
+    frames++;
+  }
+  result = class_active;
+  if (class_active) {
+    sim_hcd_run(&hUsbHostFuzz, stream_frames);
+    if ((active != NULL) && (hUsbHostFuzz.pActiveClass != NULL) && (hUsbHostFuzz.pActiveClass->pData != NULL))
+      active(&hUsbHostFuzz);
+  }
+
+  // Class handle is freed by the host library when the device is gone
+  sim_hcd_detach();
+  sim_hcd_run(&hUsbHostFuzz, SIM_FUZZ_DETACH_FRAMES);
+  USBH_Stop(&hUsbHostFuzz);
+  USBH_DeInit(&hUsbHostFuzz);
+  return result;
+}
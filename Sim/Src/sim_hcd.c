@@ -0,0 +1,443 @@
+/**
+  ******************************************************************************
+  * @file    sim_hcd.c
+  * @brief   Simulated host controller, low level driver of the host-native build
+  ******************************************************************************
+  * Replaces USB_HOST/Target/usbh_conf.c: USBH_LL_* interface of the USB host
+  * library and the usbh_conf_ext.h extensions. See sim_hcd.h.
+  * Bulk transfers are not simulated, they are always NAKed (URB_NOTREADY).
+  ******************************************************************************
+  */
+
+#include "sim_hcd.h"
+
+#include <string.h>
+
+#include "usbh_conf_ext.h"
+#include "usbh_ioreq.h"
+
+#define SIM_HCD_MAX_PIPES    16U
+#define SIM_HCD_CTRL_BUFFER  4096U
+
+// FIFO RAM of OTG_HS as used by usbh_conf.c, the layout is only checked and reported
+#define SIM_HCD_FIFO_WORDS      0x3E0U
+#define SIM_HCD_NPTX_FIFO_WORDS 0x100U
+#define SIM_HCD_MIN_FIFO_WORDS  0x10U
+
+typedef struct {
+  uint8_t open;
+  uint8_t ep_addr;
+  uint8_t ep_type;
+  uint8_t toggle;
+  uint8_t parity;
+  uint8_t armed;      // periodic URB waits for its (micro)frame
+  uint8_t direction;  // of the armed URB, 1 - IN
+  uint8_t err_count;  // transaction errors of the armed URB
+  uint8_t *buf;
+  uint16_t length;
+  uint32_t armed_frame;  // frame the URB was submitted in, it is executed in a later one
+  uint32_t xfer_count;
+  USBH_URBStateTypeDef urb_state;
+  USBH_ChannelHookTypeDef hook;
+  void *hook_context;
+} SIM_PipeTypeDef;
+
+static struct {
+  USBH_HandleTypeDef *phost;
+  const SIM_DeviceTypeDef *device;
+  USBH_SpeedTypeDef speed;
+  uint8_t started;
+  uint8_t connected;
+  uint8_t port_enabled;
+
+  uint32_t frame;
+  uint32_t frame_base;    // "frame" at the last port reset, the bus frame number (HFNUM) restarts there
+  uint32_t sof_coalesce;  // every n-th SOF interrupt is merged into the next one, 0 - none
+  uint64_t time_us;
+
+  SIM_PipeTypeDef pipes[SIM_HCD_MAX_PIPES];
+  USBH_FifoLayoutTypeDef fifo;
+  uint32_t active_submits;
+
+  // Control transfer in progress
+  USB_Setup_TypeDef setup;
+  uint8_t ctrl_data[SIM_HCD_CTRL_BUFFER];
+  uint16_t ctrl_len;
+  uint16_t ctrl_pos;
+  uint8_t ctrl_stall;
+} sim = {.speed = USBH_SPEED_HIGH};
+
+SIM_DWT_TypeDef sim_dwt;
+SIM_CoreDebug_TypeDef sim_core_debug;
+uint32_t SystemCoreClock = SIM_HCD_CORE_CLOCK;
+
+uint32_t HAL_GetTick(void) {
+  return (uint32_t) (sim.time_us / 1000U);
+}
+
+uint32_t sim_hcd_frame(void) {
+  return sim.frame;
+}
+
+uint32_t sim_hcd_frame_number(void) {
+  return (sim.frame - sim.frame_base) & 0x3FFFU;
+}
+
+void sim_hcd_set_sof_coalesce(uint32_t every) {
+  sim.sof_coalesce = every;
+}
+
+USBH_SpeedTypeDef sim_hcd_speed(void) {
+  return sim.speed;
+}
+
+uint64_t sim_hcd_time_us(void) {
+  return sim.time_us;
+}
+
+uint32_t sim_hcd_active_submits(void) {
+  return sim.active_submits;
+}
+
+static void sim_hcd_connect(void) {
+  if (sim.connected || (sim.device == NULL) || !sim.started || (sim.phost == NULL))
+    return;
+  sim.connected = 1;
+  USBH_LL_Connect(sim.phost);
+}
+
+void sim_hcd_attach(const SIM_DeviceTypeDef *device, USBH_SpeedTypeDef speed) {
+  sim.device = device;
+  sim.speed = speed;
+  sim_hcd_connect();
+}
+
+void sim_hcd_detach(void) {
+  sim.device = NULL;
+  if (sim.connected) {
+    sim.connected = 0;
+    sim.port_enabled = 0;
+    USBH_LL_Disconnect(sim.phost);
+  }
+}
+
+//****************************************************************************
+
+// URB of "pipe" is completed, the hook gets it first as in HAL_HCD_HC_NotifyURBChange_Callback
+static void sim_hcd_complete(uint8_t pipe, USBH_URBStateTypeDef state) {
+  SIM_PipeTypeDef *p = &sim.pipes[pipe];
+
+  p->urb_state = state;
+  if (p->hook != NULL)
+    (void) p->hook(sim.phost, pipe, state, p->hook_context);
+}
+
+static void sim_hcd_periodic(uint8_t pipe) {
+  SIM_PipeTypeDef *p = &sim.pipes[pipe];
+
+  if (!p->armed || (sim.frame == p->armed_frame))
+    return;
+  if (((p->parity == USBH_FRAME_EVEN) && (sim.frame & 1U)) || ((p->parity == USBH_FRAME_ODD) && !(sim.frame & 1U)))
+    return;
+
+  p->armed = 0;
+  int len = SIM_XACT_ERROR;
+  if (p->direction == 0) {
+    len = p->length;  // periodic OUT, device takes everything
+  } else if ((sim.device != NULL) && (sim.device->periodic_in != NULL)) {
+    len = sim.device->periodic_in(sim.device->context, p->ep_addr, sim.frame, p->buf, p->length);
+  }
+
+  if (len >= 0) {
+    p->err_count = 0;
+    p->xfer_count = ((uint32_t) len < p->length) ? (uint32_t) len : p->length;
+    sim_hcd_complete(pipe, USBH_URB_DONE);
+  } else if ((len == SIM_XACT_ERROR) && (++p->err_count <= 2U)) {
+    // As the HAL channel halt handler: the first two transaction errors re-enable the channel
+    // for the next (micro)frame and report URB_NOTREADY, the third one is URB_ERROR
+    p->xfer_count = 0;
+    p->armed = 1;
+    p->armed_frame = sim.frame;
+    sim_hcd_complete(pipe, USBH_URB_NOTREADY);
+  } else {
+    p->err_count = 0;
+    p->xfer_count = 0;
+    sim_hcd_complete(pipe, (len == SIM_NAK) ? USBH_URB_NOTREADY : USBH_URB_ERROR);
+  }
+}
+
+void sim_hcd_step(void) {
+  sim.frame++;
+  sim.time_us += (sim.speed == USBH_SPEED_HIGH) ? 125U : 1000U;
+  sim_dwt.CYCCNT = (uint32_t) (sim.time_us * (SIM_HCD_CORE_CLOCK / 1000000U));
+
+  if (!sim.started || !sim.port_enabled)
+    return;
+
+  // Interrupts of two SOFs may be handled as one, "phost->Timer" then falls behind the bus frame number
+  if ((sim.sof_coalesce == 0) || ((sim.frame % sim.sof_coalesce) != 0))
+    USBH_LL_IncTimer(sim.phost);
+  for (uint8_t pipe = 0; pipe < SIM_HCD_MAX_PIPES; pipe++) {
+    if (sim.pipes[pipe].open)
+      sim_hcd_periodic(pipe);
+  }
+}
+
+void sim_hcd_run(USBH_HandleTypeDef *phost, uint32_t frames) {
+  while (frames-- != 0) {
+    sim_hcd_step();
+    USBH_Process(phost);
+  }
+}
+
+//****************************************************************************
+// Control transfers
+
+static void sim_hcd_control(uint8_t pipe, uint8_t direction, uint8_t token, uint8_t *pbuff, uint16_t length) {
+  SIM_PipeTypeDef *p = &sim.pipes[pipe];
+  const SIM_DeviceTypeDef *device = sim.device;
+
+  p->xfer_count = 0;
+  if ((device == NULL) || (device->control == NULL)) {
+    p->urb_state = USBH_URB_ERROR;
+    return;
+  }
+
+  if (token == USBH_PID_SETUP) {
+    memcpy(&sim.setup, pbuff, sizeof(sim.setup));
+    sim.ctrl_len = 0;
+    sim.ctrl_pos = 0;
+    sim.ctrl_stall = 0;
+
+    uint16_t wLength = sim.setup.b.wLength.w;
+    if (((sim.setup.b.bmRequestType & USB_REQ_DIR_MASK) == USB_D2H) || (wLength == 0)) {
+      if (wLength > SIM_HCD_CTRL_BUFFER)
+        wLength = SIM_HCD_CTRL_BUFFER;
+      int len = device->control(device->context, &sim.setup, sim.ctrl_data, wLength);
+      if (len < 0)
+        sim.ctrl_stall = 1;
+      else
+        sim.ctrl_len = ((uint32_t) len < wLength) ? (uint16_t) len : wLength;
+    }
+    p->xfer_count = length;
+    p->urb_state = USBH_URB_DONE;  // SETUP is never refused
+    return;
+  }
+
+  if (sim.ctrl_stall) {
+    p->urb_state = USBH_URB_STALL;
+    return;
+  }
+
+  if (direction == 1U) {
+    // IN data stage, or the status stage of an OUT request
+    uint16_t n = (uint16_t) (sim.ctrl_len - sim.ctrl_pos);
+    if (n > length)
+      n = length;
+    if ((n != 0) && (pbuff != NULL))
+      memcpy(pbuff, &sim.ctrl_data[sim.ctrl_pos], n);
+    sim.ctrl_pos = (uint16_t) (sim.ctrl_pos + n);
+    p->xfer_count = n;
+  } else if ((length != 0) && ((sim.setup.b.bmRequestType & USB_REQ_DIR_MASK) != USB_D2H)) {
+    // OUT data stage, whole wLength is sent by one URB
+    if (length > SIM_HCD_CTRL_BUFFER)
+      length = SIM_HCD_CTRL_BUFFER;
+    memcpy(sim.ctrl_data, pbuff, length);
+    if (device->control(device->context, &sim.setup, sim.ctrl_data, length) < 0) {
+      sim.ctrl_stall = 1;
+      p->urb_state = USBH_URB_STALL;
+      return;
+    }
+    p->xfer_count = length;
+  }
+  p->urb_state = USBH_URB_DONE;
+}
+
+//****************************************************************************
+// Low level driver interface (USB host library -> HCD)
+
+USBH_StatusTypeDef USBH_LL_Init(USBH_HandleTypeDef *phost) {
+  sim.phost = phost;
+  phost->pData = &sim;
+  memset(sim.pipes, 0, sizeof(sim.pipes));
+  USBH_LL_SetTimer(phost, sim.frame);
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_DeInit(USBH_HandleTypeDef *phost) {
+  sim.started = 0;
+  sim.phost = NULL;
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_Start(USBH_HandleTypeDef *phost) {
+  sim.started = 1;
+  sim_hcd_connect();
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_Stop(USBH_HandleTypeDef *phost) {
+  sim.started = 0;
+  for (uint8_t pipe = 0; pipe < SIM_HCD_MAX_PIPES; pipe++) {
+    sim.pipes[pipe].armed = 0;
+  }
+  return USBH_OK;
+}
+
+USBH_SpeedTypeDef USBH_LL_GetSpeed(USBH_HandleTypeDef *phost) {
+  return sim.speed;
+}
+
+USBH_StatusTypeDef USBH_LL_ResetPort(USBH_HandleTypeDef *phost) {
+  if (!sim.connected)
+    return USBH_OK;
+  if (sim.device->reset != NULL)
+    sim.device->reset(sim.device->context);
+  sim.frame_base = sim.frame;
+  sim.port_enabled = 1;
+  USBH_LL_PortEnabled(phost);
+  return USBH_OK;
+}
+
+uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe) {
+  return (pipe < SIM_HCD_MAX_PIPES) ? sim.pipes[pipe].xfer_count : 0;
+}
+
+USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state) {
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num, uint8_t epnum, uint8_t dev_address, uint8_t speed,
+                                    uint8_t ep_type, uint16_t mps) {
+  if (pipe_num >= SIM_HCD_MAX_PIPES)
+    return USBH_FAIL;
+
+  SIM_PipeTypeDef *p = &sim.pipes[pipe_num];
+  p->open = 1;
+  p->ep_addr = epnum;
+  p->ep_type = ep_type;
+  p->parity = USBH_FRAME_NEXT;
+  p->armed = 0;
+  p->xfer_count = 0;
+  p->urb_state = USBH_URB_IDLE;
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe) {
+  if (pipe >= SIM_HCD_MAX_PIPES)
+    return USBH_FAIL;
+  sim.pipes[pipe].open = 0;
+  sim.pipes[pipe].armed = 0;
+  return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_SubmitURB(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t direction, uint8_t ep_type, uint8_t token,
+                                     uint8_t *pbuff, uint16_t length, uint8_t do_ping) {
+  if ((pipe >= SIM_HCD_MAX_PIPES) || !sim.pipes[pipe].open)
+    return USBH_FAIL;
+
+  SIM_PipeTypeDef *p = &sim.pipes[pipe];
+  p->urb_state = USBH_URB_IDLE;
+
+  switch (ep_type) {
+    case USBH_EP_CONTROL:
+      sim_hcd_control(pipe, direction, token, pbuff, length);
+      break;
+
+    case USBH_EP_ISO:
+    case USBH_EP_INTERRUPT:
+      if (p->armed)
+        sim.active_submits++;  // the channel is still enabled, the HAL would program it twice
+      p->err_count = 0;
+      p->direction = direction;
+      p->buf = pbuff;
+      p->length = length;
+      p->armed_frame = sim.frame;
+      p->armed = 1;
+      break;
+
+    default:
+      p->xfer_count = 0;
+      p->urb_state = USBH_URB_NOTREADY;
+      break;
+  }
+  return USBH_OK;
+}
+
+USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe) {
+  return (pipe < SIM_HCD_MAX_PIPES) ? sim.pipes[pipe].urb_state : USBH_URB_ERROR;
+}
+
+USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t toggle) {
+  if (pipe < SIM_HCD_MAX_PIPES)
+    sim.pipes[pipe].toggle = toggle;
+  return USBH_OK;
+}
+
+uint8_t USBH_LL_GetToggle(USBH_HandleTypeDef *phost, uint8_t pipe) {
+  return (pipe < SIM_HCD_MAX_PIPES) ? sim.pipes[pipe].toggle : 0;
+}
+
+// Bus keeps running while the host thread waits
+void USBH_Delay(uint32_t Delay) {
+  uint32_t frames = Delay * ((sim.speed == USBH_SPEED_HIGH) ? 8U : 1U);
+
+  while (frames-- != 0) {
+    sim_hcd_step();
+  }
+}
+
+//****************************************************************************
+// usbh_conf_ext.h
+
+USBH_StatusTypeDef USBH_LL_SetFifoLayout(USBH_HandleTypeDef *phost, uint16_t in_mps, uint8_t in_mult, uint16_t out_mps,
+                                         USBH_FifoLayoutTypeDef *layout) {
+  // Same partitioning as the target
+  uint32_t packets = (in_mult > 2U) ? in_mult : 2U;
+  uint32_t rx = packets * ((((uint32_t) in_mps + 3U) / 4U) + 1U) + 2U;
+  if (rx < (2U * (SIM_HCD_MIN_FIFO_WORDS + 1U) + 2U))
+    rx = 2U * (SIM_HCD_MIN_FIFO_WORDS + 1U) + 2U;
+  uint32_t ptx = 2U * (((uint32_t) out_mps + 3U) / 4U);
+  if (ptx < SIM_HCD_MIN_FIFO_WORDS)
+    ptx = SIM_HCD_MIN_FIFO_WORDS;
+
+  if ((rx + ptx + SIM_HCD_MIN_FIFO_WORDS) > SIM_HCD_FIFO_WORDS) {
+    USBH_ErrLog("FIFO: %lu + %lu words do not fit into %lu", (unsigned long) rx, (unsigned long) ptx, (unsigned long) SIM_HCD_FIFO_WORDS);
+    return USBH_FAIL;
+  }
+
+  uint32_t nptx = SIM_HCD_FIFO_WORDS - rx - ptx;
+  if (nptx > SIM_HCD_NPTX_FIFO_WORDS)
+    nptx = SIM_HCD_NPTX_FIFO_WORDS;
+
+  sim.fifo.rx = (uint16_t) rx;
+  sim.fifo.nptx = (uint16_t) nptx;
+  sim.fifo.ptx = (uint16_t) ptx;
+  sim.fifo.total = SIM_HCD_FIFO_WORDS;
+  USBH_LL_GetFifoLayout(phost, layout);
+  return USBH_OK;
+}
+
+void USBH_LL_GetFifoLayout(USBH_HandleTypeDef *phost, USBH_FifoLayoutTypeDef *layout) {
+  if (layout != NULL)
+    *layout = sim.fifo;
+}
+
+USBH_StatusTypeDef USBH_LL_RegisterChannelHook(USBH_HandleTypeDef *phost, uint8_t pipe, USBH_ChannelHookTypeDef hook, void *context) {
+  if (pipe >= SIM_HCD_MAX_PIPES)
+    return USBH_FAIL;
+  sim.pipes[pipe].hook = hook;
+  sim.pipes[pipe].hook_context = context;
+  return USBH_OK;
+}
+
+uint32_t USBH_LL_GetCurrentFrame(USBH_HandleTypeDef *phost) {
+  return sim_hcd_frame_number();
+}
+
+USBH_StatusTypeDef USBH_LL_SetFrameParity(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t parity) {
+  if (pipe >= SIM_HCD_MAX_PIPES)
+    return USBH_FAIL;
+  sim.pipes[pipe].parity = parity;
+  return USBH_OK;
+}
@@ -0,0 +1,47 @@
+// Native run of the stream parser benchmark (usbh_video_bench.h).
+// The parser is linked without the host library and the simulated host controller, so the Cortex-M facade
+// of the simulation and the parser globals of the class driver are provided here; nanoseconds of CLOCK_MONOTONIC take the place of DWT->CYCCNT.
+// Usage: uvc_bench [packets per case]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "usbh_video_bench.h"
+#include "usbh_video_stream_parsing.h"
+
+SIM_DWT_TypeDef sim_dwt;
+SIM_CoreDebug_TypeDef sim_core_debug;
+uint32_t SystemCoreClock = 168000000U;
+
+// Parser globals owned by the class driver (usbh_video.c, usbh_video_desc_parsing.c)
+USBH_VIDEO_TargetFormat_t USBH_VIDEO_Target_Format = UVC_CAPTURE_MODE;
+volatile uint8_t tmp_packet_framebuffer[UVC_ISOC_URBS][UVC_RX_FIFO_SIZE_LIMIT] __attribute__((aligned(4)));
+
+static uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+uint32_t HAL_GetTick(void) {
+  return (uint32_t) (monotonic_ns() / 1000000U);
+}
+
+static uint32_t bench_ticks(void) {
+  return (uint32_t) monotonic_ns();
+}
+
+int main(int argc, char **argv) {
+  const VIDEO_BenchClockTypeDef clock = {bench_ticks, 1000000000U};
+  uint32_t packets = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 0) : VIDEO_BENCH_PACKETS;
+
+  if (packets == 0) {
+    printf("usage: uvc_bench [packets per case]\n");
+    return 2;
+  }
+  video_bench_run_all(packets, &clock, (uint8_t *) uvc_frame_pool);
+  return 0;
+}
@@ -0,0 +1,184 @@
+// Replay of a URB log recorded with UVC_RECORD (see usbh_video_record.h): packets are fed into the stream
+// parser as fast as possible, in the order and with the boundaries they were received.
+// Usage: uvc_replay [-n repeat] [-f frames] [-v] log.bin
+// Prints the parser results and throughput, exit code is 0 if the log was replayed (and "frames" frames per pass were delivered).
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "usbh_video.h"
+#include "usbh_video_clock.h"
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_record.h"
+#include "usbh_video_stream_parsing.h"
+
+static uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+typedef struct {
+  uint32_t packets;
+  uint32_t lost;
+  uint64_t bytes;
+  uint32_t frames;
+} ReplayCountersTypeDef;
+
+static uint8_t *load_log(const char *path, size_t *size) {
+  FILE *f = fopen(path, "rb");
+  uint8_t *log = NULL;
+  long len;
+
+  if (f == NULL)
+    return NULL;
+  if ((fseek(f, 0, SEEK_END) == 0) && ((len = ftell(f)) > 0) && (fseek(f, 0, SEEK_SET) == 0)) {
+    log = malloc((size_t) len);
+    if ((log != NULL) && (fread(log, 1, (size_t) len, f) != (size_t) len)) {
+      free(log);
+      log = NULL;
+    }
+    *size = (size_t) len;
+  }
+  fclose(f);
+  return log;
+}
+
+// One pass over the log, returns -1 if the log is malformed.
+// Passes after the first one continue the stream where the previous pass ended, like a camera that restarts its stream.
+static int replay(const uint8_t *log, size_t size, ReplayCountersTypeDef *counters, int first_pass, int verbose) {
+  VIDEO_RecordStreamTypeDef stream = {0};
+  size_t pos = 0;
+
+  while (pos < size) {
+    VIDEO_RecordHeaderTypeDef header;
+    if ((size - pos) < sizeof(header))
+      return -1;
+    memcpy(&header, &log[pos], sizeof(header));
+    pos += sizeof(header);
+    if ((size - pos) < header.length)
+      return -1;
+    const uint8_t *data = &log[pos];
+    pos += header.length;
+
+    switch (header.type) {
+      case VIDEO_RECORD_STREAM:
+        if (header.length < sizeof(stream))
+          return -1;
+        memcpy(&stream, data, sizeof(stream));
+        if ((stream.magic != VIDEO_RECORD_MAGIC) || (stream.version != VIDEO_RECORD_VERSION) || (stream.xfer_size > UVC_RX_FIFO_SIZE_LIMIT))
+          return -1;
+        USBH_VIDEO_Target_Format = (USBH_VIDEO_TargetFormat_t) stream.format;
+        if (first_pass) {
+          video_clock_init(stream.clock_hz);
+          // As after COMMIT: the frame ring is laid out for the frame size, uncompressed frames are completed by it
+          video_stream_resize_buffers(stream.frame_size);
+        }
+        if (first_pass && verbose) {
+          printf("replay: stream %s, %u bytes per %s, interval %u, %u channel(s), clock %lu Hz, frame %lu bytes\n",
+                 (stream.format == USBH_VIDEO_MJPEG) ? "MJPEG" : "YUY2", stream.xfer_size, stream.high_speed ? "microframe" : "frame", stream.interval,
+                 stream.channels, (unsigned long) stream.clock_hz, (unsigned long) stream.frame_size);
+        }
+        break;
+
+      case VIDEO_RECORD_PACKET: {
+        if ((stream.xfer_size == 0) || (header.length > stream.xfer_size))
+          return -1;
+        // Packet lands where the URB would have been placed
+        uint8_t *buf = video_stream_rx_buffer(stream.xfer_size);
+        memcpy(buf, data, header.length);
+        video_clock_packet_received(header.timestamp, stream.high_speed != 0);
+        if (video_stream_process_packet(header.length) > 0) {
+          VIDEO_FrameTypeDef *frame = video_stream_get_frame();
+          if (frame != NULL) {
+            counters->frames++;
+            video_stream_release_frame(frame);
+          }
+        }
+        counters->packets++;
+        counters->bytes += header.length;
+        break;
+      }
+
+      case VIDEO_RECORD_LOST:
+        if (stream.xfer_size == 0)
+          return -1;
+        video_stream_rx_buffer(stream.xfer_size);
+        video_stream_drop_packet();
+        counters->lost++;
+        break;
+
+      default:
+        return -1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  ReplayCountersTypeDef counters = {0};
+  uint32_t repeat = 1;
+  uint32_t expected_frames = 0;
+  int verbose = 0;
+  size_t size = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:f:v")) != -1) {
+    switch (opt) {
+      case 'n':
+        repeat = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'f':
+        expected_frames = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        optind = argc + 1;
+        break;
+    }
+  }
+  if ((optind != (argc - 1)) || (repeat == 0)) {
+    printf("usage: uvc_replay [-n repeat] [-f frames] [-v] log.bin\n");
+    return 2;
+  }
+
+  uint8_t *log = load_log(argv[optind], &size);
+  if (log == NULL) {
+    printf("replay: cannot read %s\n", argv[optind]);
+    return 2;
+  }
+
+  video_stream_init_buffers((uint8_t *) uvc_frame_pool);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t i = 0; i < repeat; i++) {
+    if (replay(log, size, &counters, i == 0, verbose) != 0) {
+      printf("replay: malformed log after %lu packets\n", (unsigned long) counters.packets);
+      free(log);
+      return 1;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  free(log);
+
+  double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+  VIDEO_StatsTypeDef stats;
+  video_stats_read(&stats);
+
+  printf("replay: %lu packets (%llu bytes, lost %lu), %lu frames in %.3f s\n", (unsigned long) counters.packets, (unsigned long long) counters.bytes,
+         (unsigned long) counters.lost, (unsigned long) counters.frames, elapsed);
+  if ((elapsed > 0) && (counters.packets != 0)) {
+    printf("replay: %.1f ns/packet, %.1f MB/s, %.0f frames/s\n", elapsed * 1e9 / counters.packets, counters.bytes / elapsed / 1e6, counters.frames / elapsed);
+  }
+  printf("replay: parser packets %lu (empty %lu, header only %lu, bad %lu, err %lu, lost %lu), frames %lu (truncated %lu, bad %lu), FID without EOF %lu\n",
+         (unsigned long) stats.packets, (unsigned long) stats.empty_packets, (unsigned long) stats.header_only_packets, (unsigned long) stats.bad_packets,
+         (unsigned long) stats.error_packets, (unsigned long) stats.lost_packets, (unsigned long) stats.frames_delivered, (unsigned long) stats.frames_truncated,
+         (unsigned long) stats.frames_bad, (unsigned long) stats.fid_without_eof);
+  if ((expected_frames != 0) && (counters.frames != expected_frames * repeat)) {
+    printf("replay: %lu frames expected\n", (unsigned long) (expected_frames * repeat));
+    return 1;
+  }
+  return 0;
+}
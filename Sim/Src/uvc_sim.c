@@ -0,0 +1,434 @@
+// Host-native run of the UVC host: the synthetic camera is attached to the simulated host controller,
+// the USB host library enumerates it and the VIDEO class streams from it.
+// Exit code is 0 if frames were delivered.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_camera.h"
+#include "sim_hcd.h"
+#include "usbh_core.h"
+#include "usbh_video.h"
+#include "usbh_video_cache.h"
+#include "usbh_video_clock.h"
+#include "usbh_video_controls.h"
+#include "usbh_video_desc_parsing.h"
+#include "usbh_video_modes.h"
+#include "usbh_video_record.h"
+#include "usbh_video_stream_parsing.h"
+
+static uint8_t uvc_frame_pool[UVC_FRAME_RING_SLOTS][UVC_MAX_FRAME_SIZE] __attribute__((aligned(4)));
+
+static USBH_HandleTypeDef hUsbHostSim;
+static SIM_CameraTypeDef camera;
+
+// Flash sector of the camera cache: erased to 0xFF, programming only clears bits as on NOR flash
+#define SIM_CACHE_FLASH_SIZE 4096
+static uint32_t cache_flash[SIM_CACHE_FLASH_SIZE / 4];
+
+static USBH_StatusTypeDef sim_cache_erase(void) {
+  memset(cache_flash, 0xFF, sizeof(cache_flash));
+  return USBH_OK;
+}
+
+static USBH_StatusTypeDef sim_cache_program(uint32_t offset, const uint32_t *words, uint32_t count) {
+  if ((offset & 3U) || ((offset + count * 4U) > sizeof(cache_flash)))
+    return USBH_FAIL;
+  for (uint32_t i = 0; i < count; i++)
+    cache_flash[offset / 4U + i] &= words[i];
+  return USBH_OK;
+}
+
+static const VIDEO_CacheStorageTypeDef cache_storage = {
+    .base = (const uint8_t *) cache_flash,
+    .size = sizeof(cache_flash),
+    .erase = sim_cache_erase,
+    .program = sim_cache_program,
+};
+
+// Mode switch of the run: frame size and frame rate (0 - default interval), done at the half of the run
+static int switch_width = 0;
+static int switch_height = 0;
+static double switch_fps = 0;
+static uint64_t switch_us = 0;  // when the switch was requested, 0 - not yet
+static uint8_t switch_active = 0;  // 1 - class is active after the switch, 2 - its first frame is reported
+
+// MJPEG formats added by -M, one frame each: with the default formats the last one is over VIDEO_MAX_MJPEG_FORMAT,
+// its frame must not become a mode of the previous format
+static const SIM_CameraFrameTypeDef extra_mjpeg_frames[] = {
+    {176, 144, {10000000U / 30}},
+    {352, 288, {10000000U / 30}},
+    {424, 240, {10000000U / 30}},
+};
+
+// Exposure time pinned when the controls are queried: auto exposure off, fixed exposure (100 us units), -1 - not pinned
+static int32_t pin_exposure = -1;
+static uint8_t pin_queued = 0;
+
+static void print_controls(void) {
+  uint8_t num;
+  const VIDEO_ControlTypeDef *table = video_controls_table(&num);
+
+  for (uint8_t i = 0; i < num; i++) {
+    const VIDEO_ControlTypeDef *c = &table[i];
+    printf("sim: control %s (unit %d, selector %d): info 0x%02X, min %ld, max %ld, res %ld, def %ld\n", video_controls_name((VIDEO_ControlIdTypeDef) c->id),
+           c->unit, c->selector, c->info, (long) c->min, (long) c->max, (long) c->res, (long) c->def);
+  }
+}
+
+static void control_done(USBH_HandleTypeDef *phost, USBH_StatusTypeDef status, const VIDEO_ControlTypeDef *control, int32_t value, void *context) {
+  printf("sim: %s %s %ld at %.3f ms: status %d\n", (const char *) context, video_controls_name((VIDEO_ControlIdTypeDef) control->id), (long) value,
+         sim_hcd_time_us() / 1000.0, status);
+}
+
+// Requests run in order: auto exposure is switched off before the exposure time is set, then it is read back
+static void pin_controls(void) {
+  pin_queued = 1;
+  print_controls();
+  if ((USBH_VIDEO_SetControl(&hUsbHostSim, VIDEO_CONTROL_AE_MODE, 1, control_done, "set") != USBH_OK) ||
+      (USBH_VIDEO_SetControl(&hUsbHostSim, VIDEO_CONTROL_EXPOSURE_TIME_ABSOLUTE, pin_exposure, control_done, "set") != USBH_OK) ||
+      (USBH_VIDEO_GetControl(&hUsbHostSim, VIDEO_CONTROL_EXPOSURE_TIME_ABSOLUTE, control_done, "get") != USBH_OK)) {
+    printf("sim: exposure %ld is not pinned\n", (long) pin_exposure);
+  }
+}
+
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id) {
+  video_startup_user_event(phost, id);
+  if (id == HOST_USER_CLASS_ACTIVE) {
+    printf("sim: class active after %.3f ms\n", sim_hcd_time_us() / 1000.0);
+    if ((switch_us != 0) && (switch_active == 0))
+      switch_active = 1;
+  }
+}
+
+// Switch to the mode of the current format with the wanted frame size and the nearest frame rate
+static void switch_mode(void) {
+  const VIDEO_ModeTypeDef *current = video_modes_selected();
+  const VIDEO_ModeTypeDef *best = NULL;
+  const VIDEO_ModeTypeDef *table;
+  uint32_t best_diff = 0;
+  uint8_t num;
+
+  switch_us = sim_hcd_time_us();
+  if (current == NULL)
+    return;
+  table = video_modes_table(&num);
+  for (uint8_t i = 0; i < num; i++) {
+    const VIDEO_ModeTypeDef *mode = &table[i];
+    if ((mode->format != current->format) || (mode->width != switch_width) || (mode->height != switch_height))
+      continue;
+    if (switch_fps == 0) {
+      if (mode->flags & VIDEO_MODE_DEFAULT_INTERVAL)
+        best = mode;
+      continue;
+    }
+    uint32_t want = (uint32_t) (10000000.0 / switch_fps);
+    uint32_t diff = (mode->interval > want) ? (mode->interval - want) : (want - mode->interval);
+    if ((best == NULL) || (diff < best_diff)) {
+      best = mode;
+      best_diff = diff;
+    }
+  }
+  if (best == NULL) {
+    printf("sim: no mode %d x %d to switch to\n", switch_width, switch_height);
+    return;
+  }
+  USBH_StatusTypeDef status = USBH_VIDEO_SwitchMode(&hUsbHostSim, best->bFormatIndex, best->bFrameIndex, best->interval);
+  printf("sim: switch to %d x %d, interval %lu at %.3f ms: status %d\n", best->width, best->height, (unsigned long) best->interval,
+         switch_us / 1000.0, status);
+}
+
+static void print_startup(void) {
+  VIDEO_StartupTypeDef timeline;
+
+  if (USBH_VIDEO_GetStartup(&hUsbHostSim, &timeline) != USBH_OK)
+    return;
+  printf("sim: startup of %04X:%04X, ms since connect:", timeline.idVendor, timeline.idProduct);
+  for (int event = 0; event < VIDEO_STARTUP_EVENTS; event++) {
+    if (timeline.marked & (1UL << event))
+      printf("%s %s %.3f", (event != 0) ? "," : "", video_startup_event_name((VIDEO_StartupEventTypeDef) event), timeline.time_us[event] / 1000.0);
+  }
+  printf("\n");
+}
+
+// Record ring is drained into the log file
+static void drain_record(FILE *f) {
+  uint8_t buf[4096];
+  uint32_t n;
+
+  while ((n = video_record_read(buf, sizeof(buf))) != 0) {
+    fwrite(buf, 1, n, f);
+  }
+}
+
+static void usage(void) {
+  printf("usage: uvc_sim [options]\n"
+         "  -t seconds    bus time to run, 2\n"
+         "  -f mjpeg|yuy2 target format, mjpeg\n"
+         "  -s WxH        target frame size, %dx%d\n"
+         "  -r fps        frame rate of every camera frame, default intervals of the camera\n"
+         "  -m fps        lowest frame rate of the selected mode\n"
+         "  -b bytes      bandwidth limit of the selected mode, bytes per second\n"
+         "  -F            full speed bus\n"
+         "  -j us         frame start jitter\n"
+         "  -l ppm        lost packets\n"
+         "  -e ppm        packets with the ERR bit\n"
+         "  -S ppm        short packets\n"
+         "  -d ppm        camera clock drift\n"
+         "  -E            camera does not set EOF, YUY2 frames end by their size\n"
+         "  -M            add MJPEG formats up to %d: 176x144, 352x288, 424x240, the last one is not kept by the host\n"
+         "  -x seed       impairments seed, 1\n"
+         "  -o file       record the URBs of the stream to \"file\", see uvc_replay\n"
+         "  -c count      reconnect the camera \"count\" times during the run\n"
+         "  -p file       flash sector of the camera cache, loaded from and saved to \"file\"\n"
+         "  -w WxH[@fps]  switch to this frame size (and nearest frame rate) at the half of the run\n"
+         "  -a exposure   auto exposure off, exposure time in 100 us units, when the controls are queried\n"
+         "  -T n          coalesce every n-th SOF interrupt, \"phost->Timer\" falls behind the bus frame number\n",
+         USBH_VIDEO_Target_Width, USBH_VIDEO_Target_Height, SIM_CAMERA_MAX_FORMATS);
+}
+
+int main(int argc, char **argv) {
+  SIM_CameraConfigTypeDef config = sim_camera_default;
+  USBH_SpeedTypeDef speed = USBH_SPEED_HIGH;
+  double seconds = 2.0;
+  uint32_t received = 0;
+  FILE *record = NULL;
+  const char *cache_file = NULL;
+  uint32_t reconnects = 0;
+  uint32_t captured = 0;  // frames with a capture time
+  int32_t latency_min_us = INT32_MAX;
+  int32_t latency_max_us = INT32_MIN;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:f:s:r:m:b:Fj:l:e:S:d:EMx:o:c:p:w:a:T:")) != -1) {
+    switch (opt) {
+      case 't':
+        seconds = atof(optarg);
+        break;
+      case 'f':
+        USBH_VIDEO_Target_Format = (strcmp(optarg, "yuy2") == 0) ? USBH_VIDEO_YUY2 : USBH_VIDEO_MJPEG;
+        break;
+      case 's':
+        if (sscanf(optarg, "%dx%d", &USBH_VIDEO_Target_Width, &USBH_VIDEO_Target_Height) != 2) {
+          usage();
+          return 2;
+        }
+        break;
+      case 'r':
+        for (uint8_t i = 0; i < config.formats_num; i++) {
+          for (uint8_t j = 0; j < config.formats[i].frames_num; j++) {
+            memset(config.formats[i].frames[j].intervals, 0, sizeof(config.formats[i].frames[j].intervals));
+            config.formats[i].frames[j].intervals[0] = (uint32_t) (10000000.0 / atof(optarg));
+          }
+        }
+        break;
+      case 'm':
+        USBH_VIDEO_Mode_Constraints.min_fps_x100 = (uint32_t) (atof(optarg) * 100.0);
+        break;
+      case 'b':
+        USBH_VIDEO_Mode_Constraints.max_bandwidth = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'F':
+        speed = USBH_SPEED_FULL;
+        break;
+      case 'j':
+        config.impair.jitter_us = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        config.impair.loss_ppm = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'e':
+        config.impair.err_ppm = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'S':
+        config.impair.short_ppm = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'd':
+        config.impair.clock_drift_ppm = (int32_t) strtol(optarg, NULL, 0);
+        break;
+      case 'E':
+        config.impair.no_eof = 1;
+        break;
+      case 'M':
+        for (uint8_t i = 0; (i < (sizeof(extra_mjpeg_frames) / sizeof(extra_mjpeg_frames[0]))) && (config.formats_num < SIM_CAMERA_MAX_FORMATS); i++) {
+          SIM_CameraFormatTypeDef *format = &config.formats[config.formats_num++];
+          memset(format, 0, sizeof(*format));
+          format->encoding = SIM_CAMERA_MJPEG;
+          format->frames_num = 1;
+          format->frames[0] = extra_mjpeg_frames[i];
+        }
+        break;
+      case 'x':
+        config.impair.seed = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        record = fopen(optarg, "wb");
+        if (record == NULL) {
+          printf("sim: cannot create %s\n", optarg);
+          return 2;
+        }
+        break;
+      case 'c':
+        reconnects = (uint32_t) strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        cache_file = optarg;
+        break;
+      case 'w':
+        if (sscanf(optarg, "%dx%d@%lf", &switch_width, &switch_height, &switch_fps) < 2) {
+          usage();
+          return 2;
+        }
+        break;
+      case 'a':
+        pin_exposure = (int32_t) strtol(optarg, NULL, 0);
+        break;
+      case 'T':
+        sim_hcd_set_sof_coalesce((uint32_t) strtoul(optarg, NULL, 0));
+        break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+  uint64_t end_us = (uint64_t) (seconds * 1000000.0);
+
+  video_stream_init_buffers((uint8_t *) uvc_frame_pool);
+  if (sim_camera_init(&camera, &config) != 0) {
+    printf("sim: camera descriptors do not fit into %u bytes\n", (unsigned) SIM_CAMERA_DESC_SIZE);
+    return 2;
+  }
+
+  if (cache_file != NULL) {
+    sim_cache_erase();
+    FILE *f = fopen(cache_file, "rb");
+    if (f != NULL) {
+      if (fread(cache_flash, 1, sizeof(cache_flash), f) != sizeof(cache_flash))
+        sim_cache_erase();
+      fclose(f);
+    }
+    video_cache_attach_storage(&cache_storage);
+  }
+
+  USBH_Init(&hUsbHostSim, USBH_UserProcess, (speed == USBH_SPEED_HIGH) ? HOST_HS : HOST_FS);
+  USBH_RegisterClass(&hUsbHostSim, USBH_VIDEO_CLASS);
+  USBH_Start(&hUsbHostSim);
+  sim_hcd_attach(&camera.device, speed);
+  if (record != NULL)
+    video_record_start();
+
+  // Reconnects are spread evenly over the run, the camera is detached for 10 ms
+  uint64_t reconnect_period_us = end_us / (reconnects + 1);
+  uint64_t reconnect_us = reconnect_period_us;
+  while (sim_hcd_time_us() < end_us) {
+    if ((reconnects != 0) && (sim_hcd_time_us() >= reconnect_us)) {
+      print_startup();
+      sim_hcd_detach();
+      sim_hcd_run(&hUsbHostSim, (speed == USBH_SPEED_HIGH) ? 80 : 10);
+      sim_hcd_attach(&camera.device, speed);
+      reconnect_us += reconnect_period_us;
+      reconnects--;
+    }
+    if ((switch_width != 0) && (switch_us == 0) && (sim_hcd_time_us() >= end_us / 2))
+      switch_mode();
+    if ((pin_exposure >= 0) && !pin_queued && video_controls_ready())
+      pin_controls();
+    sim_hcd_run(&hUsbHostSim, 1);
+
+    VIDEO_FrameTypeDef *frame = video_stream_get_frame();
+    if (frame != NULL) {
+      received++;
+      if (frame->flags & VIDEO_FRAME_FLAG_CAPTURE) {
+        int32_t latency_us = (int32_t) (frame->delivery_time - frame->capture_time);
+        latency_min_us = (latency_us < latency_min_us) ? latency_us : latency_min_us;
+        latency_max_us = (latency_us > latency_max_us) ? latency_us : latency_max_us;
+        captured++;
+      }
+      if (switch_active == 1) {
+        printf("sim: first frame after the switch: %lu bytes, %.3f ms after the request, frame ring %lu x %lu bytes\n", (unsigned long) frame->len,
+               (sim_hcd_time_us() - switch_us) / 1000.0, (unsigned long) uvc_frame_ring.count, (unsigned long) uvc_frame_ring.buffer_size);
+        switch_active = 2;
+      }
+      video_stream_release_frame(frame);
+    }
+    if (record != NULL)
+      drain_record(record);
+  }
+  if (record != NULL) {
+    VIDEO_RecordStatsTypeDef record_stats;
+    video_record_stop();
+    drain_record(record);
+    fclose(record);
+    video_record_get_stats(&record_stats);
+    printf("sim: recorded %lu URBs, dropped %lu\n", (unsigned long) record_stats.records, (unsigned long) record_stats.dropped);
+  }
+
+  if (cache_file != NULL) {
+    video_cache_flush();
+    FILE *f = fopen(cache_file, "wb");
+    if (f != NULL) {
+      fwrite(cache_flash, 1, sizeof(cache_flash), f);
+      fclose(f);
+    }
+  }
+
+  VIDEO_StatsTypeDef stats;
+  if (USBH_VIDEO_GetStats(&hUsbHostSim, &stats) != USBH_OK) {
+    printf("sim: VIDEO class is not active\n");
+    return 1;
+  }
+  const VIDEO_ModeTypeDef *mode = video_modes_selected();
+  if (mode != NULL) {
+    uint32_t fps = VIDEO_MODE_FPS_X100(mode->interval);
+    printf("sim: mode %s %d/%d, %d x %d, %lu.%02lu fps, %lu B/s\n", (mode->format == USBH_VIDEO_MJPEG) ? "MJPEG" : "YUY2", mode->bFormatIndex,
+           mode->bFrameIndex, mode->width, mode->height, (unsigned long) (fps / 100), (unsigned long) (fps % 100), (unsigned long) mode->bandwidth);
+  }
+  print_startup();
+  // Mode of the host must be the format and frame the camera streams
+  if ((mode != NULL) && (camera.commit.bFormatIndex >= 1) && (camera.commit.bFormatIndex <= config.formats_num)) {
+    const SIM_CameraFormatTypeDef *format = &config.formats[camera.commit.bFormatIndex - 1];
+    const SIM_CameraFrameTypeDef *frame = &format->frames[camera.commit.bFrameIndex - 1];
+    if ((camera.commit.bFrameIndex == 0) || (camera.commit.bFrameIndex > format->frames_num) || (frame->width != mode->width) ||
+        (frame->height != mode->height) || ((format->encoding == SIM_CAMERA_MJPEG) != (mode->format == USBH_VIDEO_MJPEG))) {
+      printf("sim: mode %d x %d, the camera streams format %d frame %d\n", mode->width, mode->height, camera.commit.bFormatIndex,
+             camera.commit.bFrameIndex);
+      return 1;
+    }
+  }
+  printf("sim: %.3f s, camera sent %lu frames (%lu bytes, 100 ns interval %lu, payload %u), received %lu\n", sim_hcd_time_us() / 1000000.0,
+         (unsigned long) camera.counters.frames_sent, (unsigned long) camera.frame_bytes, (unsigned long) camera.interval, camera.payload,
+         (unsigned long) received);
+  printf("sim: camera packets %lu (lost %lu, err %lu, short %lu), controls set %lu\n", (unsigned long) camera.counters.packets_sent,
+         (unsigned long) camera.counters.packets_lost, (unsigned long) camera.counters.packets_err, (unsigned long) camera.counters.packets_short,
+         (unsigned long) camera.counters.control_sets);
+  printf("sim: %lu.%02lu fps, %lu B/s, packets %lu (empty %lu, header only %lu, bad %lu, err %lu, lost %lu), missed %lu\n",
+         (unsigned long) (stats.fps_x100 / 100), (unsigned long) (stats.fps_x100 % 100), (unsigned long) stats.bytes_per_sec,
+         (unsigned long) stats.packets, (unsigned long) stats.empty_packets, (unsigned long) stats.header_only_packets,
+         (unsigned long) stats.bad_packets, (unsigned long) stats.error_packets, (unsigned long) stats.lost_packets,
+         (unsigned long) stats.missed_uframes);
+  printf("sim: frames %lu (truncated %lu, bad %lu, dropped %lu, skipped %lu), FID without EOF %lu\n", (unsigned long) stats.frames_delivered,
+         (unsigned long) stats.frames_truncated, (unsigned long) stats.frames_bad, (unsigned long) stats.frames_dropped,
+         (unsigned long) stats.frames_skipped, (unsigned long) stats.fid_without_eof);
+  VIDEO_ClockStateTypeDef clock;
+  video_clock_get_state(&clock);
+  printf("sim: camera clock %lu Hz, measured %lu Hz (%ld ppm, %lu samples), %lu frames captured %ld..%ld us before delivery\n",
+         (unsigned long) clock.clock_hz, (unsigned long) clock.measured_hz, (long) clock.drift_ppm, (unsigned long) clock.samples,
+         (unsigned long) captured, (long) ((captured != 0) ? latency_min_us : 0), (long) ((captured != 0) ? latency_max_us : 0));
+  // A frame is captured after the previous one and sent within its interval: the mapped capture time must fall in
+  // the last two frame intervals before the delivery, otherwise the SCR samples were paired with wrong bus frames
+  if ((captured != 0) && ((latency_min_us < 0) || ((uint32_t) latency_max_us > camera.interval / 5U))) {
+    printf("sim: capture times are off\n");
+    return 1;
+  }
+  if ((clock.clock_hz != 0) && (received >= 10) && (captured == 0)) {
+    printf("sim: no capture times, SCR samples are rejected\n");
+    return 1;
+  }
+  if (sim_hcd_active_submits() != 0) {
+    printf("sim: %lu URBs submitted to an active channel\n", (unsigned long) sim_hcd_active_submits());
+    return 1;
+  }
+  return (received > 0) ? 0 : 1;
+}
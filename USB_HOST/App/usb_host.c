@@ -125,14 +125,12 @@ void MX_USB_HOST_Init(void)
 static void USBH_UserProcess1  (USBH_HandleTypeDef *phost, uint8_t id)
 {
   /* USER CODE BEGIN CALL_BACK_2 */
+  video_startup_user_event(phost, id);
   switch(id)
   {
-   case HOST_USER_CLASS_SELECTED: {
-      USBH_VS_SetCur(phost, VS_PROBE_CONTROL << 8);
-      USBH_VS_GetCur(phost, VS_PROBE_CONTROL << 8);
-      USBH_VS_SetCur(phost, VS_COMMIT_CONTROL << 8);
+   case HOST_USER_CLASS_SELECTED:
+     // PROBE/COMMIT is done by the VIDEO class request state machine
      break;
-    }
     case HOST_USER_SELECT_CONFIGURATION:
       break;
     case HOST_USER_DISCONNECTION:
@@ -22,15 +22,35 @@
 #include "usbh_core.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "usbh_conf_ext.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+/* USER CODE BEGIN PD */
+/* FIFO RAM words used by USB_HostInit layouts (the top of the OTG_HS RAM is left free) */
+#define USBH_HS_FIFO_WORDS          0x3E0U
+#define USBH_FS_FIFO_WORDS          0x140U
+/* Default non-periodic TX FIFO depth of USB_HostInit, it is reduced only when RX needs the space */
+#define USBH_HS_NPTX_FIFO_WORDS     0x100U
+#define USBH_FS_NPTX_FIFO_WORDS     0x60U
+/* Minimum FIFO depth (one 64 byte control packet) */
+#define USBH_MIN_FIFO_WORDS         0x10U
+/* Host channels of the biggest core (OTG_HS) */
+#define USBH_LL_MAX_CHANNELS        16U
+/* USER CODE END PD */
 /* Private macro -------------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
 /* Private variables ---------------------------------------------------------*/
+typedef struct
+{
+  USBH_ChannelHookTypeDef hook;
+  void *context;
+} USBH_ChannelHookEntryTypeDef;
+
+/* Completion hooks per core (0 - OTG_FS, 1 - OTG_HS) and channel */
+static USBH_ChannelHookEntryTypeDef USBH_ChannelHooks[2][USBH_LL_MAX_CHANNELS];
 
 /* USER CODE END PV */
 
@@ -54,6 +74,159 @@ USBH_StatusTypeDef USBH_Get_USB_Status(HAL_StatusTypeDef hal_status);
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief  Set the number of transactions per microframe of a periodic pipe.
+  *         HCTSIZ data PID of high-bandwidth isochronous IN transfers is
+  *         chosen from this value in HAL_HCD_HC_SubmitRequest.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @param  mult: 1..3
+  * @retval None
+  */
+static void USBH_LL_SetMultiCount(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t mult)
+{
+  HCD_HandleTypeDef *hhcd = (HCD_HandleTypeDef *)phost->pData;
+  uint32_t USBx_BASE = (uint32_t)hhcd->Instance;
+
+  USBx_HC((uint32_t)pipe)->HCCHAR = (USBx_HC((uint32_t)pipe)->HCCHAR & ~USB_OTG_HCCHAR_MC) |
+                                    (((uint32_t)mult << USB_OTG_HCCHAR_MC_Pos) & USB_OTG_HCCHAR_MC);
+}
+
+/**
+  * @brief  Partition the FIFO RAM of the host core, see usbh_conf_ext.h.
+  *         RX FIFO holds at least two periodic IN transactions (all transactions
+  *         of a high-bandwidth microframe) with their status words, periodic TX
+  *         FIFO is kept at the minimum if there is no periodic OUT endpoint.
+  */
+USBH_StatusTypeDef USBH_LL_SetFifoLayout(USBH_HandleTypeDef *phost, uint16_t in_mps, uint8_t in_mult,
+                                         uint16_t out_mps, USBH_FifoLayoutTypeDef *layout)
+{
+  HCD_HandleTypeDef *hhcd = (HCD_HandleTypeDef *)phost->pData;
+  USB_OTG_GlobalTypeDef *USBx = hhcd->Instance;
+  uint32_t total = (USBx == USB_OTG_HS) ? USBH_HS_FIFO_WORDS : USBH_FS_FIFO_WORDS;
+  uint32_t nptx_max = (USBx == USB_OTG_HS) ? USBH_HS_NPTX_FIFO_WORDS : USBH_FS_NPTX_FIFO_WORDS;
+  uint32_t packets = (in_mult > 2U) ? in_mult : 2U;
+  uint32_t rx;
+  uint32_t ptx;
+  uint32_t nptx;
+
+  /* Every received packet takes one status word, two more for the channel halted/transfer complete entries */
+  rx = packets * ((((uint32_t)in_mps + 3U) / 4U) + 1U) + 2U;
+  if (rx < (2U * (USBH_MIN_FIFO_WORDS + 1U) + 2U))
+  {
+    rx = 2U * (USBH_MIN_FIFO_WORDS + 1U) + 2U;
+  }
+
+  ptx = 2U * (((uint32_t)out_mps + 3U) / 4U);
+  if (ptx < USBH_MIN_FIFO_WORDS)
+  {
+    ptx = USBH_MIN_FIFO_WORDS;
+  }
+
+  if ((rx + ptx + USBH_MIN_FIFO_WORDS) > total)
+  {
+    USBH_ErrLog("FIFO: %lu + %lu words do not fit into %lu", (unsigned long)rx, (unsigned long)ptx, (unsigned long)total);
+    return USBH_FAIL;
+  }
+
+  nptx = total - rx - ptx;
+  if (nptx > nptx_max)
+  {
+    nptx = nptx_max;
+  }
+
+  USBx->GRXFSIZ = rx;
+  USBx->DIEPTXF0_HNPTXFSIZ = ((nptx << 16) & USB_OTG_NPTXFD) | rx;
+  USBx->HPTXFSIZ = ((ptx << 16) & USB_OTG_HPTXFSIZ_PTXFD) | (rx + nptx);
+
+  (void)USB_FlushTxFifo(USBx, 0x10U);
+  (void)USB_FlushRxFifo(USBx);
+
+  USBH_LL_GetFifoLayout(phost, layout);
+  USBH_UsrLog("FIFO: RX %lu, NPTX %lu, PTX %lu of %lu words", (unsigned long)rx, (unsigned long)nptx,
+              (unsigned long)ptx, (unsigned long)total);
+  return USBH_OK;
+}
+
+/**
+  * @brief  Read the current FIFO RAM layout of the host core, see usbh_conf_ext.h.
+  */
+void USBH_LL_GetFifoLayout(USBH_HandleTypeDef *phost, USBH_FifoLayoutTypeDef *layout)
+{
+  HCD_HandleTypeDef *hhcd = (HCD_HandleTypeDef *)phost->pData;
+  USB_OTG_GlobalTypeDef *USBx = hhcd->Instance;
+
+  if (layout == NULL)
+  {
+    return;
+  }
+
+  layout->rx = (uint16_t)(USBx->GRXFSIZ & 0xFFFFU);
+  layout->nptx = (uint16_t)((USBx->DIEPTXF0_HNPTXFSIZ & USB_OTG_NPTXFD) >> 16);
+  layout->ptx = (uint16_t)((USBx->HPTXFSIZ & USB_OTG_HPTXFSIZ_PTXFD) >> 16);
+  layout->total = (uint16_t)((USBx == USB_OTG_HS) ? USBH_HS_FIFO_WORDS : USBH_FS_FIFO_WORDS);
+}
+
+/**
+  * @brief  Register a completion hook of a pipe, see usbh_conf_ext.h.
+  */
+USBH_StatusTypeDef USBH_LL_RegisterChannelHook(USBH_HandleTypeDef *phost, uint8_t pipe, USBH_ChannelHookTypeDef hook, void *context)
+{
+  HCD_HandleTypeDef *hhcd = (HCD_HandleTypeDef *)phost->pData;
+  USBH_ChannelHookEntryTypeDef *entry;
+
+  if (pipe >= USBH_LL_MAX_CHANNELS)
+  {
+    return USBH_FAIL;
+  }
+
+  entry = &USBH_ChannelHooks[(hhcd->Instance == USB_OTG_HS) ? 1U : 0U][pipe];
+
+  /* The interrupt must never see a hook with the context of another one */
+  __disable_irq();
+  entry->hook = hook;
+  entry->context = context;
+  __enable_irq();
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Select the (micro)frame parity of the next periodic transfers of a pipe, see usbh_conf_ext.h.
+  */
+USBH_StatusTypeDef USBH_LL_SetFrameParity(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t parity)
+{
+  HAL_StatusTypeDef hal_status;
+  uint8_t hc_parity;
+
+  switch (parity)
+  {
+    case USBH_FRAME_EVEN:
+      hc_parity = HC_FRAME_EVEN;
+      break;
+
+    case USBH_FRAME_ODD:
+      hc_parity = HC_FRAME_ODD;
+      break;
+
+    default:
+      hc_parity = HC_FRAME_NEXT;
+      break;
+  }
+
+  hal_status = HAL_HCD_HC_SetFrameParity(phost->pData, pipe, hc_parity);
+
+  return USBH_Get_USB_Status(hal_status);
+}
+
+/**
+  * @brief  Read the (micro)frame number of the bus, see usbh_conf_ext.h.
+  */
+uint32_t USBH_LL_GetCurrentFrame(USBH_HandleTypeDef *phost)
+{
+  return HAL_HCD_GetCurrentFrame(phost->pData);
+}
+
 /* USER CODE END 1 */
 
 /*******************************************************************************
@@ -251,6 +424,18 @@ void HAL_HCD_Disconnect_Callback(HCD_HandleTypeDef *hhcd)
   */
 void HAL_HCD_HC_NotifyURBChange_Callback(HCD_HandleTypeDef *hhcd, uint8_t chnum, HCD_URBStateTypeDef urb_state)
 {
+  /* USER CODE BEGIN NotifyURBChange */
+  if (chnum < USBH_LL_MAX_CHANNELS)
+  {
+    USBH_ChannelHookEntryTypeDef *entry = &USBH_ChannelHooks[(hhcd->Instance == USB_OTG_HS) ? 1U : 0U][chnum];
+
+    if ((entry->hook != NULL) && (entry->hook(hhcd->pData, chnum, (USBH_URBStateTypeDef)urb_state, entry->context) != 0U))
+    {
+      return;
+    }
+  }
+  /* USER CODE END NotifyURBChange */
+
   /* To be used with OS to sync URB state with the global state machine */
 #if (USBH_USE_OS == 1)
   USBH_LL_NotifyURBChange(hhcd->pData);
@@ -447,7 +632,8 @@ uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe)
   * @param  dev_address: Device USB address
   * @param  speed: Device Speed
   * @param  ep_type: Endpoint type
-  * @param  mps: Endpoint max packet size
+  * @param  mps: Endpoint max packet size (wMaxPacketSize, bits 12:11 - additional
+  *         transactions per microframe of high-bandwidth periodic endpoints)
   * @retval USBH status
   */
 USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num, uint8_t epnum,
@@ -457,7 +643,16 @@ USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num,
   USBH_StatusTypeDef usb_status = USBH_OK;
 
   hal_status = HAL_HCD_HC_Init(phost->pData, pipe_num, epnum,
-                               dev_address, speed, ep_type, mps);
+                               dev_address, speed, ep_type, mps & 0x07FFU);
+
+  /* USER CODE BEGIN OpenPipe */
+  if ((hal_status == HAL_OK) && (speed == USBH_SPEED_HIGH) &&
+      ((ep_type == USBH_EP_ISO) || (ep_type == USBH_EP_INTERRUPT)))
+  {
+    /* Multi Count: transactions per microframe, HAL leaves it 0 (reserved value) */
+    USBH_LL_SetMultiCount(phost, pipe_num, (uint8_t)(((mps >> 11) & 0x03U) + 1U));
+  }
+  /* USER CODE END OpenPipe */
 
   usb_status = USBH_Get_USB_Status(hal_status);
 
@@ -597,7 +792,10 @@ USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state)
       /* USER CODE END DRIVE_LOW_CHARGE_FOR_HS */
     }
   }
-  HAL_Delay(200);
+  /* Charge pump settling, USBH_VBUS_DELAY is 0 with UVC_FAST_START */
+#if (USBH_VBUS_DELAY > 0U)
+  HAL_Delay(USBH_VBUS_DELAY);
+#endif
   return USBH_OK;
 }
 
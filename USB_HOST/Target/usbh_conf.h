@@ -84,6 +84,22 @@
 /*----------   -----------*/
 #define USBH_DEBUG_LEVEL      3U
 
+/*----------   -----------*/
+/* Fast start: enumeration waits are cut to the USB 2.0 minimums (100 ms attach debounce,
+   10 ms reset recovery), VBUS is not waited for and the VIDEO class skips the descriptor dumps */
+#ifndef UVC_FAST_START
+#define UVC_FAST_START      0U
+#endif
+
+#if (UVC_FAST_START == 1U)
+#define USBH_ATTACH_DELAY            100U
+#define USBH_RESET_RECOVERY_DELAY    10U
+#define USBH_RESET_POLL_DELAY        1U
+#define USBH_VBUS_DELAY              0U
+#else
+#define USBH_VBUS_DELAY              200U
+#endif
+
 /*----------   -----------*/
 #define USBH_USE_OS      1U
 
@@ -98,6 +114,13 @@
   #define USBH_PROCESS_STACK_SIZE    ((uint16_t)2048)
 #endif /* (USBH_USE_OS == 1) */
 
+/*----------   -----------*/
+/* Profiling probe around USBH_Process in the host thread (Core/Inc/dwt_prof.h),
+   the host core compiles it to nothing when it is not defined here */
+#include "dwt_prof.h"
+#define USBH_PROCESS_PROF_BEGIN()    DWT_PROF_BEGIN(DWT_PROF_USBH_PROCESS)
+#define USBH_PROCESS_PROF_END()      DWT_PROF_END(DWT_PROF_USBH_PROCESS)
+
 /**
   * @}
   */
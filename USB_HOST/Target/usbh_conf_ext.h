@@ -0,0 +1,99 @@
+/**
+  ******************************************************************************
+  * @file           : Target/usbh_conf_ext.h
+  * @brief          : Low level driver extensions used by the class drivers,
+  *                   implemented in usbh_conf.c.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBH_CONF_EXT__H__
+#define __USBH_CONF_EXT__H__
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+
+/* Exported constants --------------------------------------------------------*/
+
+/* (Micro)frame parity of periodic transfers, see USBH_LL_SetFrameParity */
+#define USBH_FRAME_NEXT   0U
+#define USBH_FRAME_EVEN   1U
+#define USBH_FRAME_ODD    2U
+
+/* Exported types ------------------------------------------------------------*/
+
+/* OTG core FIFO RAM layout, all sizes are in 32-bit words */
+typedef struct
+{
+  uint16_t rx;     /* RX FIFO (GRXFSIZ), shared by all IN channels */
+  uint16_t nptx;   /* non-periodic TX FIFO (HNPTXFSIZ), control and bulk OUT */
+  uint16_t ptx;    /* periodic TX FIFO (HPTXFSIZ), interrupt and isochronous OUT */
+  uint16_t total;  /* FIFO RAM available for the three FIFOs */
+} USBH_FifoLayoutTypeDef;
+
+/* Channel completion hook, called from the OTG interrupt when the URB state of the
+   channel changes. Returns 1 if the event is handled by the hook and the generic
+   URB notification of the host thread must not be sent. */
+typedef uint8_t (*USBH_ChannelHookTypeDef)(USBH_HandleTypeDef *phost, uint8_t pipe, USBH_URBStateTypeDef urb_state, void *context);
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Partition the FIFO RAM of the host core for the periodic endpoints in use.
+  *         Must be called when no transfer is in progress (FIFOs are flushed).
+  * @param  phost: Host handle
+  * @param  in_mps: Biggest periodic IN transaction size in bytes
+  * @param  in_mult: Transactions per microframe of that endpoint (1..3)
+  * @param  out_mps: Biggest periodic OUT transaction size in bytes, 0 if none
+  * @param  layout: Resulting layout, may be NULL
+  * @retval USBH_OK, USBH_FAIL if the FIFOs do not fit (layout is not changed)
+  */
+USBH_StatusTypeDef USBH_LL_SetFifoLayout(USBH_HandleTypeDef *phost, uint16_t in_mps, uint8_t in_mult,
+                                         uint16_t out_mps, USBH_FifoLayoutTypeDef *layout);
+
+/**
+  * @brief  Read the current FIFO RAM layout of the host core.
+  * @param  phost: Host handle
+  * @param  layout: Current layout
+  * @retval None
+  */
+void USBH_LL_GetFifoLayout(USBH_HandleTypeDef *phost, USBH_FifoLayoutTypeDef *layout);
+
+/**
+  * @brief  Register a completion hook of a pipe, replaces the previous one.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @param  hook: Hook, NULL removes it
+  * @param  context: Passed to the hook
+  * @retval USBH_OK, USBH_FAIL if the pipe index is out of range
+  */
+USBH_StatusTypeDef USBH_LL_RegisterChannelHook(USBH_HandleTypeDef *phost, uint8_t pipe, USBH_ChannelHookTypeDef hook, void *context);
+
+/**
+  * @brief  Select the (micro)frame parity of the next transfers of a periodic pipe.
+  *         With USBH_FRAME_EVEN/ODD the transfer can be submitted ahead of time, it is
+  *         executed in the next (micro)frame of that parity.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @param  parity: USBH_FRAME_NEXT (default, set when the pipe is opened), USBH_FRAME_EVEN or USBH_FRAME_ODD
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_LL_SetFrameParity(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t parity);
+
+/**
+  * @brief  Read the (micro)frame number of the bus (HFNUM): microframes at high speed, frames otherwise,
+  *         14 bits. It restarts at every port reset. Unlike phost->Timer, which counts the SOF
+  *         interrupts, it does not lose (micro)frames. Can be called from the OTG interrupt.
+  * @param  phost: Host handle
+  * @retval Frame number
+  */
+uint32_t USBH_LL_GetCurrentFrame(USBH_HandleTypeDef *phost);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_CONF_EXT__H__ */
@@ -23,6 +23,7 @@ set(linker_script_SRC ${linker_script_SRC}
 # Sources
 set(sources_SRCS ${sources_SRCS}
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/dma.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/dwt_prof.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/freertos.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/gpio.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/main.c
@@ -31,10 +32,22 @@ set(sources_SRCS ${sources_SRCS}
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/syscalls.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/sysmem.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/system_stm32f4xx.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/uart_log.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/usart.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/Src/uvc_cache_flash.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/Startup/startup_stm32f407zgtx.s
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_bench.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_cache.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_clock.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_controls.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_ctrl.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_desc_parsing.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_frame_ring.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_modes.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_record.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_startup.c
+    ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_stats.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Core/lib/VIDEO/Src/usbh_video_stream_parsing.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Drivers/STM32F4xx_HAL_Driver/Src/stm32f4xx_hal.c
     ${CMAKE_CURRENT_SOURCE_DIR}/Drivers/STM32F4xx_HAL_Driver/Src/stm32f4xx_hal_cortex.c